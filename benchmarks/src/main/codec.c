@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * Copyright 2008-2014 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+// Measures the compression codecs on sample record payloads. Needs no server:
+//
+//     target/codec_benchmark [record size] [iterations]
+
+#include "aerospike/as_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char alphanum[] =
+	"0123456789"
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz";
+
+static const char* words[] = {
+	"user", "session", "click", "view", "purchase", "cart", "id", "name",
+	"email", "country", "device", "mobile", "desktop", "true", "false", "null"
+};
+
+typedef void (*sample_fn)(uint8_t* buf, size_t len);
+
+static void
+sample_integers(uint8_t* buf, size_t len)
+{
+	// Big endian counters and small values, as integer bins go on the wire.
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = (i % 8) < 6 ? 0 : (uint8_t)(rand() % 64);
+	}
+}
+
+static void
+sample_strings(uint8_t* buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = alphanum[rand() % (sizeof(alphanum) - 1)];
+	}
+}
+
+static void
+sample_json(uint8_t* buf, size_t len)
+{
+	size_t n = 0;
+	int nwords = sizeof(words) / sizeof(words[0]);
+
+	while (n < len) {
+		char field[64];
+		int sz = snprintf(field, sizeof(field), "\"%s\":\"%s%d\",",
+			words[rand() % nwords], words[rand() % nwords], rand() % 1000);
+		size_t cp = (size_t)sz < len - n ? (size_t)sz : len - n;
+		memcpy(buf + n, field, cp);
+		n += cp;
+	}
+}
+
+static void
+sample_bytes(uint8_t* buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = (uint8_t)rand();
+	}
+}
+
+static double
+now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+run(const as_codec* codec, const char* sample, const uint8_t* in, size_t in_sz, int iterations)
+{
+	size_t bound = codec->bound(in_sz);
+	uint8_t* comp = malloc(bound);
+	uint8_t* out = malloc(in_sz);
+	size_t comp_sz = 0;
+	int rv = 0;
+
+	double begin = now_seconds();
+
+	for (int i = 0; i < iterations; i++) {
+		comp_sz = bound;
+
+		if (codec->compress(codec->default_level, in, in_sz, comp, &comp_sz) != 0) {
+			fprintf(stderr, "%s: compress failed\n", codec->name);
+			rv = -1;
+			goto Done;
+		}
+	}
+
+	double comp_secs = now_seconds() - begin;
+	begin = now_seconds();
+
+	for (int i = 0; i < iterations; i++) {
+		if (codec->decompress(comp, comp_sz, out, in_sz) != 0) {
+			fprintf(stderr, "%s: decompress failed\n", codec->name);
+			rv = -1;
+			goto Done;
+		}
+	}
+
+	double decomp_secs = now_seconds() - begin;
+
+	if (memcmp(in, out, in_sz) != 0) {
+		fprintf(stderr, "%s: round trip mismatch\n", codec->name);
+		rv = -1;
+		goto Done;
+	}
+
+	double mb = (double)in_sz * iterations / (1024 * 1024);
+
+	printf("%-6s %-9s %8zu %8zu %7.2f %10.1f %10.1f\n", codec->name, sample, in_sz, comp_sz,
+		(double)in_sz / comp_sz, mb / comp_secs, mb / decomp_secs);
+
+Done:
+	free(comp);
+	free(out);
+	return rv;
+}
+
+int
+main(int argc, char** argv)
+{
+	size_t size = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+	int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+
+	if (size == 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [record size] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	const as_codec* codecs[] = {
+		&as_codec_zlib,
+#ifdef AS_USE_LZ4
+		&as_codec_lz4,
+#endif
+#ifdef AS_USE_ZSTD
+		&as_codec_zstd,
+#endif
+	};
+
+	struct {
+		const char* name;
+		sample_fn fn;
+	} samples[] = {
+		{ "integers", sample_integers },
+		{ "strings", sample_strings },
+		{ "json", sample_json },
+		{ "bytes", sample_bytes }
+	};
+
+	uint8_t* buf = malloc(size);
+	int rv = 0;
+
+	printf("%-6s %-9s %8s %8s %7s %10s %10s\n", "codec", "sample", "size", "comp", "ratio",
+		"comp MB/s", "decomp MB/s");
+
+	for (size_t s = 0; s < sizeof(samples) / sizeof(samples[0]); s++) {
+		srand(1);
+		samples[s].fn(buf, size);
+
+		for (size_t c = 0; c < sizeof(codecs) / sizeof(codecs[0]); c++) {
+			if (run(codecs[c], samples[s].name, buf, size, iterations) != 0) {
+				rv = 1;
+			}
+		}
+	}
+
+	free(buf);
+	return rv;
+}
@@ -0,0 +1,158 @@
+/*******************************************************************************
+ * Copyright 2008-2014 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+// Measures the encoding of list bins into a request: through the msgpack
+// serializer and a copy, as before, and written straight into the request.
+// Needs no server:
+//
+//     target/msgpack_benchmark [list size] [iterations]
+
+#include "aerospike/as_arraylist.h"
+#include "aerospike/as_buffer.h"
+#include "aerospike/as_integer.h"
+#include "aerospike/as_msgpack.h"
+#include "aerospike/as_msgpack_writer.h"
+#include "aerospike/as_serializer.h"
+#include "aerospike/as_string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double
+now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static as_list*
+sample_integers(uint32_t n)
+{
+	as_arraylist* list = as_arraylist_new(n, 0);
+
+	for (uint32_t i = 0; i < n; i++) {
+		as_arraylist_append_int64(list, (int64_t)rand() * (i % 4 + 1));
+	}
+	return (as_list*)list;
+}
+
+static as_list*
+sample_strings(uint32_t n)
+{
+	as_arraylist* list = as_arraylist_new(n, 0);
+
+	for (uint32_t i = 0; i < n; i++) {
+		char str[32];
+		snprintf(str, sizeof(str), "value-%d", rand() % 100000);
+		as_arraylist_append_str(list, str);
+	}
+	return (as_list*)list;
+}
+
+static int
+run(const char* sample, as_list* list, int iterations)
+{
+	as_val* val = (as_val*)list;
+	size_t size = as_msgpack_writer_size(val);
+	uint8_t* request = malloc(size);
+	uint8_t* check = malloc(size);
+	int rv = 0;
+
+	// Serialize, then copy into the request.
+	double begin = now_seconds();
+
+	for (int i = 0; i < iterations; i++) {
+		as_buffer buffer;
+		as_buffer_init(&buffer);
+
+		as_serializer ser;
+		as_msgpack_init(&ser);
+		as_serializer_serialize(&ser, val, &buffer);
+		as_serializer_destroy(&ser);
+
+		memcpy(request, buffer.data, buffer.size);
+		as_buffer_destroy(&buffer);
+	}
+
+	double serializer_secs = now_seconds() - begin;
+	memcpy(check, request, size);
+
+	// Size, then write in place.
+	begin = now_seconds();
+
+	for (int i = 0; i < iterations; i++) {
+		if (as_msgpack_writer_size(val) != size) {
+			rv = -1;
+		}
+		as_msgpack_writer_write(val, request);
+	}
+
+	double writer_secs = now_seconds() - begin;
+
+	if (rv != 0 || memcmp(check, request, size) != 0) {
+		fprintf(stderr, "%s: encodings differ\n", sample);
+		rv = -1;
+	}
+
+	printf("%-9s %8u %8zu %12.0f %12.0f %7.2f\n", sample, as_list_size(list), size,
+		iterations / serializer_secs, iterations / writer_secs, serializer_secs / writer_secs);
+
+	free(request);
+	free(check);
+	return rv;
+}
+
+int
+main(int argc, char** argv)
+{
+	uint32_t n = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10000;
+
+	if (n == 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [list size] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+	as_list* integers = sample_integers(n);
+	as_list* strings = sample_strings(n);
+
+	printf("%-9s %8s %8s %12s %12s %7s\n", "sample", "elements", "bytes", "serialize/s",
+		"write/s", "speedup");
+
+	int rv = 0;
+
+	if (run("integers", integers, iterations) != 0) {
+		rv = 1;
+	}
+
+	if (run("strings", strings, iterations) != 0) {
+		rv = 1;
+	}
+
+	as_list_destroy(integers);
+	as_list_destroy(strings);
+	return rv;
+}
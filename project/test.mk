@@ -11,6 +11,7 @@ TEST_AEROSPIKE += aerospike_query/*.c
 TEST_AEROSPIKE += aerospike_scan/*.c
 TEST_AEROSPIKE += aerospike_udf/*.c
 TEST_AEROSPIKE += aerospike_ldt/*.c
+TEST_AEROSPIKE += cluster/*.c
 TEST_AEROSPIKE += policy/*.c
 TEST_AEROSPIKE += util/*.c
 
@@ -27,7 +28,7 @@ TEST_VALGRIND = --tool=memcheck --leak-check=yes --show-reachable=yes --num-call
 TEST_CFLAGS = -I$(TARGET_INCL)
 
 ifeq ($(OS),Darwin)
-TEST_LDFLAGS = -L/usr/local/lib -lssl -lcrypto -llua -lpthread -lm
+TEST_LDFLAGS = -L/usr/local/lib -lssl -lcrypto -llua -lpthread -lm -lz
 else
 TEST_LDFLAGS = -lssl -lcrypto -llua -lpthread -lm -lrt -lz
 endif
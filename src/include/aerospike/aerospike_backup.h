@@ -0,0 +1,156 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+/**
+ *	@defgroup backup_operations Backup Operations
+ *	@ingroup client_operations
+ *
+ *	Backup operations dump the records of a namespace or set to a binary file
+ *	and write them back to a cluster.
+ *
+ *	## File Format
+ *
+ *	All integers are stored in network byte order.
+ *
+ *	- Header: the magic "ASBK", a version byte, a flags byte, then the length
+ *	  of the namespace name as a byte, followed by the name.
+ *	- Blocks: the raw size and the stored size as 4 byte integers, followed
+ *	  by the stored bytes. When the file is compressed and the stored size is
+ *	  smaller than the raw size, the block is zlib compressed.
+ *	- Records, packed in the raw bytes of the blocks: a 4 byte record length,
+ *	  the 20 byte digest, the set name length as a byte and the set name, the
+ *	  generation, the void time in seconds since the citrusleaf epoch (0 if
+ *	  the record never expires), the number of bins as a 2 byte integer, and
+ *	  the bins in the same layout as the server sends them.
+ *
+ *	Bins are copied from the scan response to the file, and from the file to
+ *	the write requests, without being decoded.
+ */
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_scan.h>
+#include <aerospike/as_status.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	Counters filled by aerospike_backup_export() and aerospike_backup_restore().
+ *
+ *	@ingroup backup_operations
+ */
+typedef struct as_backup_stats_s {
+
+	/**
+	 *	Number of records exported or restored.
+	 */
+	uint64_t records;
+
+	/**
+	 *	Number of records which failed to restore.
+	 */
+	uint64_t failed;
+
+	/**
+	 *	Number of records not restored because they expired since the export.
+	 */
+	uint64_t expired;
+
+	/**
+	 *	Number of bytes written to or read from the file.
+	 */
+	uint64_t bytes;
+
+} as_backup_stats;
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Scan the namespace and set of `scan` and write the records to a file.
+ *
+ *	Nodes are scanned one after the other. The file is written in blocks of
+ *	about 1 MiB, each of them optionally compressed with zlib.
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_scan scan;
+ *	as_scan_init(&scan, "test", "demo");
+ *
+ *	if ( aerospike_backup_export(&as, &err, NULL, &scan, "demo.asbk", true, NULL) != AEROSPIKE_OK ) {
+ *		fprintf(stderr, "error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
+ *	}
+ *
+ *	as_scan_destroy(&scan);
+ *	~~~~~~~~~~
+ *
+ *	@param as			The aerospike instance to use for this operation.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param policy		The policy to use for this operation. If NULL, then the default policy will be used.
+ *	@param scan			The scan selecting the records and bins to export.
+ *	@param path			The file to create.
+ *	@param compress		Compress the blocks of the file.
+ *	@param stats		Counters to fill. May be NULL.
+ *
+ *	@return AEROSPIKE_OK on success. Otherwise an error occurred.
+ *
+ *	@ingroup backup_operations
+ */
+as_status aerospike_backup_export(
+	aerospike * as, as_error * err, const as_policy_scan * policy,
+	const as_scan * scan, const char * path, bool compress, as_backup_stats * stats
+	);
+
+/**
+ *	Write the records of a file created by aerospike_backup_export() back to
+ *	the namespace it was exported from.
+ *
+ *	The file is memory mapped. The records of each block are grouped by the
+ *	node owning their partition into chunks, which are queued to a pool of
+ *	`max_concurrent` threads. The queue is bounded, so reading the file waits
+ *	for the writes. Each chunk is sent to its node as one pipelined batch of
+ *	writes over a single connection.
+ *
+ *	Records are written with their generation ignored and their expiry
+ *	restored: the ttl is what is left of the exported void time. Records
+ *	which expired since the export are counted in `stats->expired` and
+ *	skipped.
+ *	A record which fails to write is counted in `stats->failed` and does not
+ *	stop the restore.
+ *
+ *	@param as				The aerospike instance to use for this operation.
+ *	@param err				The as_error to be populated if an error occurs.
+ *	@param policy			The policy to use for the writes. If NULL, then the default policy will be used.
+ *	@param path				The file to restore.
+ *	@param max_concurrent	Maximum number of concurrent writer threads. If zero, 1 is used.
+ *	@param stats			Counters to fill. May be NULL.
+ *
+ *	@return AEROSPIKE_OK if all records were written. Otherwise an error occurred.
+ *
+ *	@ingroup backup_operations
+ */
+as_status aerospike_backup_restore(
+	aerospike * as, as_error * err, const as_policy_write * policy,
+	const char * path, uint32_t max_concurrent, as_backup_stats * stats
+	);
@@ -37,6 +37,7 @@
 #include <aerospike/as_record.h>
 #include <aerospike/as_status.h>
 #include <aerospike/as_val.h>
+#include <aerospike/as_write_template.h>
 
 /******************************************************************************
  *	FUNCTIONS
@@ -176,6 +177,25 @@ as_status aerospike_key_put(
 	const as_key * key, as_record * rec
 	);
 
+/**
+ *	Store the values of a record with a write template. See as_write_template.h.
+ *
+ *	@param as			The aerospike instance to use for this operation.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param tmpl			The write template.
+ *	@param key			The key of the record, in the namespace and set of the template.
+ *	@param values		The value of each bin of the template, in its order. A NULL
+ *						value is sent as nil.
+ *
+ *	@return AEROSPIKE_OK if successful. Otherwise an error.
+ *
+ *	@ingroup key_operations
+ */
+as_status aerospike_key_put_template(
+	aerospike * as, as_error * err, const as_write_template * tmpl,
+	const as_key * key, as_val ** values
+	);
+
 /**
  *	Remove a record from the cluster.
  *
@@ -93,6 +93,7 @@
  */
 
 #include <aerospike/aerospike.h>
+#include <aerospike/as_columnar.h>
 #include <aerospike/as_error.h>
 #include <aerospike/as_policy.h>
 #include <aerospike/as_scan.h>
@@ -257,3 +258,50 @@ as_status aerospike_scan_foreach(
 	const as_scan * scan, 
 	aerospike_scan_foreach_callback callback, void * udata
 	);
+
+/**
+ *	Scan the records in the specified namespace and set in the cluster, and
+ *	deliver them as columns instead of records.
+ *
+ *	Bin values are copied straight from the response into the column buffers
+ *	of `batch`, which are laid out like Arrow arrays. The callback is called
+ *	each time `batch->capacity` rows are buffered, and once more with the
+ *	remaining rows when the scan completes. The batch is then cleared and
+ *	reused, so its buffers are only valid during the callback.
+ *
+ *	Only the bins named by the columns are requested. A bin that is missing
+ *	from a record, or whose type does not match its column, is stored as a
+ *	missing value. Nodes are scanned one after the other. The scan stops at
+ *	the first node that fails, and returns its error. The rows received
+ *	since the last callback are then dropped.
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_columnar_batch batch;
+ *	as_columnar_batch_init(&batch, 4096);
+ *	as_columnar_batch_add_column(&batch, "age", AS_COLUMN_INT64);
+ *	as_columnar_batch_add_column(&batch, "name", AS_COLUMN_STRING);
+ *	
+ *	if ( aerospike_scan_columnar(&as, &err, NULL, &scan, &batch, callback, NULL) != AEROSPIKE_OK ) {
+ *		fprintf(stderr, "error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
+ *	}
+ *
+ *	as_columnar_batch_destroy(&batch);
+ *	~~~~~~~~~~
+ *
+ *	@param as			The aerospike instance to use for this operation.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param policy		The policy to use for this operation. If NULL, then the default policy will be used.
+ *	@param scan			The scan to execute against the cluster. Its select list is ignored.
+ *	@param batch		The batch, with its columns defined, to fill.
+ *	@param callback		The function to be called for each batch of rows.
+ *	@param udata		User-data to be passed to the callback.
+ *
+ *	@return AEROSPIKE_OK on success. Otherwise an error occurred.
+ *
+ *	@ingroup scan_operations
+ */
+as_status aerospike_scan_columnar(
+	aerospike * as, as_error * err, const as_policy_scan * policy, 
+	const as_scan * scan, as_columnar_batch * batch,
+	as_columnar_callback callback, void * udata
+	);
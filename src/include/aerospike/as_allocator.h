@@ -0,0 +1,178 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	The subsystem an allocation is made for.
+ */
+typedef enum as_alloc_tag_e {
+
+	/**
+	 *	Bin name indexes and arenas of records.
+	 */
+	AS_ALLOC_RECORD,
+
+	/**
+	 *	Buffers holding responses read from the network.
+	 */
+	AS_ALLOC_NETWORK,
+
+	/**
+	 *	Batch read bookkeeping.
+	 */
+	AS_ALLOC_BATCH,
+
+	/**
+	 *	Query objects and requests.
+	 */
+	AS_ALLOC_QUERY,
+
+	/**
+	 *	Nodes, node lists, partition tables and info responses of the
+	 *	cluster tend thread.
+	 */
+	AS_ALLOC_TEND,
+
+	AS_ALLOC_TAG_MAX
+
+} as_alloc_tag;
+
+/**
+ *	Allocation functions used by the client for its own memory.
+ *
+ *	Each function receives the tag of the allocation, so an application can
+ *	send different subsystems to different arenas of its allocator, or put
+ *	network buffers on huge pages. `free` also receives the size of the
+ *	allocation, as given to `malloc` or `realloc`.
+ *
+ *	~~~~~~~~~~{.c}
+ *	static void * my_malloc(as_alloc_tag tag, size_t size, void * udata) {
+ *		return mallocx(size, MALLOCX_ARENA(arenas[tag]));
+ *	}
+ *	...
+ *	static as_allocator allocator = { my_malloc, my_realloc, my_free, NULL };
+ *
+ *	as_config config;
+ *	as_config_init(&config);
+ *	config.allocator = &allocator;
+ *	~~~~~~~~~~
+ *
+ *	Memory given to the application, such as bin values and the bin entries
+ *	of records, still comes from malloc() since the application releases it
+ *	with free().
+ */
+typedef struct as_allocator_s {
+
+	void * (*malloc)(as_alloc_tag tag, size_t size, void * udata);
+
+	void * (*realloc)(as_alloc_tag tag, void * p, size_t size, void * udata);
+
+	void (*free)(as_alloc_tag tag, void * p, size_t size, void * udata);
+
+	/**
+	 *	Passed to every function.
+	 */
+	void * udata;
+
+} as_allocator;
+
+/**
+ *	Allocation counters of one tag.
+ */
+typedef struct as_alloc_stats_s {
+
+	/**
+	 *	Number of allocations made.
+	 */
+	uint64_t allocs;
+
+	/**
+	 *	Number of allocations released.
+	 */
+	uint64_t frees;
+
+	/**
+	 *	Bytes currently allocated.
+	 */
+	uint64_t bytes;
+
+	/**
+	 *	Bytes allocated since the process started.
+	 */
+	uint64_t total_bytes;
+
+} as_alloc_stats;
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Use `allocator` for the allocations made from now on. NULL restores the
+ *	default, which uses malloc(). Memory is always released with the
+ *	allocator it came from, so that allocator must outlive it.
+ *
+ *	aerospike_connect() uses as_allocator_set_once() instead.
+ */
+void as_allocator_set(const as_allocator * allocator);
+
+/**
+ *	Use `allocator` unless a different one is in use already. There is one
+ *	allocator per process, so aerospike_connect() installs as_config.allocator
+ *	with this, and rejects a client configured with another one.
+ *
+ *	@return true if `allocator` is the allocator in use.
+ */
+bool as_allocator_set_once(const as_allocator * allocator);
+
+/**
+ *	Allocate `size` bytes for subsystem `tag`.
+ */
+void * as_malloc(as_alloc_tag tag, size_t size);
+
+/**
+ *	Allocate `n * size` zeroed bytes for subsystem `tag`.
+ */
+void * as_calloc(as_alloc_tag tag, size_t n, size_t size);
+
+/**
+ *	Resize memory from as_malloc(). A NULL `p` allocates.
+ */
+void * as_realloc(as_alloc_tag tag, void * p, size_t size);
+
+/**
+ *	Release memory from as_malloc(). NULL is ignored.
+ */
+void as_free(void * p);
+
+/**
+ *	Read the counters of a tag.
+ */
+void as_allocator_stats(as_alloc_tag tag, as_alloc_stats * stats);
+
+/**
+ *	The name of a tag, for reporting.
+ */
+const char * as_alloc_tag_name(as_alloc_tag tag);
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+/**
+ *	Default size of the chunks of an arena.
+ */
+#define AS_ARENA_CHUNK_SIZE (16 * 1024)
+
+/**
+ *	Maximum number of released arenas kept by each thread for reuse.
+ */
+#define AS_ARENA_THREAD_CACHE_SIZE 4
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	@private
+ *	A contiguous block of memory allocated from by an arena.
+ */
+typedef struct as_arena_chunk_s {
+
+	/**
+	 *	The chunk allocated before this one.
+	 */
+	struct as_arena_chunk_s * next;
+
+	/**
+	 *	Number of bytes in data.
+	 */
+	size_t capacity;
+
+	/**
+	 *	Number of bytes handed out.
+	 */
+	size_t used;
+
+	/**
+	 *	The memory handed out.
+	 */
+	uint8_t data[];
+
+} as_arena_chunk;
+
+/**
+ *	Region allocator used to decode records.
+ *
+ *	Memory is handed out by bumping a pointer in a chunk, and is never freed
+ *	piecemeal. Everything allocated from an arena is released at once by
+ *	as_arena_reset() or as_arena_destroy().
+ *
+ *	The first chunk is allocated with the arena and kept when the arena is
+ *	reset, so an arena reused for records of similar size does not call
+ *	malloc() again.
+ *
+ *	An arena is not thread safe.
+ */
+typedef struct as_arena_s {
+
+	/**
+	 *	@private
+	 *	The chunk being allocated from.
+	 */
+	as_arena_chunk * current;
+
+	/**
+	 *	@private
+	 *	The chunk allocated with the arena.
+	 */
+	as_arena_chunk * first;
+
+	/**
+	 *	@private
+	 *	Size of the chunks added when the current one is full.
+	 */
+	size_t chunk_size;
+
+} as_arena;
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Create an arena on the heap.
+ *
+ *	@param chunk_size	Size of the chunks. If zero, AS_ARENA_CHUNK_SIZE is used.
+ *
+ *	@return The new arena, or NULL if out of memory.
+ *
+ *	@relates as_arena
+ */
+as_arena * as_arena_new(size_t chunk_size);
+
+/**
+ *	Allocate `size` bytes, aligned for any type, from the arena.
+ *
+ *	@return The memory, or NULL if out of memory.
+ *
+ *	@relates as_arena
+ */
+void * as_arena_alloc(as_arena * arena, size_t size);
+
+/**
+ *	Check whether `p` was allocated from the arena.
+ *
+ *	@relates as_arena
+ */
+bool as_arena_owns(const as_arena * arena, const void * p);
+
+/**
+ *	Release everything allocated from the arena. Only the chunks added after
+ *	the first one are freed.
+ *
+ *	@relates as_arena
+ */
+void as_arena_reset(as_arena * arena);
+
+/**
+ *	Free the arena and all its chunks.
+ *
+ *	@relates as_arena
+ */
+void as_arena_destroy(as_arena * arena);
+
+/**
+ *	Take an arena from the cache of the calling thread, or create one if the
+ *	cache is empty.
+ *
+ *	@return The arena, or NULL if out of memory.
+ *
+ *	@relates as_arena
+ */
+as_arena * as_arena_acquire();
+
+/**
+ *	Reset an arena and put it in the cache of the calling thread, so the next
+ *	as_arena_acquire() of the thread reuses it. The arena is destroyed if the
+ *	cache is full.
+ *
+ *	@relates as_arena
+ */
+void as_arena_release(as_arena * arena);
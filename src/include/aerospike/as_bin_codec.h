@@ -0,0 +1,177 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+/**
+ *	@defgroup bin_codec_api Bin Compression
+ *	@{
+ *
+ *	Transparent compression of selected string and blob bins, with
+ *	dictionaries trained on the data of a set.
+ *
+ *	A dictionary is registered under an id. Bins are then configured, by
+ *	namespace, set and name, to be compressed with it:
+ *
+ *	~~~~~~~~~~{.c}
+ *		as_bin_dict_train(&as, &err, NULL, "test", "events", "payload",
+ *			1, NULL, 16 * 1024, 1000, NULL, NULL);
+ *		as_bin_codec_enable("test", "events", "payload", 1, 64);
+ *	~~~~~~~~~~
+ *
+ *	From then on aerospike_key_put() and the writes of aerospike_key_operate()
+ *	send the value of such a bin compressed, whenever that makes it smaller.
+ *	The server stores it as a plain blob, AS_BYTES_BLOB, starting with
+ *	AS_BIN_CODEC_TAG. Reads of any record turn such blobs back into the
+ *	original string or blob, whatever the configuration, as long as the
+ *	dictionary they name is registered. A blob that only looks compressed
+ *	fails to decompress and is read as it is.
+ *
+ *	Records hold the id of their dictionary, not the dictionary, so a
+ *	dictionary must be registered by every client reading them, and must
+ *	never change once records use it. Train a new dictionary under a new id
+ *	and point the bin at it instead. Dictionaries and bin settings are
+ *	process wide.
+ */
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_codec.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_status.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+/**
+ *	First bytes of a blob holding a compressed bin value.
+ */
+#define AS_BIN_CODEC_TAG "\xc5" "BC1"
+
+/**
+ *	Bytes in front of the compressed data: the tag, original type, dictionary
+ *	id and original size.
+ */
+#define AS_BIN_CODEC_HEADER_SIZE 13
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Register a dictionary. The dictionary is copied.
+ *
+ *	@param id		Id records compressed with the dictionary refer to it by.
+ *	@param codec	The codec, which must support dictionaries. NULL means zlib.
+ *	@param level	Compression level. 0 means the default level of the codec.
+ *	@param dict		The dictionary.
+ *	@param size		Size of the dictionary.
+ *
+ *	@return true on success. false if the codec has no dictionary support,
+ *	when out of memory, or if a different dictionary is registered under id.
+ */
+bool as_bin_dict_register(uint32_t id, const as_codec * codec, int level, const uint8_t * dict, uint32_t size);
+
+/**
+ *	Build a dictionary from a sample of the values of a bin, and register it.
+ *
+ *	The set is scanned until max_samples string or blob values of the bin
+ *	are collected. Values already compressed are sampled decompressed.
+ *
+ *	@param as			The aerospike instance to scan with.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param policy		The scan policy. If NULL, then the default policy will be used.
+ *	@param ns			Namespace to sample.
+ *	@param set			Set to sample.
+ *	@param bin			Bin to sample.
+ *	@param id			Id to register the dictionary under.
+ *	@param codec		The codec, which must support dictionaries. NULL means zlib.
+ *	@param dict_size	Largest size of the dictionary.
+ *	@param max_samples	Number of values to sample.
+ *	@param dict_r		If not NULL, receives a malloc()ed copy of the dictionary,
+ *						to store and register again on later runs.
+ *	@param size_r		If not NULL, receives the size of the dictionary.
+ *
+ *	@return AEROSPIKE_OK if successful. Otherwise an error.
+ */
+as_status as_bin_dict_train(
+	aerospike * as, as_error * err, const as_policy_scan * policy,
+	const char * ns, const char * set, const char * bin,
+	uint32_t id, const as_codec * codec, uint32_t dict_size, uint32_t max_samples,
+	uint8_t ** dict_r, uint32_t * size_r);
+
+/**
+ *	Compress a bin on writes.
+ *
+ *	@param ns			Namespace of the records.
+ *	@param set			Set of the records. NULL means every set.
+ *	@param bin			Name of the bin.
+ *	@param dict_id		Dictionary to compress with. It must be registered.
+ *	@param min_size		Values smaller than this are sent as they are.
+ *
+ *	@return true on success. false if the dictionary is not registered, the
+ *	names are too long, or when out of memory.
+ */
+bool as_bin_codec_enable(const char * ns, const char * set, const char * bin, uint32_t dict_id, uint32_t min_size);
+
+/**
+ *	Stop compressing a bin on writes. Its compressed values are still read.
+ */
+void as_bin_codec_disable(const char * ns, const char * set, const char * bin);
+
+/**
+ *	Remove every bin setting and dictionary.
+ */
+void as_bin_codec_clear();
+
+/**
+ *	@private
+ *	Compress the value of a bin if it is configured for compression.
+ *
+ *	@return A malloc()ed compressed value, to be sent as an AS_BYTES_BLOB, and
+ *	its size in out_sz, or NULL if the bin is not configured or compressing
+ *	does not pay off.
+ */
+uint8_t * as_bin_codec_compress(const char * ns, const char * set, const char * bin,
+	as_bytes_type type, const uint8_t * value, uint32_t size, uint32_t * out_sz);
+
+/**
+ *	@private
+ *	Read the header of a blob holding a compressed value.
+ *
+ *	@return true if the blob starts with a valid header, with the original type
+ *	and size.
+ */
+bool as_bin_codec_peek(const uint8_t * value, uint32_t size, as_bytes_type * type_r, uint32_t * out_sz_r);
+
+/**
+ *	@private
+ *	Decompress a compressed value into out, of the size given by
+ *	as_bin_codec_peek().
+ *
+ *	@return true on success. false if the value is corrupt or its dictionary
+ *	is not registered.
+ */
+bool as_bin_codec_decompress(const uint8_t * value, uint32_t size, uint8_t * out, uint32_t out_sz);
+
+/**
+ *	@}
+ */
@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <aerospike/as_allocator.h>
 #include <aerospike/as_config.h>
 #include <aerospike/as_node.h>
 #include <aerospike/as_partition.h>
@@ -99,6 +100,76 @@ typedef struct as_gc_item_s {
 	as_release_fn release_fn;
 } as_gc_item;
 
+/**
+ *	Counts of hedged reads.
+ */
+typedef struct as_hedge_stats_s {
+	/**
+	 *	Reads that were not answered within their hedge delay.
+	 */
+	uint64_t slow;
+	
+	/**
+	 *	Reads sent to a second replica.
+	 */
+	uint64_t hedged;
+	
+	/**
+	 *	Hedged reads answered first by the second replica.
+	 */
+	uint64_t won;
+	
+	/**
+	 *	Slow reads not hedged because of as_config.hedge_max_percent.
+	 */
+	uint64_t throttled;
+} as_hedge_stats;
+
+/**
+ *	Counts of transaction attempts.
+ */
+typedef struct as_retry_stats_s {
+	/**
+	 *	Attempts made, including the first attempt of each transaction.
+	 */
+	uint64_t attempts;
+	
+	/**
+	 *	Attempts made after a failed attempt.
+	 */
+	uint64_t retries;
+	
+	/**
+	 *	Retried reads sent to the replica rather than the node chosen by the policy.
+	 */
+	uint64_t replica_retries;
+	
+	/**
+	 *	Transactions that succeeded after a retry.
+	 */
+	uint64_t recovered;
+} as_retry_stats;
+
+/**
+ *	Counts of reads with AS_POLICY_REPLICA_ZONE, by where they were routed.
+ */
+typedef struct as_zone_stats_s {
+	/**
+	 *	Reads sent to a replica in the zone of the client.
+	 */
+	uint64_t local;
+	
+	/**
+	 *	Reads sent out of the zone because no replica is in it.
+	 */
+	uint64_t remote;
+	
+	/**
+	 *	Reads sent out of the zone because the replica in it is not healthy.
+	 */
+	uint64_t unhealthy;
+} as_zone_stats;
+
 /**
  *	Cluster of server nodes.
  */
@@ -210,6 +281,96 @@ typedef struct as_cluster_s {
 	 */
 	uint32_t tend_interval;
 	
+	/**
+	 *	@private
+	 *	Codec of compressed requests and responses.
+	 */
+	const as_codec* codec;
+	
+	/**
+	 *	@private
+	 *	Compression level, 0 for the default of the codec.
+	 */
+	int codec_level;
+	
+	/**
+	 *	@private
+	 *	Maximum share of reads hedged, in percent.
+	 */
+	uint32_t hedge_max_percent;
+	
+	/**
+	 *	@private
+	 *	Hedges that may be sent, in hundredths of a hedge.
+	 */
+	uint32_t hedge_tokens;
+	
+	/**
+	 *	@private
+	 *	Counts of hedged reads.
+	 */
+	as_hedge_stats hedge_stats;
+	
+	/**
+	 *	@private
+	 *	Counts of transaction attempts.
+	 */
+	as_retry_stats retry_stats;
+	
+	/**
+	 *	@private
+	 *	Zone of the client.
+	 */
+	char zone[AS_CONFIG_ZONE_SIZE];
+	
+	/**
+	 *	@private
+	 *	Info value holding the zone of a node, empty for none.
+	 */
+	char zone_info_name[AS_CONFIG_ZONE_SIZE];
+	
+	/**
+	 *	@private
+	 *	Zones of nodes by IP address.
+	 */
+	as_zone_map* zone_map;
+	
+	/**
+	 *	@private
+	 *	Length of zone_map array.
+	 */
+	uint32_t zone_map_size;
+	
+	/**
+	 *	@private
+	 *	Counts of zone aware reads.
+	 */
+	as_zone_stats zone_stats;
+	
+	/**
+	 *	@private
+	 *	Consecutive failures that open a node's circuit breaker, 0 for never.
+	 */
+	uint32_t breaker_threshold;
+	
+	/**
+	 *	@private
+	 *	Milliseconds a node's circuit breaker stays open before a probe.
+	 */
+	uint32_t breaker_open_ms;
+	
+	/**
+	 *	@private
+	 *	Latency percentile adaptive attempt timeouts are derived from.
+	 */
+	uint32_t adaptive_timeout_percentile;
+	
+	/**
+	 *	@private
+	 *	Multiple of the latency percentile allowed by adaptive attempt timeouts.
+	 */
+	uint32_t adaptive_timeout_multiplier;
+	
 	/**
 	 *	@private
 	 *	Random node index.
@@ -329,7 +490,7 @@ as_nodes_release(as_nodes* nodes)
 	ck_pr_dec_32_zero(&nodes->ref_count, &destroy);
 	
 	if (destroy) {
-		cf_free(nodes);
+		as_free(nodes);
 	}
 }
 
@@ -380,7 +541,7 @@ as_partition_tables_release(as_partition_tables* tables)
 	ck_pr_dec_32_zero(&tables->ref_count, &destroy);
 	
 	if (destroy) {
-		cf_free(tables);
+		as_free(tables);
 	}
 }
 
@@ -434,3 +595,57 @@ as_node_get(as_cluster* cluster, const char* ns, const cf_digest* d, bool write,
 		return as_partition_table_get_node(cluster, table, d, write, replica);
 	}
 }
+
+/**
+ *	@private
+ *	Get the replica node of a digest key's partition that is not the given node.  Return
+ *	null if there is none or it is not active.
+ *	as_nodes_release() must be called when done with node.
+ */
+as_node*
+as_partition_table_get_replica(as_partition_table* table, const cf_digest* d, as_node* node);
+
+/**
+ *	@private
+ *	Get the shared memory replica node of a digest key's partition that is not the given node.
+ *	Return null if there is none or it is not active.
+ *	as_nodes_release() must be called when done with node.
+ */
+as_node*
+as_shm_node_get_replica(as_cluster* cluster, const char* ns, const cf_digest* d, as_node* node);
+
+/**
+ *	@private
+ *	Get the replica node of a digest key's partition that is not the given node.  Return
+ *	null if there is none or it is not active.
+ *	as_nodes_release() must be called when done with node.
+ */
+static inline as_node*
+as_node_get_replica(as_cluster* cluster, const char* ns, const cf_digest* d, as_node* node)
+{
+	if (cluster->shm_info) {
+		return as_shm_node_get_replica(cluster, ns, d, node);
+	}
+	else {
+		as_partition_table* table = as_cluster_get_partition_table(cluster, ns);
+		return table ? as_partition_table_get_replica(table, d, node) : 0;
+	}
+}
+
+/**
+ *	Get counts of hedged reads since the cluster was created.
+ */
+void
+as_cluster_get_hedge_stats(as_cluster* cluster, as_hedge_stats* stats);
+
+/**
+ *	Get counts of transaction attempts since the cluster was created.
+ */
+void
+as_cluster_get_retry_stats(as_cluster* cluster, as_retry_stats* stats);
+
+/**
+ *	Get counts of zone aware reads since the cluster was created.
+ */
+void
+as_cluster_get_zone_stats(as_cluster* cluster, as_zone_stats* stats);
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+/**
+ *	Largest decompressed payload accepted from a compressed proto. Protects
+ *	against allocating whatever a corrupt size prefix asks for.
+ */
+#define AS_CODEC_MAX_SIZE (128 * 1024 * 1024)
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	A compression algorithm for request and response payloads.
+ *
+ *	A compressed proto (CL_PROTO_TYPE_CL_MSG_COMPRESSED) carries the original
+ *	size followed by the compressed data, but not the algorithm. Client and
+ *	server must therefore agree on the codec, which is chosen for a cluster
+ *	by as_config.codec. zlib is what the server speaks by default. LZ4 and
+ *	zstd are built when the library is compiled with `USE_LZ4=1` and
+ *	`USE_ZSTD=1`, for servers or proxies configured for them.
+ *
+ *	Applications can provide their own codec by filling in this structure.
+ */
+typedef struct as_codec_s {
+
+	/**
+	 *	Name, for logs and reports.
+	 */
+	const char * name;
+
+	/**
+	 *	Level used when the configured level is 0.
+	 */
+	int default_level;
+
+	/**
+	 *	Largest compressed size of `size` bytes of input. Zero if the input is
+	 *	too large for the codec.
+	 */
+	size_t (*bound)(size_t size);
+
+	/**
+	 *	Compress `in` into `out`. On entry `*out_sz` is the capacity of `out`,
+	 *	on success it is the compressed size. Returns 0 on success.
+	 */
+	int (*compress)(int level, const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz);
+
+	/**
+	 *	Decompress `in` into exactly `out_sz` bytes of `out`. Returns 0 on
+	 *	success.
+	 */
+	int (*decompress)(const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz);
+
+	/**
+	 *	compress() primed with a dictionary. NULL if the codec does not
+	 *	support dictionaries.
+	 */
+	int (*compress_dict)(int level, const uint8_t * dict, size_t dict_sz,
+		const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz);
+
+	/**
+	 *	decompress() with the dictionary the data was compressed with. NULL if
+	 *	the codec does not support dictionaries.
+	 */
+	int (*decompress_dict)(const uint8_t * dict, size_t dict_sz,
+		const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz);
+
+	/**
+	 *	Build a dictionary of at most `capacity` bytes from `n` samples laid
+	 *	end to end in `samples`, of `sizes[0]` to `sizes[n - 1]` bytes.
+	 *	Returns the size of the dictionary, 0 on failure. NULL if the codec
+	 *	does not support dictionaries.
+	 */
+	size_t (*train)(const uint8_t * samples, const size_t * sizes, uint32_t n,
+		uint8_t * dict, size_t capacity);
+
+} as_codec;
+
+/******************************************************************************
+ *	GLOBAL VARIABLES
+ *****************************************************************************/
+
+/**
+ *	zlib, at its fastest level by default. Dictionaries are zlib preset
+ *	dictionaries, of which only the last 32 KB are used.
+ */
+extern const as_codec as_codec_zlib;
+
+#ifdef AS_USE_LZ4
+/**
+ *	LZ4. The level is its acceleration: higher is faster and compresses less.
+ *	No dictionary support.
+ */
+extern const as_codec as_codec_lz4;
+#endif
+
+#ifdef AS_USE_ZSTD
+/**
+ *	Zstandard.
+ */
+extern const as_codec as_codec_zstd;
+#endif
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Find a built-in codec by name ("zlib", "lz4", "zstd").
+ *
+ *	@return The codec, or NULL if it is unknown or not built in.
+ */
+const as_codec * as_codec_find(const char * name);
+
+/**
+ *	Compress a complete request, proto header included, into a compressed
+ *	proto. The result comes from cl_buf_acquire().
+ *
+ *	@param codec		The codec. NULL means zlib.
+ *	@param level		The level. 0 means the default level of the codec.
+ *	@param buf			The request.
+ *	@param buf_sz		Size of the request.
+ *	@param frame_r		The compressed proto.
+ *	@param frame_sz_r	Size of the compressed proto.
+ *
+ *	@return 0 on success, -1 if compression failed or did not make the
+ *	request smaller, in which case it should be sent as is.
+ */
+int as_codec_compress_proto(const as_codec * codec, int level, const uint8_t * buf, size_t buf_sz,
+	uint8_t ** frame_r, size_t * frame_sz_r);
+
+/**
+ *	Decompress the body of a compressed proto: the original size followed by
+ *	the compressed messages. The result comes from cl_buf_acquire().
+ *
+ *	@param codec		The codec. NULL means zlib.
+ *	@param body			The proto body.
+ *	@param body_sz		Size of the body.
+ *	@param out_r		The messages.
+ *	@param out_sz_r		Size of the messages.
+ *
+ *	@return 0 on success, -1 on a corrupt body or when out of memory.
+ */
+int as_codec_decompress_body(const as_codec * codec, const uint8_t * body, size_t body_sz,
+	uint8_t ** out_r, size_t * out_sz_r);
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <aerospike/as_bin.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	Physical type of an as_column.
+ */
+typedef enum as_column_type_e {
+
+	/**
+	 *	Fixed width signed 64 bit integers, stored in `values`.
+	 */
+	AS_COLUMN_INT64,
+
+	/**
+	 *	Variable width UTF-8 strings, stored in `offsets` and `data`.
+	 */
+	AS_COLUMN_STRING,
+
+	/**
+	 *	Variable width binary values, stored in `offsets` and `data`.
+	 *	String bins are accepted as well.
+	 */
+	AS_COLUMN_BYTES
+
+} as_column_type;
+
+/**
+ *	A column of a columnar batch.
+ *
+ *	The buffers follow the Arrow columnar layout, so they can be handed to an
+ *	Arrow based engine without copying:
+ *
+ *	- `validity` holds one bit per row, least significant bit first. A set bit
+ *	  means the bin was present in the record and had the column's type.
+ *	- `values` holds one int64 per row for AS_COLUMN_INT64 columns.
+ *	- `offsets` holds `n_rows + 1` offsets into `data` for AS_COLUMN_STRING
+ *	  and AS_COLUMN_BYTES columns. Value `i` is
+ *	  `data[offsets[i]] .. data[offsets[i + 1]]`. Missing values are empty.
+ */
+typedef struct as_column_s {
+
+	/**
+	 *	Name of the bin stored in this column.
+	 */
+	as_bin_name name;
+
+	/**
+	 *	Physical type of the column.
+	 */
+	as_column_type type;
+
+	/**
+	 *	Number of rows without a value.
+	 */
+	uint32_t null_count;
+
+	/**
+	 *	Validity bitmap, one bit per row.
+	 */
+	uint8_t * validity;
+
+	/**
+	 *	Integer values. Only used by AS_COLUMN_INT64.
+	 */
+	int64_t * values;
+
+	/**
+	 *	Offsets into data. Only used by variable width columns.
+	 */
+	int32_t * offsets;
+
+	/**
+	 *	Value bytes. Only used by variable width columns.
+	 */
+	uint8_t * data;
+
+	/**
+	 *	Number of bytes used in data.
+	 */
+	uint32_t data_size;
+
+	/**
+	 *	Number of bytes allocated for data.
+	 */
+	uint32_t data_capacity;
+
+} as_column;
+
+/**
+ *	A batch of rows stored as columns.
+ *
+ *	Define the columns once with as_columnar_batch_add_column(). The batch is
+ *	then filled row by row, handed to the caller when `capacity` rows are
+ *	buffered and cleared for reuse, so buffers are allocated once per scan
+ *	rather than once per record.
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_columnar_batch batch;
+ *	as_columnar_batch_init(&batch, 4096);
+ *	as_columnar_batch_add_column(&batch, "age", AS_COLUMN_INT64);
+ *	as_columnar_batch_add_column(&batch, "name", AS_COLUMN_STRING);
+ *	...
+ *	as_columnar_batch_destroy(&batch);
+ *	~~~~~~~~~~
+ */
+typedef struct as_columnar_batch_s {
+
+	/**
+	 *	Number of rows currently stored.
+	 */
+	uint32_t n_rows;
+
+	/**
+	 *	Maximum number of rows stored before the batch is handed over.
+	 */
+	uint32_t capacity;
+
+	/**
+	 *	Number of columns.
+	 */
+	uint32_t n_columns;
+
+	/**
+	 *	Array of columns.
+	 */
+	as_column * columns;
+
+} as_columnar_batch;
+
+/**
+ *	Callback receiving full (or final, partial) batches.
+ *
+ *	The batch buffers are only valid for the duration of the callback; they
+ *	are overwritten by the next batch.
+ *
+ *	@param batch 		The rows received since the last callback.
+ *	@param udata 		User-data provided to the calling function.
+ *
+ *	@return `true` to continue. Otherwise, the scan is aborted.
+ */
+typedef bool (* as_columnar_callback)(const as_columnar_batch * batch, void * udata);
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Initialize a batch holding up to `capacity` rows.
+ *
+ *	@relates as_columnar_batch
+ */
+as_columnar_batch * as_columnar_batch_init(as_columnar_batch * batch, uint32_t capacity);
+
+/**
+ *	Add a column. Columns must be added before any rows.
+ *
+ *	@return the column, or NULL if the name is invalid or rows were added.
+ *
+ *	@relates as_columnar_batch
+ */
+as_column * as_columnar_batch_add_column(as_columnar_batch * batch, const char * name, as_column_type type);
+
+/**
+ *	Get the index of the column named by `name` of length `name_sz`, or -1.
+ *
+ *	@relates as_columnar_batch
+ */
+int as_columnar_batch_find_column(const as_columnar_batch * batch, const char * name, uint32_t name_sz);
+
+/**
+ *	Is the batch full and ready to be handed over?
+ *
+ *	@relates as_columnar_batch
+ */
+static inline bool as_columnar_batch_full(const as_columnar_batch * batch)
+{
+	return batch->n_rows >= batch->capacity;
+}
+
+/**
+ *	Remove all rows, keeping the columns and their buffers.
+ *
+ *	@relates as_columnar_batch
+ */
+void as_columnar_batch_clear(as_columnar_batch * batch);
+
+/**
+ *	Release all buffers of the batch.
+ *
+ *	@relates as_columnar_batch
+ */
+void as_columnar_batch_destroy(as_columnar_batch * batch);
+
+/**
+ *	Set the value of an AS_COLUMN_INT64 column for the row being added.
+ *	Each column of a row must be set at most once, either with a value or via
+ *	as_columnar_batch_end_row().
+ *
+ *	@relates as_columnar_batch
+ */
+bool as_column_set_int64(as_columnar_batch * batch, as_column * column, int64_t value);
+
+/**
+ *	Set the value of a variable width column for the row being added.
+ *
+ *	@relates as_columnar_batch
+ */
+bool as_column_set_bytes(as_columnar_batch * batch, as_column * column, const uint8_t * value, uint32_t size);
+
+/**
+ *	Complete the row being added. Columns that were not set are stored as
+ *	missing values.
+ *
+ *	@relates as_columnar_batch
+ */
+void as_columnar_batch_end_row(as_columnar_batch * batch);
+
+/**
+ *	Is the value of row `row` present in the column?
+ *
+ *	@relates as_column
+ */
+static inline bool as_column_is_valid(const as_column * column, uint32_t row)
+{
+	return (column->validity[row >> 3] >> (row & 7)) & 1;
+}
@@ -16,6 +16,8 @@
  */
 #pragma once 
 
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_codec.h>
 #include <aerospike/as_error.h>
 #include <aerospike/as_policy.h>
 #include <aerospike/as_password.h>
@@ -63,6 +65,11 @@
  */
 #define AS_CONFIG_HOSTS_SIZE 256
 
+/**
+ * The size of zone names
+ */
+#define AS_CONFIG_ZONE_SIZE 32
+
 /******************************************************************************
  *	TYPES
  *****************************************************************************/
@@ -105,6 +112,25 @@ typedef struct as_addr_map_s {
 	
 } as_addr_map;
 
+/**
+ *	Zone of a server node, for zone aware reads.
+ *
+ *	@ingroup as_config_object
+ */
+typedef struct as_zone_map_s {
+	
+	/**
+	 *	IP address of the node in string format.
+	 */
+	char * addr;
+	
+	/**
+	 *	Zone of the node.
+	 */
+	char * zone;
+	
+} as_zone_map;
+
 /**
  *	lua module config
  *
@@ -363,6 +389,43 @@ typedef struct as_config_s {
 	 *	Default: 8
 	 */
 	uint32_t shm_max_namespaces;
+
+	/**
+	 *	Shared memory maximum number of client processes publishing node statistics.
+	 *	Each attached process publishes the in-flight count, error rate and latency it
+	 *	sees for each node, and the tending process aggregates them into fleet-wide
+	 *	node statistics. Processes beyond this count still share the cluster map, but
+	 *	their node statistics are not published.
+	 *	Default: 64
+	 */
+	uint32_t shm_max_processes;
+
+	/**
+	 *	Back the shared memory segment with huge pages, so the partition tables read on
+	 *	every transaction by every process take fewer TLB entries. Huge pages must have
+	 *	been reserved, see /proc/sys/vm/nr_hugepages. If none are available, normal pages
+	 *	are used. Only the process creating the segment uses this setting. Linux only.
+	 *	Default: false
+	 */
+	bool shm_huge_pages;
+
+	/**
+	 *	NUMA node the process creating the shared memory segment places it on. Place it
+	 *	on the node the client processes run on. A negative value leaves placement to the
+	 *	kernel. Linux only.
+	 *	Default: -1
+	 */
+	int shm_numa_node;
+
+	/**
+	 *	Double buffer shared memory partition tables. The tend owner applies a whole tend
+	 *	of partition changes to a copy of each namespace's table, then switches readers
+	 *	to it at once. Otherwise changes are applied as each node reports them. Doubles
+	 *	the memory taken by partition tables. Only the process creating the segment uses
+	 *	this setting.
+	 *	Default: false
+	 */
+	bool shm_double_buffer;
 	
 	/**
 	 *	Take over shared memory cluster tending if the cluster hasn't been tended by this
@@ -370,6 +433,96 @@ typedef struct as_config_s {
 	 *	Default: 30
 	 */
 	uint32_t shm_takeover_threshold_sec;
+
+	/**
+	 *	Allocator for the memory the client uses internally, such as network
+	 *	buffers, record bins and cluster state. There is one allocator per
+	 *	process: aerospike_connect() installs it, and fails with
+	 *	AEROSPIKE_ERR_PARAM if another client installed a different one.
+	 *	Default: NULL, which uses malloc()
+	 */
+	const as_allocator * allocator;
+
+	/**
+	 *	Codec of compressed requests and responses. The server must use the
+	 *	same one, see as_codec.
+	 *	Default: NULL, which is zlib
+	 */
+	const as_codec * codec;
+
+	/**
+	 *	Compression level passed to the codec. 0 uses the default level of the
+	 *	codec, which favors speed.
+	 *	Default: 0
+	 */
+	int codec_level;
+
+	/**
+	 *	Maximum share of reads, in percent, sent to a second replica because
+	 *	the first was slow to answer. See as_policy_read.hedge_delay.
+	 *	Default: 5
+	 */
+	uint32_t hedge_max_percent;
+
+	/**
+	 *	Consecutive transactions that must fail on the network to open the
+	 *	circuit breaker of a node. While a node's breaker is open, reads go to
+	 *	its replica and writes to it fail at once with AEROSPIKE_ERR_CLUSTER,
+	 *	instead of waiting for their timeout. 0 disables the breakers.
+	 *	Default: 10
+	 */
+	uint32_t breaker_threshold;
+
+	/**
+	 *	Milliseconds a node's circuit breaker stays open before a transaction
+	 *	is let through to probe whether the node recovered.
+	 *	Default: 1000
+	 */
+	uint32_t breaker_open_ms;
+
+	/**
+	 *	Percentile of a node's recent latencies that adaptive attempt timeouts
+	 *	are derived from. See AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE.
+	 *	Default: 99
+	 */
+	uint32_t adaptive_timeout_percentile;
+
+	/**
+	 *	Multiple of the latency percentile that an adaptive attempt timeout
+	 *	allows. The policy timeout still bounds the whole transaction, and
+	 *	attempts are not limited until the node has enough latencies.
+	 *	Default: 3
+	 */
+	uint32_t adaptive_timeout_multiplier;
+
+	/**
+	 *	Zone (availability zone, rack) the client runs in. Reads with
+	 *	AS_POLICY_REPLICA_ZONE go to a replica in this zone when one is
+	 *	healthy.
+	 *	Default: empty, no zone
+	 */
+	char zone[AS_CONFIG_ZONE_SIZE];
+
+	/**
+	 *	Zones of the server nodes, by IP address. Takes precedence over
+	 *	zone_info_name. A deep copy of zone_map is performed in
+	 *	aerospike_connect().
+	 *	Default: NULL
+	 */
+	as_zone_map * zone_map;
+
+	/**
+	 *	Length of zone_map array.
+	 *	Default: 0
+	 */
+	uint32_t zone_map_size;
+
+	/**
+	 *	Name of an info value holding the zone of a node, requested from
+	 *	each node not in zone_map until it answers.
+	 *	Default: empty, zones are not requested
+	 */
+	char zone_info_name[AS_CONFIG_ZONE_SIZE];
 } as_config;
 
 /******************************************************************************
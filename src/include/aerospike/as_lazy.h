@@ -0,0 +1,86 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+/**
+ *	@defgroup lazy_api Lazy Lists and Maps
+ *	@{
+ *
+ *	List and map bins read from the database are returned as lazy values:
+ *	an as_list or as_map that keeps the serialized bytes it was read as, and
+ *	only deserializes them when an element is first accessed. Reading the
+ *	size only looks at the header. A record whose list or map bins are never
+ *	looked at never pays for decoding them.
+ *
+ *	Lazy values are used through the as_list and as_map functions like any
+ *	other. When a lazy value is written back without having been modified,
+ *	its bytes are sent as they are, without serializing it again.
+ *
+ *	Elements are owned by the lazy value, as for as_arraylist and
+ *	as_hashmap. A list or map read from a lazy value that holds nested lists
+ *	or maps may be modified in place, so once such an element has been
+ *	handed out the value is serialized again when written.
+ */
+
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_val.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Create a list on the heap from its serialized form.
+ *
+ *	@param data		The serialized list.
+ *	@param size		Size of the serialized list.
+ *	@param free		If true, data is free()d with the list.
+ *
+ *	@return The list, or NULL when out of memory.
+ */
+as_list * as_lazy_list_new(uint8_t * data, uint32_t size, bool free);
+
+/**
+ *	Create a map on the heap from its serialized form.
+ *
+ *	@param data		The serialized map.
+ *	@param size		Size of the serialized map.
+ *	@param free		If true, data is free()d with the map.
+ *
+ *	@return The map, or NULL when out of memory.
+ */
+as_map * as_lazy_map_new(uint8_t * data, uint32_t size, bool free);
+
+/**
+ *	Get the serialized form of a lazy list or map, if it is still that of
+ *	its value.
+ *
+ *	@param val		The value.
+ *	@param data_r	The serialized value, owned by the value.
+ *	@param size_r	Size of the serialized value.
+ *
+ *	@return true if val is a lazy list or map that has not been modified.
+ */
+bool as_lazy_serialized(const as_val * val, const uint8_t ** data_r, uint32_t * size_r);
+
+/**
+ *	@}
+ */
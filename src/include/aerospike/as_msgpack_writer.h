@@ -0,0 +1,54 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+/**
+ *	@private
+ *	Encoding of list and map bins straight into a request.
+ *
+ *	The msgpack serializer builds a value in a growing buffer of its own,
+ *	which is then copied into the request. Writes instead size the value
+ *	first, reserve that much in the request, and write the value in place.
+ *
+ *	The bytes written are those of the msgpack serializer. Lazy lists and
+ *	maps that have not been modified are copied as they were read.
+ */
+
+#include <aerospike/as_val.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	@private
+ *	Size of a value once encoded.
+ *
+ *	@return The size, or 0 if the value holds a type that cannot be encoded.
+ */
+size_t as_msgpack_writer_size(const as_val * val);
+
+/**
+ *	@private
+ *	Encode a value into buf, which holds as_msgpack_writer_size() bytes.
+ *
+ *	@return The number of bytes written.
+ */
+size_t as_msgpack_writer_write(const as_val * val, uint8_t * buf);
@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <aerospike/as_config.h>
 #include <aerospike/as_vector.h>
 #include <citrusleaf/cf_queue.h>
 #include <netinet/in.h>
@@ -51,6 +52,127 @@ typedef struct as_address_s {
 
 struct as_cluster_s;
 
+/**
+ *	@private
+ *	Weight of a new sample in node statistics moving averages, as a shift: 1/8.
+ */
+#define AS_NODE_STATS_EWMA_SHIFT 3
+
+/**
+ *	@private
+ *	Latency assumed for a node which has no latency yet, when the other replica
+ *	has none either.
+ */
+#define AS_NODE_LATENCY_PRIOR_US 1000
+
+/**
+ *	@private
+ *	Latency histogram buckets. Bucket i counts latencies from 2^i up to 2^(i+1)
+ *	microseconds, and the last one all longer latencies.
+ */
+#define AS_NODE_LATENCY_BUCKETS 24
+
+/**
+ *	@private
+ *	Latencies a histogram needs before percentiles are taken from it.
+ */
+#define AS_NODE_LATENCY_MIN_SAMPLES 100
+
+/**
+ *	@private
+ *	Latencies a histogram holds before its counts are halved by the tender, so it
+ *	follows recent latencies.
+ */
+#define AS_NODE_LATENCY_WINDOW 10000
+
+/**
+ *	@private
+ *	Kinds of transaction with a latency histogram.
+ */
+#define AS_NODE_LATENCY_READ 0
+#define AS_NODE_LATENCY_WRITE 1
+#define AS_NODE_LATENCY_MAX 2
+
+/**
+ *	@private
+ *	Histogram of transaction latencies on a node.
+ */
+typedef struct as_node_latency_s {
+	uint32_t buckets[AS_NODE_LATENCY_BUCKETS];
+} as_node_latency;
+
+/**
+ *	@private
+ *	Health of a node as seen by transactions. 20 bytes.
+ */
+typedef struct as_node_stats_s {
+	/**
+	 *	@private
+	 *	Transactions in progress.
+	 */
+	uint32_t in_flight;
+
+	/**
+	 *	@private
+	 *	Moving average of the latency of successful transactions in microseconds.
+	 */
+	uint32_t latency_us;
+
+	/**
+	 *	@private
+	 *	Moving average of the deviation of latencies from latency_us in microseconds.
+	 */
+	uint32_t latency_dev_us;
+
+	/**
+	 *	@private
+	 *	Moving average of the share of transactions that failed on the network,
+	 *	in parts per million.
+	 */
+	uint32_t error_ppm;
+
+	/**
+	 *	@private
+	 *	Transactions completed. Wraps around.
+	 */
+	uint32_t transactions;
+} as_node_stats;
+
+/**
+ *	@private
+ *	Circuit breaker states.
+ */
+#define AS_NODE_BREAKER_CLOSED 0
+#define AS_NODE_BREAKER_OPEN 1
+#define AS_NODE_BREAKER_PROBING 2
+
+/**
+ *	@private
+ *	Circuit breaker of a node. It opens after consecutive transactions fail on the
+ *	network, and while it is open, transactions are not sent to the node. After
+ *	as_config.breaker_open_ms, one transaction at a time is let through as a probe,
+ *	and the first success closes the breaker again.
+ */
+typedef struct as_node_breaker_s {
+	/**
+	 *	@private
+	 *	AS_NODE_BREAKER_CLOSED, AS_NODE_BREAKER_OPEN or AS_NODE_BREAKER_PROBING.
+	 */
+	uint32_t state;
+
+	/**
+	 *	@private
+	 *	Consecutive transactions that failed on the network.
+	 */
+	uint32_t failures;
+
+	/**
+	 *	@private
+	 *	When the breaker last opened or let a probe through, in milliseconds.
+	 */
+	uint64_t changed_ms;
+} as_node_breaker;
+
 /**
  *	Server node representation.
  */
@@ -129,6 +251,43 @@ typedef struct as_node_s {
 	 */
 	uint32_t index;
 	
+	/**
+	 *	@private
+	 *	Transaction statistics of this process for the node.
+	 */
+	as_node_stats stats;
+
+	/**
+	 *	@private
+	 *	Circuit breaker of this process for the node.
+	 */
+	as_node_breaker breaker;
+
+	/**
+	 *	@private
+	 *	Latency histograms of this process for the node, by kind of transaction.
+	 */
+	as_node_latency latency[AS_NODE_LATENCY_MAX];
+
+	/**
+	 *	@private
+	 *	Zone of the node, empty until known. Only used by tend thread.
+	 */
+	char zone[AS_CONFIG_ZONE_SIZE];
+
+	/**
+	 *	@private
+	 *	Is node in the zone of the client.
+	 */
+	uint8_t in_zone;
+
+	/**
+	 *	@private
+	 *	Has the zone of the node been looked up, even if the node has none. Only
+	 *	used by tend thread.
+	 */
+	uint8_t zone_checked;
+
 	/**
 	 *	@private
 	 *	Is node currently active.
@@ -257,3 +416,121 @@ as_node_get_connection(as_node* node, int* fd);
  */
 void
 as_node_put_connection(as_node* node, int fd);
+
+/**
+ *	@private
+ *	Count a transaction on the node as started.
+ */
+static inline void
+as_node_stats_begin(as_node* node)
+{
+	ck_pr_inc_32(&node->stats.in_flight);
+}
+
+/**
+ *	@private
+ *	Count a transaction on the node, started at begin_us, as completed. Transactions
+ *	that failed on the network count towards the error rate, and the time they took
+ *	towards the latency.
+ */
+void
+as_node_stats_end(as_node* node, uint64_t begin_us, bool success);
+
+/**
+ *	@private
+ *	Count a transaction on the node, started at begin_us, as failed because its
+ *	attempt timeout expired. It counts towards the error rate but not towards the
+ *	node's circuit breaker.
+ */
+void
+as_node_stats_expire(as_node* node, uint64_t begin_us);
+
+/**
+ *	@private
+ *	Add the latency of a transaction on the node, of kind AS_NODE_LATENCY_READ or
+ *	AS_NODE_LATENCY_WRITE, to the node's histogram.
+ */
+void
+as_node_latency_add(as_node* node, uint32_t kind, uint64_t latency_us);
+
+/**
+ *	@private
+ *	Upper bound in microseconds of the bucket holding the given percentile of the
+ *	node's latencies. Zero if the histogram has too few latencies yet.
+ */
+uint64_t
+as_node_latency_percentile(as_node* node, uint32_t kind, uint32_t percentile);
+
+/**
+ *	@private
+ *	Halve the histograms of the node that are full. Called by the tender.
+ */
+void
+as_node_latency_decay(as_node* node);
+
+/**
+ *	@private
+ *	Find the zone of a node, from as_config.zone_map or else from the node itself
+ *	with as_config.zone_info_name. Called by the tender until the node has answered.
+ */
+void
+as_node_update_zone(struct as_cluster_s* cluster, as_node* node);
+
+/**
+ *	@private
+ *	Whether a read with AS_POLICY_REPLICA_ZONE should go to the master rather than
+ *	the prole: the replica in the client's zone if one is healthy, otherwise the
+ *	faster one. See as_node_is_faster() for random.
+ */
+bool
+as_node_choose_zone(as_node* master, as_node* prole, uint32_t random);
+
+/**
+ *	@private
+ *	Whether a transaction may be sent to the node. False while the node's circuit
+ *	breaker is open, except for a probe after as_config.breaker_open_ms.
+ */
+bool
+as_node_breaker_allow(as_node* node);
+
+/**
+ *	@private
+ *	Whether the node's circuit breaker is open.
+ */
+static inline bool
+as_node_breaker_is_open(as_node* node)
+{
+	return ck_pr_load_32(&node->breaker.state) != AS_NODE_BREAKER_CLOSED;
+}
+
+/**
+ *	@private
+ *	Count a transaction on the node as abandoned, without a result. Used for the
+ *	slower of two requests sent for the same read.
+ */
+static inline void
+as_node_stats_cancel(as_node* node)
+{
+	ck_pr_dec_32(&node->stats.in_flight);
+}
+
+/**
+ *	@private
+ *	Get the statistics of a node. With shared memory these are aggregated across all
+ *	processes attached to it, as of the last tend. Otherwise they are those of this
+ *	process.
+ */
+void
+as_node_get_stats(as_node* node, as_node_stats* stats);
+
+/**
+ *	@private
+ *	Should a read go to node a rather than node b. Compares the expected wait on each
+ *	node, with some jitter taken from random so threads do not all pick the same node.
+ *	The wait is the latency times the transactions this process has in flight, with
+ *	shared memory latency and error rate coming from the whole fleet. A node without
+ *	a latency yet is assumed as fast as the other one, or AS_NODE_LATENCY_PRIOR_US. A
+ *	null node is never chosen.
+ */
+bool
+as_node_is_faster(as_node* a, as_node* b, uint32_t random);
@@ -386,6 +386,31 @@ as_operations * as_operations_new(uint16_t nops);
  */
 void as_operations_destroy(as_operations * ops);
 
+/**
+ *	Remove all operations from an `as_operations` so it can be filled again,
+ *	keeping the allocated entries.
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_operations ops;
+ *	as_operations_init(&ops, 2);
+ *
+ *	while ( running ) {
+ *		as_operations_add_incr(&ops, "count", 1);
+ *		as_operations_add_read(&ops, "count");
+ *		aerospike_key_operate(&as, &err, NULL, &key, &ops, &r);
+ *		as_operations_reset(&ops);
+ *	}
+ *
+ *	as_operations_destroy(&ops);
+ *	~~~~~~~~~~
+ *
+ *	@param ops 	The `as_operations` to reset.
+ *
+ *	@relates as_operations
+ *	@ingroup as_operations_object
+ */
+void as_operations_reset(as_operations * ops);
+
 /**
  *	Add a `AS_OPERATOR_WRITE` bin operation.
  *
@@ -54,6 +54,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /******************************************************************************
@@ -102,6 +103,29 @@
  */
 #define AS_POLICY_REPLICA_DEFAULT AS_POLICY_REPLICA_MASTER
 
+/**
+ *	Default hedge delay for reads: reads are not hedged.
+ *
+ *	@ingroup client_policies
+ */
+#define AS_POLICY_HEDGE_DELAY_DEFAULT 0
+
+/**
+ *	Hedge delay that hedges a read when the node has taken longer than
+ *	its recent 95th percentile latency.
+ *
+ *	@ingroup client_policies
+ */
+#define AS_POLICY_HEDGE_DELAY_ADAPTIVE 0xFFFFFFFF
+
+/**
+ *	Attempt timeout derived for each attempt from the latencies of the node
+ *	it is sent to. See as_config.adaptive_timeout_percentile.
+ *
+ *	@ingroup client_policies
+ */
+#define AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE 0xFFFFFFFF
+
 /**
  *	Default as_policy_consistency_level value for read
  *
@@ -266,7 +290,21 @@ typedef enum as_policy_replica_e {
 	/**
 	 *  Read from an unspecified replica node.
 	 */
-	AS_POLICY_REPLICA_ANY
+	AS_POLICY_REPLICA_ANY,
+
+	/**
+	 *  Read from the replica node expected to answer first, judged by its recent
+	 *  latency, error rate and requests in flight. A small share of reads goes to
+	 *  the other replica, so its statistics stay current.
+	 */
+	AS_POLICY_REPLICA_LATENCY,
+
+	/**
+	 *  Read from a replica node in the zone of the client (as_config.zone),
+	 *  if one is active and its circuit breaker is closed. Otherwise read as
+	 *  with AS_POLICY_REPLICA_LATENCY.
+	 */
+	AS_POLICY_REPLICA_ZONE
 
 } as_policy_replica;
 
@@ -362,6 +400,33 @@ typedef struct as_policy_write_s {
 	 */
 	as_policy_commit_level commit_level;
 
+	/**
+	 *	Limits the rate of writes, one token per record. The limiter is not owned by the policy.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
+	/**
+	 *	Requests of at least this many bytes are sent compressed with the
+	 *	codec of the cluster, when that makes them smaller. Worth it for large
+	 *	records over slow or metered links.
+	 *
+	 *	The default (0) never compresses.
+	 */
+	uint32_t compression_threshold;
+
+	/**
+	 *	Maximum time in milliseconds for each attempt. An attempt that takes
+	 *	longer is abandoned and, if the retry policy allows, the transaction is
+	 *	attempted again until its timeout.
+	 *
+	 *	`AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE` derives it from the recent
+	 *	latencies of writes to the node. The default (0) gives each attempt
+	 *	what is left of the timeout.
+	 */
+	uint32_t attempt_timeout;
+
 } as_policy_write;
 
 /**
@@ -397,6 +462,46 @@ typedef struct as_policy_read_s {
 	 */
 	as_policy_consistency_level consistency_level;
 
+	/**
+	 *	Decode the record into an arena taken from a per-thread cache, instead
+	 *	of allocating each bin and value separately. The arena goes back to
+	 *	the cache of the thread calling as_record_destroy().
+	 *
+	 *	Only used by aerospike_key_get().
+	 */
+	bool use_arena;
+
+	/**
+	 *	Milliseconds after which a read the node has not answered is also sent
+	 *	to the other replica. The first response is used and the other is
+	 *	discarded. The share of reads hedged is capped by
+	 *	as_config.hedge_max_percent.
+	 *
+	 *	`AS_POLICY_HEDGE_DELAY_ADAPTIVE` uses the node's recent 95th percentile
+	 *	latency instead. The default, `AS_POLICY_HEDGE_DELAY_DEFAULT`, never
+	 *	hedges.
+	 *
+	 *	Used by aerospike_key_get(), aerospike_key_select() and aerospike_key_exists().
+	 */
+	uint32_t hedge_delay;
+
+	/**
+	 *	Specifies the behavior for failed reads. Reads are retried until
+	 *	their timeout, alternating between the master and the replica.
+	 */
+	as_policy_retry retry;
+
+	/**
+	 *	Maximum time in milliseconds for each attempt. An attempt that takes
+	 *	longer is abandoned and, if the retry policy allows, the transaction is
+	 *	attempted again until its timeout.
+	 *
+	 *	`AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE` derives it from the recent
+	 *	latencies of reads from the node. The default (0) gives each attempt
+	 *	what is left of the timeout.
+	 */
+	uint32_t attempt_timeout;
+
 } as_policy_read;
 
 /**
@@ -481,6 +586,13 @@ typedef struct as_policy_operate_s {
 	 */
 	as_policy_commit_level commit_level;
 
+	/**
+	 *	Limits the rate of operations, one token per record. The limiter is not owned by the policy.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
 } as_policy_operate;
 
 /**
@@ -528,6 +640,13 @@ typedef struct as_policy_remove_s {
 	 */
 	as_policy_commit_level commit_level;
 
+	/**
+	 *	Limits the rate of removes, one token per record. The limiter is not owned by the policy.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
 } as_policy_remove;
 
 /**
@@ -545,6 +664,14 @@ typedef struct as_policy_query_s {
 	 */
 	uint32_t timeout;
 
+	/**
+	 *	Limits the rate of records received, one token per record. The limiter is not owned by the policy.
+	 *	A limited query runs on a thread per node of its own, instead of the shared query threads.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
 } as_policy_query;
 
 /**
@@ -567,6 +694,13 @@ typedef struct as_policy_scan_s {
 	 */
 	bool fail_on_cluster_change;
 
+	/**
+	 *	Limits the rate of records received, one token per record. The limiter is not owned by the policy.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
 } as_policy_scan;
 
 /**
@@ -615,6 +749,13 @@ typedef struct as_policy_batch_s {
 	 */
 	uint32_t timeout;
 
+	/**
+	 *	Limits the rate of keys requested, one token per key. The limiter is not owned by the policy.
+	 *
+	 *	The default (NULL) means no limit.
+	 */
+	struct as_rate_limiter_s * rate_limiter;
+
 } as_policy_batch;
 
 /**
@@ -785,6 +926,10 @@ as_policy_read_init(as_policy_read* p)
 	p->key = AS_POLICY_KEY_DEFAULT;
 	p->replica = AS_POLICY_REPLICA_DEFAULT;
 	p->consistency_level = AS_POLICY_CONSISTENCY_LEVEL_DEFAULT;
+	p->use_arena = false;
+	p->hedge_delay = AS_POLICY_HEDGE_DELAY_DEFAULT;
+	p->retry = AS_POLICY_RETRY_DEFAULT;
+	p->attempt_timeout = 0;
 	return p;
 }
 
@@ -803,6 +948,10 @@ as_policy_read_copy(as_policy_read* src, as_policy_read* trg)
 	trg->key = src->key;
 	trg->replica = src->replica;
 	trg->consistency_level = src->consistency_level;
+	trg->use_arena = src->use_arena;
+	trg->hedge_delay = src->hedge_delay;
+	trg->retry = src->retry;
+	trg->attempt_timeout = src->attempt_timeout;
 }
 
 /**
@@ -822,6 +971,9 @@ as_policy_write_init(as_policy_write* p)
 	p->gen = AS_POLICY_GEN_DEFAULT;
 	p->exists = AS_POLICY_EXISTS_DEFAULT;
 	p->commit_level = AS_POLICY_COMMIT_LEVEL_DEFAULT;
+	p->rate_limiter = NULL;
+	p->compression_threshold = 0;
+	p->attempt_timeout = 0;
 	return p;
 }
 
@@ -842,6 +994,9 @@ as_policy_write_copy(as_policy_write* src, as_policy_write* trg)
 	trg->gen = src->gen;
 	trg->exists = src->exists;
 	trg->commit_level = src->commit_level;
+	trg->rate_limiter = src->rate_limiter;
+	trg->compression_threshold = src->compression_threshold;
+	trg->attempt_timeout = src->attempt_timeout;
 }
 
 /**
@@ -862,6 +1017,7 @@ as_policy_operate_init(as_policy_operate* p)
 	p->replica = AS_POLICY_REPLICA_DEFAULT;
 	p->consistency_level = AS_POLICY_CONSISTENCY_LEVEL_DEFAULT;
 	p->commit_level = AS_POLICY_COMMIT_LEVEL_DEFAULT;
+	p->rate_limiter = NULL;
 	return p;
 }
 
@@ -883,6 +1039,7 @@ as_policy_operate_copy(as_policy_operate* src, as_policy_operate* trg)
 	trg->replica = src->replica;
 	trg->consistency_level = src->consistency_level;
 	trg->commit_level = src->commit_level;
+	trg->rate_limiter = src->rate_limiter;
 }
 
 /**
@@ -902,6 +1059,7 @@ as_policy_remove_init(as_policy_remove* p)
 	p->gen = AS_POLICY_GEN_DEFAULT;
 	p->generation = 0;
 	p->commit_level = AS_POLICY_COMMIT_LEVEL_DEFAULT;
+	p->rate_limiter = NULL;
 	return p;
 }
 
@@ -922,6 +1080,7 @@ as_policy_remove_copy(as_policy_remove* src, as_policy_remove* trg)
 	trg->gen = src->gen;
 	trg->generation = src->generation;
 	trg->commit_level = src->commit_level;
+	trg->rate_limiter = src->rate_limiter;
 }
 
 /**
@@ -1002,6 +1161,7 @@ static inline as_policy_batch*
 as_policy_batch_init(as_policy_batch* p)
 {
 	p->timeout = AS_POLICY_TIMEOUT_DEFAULT;
+	p->rate_limiter = NULL;
 	return p;
 }
 
@@ -1017,6 +1177,7 @@ static inline void
 as_policy_batch_copy(as_policy_batch* src, as_policy_batch* trg)
 {
 	trg->timeout = src->timeout;
+	trg->rate_limiter = src->rate_limiter;
 }
 
 /**
@@ -1061,6 +1222,7 @@ as_policy_scan_init(as_policy_scan* p)
 {
 	p->timeout = 0;
 	p->fail_on_cluster_change = false;
+	p->rate_limiter = NULL;
 	return p;
 }
 
@@ -1077,6 +1239,7 @@ as_policy_scan_copy(as_policy_scan* src, as_policy_scan* trg)
 {
 	trg->timeout = src->timeout;
 	trg->fail_on_cluster_change = src->fail_on_cluster_change;
+	trg->rate_limiter = src->rate_limiter;
 }
 
 /**
@@ -1091,6 +1254,7 @@ static inline as_policy_query*
 as_policy_query_init(as_policy_query* p)
 {
 	p->timeout = 0;
+	p->rate_limiter = NULL;
 	return p;
 }
 
@@ -1106,6 +1270,7 @@ static inline void
 as_policy_query_copy(as_policy_query* src, as_policy_query* trg)
 {
 	trg->timeout = src->timeout;
+	trg->rate_limiter = src->rate_limiter;
 }
 
 /**
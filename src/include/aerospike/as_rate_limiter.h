@@ -0,0 +1,132 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	Token bucket limiting the number of records per second a client side job
+ *	may consume or issue.
+ *
+ *	A limiter is attached to a policy by pointer, and may be shared by several
+ *	policies and threads so they are limited together:
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_rate_limiter limiter;
+ *	as_rate_limiter_init(&limiter, 20000, 1000);
+ *
+ *	as_policy_scan policy;
+ *	as_policy_scan_init(&policy);
+ *	policy.rate_limiter = &limiter;
+ *	...
+ *	as_rate_limiter_destroy(&limiter);
+ *	~~~~~~~~~~
+ *
+ *	Scans and queries take one token per record received and pause reading
+ *	the socket while the bucket is empty, so the server is slowed down by TCP
+ *	flow control. Batch reads take one token per key before sending a request
+ *	to a node. Writes take one token before sending the request.
+ */
+typedef struct as_rate_limiter_s {
+
+	/**
+	 *	@private
+	 *	Protects the fields below.
+	 */
+	pthread_mutex_t lock;
+
+	/**
+	 *	@private
+	 *	Tokens added per second.
+	 */
+	uint32_t rate;
+
+	/**
+	 *	@private
+	 *	Maximum number of tokens in micro tokens.
+	 */
+	int64_t capacity;
+
+	/**
+	 *	@private
+	 *	Available micro tokens. Negative when waiting callers reserved tokens
+	 *	that were not refilled yet.
+	 */
+	int64_t credit;
+
+	/**
+	 *	@private
+	 *	Time of the last refill in microseconds.
+	 */
+	uint64_t last_us;
+
+} as_rate_limiter;
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Initialize a limiter allowing `rate` tokens per second, with up to `burst`
+ *	tokens taken at once after an idle period. The bucket starts full.
+ *
+ *	@param limiter	The limiter to initialize.
+ *	@param rate		Tokens per second. Must be greater than zero.
+ *	@param burst	Size of the bucket. If zero, rate / 10 (at least 1) is used.
+ *
+ *	@return The initialized limiter, or NULL if rate is zero.
+ *
+ *	@relates as_rate_limiter
+ */
+as_rate_limiter * as_rate_limiter_init(as_rate_limiter * limiter, uint32_t rate, uint32_t burst);
+
+/**
+ *	Change the rate of a limiter in use.
+ *
+ *	@relates as_rate_limiter
+ */
+void as_rate_limiter_set_rate(as_rate_limiter * limiter, uint32_t rate);
+
+/**
+ *	Take `n` tokens, sleeping until they are available. Callers are served in
+ *	the order they arrive. A NULL limiter does not limit.
+ *
+ *	@relates as_rate_limiter
+ */
+void as_rate_limiter_acquire(as_rate_limiter * limiter, uint32_t n);
+
+/**
+ *	Take `n` tokens if they are available now.
+ *
+ *	@return `true` if the tokens were taken.
+ *
+ *	@relates as_rate_limiter
+ */
+bool as_rate_limiter_try_acquire(as_rate_limiter * limiter, uint32_t n);
+
+/**
+ *	Release the resources of a limiter.
+ *
+ *	@relates as_rate_limiter
+ */
+void as_rate_limiter_destroy(as_rate_limiter * limiter);
@@ -194,8 +194,36 @@ typedef struct as_record_s {
 	 */
 	as_bins bins;
 
+	/**
+	 *	@private
+	 *	Arena holding the bin entries and the string and bytes values of a
+	 *	record read with as_policy_read.use_arena. Released when the record
+	 *	is destroyed.
+	 */
+	struct as_arena_s * arena;
+
+	/**
+	 *	@private
+	 *	Open addressing hash of bin names. Each slot holds the position of a
+	 *	bin in bins.entries plus one, or zero if empty. Built when the record
+	 *	grows past AS_RECORD_INDEX_THRESHOLD bins.
+	 */
+	uint16_t * index;
+
+	/**
+	 *	@private
+	 *	Number of slots in index minus one.
+	 */
+	uint32_t index_mask;
+
 } as_record;
 
+/**
+ *	Number of bins above which bins are looked up through a hash of their
+ *	names instead of by comparing every name.
+ */
+#define AS_RECORD_INDEX_THRESHOLD 16
+
 /**
  * When the record is given a TTL value of ZERO, it will adopt the TTL value
  * that is the default TTL value for the namespace (defined in the config file).
@@ -295,6 +323,37 @@ as_record * as_record_init(as_record * rec, uint16_t nbins);
  */
 void as_record_destroy(as_record * rec);
 
+/**
+ *	Empty the record so it can be filled again by the next read, without
+ *	releasing its storage.
+ *
+ *	The bin values and the key are released. The bin entries are kept, and
+ *	so is the arena of a record read with as_policy_read.use_arena, so
+ *	reading the same shape of record again allocates no record memory as
+ *	long as its bins are integers, strings or blobs. List and map values
+ *	are still allocated when they are decoded.
+ *
+ *	~~~~~~~~~~{.c}
+ *	as_record rec;
+ *	as_record_init(&rec, 0);
+ *	as_record * r = &rec;
+ *
+ *	while ( running ) {
+ *		aerospike_key_get(&as, &err, &policy, &key, &r);
+ *		as_record_set_int64(r, "count", as_record_get_int64(r, "count", 0) + 1);
+ *		aerospike_key_put(&as, &err, NULL, &key, r);
+ *		as_record_reset(r);
+ *	}
+ *
+ *	as_record_destroy(&rec);
+ *	~~~~~~~~~~
+ *
+ *	@param rec The record to reset.
+ *
+ *	@relates as_record
+ */
+void as_record_reset(as_record * rec);
+
 /**
  *	Get the number of bins in the record.
  *
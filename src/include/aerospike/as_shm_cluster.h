@@ -17,6 +17,7 @@
 #pragma once
 
 #include <aerospike/as_config.h>
+#include <aerospike/as_node.h>
 #include <aerospike/as_partition.h>
 #include <citrusleaf/cf_queue.h>
 #include <citrusleaf/cl_types.h>
@@ -83,7 +84,13 @@ typedef struct as_partition_shm_s {
 
 /**
  *	@private
- *	Shared memory representation of map of namespace to data partitions. 32 bytes + partitions size.
+ *	Alignment of the partition tables and statistics in the shared memory segment.
+ */
+#define AS_SHM_CACHE_LINE 64
+
+/**
+ *	@private
+ *	Shared memory representation of map of namespace to data partitions. 64 bytes + partitions size.
  */
 typedef struct as_partition_table_shm_s {
 	/**
@@ -94,18 +101,88 @@ typedef struct as_partition_table_shm_s {
 	
 	/**
 	 *	@private
-	 *	Array of partitions for a given namespace.
+	 *	Sequence counter, odd while the tend owner changes the partitions readers use.
+	 *	Readers retry if it changed while they read, so master and prole are consistent.
+	 */
+	uint32_t seq;
+	
+	/**
+	 *	@private
+	 *	Partitions buffer readers use. Always zero unless partitions are double buffered.
+	 */
+	uint32_t active;
+	
+	/**
+	 *	@private
+	 *	Is the other buffer holding updates not yet published. Double buffering only.
+	 */
+	uint32_t pending;
+	
+	/**
+	 *	@private
+	 *	Pad to cache line boundary, so partitions start on a cache line.
+	 */
+	char pad[AS_SHM_CACHE_LINE - AS_MAX_NAMESPACE_SIZE - 12];
+	
+	/**
+	 *	@private
+	 *	Array of partitions for a given namespace. With double buffering, two arrays
+	 *	follow each other.
 	 */
 	as_partition_shm partitions[];
 } as_partition_table_shm;
 
+/**
+ *	@private
+ *	Shared memory node statistics published by one client instance. 24 bytes + node stats
+ *	size.
+ */
+typedef struct as_process_stats_shm_s {
+	/**
+	 *	@private
+	 *	Process id of the publisher, zero if the slot is free.
+	 */
+	uint32_t pid;
+	
+	/**
+	 *	@private
+	 *	Set once the publisher followed the map to a larger segment. The tend owner
+	 *	keeps updating the segment until every live publisher has.
+	 */
+	uint32_t followed;
+	
+	/**
+	 *	@private
+	 *	Instance of the publisher within its process, see as_shm_info.token.
+	 */
+	uint32_t token;
+	
+	/**
+	 *	@private
+	 *	Pad to 8 byte boundary.
+	 */
+	uint32_t pad;
+	
+	/**
+	 *	@private
+	 *	Last time the statistics were published in milliseconds since epoch.
+	 */
+	uint64_t timestamp;
+	
+	/**
+	 *	@private
+	 *	Statistics of each node, indexed as the nodes array.
+	 */
+	as_node_stats nodes[];
+} as_process_stats_shm;
+
 /**
  *	@private
  *	Shared memory cluster map. The map contains fixed arrays of nodes and partition tables.
- *	Each partition table contains a fixed array of partitions.  The shared memory segment will be 
- *	sized on startup and never change afterwards.  If the max nodes or max namespaces are reached, 
- *	the tender client will ignore additional nodes/namespaces and log an error message that the
- *	corresponding array is full.
+ *	Each partition table contains a fixed array of partitions.  The shared memory segment is
+ *	sized on startup.  If the max nodes or max namespaces are reached, the tender client copies
+ *	the map to a new segment with twice the capacity, publishes the new segment's id in the old
+ *	one, and all attached processes move to it.  Node indexes are kept, so routing is unchanged.
  */
 typedef struct as_cluster_shm_s {
 	/**
@@ -168,6 +245,50 @@ typedef struct as_cluster_shm_s {
 	 */
 	uint32_t partition_table_byte_size;
 
+	/**
+	 *	@private
+	 *	Cluster offset to fleet-wide node statistics, indexed as the nodes array. The
+	 *	tend owner aggregates them from the process statistics.
+	 */
+	uint32_t node_stats_offset;
+
+	/**
+	 *	@private
+	 *	Cluster offset to process statistics array.
+	 */
+	uint32_t process_stats_offset;
+
+	/**
+	 *	@private
+	 *	Maximum size of process statistics array.
+	 */
+	uint32_t process_stats_capacity;
+
+	/**
+	 *	@private
+	 *	Bytes required to hold one process statistics entry.
+	 */
+	uint32_t process_stats_byte_size;
+
+	/**
+	 *	@private
+	 *	Number of partitions arrays per partition table: 1, or 2 if double buffered.
+	 */
+	uint32_t partition_buffers;
+
+	/**
+	 *	@private
+	 *	Segment version, starting at one. Incremented each time the map is moved to a
+	 *	larger segment.
+	 */
+	uint32_t version;
+
+	/**
+	 *	@private
+	 *	Shared memory identifier of the segment the map moved to, once moved is set.
+	 */
+	int successor_id;
+
 	/**
 	 *	@private
 	 *	Spin lock for taking over from a dead cluster tender.
@@ -186,11 +307,19 @@ typedef struct as_cluster_shm_s {
 	 */
 	uint8_t ready;
 	
+	/**
+	 *	@private
+	 *	Has the map moved to a larger segment. The tend owner keeps the segment up to
+	 *	date until every live process has followed, except for nodes and namespaces
+	 *	beyond its capacity.
+	 */
+	uint8_t moved;
+	
 	/**
 	 *	@private
 	 *	Pad to 8 byte boundary.
 	 */
-	char pad[6];
+	char pad[5];
 
 	/*
 	 *	@private
@@ -198,7 +327,8 @@ typedef struct as_cluster_shm_s {
 	 */
 	as_node_shm nodes[];
 	
-	// This is where the dynamically allocated partition tables are located.
+	// This is where the dynamically allocated partition tables are located, cache line aligned,
+	// followed by the fleet-wide node statistics and the process statistics.
 } as_cluster_shm;
 
 /**
@@ -219,12 +349,43 @@ typedef struct as_shm_info_s {
 	 */
 	as_node** local_nodes;
 	
+	/**
+	 *	@private
+	 *	Statistics slot of this instance, or null if all slots were taken.
+	 */
+	as_process_stats_shm* process_stats;
+	
+	/**
+	 *	@private
+	 *	Tells apart the slots of instances in the same process, which share a pid.
+	 */
+	uint32_t token;
+	
 	/**
 	 *	@private
 	 *	Shared memory identifier.
 	 */
 	int shm_id;
 	
+	/**
+	 *	@private
+	 *	Segments and local node arrays replaced after the map moved. They stay valid
+	 *	until the cluster is destroyed, because other threads may still read them.
+	 */
+	as_vector /* <as_shm_retired> */ retired;
+	
+	/**
+	 *	@private
+	 *	Back new segments with huge pages.
+	 */
+	bool huge_pages;
+	
+	/**
+	 *	@private
+	 *	NUMA node new segments are placed on, or negative.
+	 */
+	int numa_node;
+	
 	/**
 	 *	@private
 	 *	Take over shared memory cluster tending if the cluster hasn't been tended by this
@@ -278,6 +439,38 @@ as_shm_remove_nodes(struct as_cluster_s* cluster, as_vector* /* <as_node*> */ no
 void
 as_shm_update_partitions(as_shm_info* shm_info, const char* ns, char* bitmap_b64, int64_t len, as_node* node, bool master);
 
+/**
+ *	@private
+ *	Make the partitions updated since the last call visible to readers, all at once.
+ *	Only does something when partitions are double buffered. Called by the tend owner.
+ */
+void
+as_shm_publish_partitions(as_cluster_shm* cluster_shm);
+
+/**
+ *	@private
+ *	Close the changes left open by a tend owner that died while updating partitions.
+ *	Called by the new tend owner.
+ */
+void
+as_shm_repair_partition_tables(as_cluster_shm* cluster_shm);
+
+/**
+ *	@private
+ *	Get the node indexes of the master and prole of a partition, as readers see them.
+ *	Indexes start at one, zero is unset. Return false if the namespace has no table.
+ */
+bool
+as_shm_get_partition(as_cluster_shm* cluster_shm, const char* ns, uint32_t partition_id, uint32_t* master, uint32_t* prole);
+
+/**
+ *	@private
+ *	Allocate a segment in process memory, laid out as shared segments are and without
+ *	process statistics. Free it with free().
+ */
+as_cluster_shm*
+as_shm_create_local(uint32_t n_partitions, uint32_t partition_buffers, uint32_t nodes_capacity, uint32_t partition_tables_capacity);
+
 /**
  *	@private
  *	Get shared memory mapped node given digest key.  If there is no mapped node, a random node is 
@@ -286,6 +479,14 @@ as_shm_update_partitions(as_shm_info* shm_info, const char* ns, char* bitmap_b64
 as_node*
 as_shm_node_get(struct as_cluster_s* cluster, const char* ns, const cf_digest* d, bool write, as_policy_replica replica);
 
+/**
+ *	@private
+ *	Get fleet-wide statistics of the node at the given shared memory node index.
+ *	Return false if they are not available.
+ */
+bool
+as_shm_get_node_stats(as_shm_info* shm_info, uint32_t index, as_node_stats* stats);
+
 /**
  *	@private
  *	Get shared memory partition tables array.
@@ -315,3 +516,24 @@ as_shm_next_partition_table(as_cluster_shm* cluster_shm, as_partition_table_shm*
 {
 	return (as_partition_table_shm*) ((char*)table + cluster_shm->partition_table_byte_size);
 }
+
+/**
+ *	@private
+ *	Get shared memory fleet-wide node statistics array.
+ */
+static inline as_node_stats*
+as_shm_get_node_stats_array(as_cluster_shm* cluster_shm)
+{
+	return (as_node_stats*) ((char*)cluster_shm + cluster_shm->node_stats_offset);
+}
+
+/**
+ *	@private
+ *	Get process statistics identified by index.
+ */
+static inline as_process_stats_shm*
+as_shm_get_process_stats(as_cluster_shm* cluster_shm, uint32_t index)
+{
+	return (as_process_stats_shm*) ((char*)cluster_shm + cluster_shm->process_stats_offset +
+		(cluster_shm->process_stats_byte_size * index));
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+/**
+ *	@defgroup write_template_api Write Templates
+ *	@ingroup key_operations
+ *	@{
+ *
+ *	A write template is a write prepared once for a namespace, set, bins and
+ *	operations, to be executed on many records. The request is laid out when
+ *	the template is initialized. Each write with it only fills in the key,
+ *	the values and their sizes, instead of building the whole request again.
+ *
+ *	~~~~~~~~~~{.c}
+ *		const char * bins[] = { "name", "visits" };
+ *		as_operator ops[] = { AS_OPERATOR_WRITE, AS_OPERATOR_INCR };
+ *
+ *		as_write_template tmpl;
+ *		if ( as_write_template_init(&as, &err, &tmpl, NULL, "test", "users", bins, ops, 2, 0) != AEROSPIKE_OK ) {
+ *			fprintf(stderr, "error(%d) %s at [%s:%d]", err.code, err.message, err.file, err.line);
+ *		}
+ *
+ *		as_string name;
+ *		as_integer one;
+ *		as_val * values[] = {
+ *			(as_val *) as_string_init(&name, "alice", false),
+ *			(as_val *) as_integer_init(&one, 1)
+ *		};
+ *
+ *		as_key key;
+ *		as_key_init(&key, "test", "users", "alice");
+ *		aerospike_key_put_template(&as, &err, &tmpl, &key, values);
+ *
+ *		as_write_template_destroy(&tmpl);
+ *	~~~~~~~~~~
+ *
+ *	The policy, the TTL and whether keys are sent are fixed by the template.
+ */
+
+#include <aerospike/aerospike.h>
+#include <aerospike/as_bin.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_operations.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_status.h>
+
+#include <stdint.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+struct cl_write_template_s;
+
+/**
+ *	A write prepared for a namespace, set, bins and operations.
+ */
+typedef struct as_write_template_s {
+
+	/**
+	 *	@private
+	 *	Namespace of the records written.
+	 */
+	as_namespace ns;
+
+	/**
+	 *	@private
+	 *	Set of the records written.
+	 */
+	as_set set;
+
+	/**
+	 *	@private
+	 *	The policy the template was compiled with.
+	 */
+	as_policy_write policy;
+
+	/**
+	 *	@private
+	 *	Number of bins.
+	 */
+	uint16_t n_bins;
+
+	/**
+	 *	@private
+	 *	Names of the bins.
+	 */
+	as_bin_name * bins;
+
+	/**
+	 *	@private
+	 *	Operation on each bin.
+	 */
+	as_operator * ops;
+
+	/**
+	 *	@private
+	 *	The compiled request.
+	 */
+	struct cl_write_template_s * compiled;
+
+} as_write_template;
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Prepare a write.
+ *
+ *	@param as			The aerospike instance to use for this operation.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param tmpl			The template to initialize.
+ *	@param policy		The policy to use for writes. If NULL, then the default policy will be used.
+ *						Generation checks are not supported.
+ *	@param ns			Namespace of the records.
+ *	@param set			Set of the records.
+ *	@param bins			Names of the bins written.
+ *	@param ops			Operation on each bin: AS_OPERATOR_WRITE, AS_OPERATOR_INCR,
+ *						AS_OPERATOR_APPEND, AS_OPERATOR_PREPEND or AS_OPERATOR_TOUCH.
+ *	@param n_bins		Number of bins.
+ *	@param ttl			TTL of the records written.
+ *
+ *	@return AEROSPIKE_OK if successful. Otherwise an error.
+ */
+as_status as_write_template_init(
+	aerospike * as, as_error * err, as_write_template * tmpl, const as_policy_write * policy,
+	const as_namespace ns, const as_set set, const char ** bins, const as_operator * ops, uint16_t n_bins,
+	uint32_t ttl);
+
+/**
+ *	Release the resources of a template.
+ */
+void as_write_template_destroy(as_write_template * tmpl);
+
+/**
+ *	@}
+ */
@@ -40,4 +40,5 @@ cl_cluster_batch_shutdown(as_cluster* asc);
 
 cl_rv citrusleaf_batch_read(as_cluster *asc, char *ns,
 		const cf_digest *digests, int n_digests, cl_bin *bins, int n_bins,
-		bool get_bin_data, citrusleaf_get_many_cb cb, void *udata);
+		bool get_bin_data, citrusleaf_get_many_cb cb, void *udata,
+		struct as_rate_limiter_s *rate_limiter);
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+/**
+ * Number of released buffers each thread keeps for reuse.
+ */
+#define CL_BUF_CACHE_SIZE 4
+
+/**
+ * Smallest buffer allocated. Requests and responses that need a buffer are
+ * larger than the 16 KB stack buffers, so this avoids regrowing right away.
+ */
+#define CL_BUF_MIN_SIZE (32 * 1024)
+
+/**
+ * Released buffers larger than this are freed rather than kept, so one huge
+ * record does not pin its memory in every thread that saw it.
+ */
+#define CL_BUF_RETAIN_MAX (8 * 1024 * 1024)
+
+/**
+ * A kept buffer not reused within this many acquires of its thread is freed.
+ * A thread whose record sizes drop gives back its high-water mark.
+ */
+#define CL_BUF_TRIM_INTERVAL 1024
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * Get a buffer of at least size bytes for a request or response.
+ *
+ * The smallest buffer kept by the calling thread that is large enough is
+ * reused. Otherwise a buffer is allocated, rounded up to a power of two, and
+ * is kept when released so later transactions of the same size do not call
+ * malloc() or fault in new pages.
+ *
+ * Returns NULL if out of memory.
+ */
+uint8_t * cl_buf_acquire(size_t size);
+
+/**
+ * Give back a buffer from cl_buf_acquire(). It is kept by the calling thread
+ * for reuse, evicting the smallest kept buffer if the cache is full. NULL is
+ * ignored.
+ */
+void cl_buf_release(uint8_t * buf);
+
+/**
+ * Free all buffers kept by the calling thread. They are also freed when the
+ * thread exits.
+ */
+void cl_buf_cache_trim();
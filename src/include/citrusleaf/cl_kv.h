@@ -17,9 +17,52 @@
 #pragma once
 
 #include <citrusleaf/cl_types.h>
+#include <citrusleaf/cf_proto.h>
 #include <aerospike/as_cluster.h>
 #include <citrusleaf/cl_write.h>
 
+/******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ * Callback for citrusleaf_get_all_ops(). Receives the ops of the response
+ * in host byte order, still in the read buffer; iterate them with
+ * cl_msg_op_get_next(). The ops are only valid until the callback returns.
+ * Non-zero return in the callback fails the call with that value.
+ */
+typedef int (*citrusleaf_get_ops_cb) (cl_msg_op *ops, int n_ops, void *udata);
+
+/**
+ * A write compiled once for a namespace, set, bins and operations, see
+ * citrusleaf_write_template_init(). The request image holds the header, the
+ * namespace and set fields, and the op headers with the bin names, all in
+ * network order. Putting with it copies the image and fills in the size,
+ * key, digest and values.
+ */
+typedef struct cl_write_template_s {
+    char            *ns;
+    cl_write_parameters wp;
+    int             n_ops;
+    uint8_t         *image;
+    size_t          prefix_sz;      // header and fields, up to the key and digest
+    size_t          *op_offsets;    // of each op header in image, n_ops + 1 of them
+} cl_write_template;
+
+/**
+ * A record for citrusleaf_put_ops_pipelined(), with its bins given as ops in
+ * network order, the way scans return them. The op codes are replaced by
+ * writes when the request is compiled.
+ */
+typedef struct cl_ops_record_s {
+    const cf_digest *digest;
+    const char      *set;           // NULL for no set
+    uint32_t        record_ttl;
+    const uint8_t   *ops;
+    size_t          ops_sz;
+    uint16_t        n_ops;
+} cl_ops_record;
+
 /******************************************************************************
  * FUNCTIONS
  ******************************************************************************/
@@ -39,23 +82,57 @@
  * (the simple 'get') See that call for information there.
  */
  
-cl_rv citrusleaf_get_all(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin **bins, int *n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
+cl_rv citrusleaf_get_all(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin **bins, int *n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p);
 cl_rv citrusleaf_get_all_digest(as_cluster *asc, const char *ns, const cf_digest *d, cl_bin **bins, int *n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
 cl_rv citrusleaf_get_all_digest_getsetname(as_cluster *asc, const char *ns, const cf_digest *d, cl_bin **bins, int *n_bins, int timeout_ms, uint32_t *cl_gen, char **setname, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
 
+/**
+ * get-all handing the bins to a callback as they are in the response, so the
+ * caller decides where their values are copied. The callback is only called
+ * if the record was found.
+ */
+cl_rv citrusleaf_get_all_ops(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, citrusleaf_get_ops_cb cb, void *udata, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p);
+
 /**
  * Put is like insert. Create a list of bins, and call this function to set them.
  */
 cl_rv citrusleaf_put(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, const cl_bin *bins, int n_bins, const cl_write_parameters *cl_w_p, int commit_level);
 cl_rv citrusleaf_put_digest(as_cluster *asc, const char *ns, const cf_digest *d, const cl_bin *bins, int n_bins, const cl_write_parameters *cl_w_p, int commit_level);
 cl_rv citrusleaf_put_digest_with_setname(as_cluster *asc, const char *ns, const char *set, const cf_digest *d, const cl_bin *bins, int n_bins, const cl_write_parameters *cl_w_p, int commit_level);
+
+/**
+ * Compile a write of the named bins, with one operation per bin. The write
+ * parameters, commit level and whether a key is sent are fixed by the
+ * template. Memcache increments are not supported.
+ */
+int citrusleaf_write_template_init(cl_write_template *t, const char *ns, const char *set, const char **bin_names, const cl_operator *ops, int n_bins, bool send_key, const cl_write_parameters *cl_w_p, int commit_level);
+void citrusleaf_write_template_destroy(cl_write_template *t);
+
+/**
+ * Put the values of a template's bins, in its order. key must be given if
+ * and only if the template sends keys.
+ */
+cl_rv citrusleaf_write_template_put(as_cluster *asc, const cl_write_template *t, const cl_object *key, const cf_digest *d, const cl_bin *values);
+
+/**
+ * Write records to one node over one connection. All the requests are sent
+ * before the responses are read back in the same order, so the records share
+ * a round trip. results[i] gets the result code of record i. Generations are
+ * not checked. If the responses cannot all be read, the error is returned and
+ * is also the result of the records without a response.
+ */
+cl_rv citrusleaf_put_ops_pipelined(as_cluster *asc, as_node *node, const char *ns, const cl_ops_record *records, int n_records, uint32_t timeout_ms, int *results);
+
 cl_rv citrusleaf_restore(as_cluster *asc, const char *ns, const cf_digest *digest, const char *set, const cl_bin *values, int n_values, const cl_write_parameters *cl_w_p, int commit_level);
 
 /**
  * Get is like select in SQL. Create a list of bins to get, and call this function to retrieve
  * the values.
+ *
+ * read_p, if not NULL, gives the retry policy, attempt timeout and hedge delay of the read.
+ * Its timeout is replaced by timeout_ms.
  */
-cl_rv citrusleaf_get(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
+cl_rv citrusleaf_get(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p);
 cl_rv citrusleaf_get_digest(as_cluster *asc, const char *ns, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
 
 /**
@@ -68,5 +145,5 @@ cl_rv citrusleaf_delete_digest(as_cluster *asc, const char *ns,  const cf_digest
  * Efficiently determine if the key exists.
  *  (Note:  The bins are currently ignored but may be testable in the future.)
  */
-cl_rv citrusleaf_exists_key(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
+cl_rv citrusleaf_exists_key(as_cluster *asc, const char *ns, const char *set, const cl_object *key, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p);
 cl_rv citrusleaf_exists_digest(as_cluster *asc, const char *ns, const cf_digest *d, cl_bin *bins, int n_bins, int timeout_ms, uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica);
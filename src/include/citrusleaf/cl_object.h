@@ -45,6 +45,7 @@ typedef enum cl_type_e {
     CL_LUA_BLOB     = 18,
     CL_MAP          = 19,
     CL_LIST         = 20,
+    CL_AS_VAL       = 666665, // client only: u.blob is an as_list or as_map, see as_msgpack_writer.h
     CL_UNKNOWN      = 666666
 } cl_type;
 
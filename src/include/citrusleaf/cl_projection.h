@@ -0,0 +1,126 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <citrusleaf/cf_proto.h>
+#include <citrusleaf/cl_types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ * One slot of the projection hash table. An empty name marks an unused slot.
+ */
+typedef struct cl_projection_slot_s {
+    uint32_t    hash;
+    char        name[CL_BINNAME_SIZE];
+} cl_projection_slot;
+
+/**
+ * Set of bin names a request wants returned to the caller, for responses the
+ * server could not filter itself.
+ *
+ * The set is compiled once per request into an open addressed hash table, so
+ * the response parser can decide per op, without allocating, whether the bin
+ * should be decoded or skipped by length.
+ *
+ * A projection with no names accepts every bin.
+ */
+typedef struct cl_projection_s {
+    uint32_t                n_names;
+    uint32_t                mask;
+    cl_projection_slot *    slots;
+} cl_projection;
+
+/**
+ * Called by cl_projection_parse_ops() with each op to decode, in host order.
+ */
+typedef void (* cl_projection_op_cb)(cl_msg_op * op, void * udata);
+
+/******************************************************************************
+ * INLINE FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * FNV-1a hash over a bin name which is not necessarily null terminated.
+ */
+static inline uint32_t cl_projection_hash(const uint8_t * name, uint32_t name_sz) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < name_sz; i++) {
+        h ^= name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Should the bin named by the wire bytes be decoded?
+ */
+static inline bool cl_projection_contains(const cl_projection * proj, const uint8_t * name, uint32_t name_sz) {
+    if (proj == NULL || proj->n_names == 0) {
+        return true;
+    }
+
+    if (name_sz >= CL_BINNAME_SIZE) {
+        return false;
+    }
+
+    uint32_t h = cl_projection_hash(name, name_sz);
+    uint32_t i = h & proj->mask;
+
+    // The table is never full, so probing always ends on an empty slot.
+    while (proj->slots[i].name[0]) {
+        cl_projection_slot * slot = &proj->slots[i];
+
+        if (slot->hash == h && memcmp(slot->name, name, name_sz) == 0 && slot->name[name_sz] == 0) {
+            return true;
+        }
+        i = (i + 1) & proj->mask;
+    }
+    return false;
+}
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * Initialize an empty projection with room for n_names bin names.
+ */
+int cl_projection_init(cl_projection * proj, uint32_t n_names);
+
+/**
+ * Add a bin name to the projection. Names longer than a bin name are rejected.
+ */
+int cl_projection_add(cl_projection * proj, const char * name);
+
+/**
+ * Release the hash table of the projection.
+ */
+void cl_projection_destroy(cl_projection * proj);
+
+/**
+ * Swap the n_ops response ops at buf to host order and pass the ones in the
+ * projection to the callback. The others are stepped over by length and never
+ * decoded. Returns the first byte past the ops.
+ */
+uint8_t * cl_projection_parse_ops(const cl_projection * proj, uint8_t * buf, uint16_t n_ops, cl_projection_op_cb cb, void * udata);
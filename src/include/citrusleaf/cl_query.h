@@ -60,6 +60,7 @@ typedef struct cl_query {
     void            * res_streamq;
     int             limit;  
     uint64_t        job_id;
+    struct as_rate_limiter_s * rate_limiter; // records received, not owned
 } cl_query;
 
 typedef struct cl_query_response_record_t {
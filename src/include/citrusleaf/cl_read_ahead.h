@@ -0,0 +1,178 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <aerospike/as_codec.h>
+
+/******************************************************************************
+ * MACROS
+ ******************************************************************************/
+
+/**
+ * Default size of a read-ahead buffer. Large enough for many scan records per
+ * read, so the kernel socket buffer is drained in few system calls.
+ */
+#define CL_READ_AHEAD_SIZE (256 * 1024)
+
+/**
+ * Buffers grown beyond this size for a large proto are shrunk back to
+ * CL_READ_AHEAD_SIZE by cl_read_ahead_reset().
+ */
+#define CL_READ_AHEAD_RETAIN_MAX (4 * 1024 * 1024)
+
+/******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ * Receive buffer for streamed responses.
+ *
+ * Instead of one blocking read for each proto header and one for each body,
+ * every read asks for as much as the free space allows. Bytes between start
+ * and end are received but not consumed yet.
+ *
+ * Once cl_read_ahead_start() is called, a receive thread reads the socket
+ * into a second buffer while the caller parses the first, so network and CPU
+ * work overlap. A fill moves what the thread received behind the unconsumed
+ * bytes. Frames stay contiguous in the first buffer, which only the caller
+ * touches, so pointers into it stay valid until the next fill.
+ *
+ * The receive thread lives as long as the buffers, and waits for the next
+ * stream in between, so a worker thread's streams share one receive thread.
+ */
+typedef struct cl_read_ahead_s {
+    uint8_t *   buf;
+    size_t      capacity;
+    size_t      start;
+    size_t      end;
+
+    // Filled by the receive thread, guarded by lock.
+    uint8_t *   recv_buf;
+    size_t      recv_size;
+    int         recv_err;
+
+    int         fd;
+    int         wake_fds[2];    // wakes the receive thread's poll to stop it
+    bool        receiving;      // the caller streams with the receive thread
+    bool        streaming;      // the receive thread reads fd, guarded by lock
+    bool        stop;
+    bool        exit;           // ends the receive thread, guarded by lock
+    bool        started;        // the receive thread exists
+    bool        in_use;         // handed out by cl_read_ahead_acquire()
+
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} cl_read_ahead;
+
+/******************************************************************************
+ * INLINE FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * Number of received bytes not consumed yet, including those the receive
+ * thread read past the last fill. Call after cl_read_ahead_stop().
+ */
+static inline size_t cl_read_ahead_available(const cl_read_ahead * ra) {
+    return ra->end - ra->start + ra->recv_size;
+}
+
+/**
+ * First byte not consumed yet. Valid until the next fill.
+ */
+static inline uint8_t * cl_read_ahead_peek(const cl_read_ahead * ra) {
+    return ra->buf + ra->start;
+}
+
+/**
+ * Mark n bytes as parsed.
+ */
+static inline void cl_read_ahead_consume(cl_read_ahead * ra, size_t n) {
+    ra->start += n;
+    if (ra->start == ra->end) {
+        ra->start = ra->end = 0;
+    }
+}
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+/**
+ * Allocate the buffer. Returns 0 on success.
+ */
+int cl_read_ahead_init(cl_read_ahead * ra, size_t capacity);
+
+/**
+ * The calling thread's buffer, kept across streams. A stream started while
+ * the thread's buffer is in use, from a callback of another stream, gets a
+ * buffer of its own. Returns NULL if no buffer can be allocated.
+ */
+cl_read_ahead * cl_read_ahead_acquire();
+
+/**
+ * Give back a buffer from cl_read_ahead_acquire(). Stops receiving and resets
+ * the buffer.
+ */
+void cl_read_ahead_release(cl_read_ahead * ra);
+
+/**
+ * Receive from fd in the background until cl_read_ahead_stop(). The receive
+ * thread is created by the first call, and reused by later ones. If it cannot
+ * be created, fills read the socket themselves, synchronously, which is
+ * slower but parses the same.
+ */
+void cl_read_ahead_start(cl_read_ahead * ra, int fd);
+
+/**
+ * Stop receiving from fd. The receive thread waits for the next stream. Must
+ * be called before fd is closed or handed back to the pool. Bytes received but not filled yet still count as available, so
+ * a response followed by unexpected bytes can be detected. Does nothing if not
+ * receiving.
+ */
+void cl_read_ahead_stop(cl_read_ahead * ra);
+
+/**
+ * Wait until at least need bytes are available, compacting or growing the
+ * buffer as required. Without a receive thread, reads the blocking socket
+ * directly. Returns 0 on success, otherwise an errno value.
+ */
+int cl_read_ahead_fill(cl_read_ahead * ra, int fd, size_t need);
+
+/**
+ * Replace the sz byte body of a compressed proto, which must be available at
+ * the front of the buffer, with the messages it holds. They are then parsed
+ * like those of any other proto. Returns 0 on success and sets out_sz to
+ * their size.
+ */
+int cl_read_ahead_inflate(cl_read_ahead * ra, const as_codec * codec, size_t sz, size_t * out_sz);
+
+/**
+ * Drop unconsumed bytes and shrink an oversized buffer, to reuse it for
+ * another response.
+ */
+void cl_read_ahead_reset(cl_read_ahead * ra);
+
+/**
+ * Stop receiving, end the receive thread and release the buffers.
+ */
+void cl_read_ahead_destroy(cl_read_ahead * ra);
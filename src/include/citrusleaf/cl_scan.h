@@ -17,6 +17,7 @@
 #pragma once
 
 #include <citrusleaf/cl_types.h>
+#include <citrusleaf/cf_proto.h>
 #include <aerospike/as_cluster.h>
 
 /******************************************************************************
@@ -34,6 +35,16 @@ typedef struct cl_node_response_s cl_node_response;
  * Non-zero return in the callback aborts the call
  */
 
+/**
+ * Op level scan callback, for callers which read bin values straight from the
+ * response instead of having them decoded into cl_bin objects.
+ * ops points to n_ops contiguous ops in host byte order, walk them with
+ * cl_msg_op_get_next(). The ops are only valid until the callback returns.
+ * Non-zero return in the callback aborts the call
+ */
+typedef int (*citrusleaf_scan_ops_cb) (char *ns, cf_digest *keyd, char *set, uint32_t generation,
+    uint32_t record_ttl, cl_msg_op *ops, int n_ops, void *udata);
+
 typedef enum cl_scan_priority { 
     CL_SCAN_PRIORITY_AUTO, 
     CL_SCAN_PRIORITY_LOW, 
@@ -62,6 +73,7 @@ struct cl_scan_parameters_s {
     cl_scan_priority    priority;   // honored by server: priority of scan
     bool concurrent;				// honored on client: work on nodes in parallel or serially
     uint8_t threads_per_node;       // honored on client: have multiple threads per node. @TODO
+    struct as_rate_limiter_s *rate_limiter; // honored on client: records per second, not owned
 };
 
 struct cl_node_response_s {
@@ -79,6 +91,7 @@ static inline void cl_scan_parameters_set_default(cl_scan_parameters *cl_scan_p)
     cl_scan_p->concurrent = false;
     cl_scan_p->threads_per_node = 1;    // not honored currently
     cl_scan_p->priority = CL_SCAN_PRIORITY_AUTO;
+    cl_scan_p->rate_limiter = NULL;
 }
 
 
@@ -101,6 +114,10 @@ cl_rv citrusleaf_scan_node (
     as_cluster *asc, char *node_name, char *ns, char *set, cl_bin *bins, int n_bins, bool nobindata, uint8_t scan_pct,
     citrusleaf_get_many_cb cb, void *udata, cl_scan_parameters *scan_p);
 
+cl_rv citrusleaf_scan_node_ops (
+    as_cluster *asc, char *node_name, char *ns, char *set, cl_bin *bins, int n_bins, uint8_t scan_pct,
+    citrusleaf_scan_ops_cb cb, void *udata, cl_scan_parameters *scan_p);
+
 //
 // Asynchronous calls to perform operations on many records.
 //
@@ -45,6 +45,9 @@ typedef struct cl_write_parameters_s {
     int             timeout_ms;
     uint32_t        record_ttl;             // seconds, from now, when the record would be auto-removed from the DBcd 
     cl_write_policy w_pol;
+    uint32_t        compression_threshold;  // requests of at least this size are sent compressed, 0 for never
+    uint32_t        hedge_delay_ms;         // reads unanswered this long are also sent to the other replica, 0 for never
+    uint32_t        attempt_timeout_ms;     // each attempt is abandoned after this long, 0 for what is left of timeout_ms
 } cl_write_parameters;
 
 /******************************************************************************
@@ -64,6 +67,9 @@ static inline void cl_write_parameters_set_default(cl_write_parameters *cl_w_p)
     cl_w_p->timeout_ms = 0;
     cl_w_p->record_ttl = 0;
     cl_w_p->w_pol = CL_WRITE_ONESHOT;
+    cl_w_p->compression_threshold = 0;
+    cl_w_p->hedge_delay_ms = 0;
+    cl_w_p->attempt_timeout_ms = 0;
 }
 
 static inline void cl_write_parameters_set_generation( cl_write_parameters *cl_w_p, uint32_t generation) {
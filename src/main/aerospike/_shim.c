@@ -14,8 +14,11 @@
  * License for the specific language governing permissions and limitations under
  * the License.
  */
+#include <aerospike/as_arena.h>
+#include <aerospike/as_bin_codec.h>
 #include <aerospike/as_bytes.h>
 #include <aerospike/as_integer.h>
+#include <aerospike/as_lazy.h>
 #include <aerospike/as_list.h>
 #include <aerospike/as_map.h>
 #include <aerospike/as_operations.h>
@@ -25,8 +28,10 @@
 #include <aerospike/as_status.h>
 
 #include <aerospike/as_msgpack.h>
+#include <aerospike/as_msgpack_writer.h>
 #include <aerospike/as_serializer.h>
 
+#include <citrusleaf/cf_byte_order.h>
 #include <citrusleaf/citrusleaf.h>
 #include <citrusleaf/cl_types.h>
 
@@ -143,6 +148,14 @@ void asval_to_clobject(as_val * val, cl_object * obj)
 			break;
 		}
 		case AS_LIST:{
+			// Unmodified lists read from the database go back as they came.
+			const uint8_t * data;
+			uint32_t size;
+			if ( as_lazy_serialized(val, &data, &size) ) {
+				citrusleaf_object_init_blob2(obj, data, size, CL_LIST);
+				break;
+			}
+
 			as_buffer buffer;
 			as_buffer_init(&buffer);
 
@@ -155,6 +168,13 @@ void asval_to_clobject(as_val * val, cl_object * obj)
 			break;
 		}
 		case AS_MAP: {
+			const uint8_t * data;
+			uint32_t size;
+			if ( as_lazy_serialized(val, &data, &size) ) {
+				citrusleaf_object_init_blob2(obj, data, size, CL_MAP);
+				break;
+			}
+
 			as_buffer buffer;
 			as_buffer_init(&buffer);
 
@@ -175,7 +195,22 @@ void asval_to_clobject(as_val * val, cl_object * obj)
 
 void asbinvalue_to_clobject(as_bin_value * binval, cl_object * obj)
 {
-	asval_to_clobject((as_val *) binval, obj);
+	as_val * val = (as_val *) binval;
+
+	// Lists and maps are encoded when the request is, straight into it. The
+	// bin keeps the value, which must live until the request is built.
+	if ( val->type == AS_LIST || val->type == AS_MAP ) {
+		size_t size = as_msgpack_writer_size(val);
+		if ( size ) {
+			obj->type = CL_AS_VAL;
+			obj->sz = size;
+			obj->u.blob = val;
+			obj->free = NULL;
+			return;
+		}
+	}
+
+	asval_to_clobject(val, obj);
 }
 
 void asbin_to_clbin(as_bin * as, cl_bin * cl) 
@@ -193,6 +228,82 @@ void asrecord_to_clbins(as_record * rec, cl_bin * bins, uint32_t nbins)
 	}
 }
 
+/**
+ * Replace a string or blob value by its compressed form if its bin is
+ * configured for compression. See as_bin_codec_enable().
+ */
+void clbin_compress(const char * ns, const char * set, cl_bin * bin)
+{
+	cl_object * obj = &bin->object;
+	as_bytes_type type;
+
+	switch (obj->type) {
+		case CL_STR:
+			type = AS_BYTES_STRING;
+			break;
+		case CL_BLOB:
+		case CL_JAVA_BLOB:
+		case CL_CSHARP_BLOB:
+		case CL_PYTHON_BLOB:
+		case CL_RUBY_BLOB:
+		case CL_PHP_BLOB:
+		case CL_ERLANG_BLOB:
+			type = (as_bytes_type) obj->type;
+			break;
+		default:
+			return;
+	}
+
+	if ( obj->sz > UINT32_MAX ) {
+		return;
+	}
+
+	uint32_t sz = 0;
+	uint8_t * value = as_bin_codec_compress(ns, set, bin->bin_name, type,
+			(const uint8_t *) obj->u.blob, (uint32_t) obj->sz, &sz);
+
+	if ( value ) {
+		citrusleaf_object_free(obj);
+		citrusleaf_object_init_blob_handoff(obj, value, sz, CL_BLOB);
+	}
+}
+
+/**
+ * Set a bin to the original value of a compressed one. Returns false if the
+ * value can't be decompressed, to be kept as it is.
+ */
+static bool clvalue_decompress_to_asrecord(const char * name, const uint8_t * value, uint32_t sz, as_record * r)
+{
+	as_bytes_type type;
+	uint32_t out_sz;
+
+	if ( !as_bin_codec_peek(value, sz, &type, &out_sz) ) {
+		return false;
+	}
+
+	// Room for the terminator if it is a string.
+	uint8_t * out = (uint8_t *) (r->arena ? as_arena_alloc(r->arena, out_sz + 1) : malloc(out_sz + 1));
+	if ( !out ) {
+		return false;
+	}
+
+	if ( !as_bin_codec_decompress(value, sz, out, out_sz) ) {
+		if ( !r->arena ) {
+			free(out);
+		}
+		return false;
+	}
+
+	if ( type == AS_BYTES_STRING ) {
+		out[out_sz] = 0;
+		as_record_set_strp(r, name, (char *) out, r->arena == NULL);
+	}
+	else {
+		as_record_set_raw_typep(r, name, out, out_sz, type, r->arena == NULL);
+	}
+	return true;
+}
+
 
 void askey_from_clkey(as_key * key, const as_namespace ns, const as_set set, cl_object * clkey)
 {
@@ -235,6 +346,40 @@ void askey_from_clkey(as_key * key, const as_namespace ns, const as_set set, cl_
 }
 
 
+/**
+ * Wrap a list or map object in a lazy value, decoded on first access. The
+ * object's buffer is taken over if the object owns it, copied otherwise.
+ */
+static as_val * clobject_to_lazy(cl_object * obj)
+{
+	uint8_t * data = (uint8_t *) obj->u.blob;
+	bool owned = obj->free == obj->u.blob;
+
+	if ( !owned ) {
+		data = (uint8_t *) malloc(obj->sz);
+		if ( !data ) {
+			return NULL;
+		}
+		memcpy(data, obj->u.blob, obj->sz);
+	}
+
+	as_val * val = obj->type == CL_LIST ?
+			(as_val *) as_lazy_list_new(data, (uint32_t) obj->sz, true) :
+			(as_val *) as_lazy_map_new(data, (uint32_t) obj->sz, true);
+
+	if ( !val ) {
+		if ( !owned ) {
+			free(data);
+		}
+		return NULL;
+	}
+
+	if ( owned ) {
+		obj->free = NULL;
+	}
+	return val;
+}
+
 void clbin_to_asval(cl_bin * bin, as_serializer * ser, as_val ** val) 
 {
 	if ( val == NULL ) return;
@@ -258,14 +403,7 @@ void clbin_to_asval(cl_bin * bin, as_serializer * ser, as_val ** val)
 		}
 		case CL_LIST :
 		case CL_MAP : {
-			// use a temporary buffer, which doesn't need to be destroyed
-			as_buffer buf = {
-				.capacity = (uint32_t) bin->object.sz,
-				.size = (uint32_t) bin->object.sz,
-				.data = (uint8_t *) bin->object.u.blob
-			};
-			// print_buffer(&buf);
-			as_serializer_deserialize(ser, &buf, val);
+			*val = clobject_to_lazy(&bin->object);
 			break;
 		}
 		case CL_BLOB:
@@ -276,7 +414,7 @@ void clbin_to_asval(cl_bin * bin, as_serializer * ser, as_val ** val)
 		case CL_ERLANG_BLOB:
 		default : {
 			*val = NULL;
-			uint8_t * raw = malloc(sizeof(bin->object.sz));
+			uint8_t * raw = malloc(bin->object.sz);
 			memcpy(raw, bin->object.u.blob, bin->object.sz);
 			as_bytes * b = as_bytes_new_wrap(raw, (uint32_t)bin->object.sz, true /*ismalloc*/);
 			b->type = (as_bytes_type)bin->object.type;
@@ -306,22 +444,17 @@ void clbin_to_asrecord(cl_bin * bin, as_record * r)
 		}
 		case CL_LIST:
 		case CL_MAP: {
-
-			as_val * val = NULL;
-
-			as_buffer buffer;
-			buffer.data = (uint8_t *) bin->object.u.blob;
-			buffer.size = (uint32_t)bin->object.sz;
-
-			as_serializer ser;
-			as_msgpack_init(&ser);
-			as_serializer_deserialize(&ser, &buffer, &val);
-			as_serializer_destroy(&ser);
-
-			as_record_set(r, bin->bin_name, (as_bin_value *) val);
+			as_val * val = clobject_to_lazy(&bin->object);
+			if ( val ) {
+				as_record_set(r, bin->bin_name, (as_bin_value *) val);
+			}
 			break;
 		}
 		default: {
+			if ( bin->object.type == CL_BLOB &&
+				clvalue_decompress_to_asrecord(bin->bin_name, (const uint8_t *) bin->object.u.blob, (uint32_t)bin->object.sz, r) ) {
+				break;
+			}
 			as_record_set_raw_typep(r, bin->bin_name, bin->object.u.blob, (uint32_t)bin->object.sz, (as_bytes_type)bin->object.type, true);
 			// the following completes the handoff of the value.
 			bin->object.free = NULL;
@@ -340,6 +473,159 @@ void clbins_to_asrecord(cl_bin * bins, uint32_t nbins, as_record * r)
 }
 
 
+/**
+ * Decode a response op straight into the record, without staging it in a
+ * cl_bin first. Values are copied once out of the read buffer, into the
+ * record's arena if it has one; lists and maps stay serialized until they
+ * are first accessed.
+ */
+void clmsgop_to_asrecord(cl_msg_op * op, as_record * r)
+{
+	if ( op->name_sz >= AS_BIN_NAME_MAX_SIZE ) {
+		return;
+	}
+
+	as_bin_name name;
+	memcpy(name, op->name, op->name_sz);
+	name[op->name_sz] = 0;
+
+	uint8_t * value = cl_msg_op_get_value_p(op);
+	uint32_t sz = cl_msg_op_get_value_sz(op);
+
+	switch(op->particle_type) {
+		case CL_NULL: {
+			as_record_set_nil(r, name);
+			break;
+		}
+		case CL_INT: {
+			int64_t i = 0;
+			if ( sz == sizeof(int64_t) ) {
+				i = (int64_t) cf_swap_from_be64(*(uint64_t *) value);
+			}
+			else if ( sz < sizeof(int64_t) ) {
+				for ( uint32_t j = 0; j < sz; j++ ) {
+					i = (i << 8) | value[j];
+				}
+			}
+			as_record_set_int64(r, name, i);
+			break;
+		}
+		case CL_STR: {
+			char * str = (char *) (r->arena ? as_arena_alloc(r->arena, sz + 1) : malloc(sz + 1));
+			if ( !str ) {
+				break;
+			}
+			memcpy(str, value, sz);
+			str[sz] = 0;
+			as_record_set_strp(r, name, str, r->arena == NULL);
+			break;
+		}
+		case CL_LIST:
+		case CL_MAP: {
+			// Kept serialized until first accessed.
+			uint8_t * data = (uint8_t *) (r->arena ? as_arena_alloc(r->arena, sz) : malloc(sz));
+			if ( !data ) {
+				break;
+			}
+			memcpy(data, value, sz);
+
+			as_val * val = op->particle_type == CL_LIST ?
+					(as_val *) as_lazy_list_new(data, sz, r->arena == NULL) :
+					(as_val *) as_lazy_map_new(data, sz, r->arena == NULL);
+			if ( !val ) {
+				if ( !r->arena ) {
+					free(data);
+				}
+				break;
+			}
+			as_record_set(r, name, (as_bin_value *) val);
+			break;
+		}
+		default: {
+			if ( op->particle_type == CL_BLOB &&
+				clvalue_decompress_to_asrecord(name, value, sz, r) ) {
+				break;
+			}
+			uint8_t * raw = (uint8_t *) (r->arena ? as_arena_alloc(r->arena, sz) : malloc(sz));
+			if ( !raw ) {
+				break;
+			}
+			memcpy(raw, value, sz);
+			as_record_set_raw_typep(r, name, raw, sz, (as_bytes_type) op->particle_type, r->arena == NULL);
+			break;
+		}
+	}
+}
+
+/**
+ * Make room for nbins bins in the record. Existing bins are kept. The new
+ * entries come from the record's arena if it has one.
+ */
+bool asrecord_reserve(as_record * rec, uint16_t nbins)
+{
+	if ( nbins <= rec->bins.capacity ) {
+		return true;
+	}
+
+	as_bin * entries = (as_bin *) (rec->arena ?
+			as_arena_alloc(rec->arena, sizeof(as_bin) * nbins) : malloc(sizeof(as_bin) * nbins));
+	if ( !entries ) {
+		return false;
+	}
+
+	// Inline values are pointed to by their own bin, so they follow the copy.
+	for ( uint16_t i = 0; i < rec->bins.size; i++ ) {
+		as_bin * bin = &rec->bins.entries[i];
+		entries[i] = *bin;
+		if ( bin->valuep == &bin->value ) {
+			entries[i].valuep = &entries[i].value;
+		}
+	}
+
+	if ( rec->bins._free ) {
+		free(rec->bins.entries);
+	}
+	rec->bins.entries = entries;
+	rec->bins.capacity = nbins;
+	rec->bins._free = rec->arena == NULL;
+	return true;
+}
+
+/**
+ * Empty a heap initialized record so it can be filled again by the next
+ * response. Bin values and the key value are released, the bin entries are
+ * kept and only grown when nbins exceeds the current capacity.
+ */
+void asrecord_clear(as_record * rec, uint16_t nbins)
+{
+	as_record_reset(rec);
+	asrecord_reserve(rec, nbins);
+}
+
+
+void aspolicyread_to_clwriteparameters(const as_policy_read * policy, cl_write_parameters * wp)
+{
+	if ( !policy || !wp ) {
+		return;
+	}
+
+	cl_write_parameters_set_default(wp);
+
+	wp->timeout_ms = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
+	wp->hedge_delay_ms = policy->hedge_delay;
+	wp->attempt_timeout_ms = policy->attempt_timeout;
+
+	switch(policy->retry) {
+		case AS_POLICY_RETRY_ONCE:
+			wp->w_pol = CL_WRITE_RETRY;
+			break;
+		case AS_POLICY_RETRY_NONE:
+		default:
+			wp->w_pol = CL_WRITE_ONESHOT;
+			break;
+	}
+}
+
 void aspolicywrite_to_clwriteparameters(const as_policy_write * policy, const as_record * rec, cl_write_parameters * wp) 
 {
 	if ( !policy || !rec || !wp ) {
@@ -359,6 +645,9 @@ void aspolicywrite_to_clwriteparameters(const as_policy_write * policy, const as
 	
 	wp->timeout_ms = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
 	wp->record_ttl = rec->ttl;
+	wp->compression_threshold = policy->compression_threshold;
+	wp->hedge_delay_ms = 0;
+	wp->attempt_timeout_ms = policy->attempt_timeout;
 
 	switch(policy->gen) {
 		case AS_POLICY_GEN_EQ:
@@ -408,6 +697,9 @@ void aspolicyoperate_to_clwriteparameters(const as_policy_operate * policy, cons
 	
 	wp->timeout_ms = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
 	wp->record_ttl = ops->ttl;
+	wp->compression_threshold = 0;
+	wp->hedge_delay_ms = 0;
+	wp->attempt_timeout_ms = 0;
 
 	switch(policy->gen) {
 		case AS_POLICY_GEN_EQ:
@@ -457,6 +749,9 @@ void aspolicyremove_to_clwriteparameters(const as_policy_remove * policy, cl_wri
 	
 	wp->timeout_ms = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
 	wp->record_ttl = 0;
+	wp->compression_threshold = 0;
+	wp->hedge_delay_ms = 0;
+	wp->attempt_timeout_ms = 0;
 
 	switch(policy->gen) {
 		case AS_POLICY_GEN_EQ:
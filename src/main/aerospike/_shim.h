@@ -23,10 +23,12 @@
 #include <aerospike/as_status.h>
 #include <aerospike/as_serializer.h>
 
+#include <citrusleaf/cf_proto.h>
 #include <citrusleaf/citrusleaf.h>
 #include <citrusleaf/cl_types.h>
 #include <citrusleaf/cl_write.h>
 
+#include <stdbool.h>
 #include <stdint.h>
 
 as_status as_error_fromrc(as_error * err, cl_rv rc);
@@ -39,6 +41,14 @@ void clbin_to_asrecord(cl_bin * bin, as_record * r);
 
 void clbins_to_asrecord(cl_bin * bins, uint32_t nbins, as_record * rec);
 
+void clmsgop_to_asrecord(cl_msg_op * op, as_record * rec);
+
+bool asrecord_reserve(as_record * rec, uint16_t nbins);
+
+void asrecord_clear(as_record * rec, uint16_t nbins);
+
+void aspolicyread_to_clwriteparameters(const as_policy_read * policy, cl_write_parameters * wp);
+
 void aspolicywrite_to_clwriteparameters(const as_policy_write * policy, const as_record * rec, cl_write_parameters * wp);
 
 void aspolicyoperate_to_clwriteparameters(const as_policy_operate * policy, const as_operations * ops, cl_write_parameters * wp);
@@ -52,3 +62,5 @@ void asbinvalue_to_clobject(as_bin_value * val, cl_object * obj);
 void asbin_to_clbin(as_bin * as, cl_bin * cl);
 
 void asrecord_to_clbins(as_record * rec, cl_bin * bins, uint32_t nbins);
+
+void clbin_compress(const char * ns, const char * set, cl_bin * bin);
@@ -106,6 +106,12 @@ as_status aerospike_connect(aerospike * as, as_error * err)
     memcpy(config.user_path, as->config.lua.user_path, sizeof(config.user_path));
     
     as_module_configure(&mod_lua, &config);
+
+	// Install the allocator before the cluster allocates its nodes. It is
+	// shared by every client of the process.
+	if ( as->config.allocator && ! as_allocator_set_once(as->config.allocator) ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "A different allocator is already in use");
+	}
 	
 	// Create the cluster object.
 	int status = as_cluster_create(&as->config, &as->cluster);
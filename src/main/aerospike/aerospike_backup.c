@@ -0,0 +1,837 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/aerospike_backup.h>
+#include <aerospike/aerospike_key.h>
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/as_cluster.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_rate_limiter.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_vector.h>
+
+#include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cf_clock.h>
+#include <citrusleaf/cl_kv.h>
+#include <citrusleaf/cl_scan.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "_shim.h"
+#include "ck_pr.h"
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+#define BACKUP_MAGIC "ASBK"
+#define BACKUP_MAGIC_SIZE 4
+#define BACKUP_VERSION 2
+#define BACKUP_FLAG_COMPRESSED 0x01
+
+#define BACKUP_BLOCK_SIZE (1024 * 1024)
+#define BACKUP_BLOCK_HEADER_SIZE 8
+
+// Digest, set name length, generation, void time and number of bins.
+#define BACKUP_RECORD_FIXED_SIZE (AS_DIGEST_VALUE_SIZE + 1 + 4 + 4 + 2)
+
+// Number of records of one node sent by a restore thread in one pipelined
+// batch.
+#define RESTORE_CHUNK_SIZE 256
+
+// Chunks queued per restore thread before the reader waits.
+#define RESTORE_QUEUE_PER_THREAD 2
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+typedef struct backup_writer_s {
+
+	FILE * fp;
+
+	// records not written yet
+	uint8_t * block;
+	uint32_t block_size;
+	uint32_t block_capacity;
+
+	// compression output, sized for the largest block
+	uint8_t * zbuf;
+	uLong zbuf_capacity;
+
+	bool compress;
+	bool failed;
+
+	// a record without a digest, or too large a set name or bin count
+	bool invalid;
+
+	as_backup_stats * stats;
+
+} backup_writer;
+
+typedef struct restore_block_s {
+
+	// decompressed block, NULL if the records are read from the mapping
+	uint8_t * raw;
+
+	// chunks still pointing into the block
+	uint32_t ref_count;
+
+} restore_block;
+
+typedef struct restore_chunk_s {
+
+	// node owning the records, NULL if there is none
+	as_node * node;
+
+	restore_block * block;
+
+	// record pointers, each at its length prefix
+	uint32_t n_records;
+	uint8_t * records[RESTORE_CHUNK_SIZE];
+
+} restore_chunk;
+
+typedef struct restore_ctx_s {
+
+	aerospike * as;
+	const as_policy_write * policy;
+	const char * ns;
+
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	// chunks waiting for a thread
+	restore_chunk ** queue;
+	uint32_t capacity;
+	uint32_t head;
+	uint32_t size;
+
+	// no more chunks will be queued
+	bool done;
+
+	uint32_t n_threads;
+
+	as_backup_stats * stats;
+
+} restore_ctx;
+
+/******************************************************************************
+ *	FUNCTION DECLS
+ *****************************************************************************/
+
+as_status aerospike_scan_init(aerospike * as, as_error * err);
+
+/******************************************************************************
+ *	STATIC FUNCTIONS - EXPORT
+ *****************************************************************************/
+
+static inline uint8_t * backup_put32(uint8_t * p, uint32_t v)
+{
+	v = cf_swap_to_be32(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint32_t backup_get32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return cf_swap_from_be32(v);
+}
+
+static bool backup_write(backup_writer * w, const void * data, size_t size)
+{
+	if ( fwrite(data, 1, size, w->fp) != size ) {
+		w->failed = true;
+		return false;
+	}
+	w->stats->bytes += size;
+	return true;
+}
+
+static bool backup_flush(backup_writer * w)
+{
+	if ( w->block_size == 0 ) {
+		return true;
+	}
+
+	uint8_t header[BACKUP_BLOCK_HEADER_SIZE];
+	const uint8_t * stored = w->block;
+	uint32_t stored_size = w->block_size;
+
+	if ( w->compress ) {
+		uLong bound = compressBound(w->block_size);
+
+		if ( bound > w->zbuf_capacity ) {
+			uint8_t * zbuf = (uint8_t *) realloc(w->zbuf, bound);
+			if ( !zbuf ) {
+				w->failed = true;
+				return false;
+			}
+			w->zbuf = zbuf;
+			w->zbuf_capacity = bound;
+		}
+
+		uLongf zsize = w->zbuf_capacity;
+
+		// Blocks which do not shrink are stored as they are.
+		if ( compress2(w->zbuf, &zsize, w->block, w->block_size, Z_BEST_SPEED) == Z_OK && zsize < w->block_size ) {
+			stored = w->zbuf;
+			stored_size = (uint32_t) zsize;
+		}
+	}
+
+	backup_put32(backup_put32(header, w->block_size), stored_size);
+
+	if ( !backup_write(w, header, sizeof(header)) || !backup_write(w, stored, stored_size) ) {
+		return false;
+	}
+	w->block_size = 0;
+	return true;
+}
+
+/**
+ * Append a scan response record to the current block. The ops are in host
+ * byte order, only their sizes need to be swapped back.
+ */
+static int backup_export_cb(char *ns, cf_digest *keyd, char *set, uint32_t generation,
+		uint32_t record_ttl, cl_msg_op *ops, int n_ops, void *udata)
+{
+	backup_writer * w = (backup_writer *) udata;
+	size_t set_sz = strlen(set);
+
+	// Records are restored by digest, so one without can't be exported.
+	if ( !keyd || set_sz > UINT8_MAX || n_ops > UINT16_MAX ) {
+		w->invalid = true;
+		return 1;
+	}
+
+	uint32_t size = BACKUP_RECORD_FIXED_SIZE + (uint32_t) set_sz;
+
+	cl_msg_op * op = ops;
+	for ( int i = 0; i < n_ops; i++, op = cl_msg_op_get_next(op) ) {
+		size += sizeof(op->op_sz) + op->op_sz;
+	}
+
+	uint32_t needed = sizeof(uint32_t) + size;
+
+	if ( w->block_size + needed > w->block_capacity ) {
+		if ( !backup_flush(w) ) {
+			return 1;
+		}
+
+		// A single record larger than a block gets a block of its own.
+		if ( needed > w->block_capacity ) {
+			uint8_t * block = (uint8_t *) realloc(w->block, needed);
+			if ( !block ) {
+				w->failed = true;
+				return 1;
+			}
+			w->block = block;
+			w->block_capacity = needed;
+		}
+	}
+
+	uint8_t * p = w->block + w->block_size;
+	p = backup_put32(p, size);
+	memcpy(p, keyd, AS_DIGEST_VALUE_SIZE);
+	p += AS_DIGEST_VALUE_SIZE;
+	*p++ = (uint8_t) set_sz;
+	memcpy(p, set, set_sz);
+	p += set_sz;
+	p = backup_put32(p, generation);
+	// The expiry is stored as a void time, so the time spent between export
+	// and restore counts against it.
+	p = backup_put32(p, record_ttl == AS_RECORD_NO_EXPIRE_TTL ? 0 : cf_clepoch_seconds() + record_ttl);
+	uint16_t n_bins = cf_swap_to_be16((uint16_t) n_ops);
+	memcpy(p, &n_bins, sizeof(n_bins));
+	p += sizeof(n_bins);
+
+	op = ops;
+	for ( int i = 0; i < n_ops; i++, op = cl_msg_op_get_next(op) ) {
+		p = backup_put32(p, op->op_sz);
+		memcpy(p, ((uint8_t *) op) + sizeof(op->op_sz), op->op_sz);
+		p += op->op_sz;
+	}
+
+	w->block_size += needed;
+	w->stats->records++;
+	return 0;
+}
+
+/******************************************************************************
+ *	STATIC FUNCTIONS - RESTORE
+ *****************************************************************************/
+
+static void restore_block_release(restore_block * block)
+{
+	bool destroy;
+	ck_pr_dec_32_zero(&block->ref_count, &destroy);
+
+	if ( destroy ) {
+		free(block->raw);
+		free(block);
+	}
+}
+
+static void restore_chunk_destroy(restore_chunk * chunk)
+{
+	if ( chunk->node ) {
+		as_node_release(chunk->node);
+	}
+	restore_block_release(chunk->block);
+	free(chunk);
+}
+
+/**
+ * Point rec at the digest, set and ops of the record at rp, leaving the ops
+ * as they are in the file. Returns false if the record is malformed.
+ */
+static bool restore_record_parse(uint8_t * rp, as_set set, cl_ops_record * rec, uint32_t * void_time)
+{
+	uint32_t size = backup_get32(rp);
+	uint8_t * p = rp + sizeof(uint32_t);
+	uint8_t * end = p + size;
+
+	rec->digest = (const cf_digest *) p;
+	p += AS_DIGEST_VALUE_SIZE;
+
+	uint8_t set_sz = *p++;
+	if ( set_sz >= AS_SET_MAX_SIZE || p + set_sz + 10 > end ) {
+		return false;
+	}
+	memcpy(set, p, set_sz);
+	set[set_sz] = 0;
+	rec->set = set_sz ? set : NULL;
+	p += set_sz;
+
+	p += sizeof(uint32_t); // generation is not restored
+	*void_time = backup_get32(p);
+	p += sizeof(uint32_t);
+	rec->n_ops = (uint16_t) ((p[0] << 8) | p[1]);
+	p += sizeof(uint16_t);
+
+	rec->ops = p;
+
+	for ( uint16_t i = 0; i < rec->n_ops; i++ ) {
+		if ( p + sizeof(cl_msg_op) > end ) {
+			return false;
+		}
+
+		uint32_t op_sz = backup_get32(p);
+		if ( op_sz > (uint32_t) (end - p) - sizeof(uint32_t) ) {
+			return false;
+		}
+		p += sizeof(uint32_t) + op_sz;
+	}
+
+	rec->ops_sz = p - rec->ops;
+	return p == end;
+}
+
+/**
+ * Write the records of a chunk to their node in one pipelined batch. Records
+ * which expired since the export are skipped.
+ */
+static void restore_chunk_write(restore_ctx * ctx, restore_chunk * chunk)
+{
+	cl_ops_record records[RESTORE_CHUNK_SIZE];
+	as_set sets[RESTORE_CHUNK_SIZE];
+	int results[RESTORE_CHUNK_SIZE];
+	uint32_t now = cf_clepoch_seconds();
+	int n_records = 0;
+
+	for ( uint32_t i = 0; i < chunk->n_records; i++ ) {
+		cl_ops_record * rec = &records[n_records];
+		uint32_t void_time;
+
+		if ( !restore_record_parse(chunk->records[i], sets[n_records], rec, &void_time) ) {
+			ck_pr_inc_64(&ctx->stats->failed);
+			continue;
+		}
+
+		if ( void_time == 0 ) {
+			rec->record_ttl = AS_RECORD_NO_EXPIRE_TTL;
+		}
+		else if ( void_time > now ) {
+			rec->record_ttl = void_time - now;
+		}
+		else {
+			ck_pr_inc_64(&ctx->stats->expired);
+			continue;
+		}
+		n_records++;
+	}
+
+	if ( n_records == 0 ) {
+		return;
+	}
+
+	if ( !chunk->node ) {
+		ck_pr_add_64(&ctx->stats->failed, n_records);
+		return;
+	}
+
+	as_rate_limiter_acquire(ctx->policy->rate_limiter, n_records);
+
+	citrusleaf_put_ops_pipelined(ctx->as->cluster, chunk->node, ctx->ns, records, n_records,
+			ctx->policy->timeout, results);
+
+	for ( int i = 0; i < n_records; i++ ) {
+		if ( results[i] == AEROSPIKE_OK ) {
+			ck_pr_inc_64(&ctx->stats->records);
+		}
+		else {
+			ck_pr_inc_64(&ctx->stats->failed);
+		}
+	}
+}
+
+static void * restore_worker(void * udata)
+{
+	restore_ctx * ctx = (restore_ctx *) udata;
+
+	while ( true ) {
+		pthread_mutex_lock(&ctx->lock);
+
+		while ( ctx->size == 0 && !ctx->done ) {
+			pthread_cond_wait(&ctx->not_empty, &ctx->lock);
+		}
+
+		if ( ctx->size == 0 ) {
+			pthread_mutex_unlock(&ctx->lock);
+			break;
+		}
+
+		restore_chunk * chunk = ctx->queue[ctx->head];
+		ctx->head = (ctx->head + 1) % ctx->capacity;
+		ctx->size--;
+		pthread_cond_signal(&ctx->not_full);
+		pthread_mutex_unlock(&ctx->lock);
+
+		restore_chunk_write(ctx, chunk);
+		restore_chunk_destroy(chunk);
+	}
+	return NULL;
+}
+
+/**
+ * Hand a chunk to the writer threads, waiting while the queue is full.
+ */
+static void restore_push(restore_ctx * ctx, restore_chunk * chunk)
+{
+	if ( ctx->n_threads == 0 ) {
+		restore_chunk_write(ctx, chunk);
+		restore_chunk_destroy(chunk);
+		return;
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+
+	while ( ctx->size == ctx->capacity ) {
+		pthread_cond_wait(&ctx->not_full, &ctx->lock);
+	}
+
+	ctx->queue[(ctx->head + ctx->size) % ctx->capacity] = chunk;
+	ctx->size++;
+	pthread_cond_signal(&ctx->not_empty);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+/**
+ * Group the records of a block by node into chunks, and queue each chunk as
+ * soon as it is full. The partial chunks are queued at the end of the block.
+ */
+static as_status restore_block_queue(aerospike * as, as_error * err, restore_ctx * ctx, restore_block * block, uint8_t * data, uint32_t size)
+{
+	as_vector chunks;
+	as_vector_inita(&chunks, sizeof(restore_chunk *), 16);
+
+	uint8_t * p = data;
+	uint8_t * end = data + size;
+	as_status status = AEROSPIKE_OK;
+
+	while ( p < end ) {
+		if ( p + sizeof(uint32_t) > end ) {
+			status = as_error_update(err, AEROSPIKE_ERR_CLIENT, "Truncated backup record");
+			break;
+		}
+
+		uint32_t rec_size = backup_get32(p);
+		if ( rec_size < BACKUP_RECORD_FIXED_SIZE || rec_size > (uint32_t) (end - p) - sizeof(uint32_t) ) {
+			status = as_error_update(err, AEROSPIKE_ERR_CLIENT, "Invalid backup record size %u", rec_size);
+			break;
+		}
+
+		as_node * node = as_node_get(as->cluster, ctx->ns, (const cf_digest *) (p + sizeof(uint32_t)), true, AS_POLICY_REPLICA_MASTER);
+		restore_chunk * chunk = NULL;
+		uint32_t index;
+
+		for ( index = 0; index < chunks.size; index++ ) {
+			restore_chunk * c = (restore_chunk *) as_vector_get_ptr(&chunks, index);
+			if ( c->node == node ) {
+				chunk = c;
+				break;
+			}
+		}
+
+		if ( chunk ) {
+			if ( node ) {
+				as_node_release(node);
+			}
+		}
+		else {
+			chunk = (restore_chunk *) malloc(sizeof(restore_chunk));
+			if ( !chunk ) {
+				if ( node ) {
+					as_node_release(node);
+				}
+				status = as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate restore chunk");
+				break;
+			}
+			chunk->node = node;
+			chunk->block = block;
+			chunk->n_records = 0;
+			ck_pr_inc_32(&block->ref_count);
+			as_vector_append(&chunks, &chunk);
+		}
+
+		chunk->records[chunk->n_records++] = p;
+		p += sizeof(uint32_t) + rec_size;
+
+		if ( chunk->n_records == RESTORE_CHUNK_SIZE ) {
+			as_vector_remove(&chunks, index);
+			restore_push(ctx, chunk);
+		}
+	}
+
+	for ( uint32_t i = 0; i < chunks.size; i++ ) {
+		restore_push(ctx, (restore_chunk *) as_vector_get_ptr(&chunks, i));
+	}
+	as_vector_destroy(&chunks);
+	return status;
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_status aerospike_backup_export(
+	aerospike * as, as_error * err, const as_policy_scan * policy,
+	const as_scan * scan, const char * path, bool compress, as_backup_stats * stats)
+{
+	as_error_reset(err);
+
+	if (! policy) {
+		policy = &as->config.policies.scan;
+	}
+
+	if ( scan->no_bins || scan->apply_each.function[0] != '\0' ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Export does not support no_bins or apply_each");
+	}
+
+	as_backup_stats local_stats;
+	if ( !stats ) {
+		stats = &local_stats;
+	}
+	memset(stats, 0, sizeof(as_backup_stats));
+
+	if ( aerospike_scan_init(as, err) != AEROSPIKE_OK ) {
+		return err->code;
+	}
+
+	int n_nodes = 0;
+	char * node_names = NULL;
+	as_cluster_get_node_names(as->cluster, &n_nodes, &node_names);
+
+	if ( n_nodes == 0 || !node_names ) {
+		return as_error_update(err, AEROSPIKE_ERR_CLUSTER, "Cluster is empty");
+	}
+
+	backup_writer w = {
+		.fp = fopen(path, "wb"),
+		.block = (uint8_t *) malloc(BACKUP_BLOCK_SIZE),
+		.block_size = 0,
+		.block_capacity = BACKUP_BLOCK_SIZE,
+		.zbuf = NULL,
+		.zbuf_capacity = 0,
+		.compress = compress,
+		.failed = false,
+		.invalid = false,
+		.stats = stats
+	};
+
+	if ( !w.fp || !w.block ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to create %s: errno %d", path, errno);
+		goto Cleanup;
+	}
+
+	size_t ns_sz = strlen(scan->ns);
+	uint8_t header[BACKUP_MAGIC_SIZE + 3 + AS_NAMESPACE_MAX_SIZE];
+	memcpy(header, BACKUP_MAGIC, BACKUP_MAGIC_SIZE);
+	header[BACKUP_MAGIC_SIZE] = BACKUP_VERSION;
+	header[BACKUP_MAGIC_SIZE + 1] = compress ? BACKUP_FLAG_COMPRESSED : 0;
+	header[BACKUP_MAGIC_SIZE + 2] = (uint8_t) ns_sz;
+	memcpy(header + BACKUP_MAGIC_SIZE + 3, scan->ns, ns_sz);
+
+	if ( !backup_write(&w, header, BACKUP_MAGIC_SIZE + 3 + ns_sz) ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to write %s: errno %d", path, errno);
+		goto Cleanup;
+	}
+
+	cl_scan_parameters params = {
+		.fail_on_cluster_change = policy->fail_on_cluster_change,
+		.priority = (cl_scan_priority) scan->priority,
+		.concurrent = false,
+		.threads_per_node = 0,
+		.rate_limiter = policy->rate_limiter
+	};
+
+	int n_bins = scan->select.size;
+	cl_bin * bins = NULL;
+	if ( n_bins > 0 ) {
+		bins = (cl_bin *) alloca(sizeof(cl_bin) * n_bins);
+		for ( int i = 0; i < n_bins; i++ ) {
+			strcpy(bins[i].bin_name, scan->select.entries[i]);
+			citrusleaf_object_init_null(&bins[i].object);
+		}
+	}
+
+	char * nptr = node_names;
+	for ( int i = 0; i < n_nodes; i++, nptr += NODE_NAME_SIZE ) {
+		cl_rv clrv = citrusleaf_scan_node_ops(as->cluster, nptr, (char *) scan->ns, (char *) scan->set,
+				bins, n_bins, scan->percent, backup_export_cb, &w, &params);
+
+		if ( w.failed ) {
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to write %s: errno %d", path, errno);
+			goto Cleanup;
+		}
+
+		if ( w.invalid ) {
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Node %s sent a record that can't be exported", nptr);
+			goto Cleanup;
+		}
+
+		if ( clrv != AEROSPIKE_OK ) {
+			as_error_fromrc(err, clrv);
+			goto Cleanup;
+		}
+	}
+
+	if ( !backup_flush(&w) || fflush(w.fp) != 0 ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to write %s: errno %d", path, errno);
+	}
+
+Cleanup:
+	if ( w.fp && fclose(w.fp) != 0 && err->code == AEROSPIKE_OK ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to write %s: errno %d", path, errno);
+	}
+	free(w.block);
+	free(w.zbuf);
+	free(node_names);
+	return err->code;
+}
+
+as_status aerospike_backup_restore(
+	aerospike * as, as_error * err, const as_policy_write * policy,
+	const char * path, uint32_t max_concurrent, as_backup_stats * stats)
+{
+	as_error_reset(err);
+
+	if (! policy) {
+		policy = &as->config.policies.write;
+	}
+
+	if ( max_concurrent == 0 ) {
+		max_concurrent = 1;
+	}
+
+	as_backup_stats local_stats;
+	if ( !stats ) {
+		stats = &local_stats;
+	}
+	memset(stats, 0, sizeof(as_backup_stats));
+
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 ) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to open %s: errno %d", path, errno);
+	}
+
+	struct stat st;
+	if ( fstat(fd, &st) != 0 || st.st_size < BACKUP_MAGIC_SIZE + 3 ) {
+		close(fd);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Invalid backup file %s", path);
+	}
+
+	// The records are sent as they are in the file, so the mapping is only
+	// read.
+	size_t file_size = (size_t) st.st_size;
+	uint8_t * map = (uint8_t *) mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( map == MAP_FAILED ) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to map %s: errno %d", path, errno);
+	}
+	madvise(map, file_size, MADV_SEQUENTIAL);
+
+	uint8_t * p = map;
+	uint8_t * end = map + file_size;
+
+	if ( memcmp(p, BACKUP_MAGIC, BACKUP_MAGIC_SIZE) != 0 || p[BACKUP_MAGIC_SIZE] != BACKUP_VERSION ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Invalid backup file %s", path);
+		munmap(map, file_size);
+		return err->code;
+	}
+
+	bool compressed = (p[BACKUP_MAGIC_SIZE + 1] & BACKUP_FLAG_COMPRESSED) != 0;
+	uint8_t ns_sz = p[BACKUP_MAGIC_SIZE + 2];
+	p += BACKUP_MAGIC_SIZE + 3;
+
+	as_namespace ns;
+	if ( ns_sz >= AS_NAMESPACE_MAX_SIZE || p + ns_sz > end ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Invalid backup file %s", path);
+		munmap(map, file_size);
+		return err->code;
+	}
+	memcpy(ns, p, ns_sz);
+	ns[ns_sz] = 0;
+	p += ns_sz;
+
+	restore_ctx ctx = {
+		.as = as,
+		.policy = policy,
+		.ns = ns,
+		.queue = (restore_chunk **) malloc(sizeof(restore_chunk *) * max_concurrent * RESTORE_QUEUE_PER_THREAD),
+		.capacity = max_concurrent * RESTORE_QUEUE_PER_THREAD,
+		.head = 0,
+		.size = 0,
+		.done = false,
+		.n_threads = 0,
+		.stats = stats
+	};
+
+	if ( !ctx.queue ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate restore queue");
+		munmap(map, file_size);
+		return err->code;
+	}
+
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.not_empty, NULL);
+	pthread_cond_init(&ctx.not_full, NULL);
+
+	// The threads live for the whole restore. If none can be started, the
+	// chunks are written by this thread as they are queued.
+	pthread_t * threads = (pthread_t *) alloca(sizeof(pthread_t) * max_concurrent);
+
+	for ( uint32_t i = 0; i < max_concurrent; i++ ) {
+		if ( pthread_create(&threads[ctx.n_threads], NULL, restore_worker, &ctx) == 0 ) {
+			ctx.n_threads++;
+		}
+	}
+
+	while ( p < end ) {
+		if ( end - p < BACKUP_BLOCK_HEADER_SIZE ) {
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Truncated backup file %s", path);
+			break;
+		}
+
+		uint32_t raw_size = backup_get32(p);
+		uint32_t stored_size = backup_get32(p + sizeof(uint32_t));
+		p += BACKUP_BLOCK_HEADER_SIZE;
+
+		if ( stored_size > (size_t) (end - p) ) {
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Truncated backup file %s", path);
+			break;
+		}
+
+		restore_block * block = (restore_block *) malloc(sizeof(restore_block));
+		if ( !block ) {
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate restore block");
+			break;
+		}
+		block->raw = NULL;
+		block->ref_count = 1;
+
+		uint8_t * data = p;
+
+		// Each decompressed block has its own buffer, freed by the last
+		// thread done with its records.
+		if ( compressed && stored_size < raw_size ) {
+			block->raw = (uint8_t *) malloc(raw_size);
+			if ( !block->raw ) {
+				restore_block_release(block);
+				as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate %u bytes", raw_size);
+				break;
+			}
+
+			uLongf size = raw_size;
+			if ( uncompress(block->raw, &size, p, stored_size) != Z_OK || size != raw_size ) {
+				restore_block_release(block);
+				as_error_update(err, AEROSPIKE_ERR_CLIENT, "Corrupt block in backup file %s", path);
+				break;
+			}
+			data = block->raw;
+		}
+		else if ( stored_size != raw_size ) {
+			restore_block_release(block);
+			as_error_update(err, AEROSPIKE_ERR_CLIENT, "Invalid block in backup file %s", path);
+			break;
+		}
+
+		as_status status = restore_block_queue(as, err, &ctx, block, data, raw_size);
+		restore_block_release(block);
+
+		if ( status != AEROSPIKE_OK ) {
+			break;
+		}
+
+		p += stored_size;
+		stats->bytes += BACKUP_BLOCK_HEADER_SIZE + stored_size;
+	}
+
+	pthread_mutex_lock(&ctx.lock);
+	ctx.done = true;
+	pthread_cond_broadcast(&ctx.not_empty);
+	pthread_mutex_unlock(&ctx.lock);
+
+	for ( uint32_t i = 0; i < ctx.n_threads; i++ ) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&ctx.not_full);
+	pthread_cond_destroy(&ctx.not_empty);
+	pthread_mutex_destroy(&ctx.lock);
+	free(ctx.queue);
+	munmap(map, file_size);
+
+	if ( err->code == AEROSPIKE_OK && stats->failed > 0 ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to restore %" PRIu64 " records", stats->failed);
+	}
+	return err->code;
+}
@@ -109,6 +109,10 @@ static as_status batch_read(
 {
 	as_error_reset(err);
 
+	if (! policy) {
+		policy = &as->config.policies.batch;
+	}
+
 	// Lazily initialize batch machinery:
 	cl_cluster_batch_init(as->cluster);
 
@@ -155,7 +159,7 @@ static as_status batch_read(
 	bridge.n = n;
 
 	cl_rv rc = citrusleaf_batch_read(as->cluster, ns, digests, n, NULL, 0,
-			get_bin_data, cl_batch_cb, &bridge);
+			get_bin_data, cl_batch_cb, &bridge, policy->rate_limiter);
 
 	callback(results, n, udata);
 
@@ -17,6 +17,7 @@
 #include <aerospike/aerospike.h>
 #include <aerospike/aerospike_key.h>
 
+#include <aerospike/as_arena.h>
 #include <aerospike/as_bin.h>
 #include <aerospike/as_buffer.h>
 #include <aerospike/as_error.h>
@@ -25,6 +26,7 @@
 #include <aerospike/as_log.h>
 #include <aerospike/as_operations.h>
 #include <aerospike/as_policy.h>
+#include <aerospike/as_rate_limiter.h>
 #include <aerospike/as_record.h>
 #include <aerospike/as_status.h>
 
@@ -40,6 +42,52 @@
 
 #include "../citrusleaf/internal.h"
 
+/******************************************************************************
+ * STATIC FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Decode the bins of a get response into an arena backed record. The record
+ *	is created if udata points to NULL.
+ */
+static int aerospike_key_get_arena_cb(cl_msg_op * ops, int n_ops, void * udata)
+{
+	as_record ** recp = (as_record **) udata;
+
+	if ( recp == NULL ) {
+		return AEROSPIKE_OK;
+	}
+
+	as_record * r = *recp;
+
+	if ( r == NULL ) {
+		r = as_record_new(0);
+		if ( r == NULL ) {
+			return AEROSPIKE_ERR_CLIENT;
+		}
+		*recp = r;
+	}
+
+	if ( r->arena == NULL ) {
+		r->arena = as_arena_acquire();
+		if ( r->arena == NULL ) {
+			return AEROSPIKE_ERR_CLIENT;
+		}
+	}
+
+	if ( ! asrecord_reserve(r, (uint16_t) n_ops) ) {
+		return AEROSPIKE_ERR_CLIENT;
+	}
+
+	cl_msg_op * op = ops;
+	for ( int i = 0; i < n_ops; i++ ) {
+		clmsgop_to_asrecord(op, r);
+		op = cl_msg_op_get_next(op);
+	}
+
+	return AEROSPIKE_OK;
+}
+
 /******************************************************************************
  * FUNCTIONS
  *****************************************************************************/
@@ -68,6 +116,8 @@ as_status aerospike_key_get(
 	}
 
 	uint32_t    timeout = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
+	cl_write_parameters rp;
+	aspolicyread_to_clwriteparameters(policy, &rp);
 	uint32_t    gen = 0;
 	uint32_t 	ttl = 0;
 	int         nvalues = 0;
@@ -91,11 +141,36 @@ as_status aerospike_key_get(
 		}
 	}
 
+	if ( policy->use_arena ) {
+		as_record * r = rec ? *rec : NULL;
+		cl_object okey;
+
+		if ( policy->key == AS_POLICY_KEY_SEND ) {
+			asval_to_clobject((as_val *) key->valuep, &okey);
+		}
+
+		as_digest * digest = as_key_digest((as_key *) key);
+		rc = citrusleaf_get_all_ops(as->cluster, key->ns, key->set,
+				policy->key == AS_POLICY_KEY_SEND ? &okey : NULL, (cf_digest*)digest->value,
+				aerospike_key_get_arena_cb, rec ? &r : NULL, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
+
+		if ( rc == AEROSPIKE_OK && r != NULL ) {
+			r->gen = (uint16_t) gen;
+			r->ttl = ttl;
+			*rec = r;
+		}
+		else if ( r != NULL && r != *rec ) {
+			as_record_destroy(r);
+		}
+
+		return as_error_fromrc(err,rc);
+	}
+
 	switch ( policy->key ) {
 		case AS_POLICY_KEY_DIGEST: {
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_get_all(as->cluster, key->ns, key->set, NULL, (cf_digest*)digest->value,
-					&values, &nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					&values, &nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		case AS_POLICY_KEY_SEND: {
@@ -103,7 +178,7 @@ as_status aerospike_key_get(
 			asval_to_clobject((as_val *) key->valuep, &okey);
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_get_all(as->cluster, key->ns, key->set, &okey, (cf_digest*)digest->value,
-					&values, &nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					&values, &nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		default: {
@@ -117,12 +192,7 @@ as_status aerospike_key_get(
 		if ( r == NULL ) {
 			r = as_record_new(0);
 		}
-		if ( r->bins.entries == NULL ) {
-			r->bins.capacity = nvalues;
-			r->bins.size = 0;
-			r->bins.entries = malloc(sizeof(as_bin) * nvalues);
-			r->bins._free = true;
-		}
+		asrecord_reserve(r, (uint16_t) nvalues);
 		clbins_to_asrecord(values, nvalues, r);
 		r->gen = (uint16_t) gen;
 		r->ttl = ttl;
@@ -163,6 +233,8 @@ as_status aerospike_key_select(
 	}
 
 	uint32_t    timeout = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
+	cl_write_parameters rp;
+	aspolicyread_to_clwriteparameters(policy, &rp);
 	uint32_t    gen = 0;
 	uint32_t 	ttl = 0;
 	int         nvalues = 0;
@@ -203,7 +275,7 @@ as_status aerospike_key_select(
 		case AS_POLICY_KEY_DIGEST: {
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_get(as->cluster, key->ns, key->set, NULL, (cf_digest*)digest->value,
-					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		case AS_POLICY_KEY_SEND: {
@@ -211,7 +283,7 @@ as_status aerospike_key_select(
 			asval_to_clobject((as_val *) key->valuep, &okey);
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_get(as->cluster, key->ns, key->set, &okey, (cf_digest*)digest->value,
-					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		default: {
@@ -225,12 +297,7 @@ as_status aerospike_key_select(
 		if ( r == NULL ) {
 			r = as_record_new(0);
 		}
-		if ( r->bins.entries == NULL ) {
-			r->bins.capacity = nvalues;
-			r->bins.size = 0;
-			r->bins.entries = malloc(sizeof(as_bin) * nvalues);
-			r->bins._free = true;
-		}
+		asrecord_reserve(r, (uint16_t) nvalues);
 		clbins_to_asrecord(values, nvalues, r);
 		r->gen = (uint16_t) gen;
 		r->ttl = ttl;
@@ -269,6 +336,8 @@ as_status aerospike_key_exists(
 	}
 
 	uint32_t    timeout = policy->timeout == UINT32_MAX ? 0 : policy->timeout;
+	cl_write_parameters rp;
+	aspolicyread_to_clwriteparameters(policy, &rp);
 	uint32_t	gen = 0;
 	uint32_t	ttl = 0; // TODO - a version of 'exists' that returns all metadata
 	int     	nvalues = 0;
@@ -296,7 +365,7 @@ as_status aerospike_key_exists(
 		case AS_POLICY_KEY_DIGEST: {
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_exists_key(as->cluster, key->ns, key->set, NULL, (cf_digest*)digest->value,
-					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		case AS_POLICY_KEY_SEND: {
@@ -304,7 +373,7 @@ as_status aerospike_key_exists(
 			asval_to_clobject((as_val *) key->valuep, &okey);
 			as_digest * digest = as_key_digest((as_key *) key);
 			rc = citrusleaf_exists_key(as->cluster, key->ns, key->set, &okey, (cf_digest*)digest->value,
-					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica);
+					values, nvalues, timeout, &gen, &ttl, consistency_level, policy->replica, &rp);
 			break;
 		}
 		default: {
@@ -363,6 +432,8 @@ as_status aerospike_key_put(
 		policy = &as->config.policies.write;
 	}
 
+	as_rate_limiter_acquire(policy->rate_limiter, 1);
+
 	cl_write_parameters wp;
 	aspolicywrite_to_clwriteparameters(policy, rec, &wp);
 
@@ -371,6 +442,10 @@ as_status aerospike_key_put(
 
 	asrecord_to_clbins(rec, values, nvalues);
 
+	for ( int i = 0; i < nvalues; i++ ) {
+		clbin_compress(key->ns, key->set, &values[i]);
+	}
+
 	cl_rv rc = AEROSPIKE_OK;
 
 	int commit_level = 0;
@@ -414,6 +489,59 @@ as_status aerospike_key_put(
 	return as_error_fromrc(err,rc); 
 }
 
+/**
+ *	Store the values of a record with a write template. Only the key, digest
+ *	and values are laid into the compiled request.
+ */
+as_status aerospike_key_put_template(
+	aerospike * as, as_error * err, const as_write_template * tmpl,
+	const as_key * key, as_val ** values)
+{
+	// we want to reset the error so, we have a clean state
+	as_error_reset(err);
+
+	if ( strcmp(key->ns, tmpl->ns) != 0 || strcmp(key->set, tmpl->set) != 0 ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "key is not in the namespace and set of the template");
+	}
+
+	as_rate_limiter_acquire(tmpl->policy.rate_limiter, 1);
+
+	int			nvalues	= tmpl->n_bins;
+	cl_bin *	bins	= (cl_bin *) alloca(sizeof(cl_bin) * nvalues);
+
+	for ( int i = 0; i < nvalues; i++ ) {
+		if ( values[i] ) {
+			asbinvalue_to_clobject((as_bin_value *) values[i], &bins[i].object);
+		}
+		else {
+			citrusleaf_object_init_null(&bins[i].object);
+		}
+
+		// Appends and prepends must reach the server as they are.
+		if ( tmpl->ops[i] == AS_OPERATOR_WRITE ) {
+			strcpy(bins[i].bin_name, tmpl->bins[i]);
+			clbin_compress(key->ns, key->set, &bins[i]);
+		}
+	}
+
+	as_digest * digest = as_key_digest((as_key *) key);
+	cl_rv rc = AEROSPIKE_OK;
+
+	if ( tmpl->policy.key == AS_POLICY_KEY_SEND ) {
+		cl_object okey;
+		asval_to_clobject((as_val *) key->valuep, &okey);
+		rc = citrusleaf_write_template_put(as->cluster, tmpl->compiled, &okey, (cf_digest*)digest->value, bins);
+	}
+	else {
+		rc = citrusleaf_write_template_put(as->cluster, tmpl->compiled, NULL, (cf_digest*)digest->value, bins);
+	}
+
+	// We are freeing the bins' objects, as opposed to bins themselves.
+	citrusleaf_bins_free(bins, nvalues);
+
+	return as_error_fromrc(err,rc);
+}
+
 /**
  *	Remove a record from the cluster.
  *
@@ -444,6 +572,8 @@ as_status aerospike_key_remove(
 		policy = &as->config.policies.remove;
 	}
 
+	as_rate_limiter_acquire(policy->rate_limiter, 1);
+
 	cl_write_parameters wp;
 	aspolicyremove_to_clwriteparameters(policy, &wp);
 
@@ -525,6 +655,8 @@ as_status aerospike_key_operate(
 		policy = &as->config.policies.operate;
 	}
 
+	as_rate_limiter_acquire(policy->rate_limiter, 1);
+
 	cl_write_parameters wp;
 	aspolicyoperate_to_clwriteparameters(policy, ops, &wp);
 
@@ -554,6 +686,11 @@ as_status aerospike_key_operate(
 		}
 
 		asbinvalue_to_clobject(op->bin.valuep, &clop->bin.object);
+
+		// Appends and prepends must reach the server as they are.
+		if (op->op == AS_OPERATOR_WRITE) {
+			clbin_compress(key->ns, key->set, &clop->bin);
+		}
 	}
 
 	int consistency_level = 0;
@@ -630,12 +767,7 @@ as_status aerospike_key_operate(
 		if ( r == NULL ) {
 			r = as_record_new(0);
 		}
-		if ( r->bins.entries == NULL ) {
-			r->bins.capacity = n_operations;
-			r->bins.size = 0;
-			r->bins.entries = malloc(sizeof(as_bin) * n_operations);
-			r->bins._free = true;
-		}
+		asrecord_reserve(r, (uint16_t) n_operations);
 		clbins_to_asrecord(result_bins, n_operations, r);
 		r->gen = (uint16_t) gen;
 		r->ttl = ttl;
@@ -122,15 +122,16 @@ as_status aerospike_query_foreach(
 	as_error_reset(err);
     as_val *  err_val = NULL;
 	
-	//if (! policy) {
-	//	policy = &as->config.policies.query;
-	//}
+	if (! policy) {
+		policy = &as->config.policies.query;
+	}
 	
 	if ( aerospike_query_init(as, err) != AEROSPIKE_OK ) {
 		return err->code;
 	}
 
 	cl_query * clquery = as_query_toclquery(query);
+	clquery->rate_limiter = policy->rate_limiter;
 
 	clquery_bridge bridge = {
 		.udata = udata,
@@ -16,6 +16,7 @@
  */
 #include <aerospike/aerospike_scan.h>
 #include <aerospike/aerospike_info.h>
+#include <aerospike/as_columnar.h>
 #include <aerospike/as_key.h>
 #include <aerospike/as_log.h>
 
@@ -43,6 +44,22 @@ typedef struct scan_bridge_s {
 
 } scan_bridge;
 
+typedef struct columnar_bridge_s {
+
+	// batch being filled
+	as_columnar_batch * batch;
+
+	// user-provided data
+	void * udata;
+
+	// user-provided callback
+	as_columnar_callback callback;
+
+	// set when the callback asked to stop
+	bool aborted;
+
+} columnar_bridge;
+
 /******************************************************************************
  * FUNCTION DECLS
  *****************************************************************************/
@@ -165,6 +182,77 @@ static int generic_cb(as_val * val, void * udata)
 	return rv ? 0 : 1;
 }
 
+/**
+ * Copy the values of a record's ops into the current row of the batch.
+ * Values go straight from the read buffer into the column buffers. Bins
+ * without a column are skipped, bins of the wrong type are stored as missing.
+ */
+static int columnar_cb(char *ns, cf_digest *keyd, char *set, uint32_t generation,
+		uint32_t record_ttl, cl_msg_op *ops, int n_ops, void *udata)
+{
+	columnar_bridge * bridge = (columnar_bridge *) udata;
+	as_columnar_batch * batch = bridge->batch;
+
+	cl_msg_op * op = ops;
+	for ( int i = 0; i < n_ops; i++, op = cl_msg_op_get_next(op) ) {
+
+		int idx = as_columnar_batch_find_column(batch, (char *) op->name, op->name_sz);
+		if ( idx < 0 ) {
+			continue;
+		}
+
+		as_column * column = &batch->columns[idx];
+		uint8_t * value = cl_msg_op_get_value_p(op);
+		uint32_t sz = cl_msg_op_get_value_sz(op);
+
+		switch ( op->particle_type ) {
+			case CL_INT: {
+				if ( column->type != AS_COLUMN_INT64 ) break;
+				int64_t v = 0;
+				if ( sz == sizeof(int64_t) ) {
+					v = (int64_t) cf_swap_from_be64(*(uint64_t *) value);
+				}
+				else if ( sz < sizeof(int64_t) ) {
+					for ( uint32_t j = 0; j < sz; j++ ) {
+						v = (v << 8) | value[j];
+					}
+				}
+				else {
+					break;
+				}
+				as_column_set_int64(batch, column, v);
+				break;
+			}
+			case CL_STR: {
+				if ( column->type == AS_COLUMN_INT64 ) break;
+				as_column_set_bytes(batch, column, value, sz);
+				break;
+			}
+			case CL_BLOB: {
+				if ( column->type != AS_COLUMN_BYTES ) break;
+				as_column_set_bytes(batch, column, value, sz);
+				break;
+			}
+			default: {
+				break;
+			}
+		}
+	}
+
+	as_columnar_batch_end_row(batch);
+
+	if ( as_columnar_batch_full(batch) ) {
+		bool rv = bridge->callback(batch, bridge->udata);
+		as_columnar_batch_clear(batch);
+
+		if ( !rv ) {
+			bridge->aborted = true;
+			return 1;
+		}
+	}
+	return 0;
+}
+
 /**
  * This is the main driver function which can cater to different types of
  * scan interfaces exposed to the outside world. This functions should not be
@@ -204,7 +292,8 @@ static as_status aerospike_scan_generic(
 			.fail_on_cluster_change = clscan.params.fail_on_cluster_change,
 			.priority = clscan.params.priority,
 			.concurrent = clscan.params.concurrent,
-			.threads_per_node = 0
+			.threads_per_node = 0,
+			.rate_limiter = policy->rate_limiter
 		};
 
 		int n_bins = scan->select.size;
@@ -517,6 +606,101 @@ as_status aerospike_scan_foreach(
 	return aerospike_scan_generic(as, err, policy, NULL, scan, callback, udata);
 }
 
+/**
+ *	Scan the records in the specified namespace and set in the cluster, and
+ *	deliver them as columns.
+ *
+ *	@param as			The aerospike instance to use for this operation.
+ *	@param err			The as_error to be populated if an error occurs.
+ *	@param policy		The policy to use for this operation. If NULL, then the default policy will be used.
+ *	@param scan			The scan to execute against the cluster.
+ *	@param batch		The batch, with its columns defined, to fill.
+ *	@param callback		The function to be called for each full batch.
+ *	@param udata		User-data to be passed to the callback.
+ *
+ *	@return AEROSPIKE_OK on success. Otherwise an error occurred.
+ */
+as_status aerospike_scan_columnar(
+	aerospike * as, as_error * err, const as_policy_scan * policy, 
+	const as_scan * scan, as_columnar_batch * batch,
+	as_columnar_callback callback, void * udata)
+{
+	as_error_reset(err);
+
+	if (! policy) {
+		policy = &as->config.policies.scan;
+	}
+
+	if ( batch->n_columns == 0 ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Columnar scan requires at least one column");
+	}
+
+	if ( scan->no_bins || scan->apply_each.function[0] != '\0' ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Columnar scan does not support no_bins or apply_each");
+	}
+
+	if ( aerospike_scan_init(as, err) != AEROSPIKE_OK ) {
+		return err->code;
+	}
+
+	as_columnar_batch_clear(batch);
+
+	columnar_bridge bridge = {
+		.batch = batch,
+		.udata = udata,
+		.callback = callback,
+		.aborted = false
+	};
+
+	cl_scan_parameters params = {
+		.fail_on_cluster_change = policy->fail_on_cluster_change,
+		.priority = (cl_scan_priority) scan->priority,
+		.concurrent = false,
+		.threads_per_node = 0,
+		.rate_limiter = policy->rate_limiter
+	};
+
+	// Only the bins backing a column are requested from the server.
+	int n_bins = (int) batch->n_columns;
+	cl_bin * bins = (cl_bin *) alloca(sizeof(cl_bin) * n_bins);
+	for ( int i = 0; i < n_bins; i++ ) {
+		strcpy(bins[i].bin_name, batch->columns[i].name);
+		citrusleaf_object_init_null(&bins[i].object);
+	}
+
+	// Nodes are scanned one after the other, so a single batch is filled
+	// without locking and every callback sees a full batch.
+	int n_nodes = 0;
+	char * node_names = NULL;
+	as_cluster_get_node_names(as->cluster, &n_nodes, &node_names);
+
+	if ( n_nodes == 0 || !node_names ) {
+		return as_error_update(err, AEROSPIKE_ERR_CLUSTER, "Cluster is empty");
+	}
+
+	as_status rc = AEROSPIKE_OK;
+	char * nptr = node_names;
+
+	// Stop at the first node that fails, and report its error.
+	for ( int i = 0; i < n_nodes && !bridge.aborted && rc == AEROSPIKE_OK; i++, nptr += NODE_NAME_SIZE ) {
+		cl_rv clrv = citrusleaf_scan_node_ops(as->cluster, nptr, (char *) scan->ns, (char *) scan->set,
+				bins, n_bins, scan->percent, columnar_cb, &bridge, &params);
+
+		if ( clrv != AEROSPIKE_OK ) {
+			rc = as_error_fromrc(err, clrv);
+		}
+	}
+	free(node_names);
+
+	// Hand over the rows of the last, partial batch, unless the scan failed.
+	if ( rc == AEROSPIKE_OK && !bridge.aborted && batch->n_rows > 0 ) {
+		bridge.aborted = !callback(batch, udata);
+	}
+	as_columnar_batch_clear(batch);
+
+	return rc;
+}
+
 /**
  * Initialize scan environment
  */
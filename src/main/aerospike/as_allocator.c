@@ -0,0 +1,218 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_allocator.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ck_pr.h"
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+#define TAG_SHIFT 56
+#define SIZE_MASK ((1ULL << TAG_SHIFT) - 1)
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	Prefix of every allocation, remembering where it came from so it is
+ *	released to the same allocator and counted against the same tag. Its
+ *	size keeps the memory handed out 16 byte aligned.
+ */
+typedef struct as_alloc_header_s {
+	const as_allocator * allocator;
+	uint64_t size_tag;
+} as_alloc_header;
+
+/**
+ *	Counters of a tag, on their own cache line.
+ */
+typedef struct as_alloc_counters_s {
+	as_alloc_stats stats;
+	uint8_t pad[64 - sizeof(as_alloc_stats)];
+} as_alloc_counters;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static void * as_libc_malloc(as_alloc_tag tag, size_t size, void * udata);
+static void * as_libc_realloc(as_alloc_tag tag, void * p, size_t size, void * udata);
+static void as_libc_free(as_alloc_tag tag, void * p, size_t size, void * udata);
+
+/******************************************************************************
+ *	STATIC VARIABLES
+ *****************************************************************************/
+
+static const as_allocator g_libc_allocator = {
+	.malloc = as_libc_malloc,
+	.realloc = as_libc_realloc,
+	.free = as_libc_free,
+	.udata = NULL
+};
+
+static const as_allocator * g_allocator = &g_libc_allocator;
+
+static as_alloc_counters g_counters[AS_ALLOC_TAG_MAX];
+
+static const char * g_tag_names[AS_ALLOC_TAG_MAX] = {
+	"record",
+	"network",
+	"batch",
+	"query",
+	"tend"
+};
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static void * as_libc_malloc(as_alloc_tag tag, size_t size, void * udata)
+{
+	return malloc(size);
+}
+
+static void * as_libc_realloc(as_alloc_tag tag, void * p, size_t size, void * udata)
+{
+	return realloc(p, size);
+}
+
+static void as_libc_free(as_alloc_tag tag, void * p, size_t size, void * udata)
+{
+	free(p);
+}
+
+static inline void as_alloc_count(as_alloc_tag tag, uint64_t size)
+{
+	as_alloc_stats * stats = &g_counters[tag].stats;
+	ck_pr_inc_64(&stats->allocs);
+	ck_pr_add_64(&stats->bytes, size);
+	ck_pr_add_64(&stats->total_bytes, size);
+}
+
+static inline void as_alloc_uncount(as_alloc_tag tag, uint64_t size)
+{
+	as_alloc_stats * stats = &g_counters[tag].stats;
+	ck_pr_inc_64(&stats->frees);
+	ck_pr_sub_64(&stats->bytes, size);
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+void as_allocator_set(const as_allocator * allocator)
+{
+	ck_pr_store_ptr(&g_allocator, allocator ? allocator : &g_libc_allocator);
+}
+
+bool as_allocator_set_once(const as_allocator * allocator)
+{
+	if ( ck_pr_cas_ptr((void *) &g_allocator, (void *) &g_libc_allocator, (void *) allocator) ) {
+		return true;
+	}
+	return ck_pr_load_ptr(&g_allocator) == allocator;
+}
+
+void * as_malloc(as_alloc_tag tag, size_t size)
+{
+	const as_allocator * allocator = ck_pr_load_ptr(&g_allocator);
+
+	as_alloc_header * h = (as_alloc_header *)
+		allocator->malloc(tag, sizeof(as_alloc_header) + size, allocator->udata);
+	if ( !h ) {
+		return NULL;
+	}
+
+	h->allocator = allocator;
+	h->size_tag = ((uint64_t) tag << TAG_SHIFT) | size;
+	as_alloc_count(tag, size);
+	return h + 1;
+}
+
+void * as_calloc(as_alloc_tag tag, size_t n, size_t size)
+{
+	if ( size && n > SIZE_MAX / size ) {
+		return NULL;
+	}
+
+	void * p = as_malloc(tag, n * size);
+	if ( p ) {
+		memset(p, 0, n * size);
+	}
+	return p;
+}
+
+void * as_realloc(as_alloc_tag tag, void * p, size_t size)
+{
+	if ( !p ) {
+		return as_malloc(tag, size);
+	}
+
+	as_alloc_header * h = (as_alloc_header *) p - 1;
+	const as_allocator * allocator = h->allocator;
+	as_alloc_tag old_tag = (as_alloc_tag) (h->size_tag >> TAG_SHIFT);
+	uint64_t old_size = h->size_tag & SIZE_MASK;
+
+	h = (as_alloc_header *)
+		allocator->realloc(tag, h, sizeof(as_alloc_header) + size, allocator->udata);
+	if ( !h ) {
+		return NULL;
+	}
+
+	h->size_tag = ((uint64_t) tag << TAG_SHIFT) | size;
+	as_alloc_uncount(old_tag, old_size);
+	as_alloc_count(tag, size);
+	return h + 1;
+}
+
+void as_free(void * p)
+{
+	if ( !p ) {
+		return;
+	}
+
+	as_alloc_header * h = (as_alloc_header *) p - 1;
+	as_alloc_tag tag = (as_alloc_tag) (h->size_tag >> TAG_SHIFT);
+	uint64_t size = h->size_tag & SIZE_MASK;
+
+	as_alloc_uncount(tag, size);
+	h->allocator->free(tag, h, sizeof(as_alloc_header) + size, h->allocator->udata);
+}
+
+void as_allocator_stats(as_alloc_tag tag, as_alloc_stats * stats)
+{
+	if ( tag >= AS_ALLOC_TAG_MAX ) {
+		memset(stats, 0, sizeof(as_alloc_stats));
+		return;
+	}
+
+	as_alloc_stats * s = &g_counters[tag].stats;
+	stats->allocs = ck_pr_load_64(&s->allocs);
+	stats->frees = ck_pr_load_64(&s->frees);
+	stats->bytes = ck_pr_load_64(&s->bytes);
+	stats->total_bytes = ck_pr_load_64(&s->total_bytes);
+}
+
+const char * as_alloc_tag_name(as_alloc_tag tag)
+{
+	return tag < AS_ALLOC_TAG_MAX ? g_tag_names[tag] : "unknown";
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_arena.h>
+
+#include <pthread.h>
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+#define ARENA_ALIGN 8
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+typedef struct as_arena_cache_s {
+	uint32_t count;
+	as_arena * arenas[AS_ARENA_THREAD_CACHE_SIZE];
+} as_arena_cache;
+
+/******************************************************************************
+ *	STATIC VARIABLES
+ *****************************************************************************/
+
+static pthread_once_t g_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_cache_key;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static void as_arena_cache_destroy(void * udata)
+{
+	as_arena_cache * cache = (as_arena_cache *) udata;
+
+	for ( uint32_t i = 0; i < cache->count; i++ ) {
+		as_arena_destroy(cache->arenas[i]);
+	}
+	as_free(cache);
+}
+
+static void as_arena_cache_key_create()
+{
+	pthread_key_create(&g_cache_key, as_arena_cache_destroy);
+}
+
+static as_arena_cache * as_arena_cache_get()
+{
+	pthread_once(&g_cache_once, as_arena_cache_key_create);
+
+	as_arena_cache * cache = (as_arena_cache *) pthread_getspecific(g_cache_key);
+
+	if ( !cache ) {
+		cache = (as_arena_cache *) as_malloc(AS_ALLOC_RECORD, sizeof(as_arena_cache));
+		if ( !cache ) {
+			return NULL;
+		}
+		cache->count = 0;
+		pthread_setspecific(g_cache_key, cache);
+	}
+	return cache;
+}
+
+static as_arena_chunk * as_arena_chunk_new(size_t capacity)
+{
+	as_arena_chunk * chunk = (as_arena_chunk *) as_malloc(AS_ALLOC_RECORD, sizeof(as_arena_chunk) + capacity);
+	if ( !chunk ) {
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+	return chunk;
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_arena * as_arena_new(size_t chunk_size)
+{
+	if ( chunk_size == 0 ) {
+		chunk_size = AS_ARENA_CHUNK_SIZE;
+	}
+
+	// The arena and its first chunk are a single allocation. The size of the
+	// header keeps the chunk aligned.
+	size_t header_sz = (sizeof(as_arena) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	as_arena * arena = (as_arena *) as_malloc(AS_ALLOC_RECORD, header_sz + sizeof(as_arena_chunk) + chunk_size);
+	if ( !arena ) {
+		return NULL;
+	}
+
+	as_arena_chunk * first = (as_arena_chunk *) ((uint8_t *) arena + header_sz);
+	first->next = NULL;
+	first->capacity = chunk_size;
+	first->used = 0;
+
+	arena->current = first;
+	arena->first = first;
+	arena->chunk_size = chunk_size;
+	return arena;
+}
+
+void * as_arena_alloc(as_arena * arena, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	as_arena_chunk * chunk = arena->current;
+
+	if ( chunk->capacity - chunk->used < size ) {
+		chunk = as_arena_chunk_new(size > arena->chunk_size ? size : arena->chunk_size);
+		if ( !chunk ) {
+			return NULL;
+		}
+		chunk->next = arena->current;
+		arena->current = chunk;
+	}
+
+	void * p = chunk->data + chunk->used;
+	chunk->used += size;
+	return p;
+}
+
+bool as_arena_owns(const as_arena * arena, const void * p)
+{
+	const uint8_t * b = (const uint8_t *) p;
+
+	for ( const as_arena_chunk * chunk = arena->current; chunk; chunk = chunk->next ) {
+		if ( b >= chunk->data && b < chunk->data + chunk->capacity ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void as_arena_reset(as_arena * arena)
+{
+	as_arena_chunk * chunk = arena->current;
+
+	while ( chunk != arena->first ) {
+		as_arena_chunk * next = chunk->next;
+		as_free(chunk);
+		chunk = next;
+	}
+
+	arena->first->used = 0;
+	arena->current = arena->first;
+}
+
+void as_arena_destroy(as_arena * arena)
+{
+	if ( arena ) {
+		as_arena_reset(arena);
+		as_free(arena);
+	}
+}
+
+as_arena * as_arena_acquire()
+{
+	as_arena_cache * cache = as_arena_cache_get();
+
+	if ( cache && cache->count > 0 ) {
+		return cache->arenas[--cache->count];
+	}
+	return as_arena_new(0);
+}
+
+void as_arena_release(as_arena * arena)
+{
+	if ( !arena ) {
+		return;
+	}
+
+	as_arena_reset(arena);
+
+	as_arena_cache * cache = as_arena_cache_get();
+
+	if ( cache && cache->count < AS_ARENA_THREAD_CACHE_SIZE ) {
+		cache->arenas[cache->count++] = arena;
+		return;
+	}
+	as_arena_destroy(arena);
+}
@@ -0,0 +1,492 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_bin.h>
+#include <aerospike/as_bin_codec.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_scan.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_vector.h>
+
+#include <citrusleaf/cf_byte_order.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ck_pr.h"
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+typedef struct as_bin_dict_s {
+	uint32_t id;
+	uint32_t size;
+	const as_codec * codec;
+	int level;
+	uint8_t * data;
+} as_bin_dict;
+
+typedef struct as_bin_codec_rule_s {
+	as_namespace ns;
+	as_set set;
+	as_bin_name bin;
+	bool any_set;
+	uint32_t dict_id;
+	uint32_t min_size;
+} as_bin_codec_rule;
+
+typedef struct as_bin_sampler_s {
+	pthread_mutex_t lock;
+	const char * bin;
+	uint32_t max_samples;
+	uint32_t n_samples;
+	size_t * sizes;
+	uint8_t * data;
+	size_t data_sz;
+	size_t data_capacity;
+	bool failed;
+} as_bin_sampler;
+
+/******************************************************************************
+ *	STATIC VARIABLES
+ *****************************************************************************/
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_rwlock_t g_lock = PTHREAD_RWLOCK_INITIALIZER;
+static as_vector g_dicts;
+static as_vector g_rules;
+
+// Read without the lock, so writes of unconfigured clients skip it.
+static uint32_t g_rule_count = 0;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static void as_bin_codec_init()
+{
+	as_vector_init(&g_dicts, sizeof(as_bin_dict), 4);
+	as_vector_init(&g_rules, sizeof(as_bin_codec_rule), 4);
+}
+
+static as_bin_dict * as_bin_dict_find(uint32_t id)
+{
+	for ( uint32_t i = 0; i < g_dicts.size; i++ ) {
+		as_bin_dict * dict = (as_bin_dict *) as_vector_get(&g_dicts, i);
+		if ( dict->id == id ) {
+			return dict;
+		}
+	}
+	return NULL;
+}
+
+static int as_bin_codec_rule_find(const char * ns, const char * set, const char * bin)
+{
+	for ( uint32_t i = 0; i < g_rules.size; i++ ) {
+		as_bin_codec_rule * rule = (as_bin_codec_rule *) as_vector_get(&g_rules, i);
+
+		if ( strcmp(rule->ns, ns) == 0 && strcmp(rule->bin, bin) == 0 &&
+			(rule->any_set ? set == NULL : (set && strcmp(rule->set, set) == 0)) ) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+static const as_bin_codec_rule * as_bin_codec_rule_match(const char * ns, const char * set, const char * bin)
+{
+	for ( uint32_t i = 0; i < g_rules.size; i++ ) {
+		as_bin_codec_rule * rule = (as_bin_codec_rule *) as_vector_get(&g_rules, i);
+
+		if ( strcmp(rule->bin, bin) == 0 && strcmp(rule->ns, ns) == 0 &&
+			(rule->any_set || strcmp(rule->set, set ? set : "") == 0) ) {
+			return rule;
+		}
+	}
+	return NULL;
+}
+
+static bool as_bin_sampler_add(as_bin_sampler * sampler, const uint8_t * value, size_t size)
+{
+	if ( sampler->data_sz + size > sampler->data_capacity ) {
+		size_t capacity = sampler->data_capacity ? sampler->data_capacity : 64 * 1024;
+
+		while ( capacity < sampler->data_sz + size ) {
+			capacity *= 2;
+		}
+
+		uint8_t * data = (uint8_t *) as_realloc(AS_ALLOC_RECORD, sampler->data, capacity);
+		if ( !data ) {
+			return false;
+		}
+		sampler->data = data;
+		sampler->data_capacity = capacity;
+	}
+
+	memcpy(sampler->data + sampler->data_sz, value, size);
+	sampler->data_sz += size;
+	sampler->sizes[sampler->n_samples++] = size;
+	return true;
+}
+
+static bool as_bin_sampler_cb(const as_val * val, void * udata)
+{
+	as_bin_sampler * sampler = (as_bin_sampler *) udata;
+	as_record * rec = as_record_fromval(val);
+
+	if ( !rec ) {
+		return true;
+	}
+
+	as_bin_value * value = as_record_get(rec, sampler->bin);
+	const uint8_t * bytes = NULL;
+	size_t size = 0;
+
+	if ( value && value->nil.type == AS_STRING ) {
+		bytes = (const uint8_t *) as_string_get(&value->string);
+		size = as_string_len(&value->string);
+	}
+	else if ( value && value->nil.type == AS_BYTES ) {
+		bytes = value->bytes.value;
+		size = value->bytes.size;
+	}
+
+	if ( !bytes || size == 0 ) {
+		return true;
+	}
+
+	pthread_mutex_lock(&sampler->lock);
+
+	bool more = sampler->n_samples < sampler->max_samples && !sampler->failed;
+
+	if ( more ) {
+		if ( !as_bin_sampler_add(sampler, bytes, size) ) {
+			sampler->failed = true;
+		}
+		more = sampler->n_samples < sampler->max_samples && !sampler->failed;
+	}
+
+	pthread_mutex_unlock(&sampler->lock);
+	return more;
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+bool as_bin_dict_register(uint32_t id, const as_codec * codec, int level, const uint8_t * dict, uint32_t size)
+{
+	if ( !codec ) {
+		codec = &as_codec_zlib;
+	}
+
+	if ( !codec->compress_dict || !codec->decompress_dict || !dict || size == 0 ) {
+		return false;
+	}
+
+	pthread_once(&g_once, as_bin_codec_init);
+	pthread_rwlock_wrlock(&g_lock);
+
+	as_bin_dict * existing = as_bin_dict_find(id);
+
+	if ( existing ) {
+		// Records already refer to it, so it can be registered again but
+		// never replaced.
+		bool same = existing->codec == codec && existing->size == size &&
+			memcmp(existing->data, dict, size) == 0;
+		pthread_rwlock_unlock(&g_lock);
+		return same;
+	}
+
+	uint8_t * data = (uint8_t *) as_malloc(AS_ALLOC_RECORD, size);
+
+	if ( !data ) {
+		pthread_rwlock_unlock(&g_lock);
+		return false;
+	}
+	memcpy(data, dict, size);
+
+	as_bin_dict entry = {
+		.id = id,
+		.size = size,
+		.codec = codec,
+		.level = level ? level : codec->default_level,
+		.data = data
+	};
+	as_vector_append(&g_dicts, &entry);
+
+	pthread_rwlock_unlock(&g_lock);
+	return true;
+}
+
+as_status as_bin_dict_train(
+	aerospike * as, as_error * err, const as_policy_scan * policy,
+	const char * ns, const char * set, const char * bin,
+	uint32_t id, const as_codec * codec, uint32_t dict_size, uint32_t max_samples,
+	uint8_t ** dict_r, uint32_t * size_r)
+{
+	as_error_reset(err);
+
+	if ( !codec ) {
+		codec = &as_codec_zlib;
+	}
+
+	if ( !codec->train ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Codec %s does not support dictionaries", codec->name);
+	}
+
+	if ( dict_size == 0 || max_samples == 0 ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "Dictionary size and sample count must be positive");
+	}
+
+	as_bin_sampler sampler;
+	memset(&sampler, 0, sizeof(sampler));
+	pthread_mutex_init(&sampler.lock, NULL);
+	sampler.bin = bin;
+	sampler.max_samples = max_samples;
+	sampler.sizes = (size_t *) as_malloc(AS_ALLOC_RECORD, sizeof(size_t) * max_samples);
+
+	uint8_t * dict = (uint8_t *) malloc(dict_size);
+
+	if ( !sampler.sizes || !dict ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate dictionary samples");
+		goto Done;
+	}
+
+	as_scan scan;
+	as_scan_init(&scan, ns, set);
+	as_scan_select_inita(&scan, 1);
+	as_scan_select(&scan, bin);
+
+	as_status status = aerospike_scan_foreach(as, err, policy, &scan, as_bin_sampler_cb, &sampler);
+	as_scan_destroy(&scan);
+
+	if ( sampler.failed ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to allocate dictionary samples");
+		goto Done;
+	}
+
+	// Stopping the scan once enough samples are in is not an error.
+	if ( status != AEROSPIKE_OK && sampler.n_samples < max_samples ) {
+		goto Done;
+	}
+	as_error_reset(err);
+
+	if ( sampler.n_samples == 0 ) {
+		as_error_update(err, AEROSPIKE_ERR_BIN_NOT_FOUND, "No string or blob values of bin %s to sample", bin);
+		goto Done;
+	}
+
+	size_t size = codec->train(sampler.data, sampler.sizes, sampler.n_samples, dict, dict_size);
+
+	if ( size == 0 ) {
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "Failed to train a dictionary from %u samples", sampler.n_samples);
+		goto Done;
+	}
+
+	if ( !as_bin_dict_register(id, codec, 0, dict, (uint32_t) size) ) {
+		as_error_update(err, AEROSPIKE_ERR_PARAM, "Another dictionary is registered under id %u", id);
+		goto Done;
+	}
+
+	if ( dict_r ) {
+		*dict_r = dict;
+		dict = NULL;
+	}
+	if ( size_r ) {
+		*size_r = (uint32_t) size;
+	}
+
+Done:
+	free(dict);
+	as_free(sampler.sizes);
+	as_free(sampler.data);
+	pthread_mutex_destroy(&sampler.lock);
+	return err->code;
+}
+
+bool as_bin_codec_enable(const char * ns, const char * set, const char * bin, uint32_t dict_id, uint32_t min_size)
+{
+	if ( strlen(ns) >= AS_NAMESPACE_MAX_SIZE || (set && strlen(set) >= AS_SET_MAX_SIZE) ||
+		strlen(bin) >= AS_BIN_NAME_MAX_SIZE ) {
+		return false;
+	}
+
+	pthread_once(&g_once, as_bin_codec_init);
+	pthread_rwlock_wrlock(&g_lock);
+
+	if ( !as_bin_dict_find(dict_id) ) {
+		pthread_rwlock_unlock(&g_lock);
+		return false;
+	}
+
+	as_bin_codec_rule rule;
+	memset(&rule, 0, sizeof(rule));
+	strcpy(rule.ns, ns);
+	strcpy(rule.set, set ? set : "");
+	strcpy(rule.bin, bin);
+	rule.any_set = set == NULL;
+	rule.dict_id = dict_id;
+	rule.min_size = min_size;
+
+	int i = as_bin_codec_rule_find(ns, set, bin);
+
+	if ( i >= 0 ) {
+		as_vector_set(&g_rules, (uint32_t) i, &rule);
+	}
+	else {
+		as_vector_append(&g_rules, &rule);
+	}
+	ck_pr_store_32(&g_rule_count, g_rules.size);
+
+	pthread_rwlock_unlock(&g_lock);
+	return true;
+}
+
+void as_bin_codec_disable(const char * ns, const char * set, const char * bin)
+{
+	pthread_once(&g_once, as_bin_codec_init);
+	pthread_rwlock_wrlock(&g_lock);
+
+	int i = as_bin_codec_rule_find(ns, set, bin);
+
+	if ( i >= 0 ) {
+		as_vector_remove(&g_rules, (uint32_t) i);
+		ck_pr_store_32(&g_rule_count, g_rules.size);
+	}
+
+	pthread_rwlock_unlock(&g_lock);
+}
+
+void as_bin_codec_clear()
+{
+	pthread_once(&g_once, as_bin_codec_init);
+	pthread_rwlock_wrlock(&g_lock);
+
+	for ( uint32_t i = 0; i < g_dicts.size; i++ ) {
+		as_free(((as_bin_dict *) as_vector_get(&g_dicts, i))->data);
+	}
+	as_vector_clear(&g_dicts);
+	as_vector_clear(&g_rules);
+	ck_pr_store_32(&g_rule_count, 0);
+
+	pthread_rwlock_unlock(&g_lock);
+}
+
+uint8_t * as_bin_codec_compress(const char * ns, const char * set, const char * bin,
+	as_bytes_type type, const uint8_t * value, uint32_t size, uint32_t * out_sz)
+{
+	if ( ck_pr_load_32(&g_rule_count) == 0 ) {
+		return NULL;
+	}
+
+	// Already compressed, read back as it is without its dictionary.
+	as_bytes_type orig_type;
+	uint32_t orig_sz;
+
+	if ( as_bin_codec_peek(value, size, &orig_type, &orig_sz) ) {
+		return NULL;
+	}
+
+	pthread_rwlock_rdlock(&g_lock);
+
+	const as_bin_codec_rule * rule = as_bin_codec_rule_match(ns, set, bin);
+	as_bin_dict * dict = rule && size >= rule->min_size ? as_bin_dict_find(rule->dict_id) : NULL;
+	uint8_t * out = NULL;
+
+	if ( dict ) {
+		// Only worth it if smaller, so no room for more than the original.
+		size_t capacity = size > AS_BIN_CODEC_HEADER_SIZE ? size - AS_BIN_CODEC_HEADER_SIZE : 0;
+		out = capacity ? (uint8_t *) malloc(AS_BIN_CODEC_HEADER_SIZE + capacity) : NULL;
+
+		if ( out && dict->codec->compress_dict(dict->level, dict->data, dict->size, value, size,
+				out + AS_BIN_CODEC_HEADER_SIZE, &capacity) == 0 ) {
+			uint32_t id = cf_swap_to_be32(dict->id);
+			uint32_t sz = cf_swap_to_be32(size);
+			memcpy(out, AS_BIN_CODEC_TAG, 4);
+			out[4] = (uint8_t) type;
+			memcpy(out + 5, &id, sizeof(id));
+			memcpy(out + 9, &sz, sizeof(sz));
+			*out_sz = (uint32_t) (AS_BIN_CODEC_HEADER_SIZE + capacity);
+		}
+		else {
+			free(out);
+			out = NULL;
+		}
+	}
+
+	pthread_rwlock_unlock(&g_lock);
+	return out;
+}
+
+bool as_bin_codec_peek(const uint8_t * value, uint32_t size, as_bytes_type * type_r, uint32_t * out_sz_r)
+{
+	if ( size < AS_BIN_CODEC_HEADER_SIZE || memcmp(value, AS_BIN_CODEC_TAG, 4) != 0 ) {
+		return false;
+	}
+
+	switch ( value[4] ) {
+		case AS_BYTES_STRING:
+		case AS_BYTES_BLOB:
+		case AS_BYTES_JAVA:
+		case AS_BYTES_CSHARP:
+		case AS_BYTES_PYTHON:
+		case AS_BYTES_RUBY:
+		case AS_BYTES_PHP:
+		case AS_BYTES_ERLANG:
+			break;
+		default:
+			return false;
+	}
+
+	uint32_t sz;
+	memcpy(&sz, value + 9, sizeof(sz));
+	sz = cf_swap_from_be32(sz);
+
+	if ( sz > AS_CODEC_MAX_SIZE ) {
+		return false;
+	}
+
+	*type_r = (as_bytes_type) value[4];
+	*out_sz_r = sz;
+	return true;
+}
+
+bool as_bin_codec_decompress(const uint8_t * value, uint32_t size, uint8_t * out, uint32_t out_sz)
+{
+	if ( size < AS_BIN_CODEC_HEADER_SIZE ) {
+		return false;
+	}
+
+	uint32_t id;
+	memcpy(&id, value + 5, sizeof(id));
+	id = cf_swap_from_be32(id);
+
+	pthread_once(&g_once, as_bin_codec_init);
+	pthread_rwlock_rdlock(&g_lock);
+
+	as_bin_dict * dict = as_bin_dict_find(id);
+	bool ok = dict && dict->codec->decompress_dict(dict->data, dict->size,
+		value + AS_BIN_CODEC_HEADER_SIZE, size - AS_BIN_CODEC_HEADER_SIZE, out, out_sz) == 0;
+
+	pthread_rwlock_unlock(&g_lock);
+	return ok;
+}
@@ -133,7 +133,7 @@ static as_nodes*
 as_nodes_create(uint32_t capacity)
 {
 	size_t size = sizeof(as_nodes) + (sizeof(as_node*) * capacity);
-	as_nodes* nodes = cf_malloc(size);
+	as_nodes* nodes = as_malloc(AS_ALLOC_TEND, size);
 	memset(nodes, 0, size);
 	nodes->ref_count = 1;
 	nodes->size = capacity;
@@ -319,11 +319,20 @@ as_cluster_find_nodes_to_remove(as_cluster* cluster, uint32_t refresh_count, as_
 			as_vector_append(nodes_to_remove, &node);
 			continue;
 		}
-		
+
+		// Transactions failing on the node confirm an info request failure,
+		// so the node need not wait for other nodes to drop it.
+		bool unreachable = node->failures > 0 && as_node_breaker_is_open(node);
+
+		if (unreachable && nodes->size > 1 && refresh_count > 0) {
+			as_vector_append(nodes_to_remove, &node);
+			continue;
+		}
+
 		switch (nodes->size) {
 			case 1:
 				// Single node clusters rely on whether it responded to info requests.
-				if (node->failures >= 5) {
+				if (node->failures >= 5 || unreachable) {
 					// 5 consecutive info requests failed. Try seeds.
 					if (as_cluster_seed_nodes(cluster, false) == 0) {
 						// Seed nodes found. Remove unresponsive node.
@@ -573,6 +582,8 @@ as_cluster_tend(as_cluster* cluster, bool enable_seed_warnings)
 		as_node* node = nodes->array[i];
 		
 		if (node->active) {
+			as_node_latency_decay(node);
+			
 			if (as_node_refresh(cluster, node, &friends)) {
 				node->failures = 0;
 				refresh_count++;
@@ -761,6 +772,22 @@ ip_map_create(as_addr_map* source_map, uint32_t size)
 	return target_map;
 }
 
+static as_zone_map*
+zone_map_create(as_zone_map* source_map, uint32_t size)
+{
+	as_zone_map* target_map = cf_malloc(sizeof(as_zone_map) * size);
+	as_zone_map* target = target_map;
+	as_zone_map* source = source_map;
+
+	for (uint32_t i = 0; i < size; i++) {
+		target->addr = cf_strdup(source->addr);
+		target->zone = cf_strdup(source->zone);
+		source++;
+		target++;
+	}
+	return target_map;
+}
+
 as_node*
 as_node_get_random(as_cluster* cluster)
 {
@@ -829,6 +856,32 @@ as_cluster_get_node_names(as_cluster* cluster, int* n_nodes, char** node_names)
 	as_nodes_release(nodes);
 }
 
+void
+as_cluster_get_hedge_stats(as_cluster* cluster, as_hedge_stats* stats)
+{
+	stats->slow = ck_pr_load_64(&cluster->hedge_stats.slow);
+	stats->hedged = ck_pr_load_64(&cluster->hedge_stats.hedged);
+	stats->won = ck_pr_load_64(&cluster->hedge_stats.won);
+	stats->throttled = ck_pr_load_64(&cluster->hedge_stats.throttled);
+}
+
+void
+as_cluster_get_retry_stats(as_cluster* cluster, as_retry_stats* stats)
+{
+	stats->attempts = ck_pr_load_64(&cluster->retry_stats.attempts);
+	stats->retries = ck_pr_load_64(&cluster->retry_stats.retries);
+	stats->replica_retries = ck_pr_load_64(&cluster->retry_stats.replica_retries);
+	stats->recovered = ck_pr_load_64(&cluster->retry_stats.recovered);
+}
+
+void
+as_cluster_get_zone_stats(as_cluster* cluster, as_zone_stats* stats)
+{
+	stats->local = ck_pr_load_64(&cluster->zone_stats.local);
+	stats->remote = ck_pr_load_64(&cluster->zone_stats.remote);
+	stats->unhealthy = ck_pr_load_64(&cluster->zone_stats.unhealthy);
+}
+
 bool
 as_cluster_is_connected(as_cluster* cluster)
 {
@@ -870,6 +923,13 @@ as_cluster_create(as_config* config, as_cluster** cluster_out)
 	cluster->tend_interval = (config->tender_interval < 1000)? 1000 : config->tender_interval;
 	cluster->conn_queue_size = config->max_threads + 1;  // Add one connection for tend thread.
 	cluster->conn_timeout_ms = (config->conn_timeout_ms == 0) ? 1000 : config->conn_timeout_ms;
+	cluster->codec = config->codec ? config->codec : &as_codec_zlib;
+	cluster->codec_level = config->codec_level;
+	cluster->hedge_max_percent = config->hedge_max_percent;
+	cluster->breaker_threshold = config->breaker_threshold;
+	cluster->breaker_open_ms = config->breaker_open_ms;
+	cluster->adaptive_timeout_percentile = config->adaptive_timeout_percentile > 100 ? 100 : config->adaptive_timeout_percentile;
+	cluster->adaptive_timeout_multiplier = config->adaptive_timeout_multiplier;
 	
 	// Initialize seed hosts.
 	cluster->seeds_size = seeds_size(config);
@@ -881,6 +941,15 @@ as_cluster_create(as_config* config, as_cluster** cluster_out)
 		cluster->ip_map = ip_map_create(config->ip_map, config->ip_map_size);
 	}
 
+	// Initialize zones if provided.
+	as_strncpy(cluster->zone, config->zone, sizeof(cluster->zone));
+	as_strncpy(cluster->zone_info_name, config->zone_info_name, sizeof(cluster->zone_info_name));
+	
+	if (config->zone_map && config->zone_map_size > 0) {
+		cluster->zone_map_size = config->zone_map_size;
+		cluster->zone_map = zone_map_create(config->zone_map, config->zone_map_size);
+	}
+
 	// Initialize empty nodes.
 	cluster->nodes = as_nodes_create(0);
 	
@@ -968,6 +1037,17 @@ as_cluster_destroy(as_cluster* cluster)
 		cf_free(cluster->ip_map);
 	}
 
+	// Destroy zone map.
+	if (cluster->zone_map) {
+		as_zone_map* entry = cluster->zone_map;
+		for (uint32_t i = 0; i < cluster->zone_map_size; i++) {
+			cf_free(entry->addr);
+			cf_free(entry->zone);
+			entry++;
+		}
+		cf_free(cluster->zone_map);
+	}
+
 	// Destroy seeds.
 	as_seed* seed = cluster->seeds;
 	for (uint32_t i = 0; i < cluster->seeds_size; i++) {
@@ -0,0 +1,569 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_codec.h>
+
+#include <citrusleaf/cf_proto.h>
+#include <citrusleaf/cl_buf_cache.h>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef AS_USE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef AS_USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+/**
+ *	Dictionary training: length of the substrings counted, and of the
+ *	segments copied into the dictionary around the frequent ones.
+ */
+#define TRAIN_GRAM 8
+#define TRAIN_SEGMENT 32
+
+/**
+ *	Largest dictionary zlib can use: its window.
+ */
+#define ZLIB_DICT_MAX (32 * 1024)
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+typedef struct as_train_entry_s {
+	uint32_t hash;
+	uint32_t count;
+	uint32_t offset;
+	uint32_t sample;
+} as_train_entry;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static inline uint32_t as_train_hash(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	uint32_t h = (uint32_t) ((v * 0x9E3779B97F4A7C15ULL) >> 32);
+	return h ? h : 1;
+}
+
+static as_train_entry * as_train_find(as_train_entry * table, uint32_t mask, uint32_t hash)
+{
+	uint32_t i = hash & mask;
+
+	while ( table[i].hash && table[i].hash != hash ) {
+		i = (i + 1) & mask;
+	}
+	return &table[i];
+}
+
+static int as_train_entry_cmp(const void * a, const void * b)
+{
+	const as_train_entry * ea = *(const as_train_entry **) a;
+	const as_train_entry * eb = *(const as_train_entry **) b;
+
+	if ( ea->count != eb->count ) {
+		return ea->count > eb->count ? -1 : 1;
+	}
+	return ea->offset < eb->offset ? -1 : (ea->offset > eb->offset);
+}
+
+/**
+ *	Dictionary training for codecs without a trainer of their own. Counts in
+ *	how many samples each short substring appears, then fills the dictionary
+ *	with the segments around the most common ones, skipping substrings an
+ *	earlier segment already holds. The most common segments go last, where
+ *	an LZ77 window finds them at the shortest distance.
+ */
+static size_t as_train_segments(const uint8_t * samples, const size_t * sizes, uint32_t n,
+	uint8_t * dict, size_t capacity)
+{
+	size_t total = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		total += sizes[i];
+	}
+
+	if ( total < TRAIN_GRAM || total > UINT32_MAX || capacity == 0 ) {
+		return 0;
+	}
+
+	uint32_t slots = 1024;
+
+	while ( slots < total * 2 && slots < (1 << 22) ) {
+		slots <<= 1;
+	}
+
+	uint32_t mask = slots - 1;
+	uint32_t limit = slots / 4 * 3;
+	uint32_t used = 0;
+	size_t * ends = (size_t *) as_malloc(AS_ALLOC_RECORD, sizeof(size_t) * n);
+	as_train_entry * table = (as_train_entry *) as_calloc(AS_ALLOC_RECORD, slots, sizeof(as_train_entry));
+
+	if ( !ends || !table ) {
+		as_free(ends);
+		as_free(table);
+		return 0;
+	}
+
+	size_t start = 0;
+
+	for ( uint32_t i = 0; i < n; i++ ) {
+		ends[i] = start + sizes[i];
+
+		for ( size_t p = start; p + TRAIN_GRAM <= ends[i]; p++ ) {
+			uint32_t hash = as_train_hash(samples + p);
+			as_train_entry * e = as_train_find(table, mask, hash);
+
+			if ( e->hash ) {
+				// Count samples, not repetitions within one.
+				if ( e->sample != i ) {
+					e->count++;
+					e->sample = i;
+				}
+			}
+			else if ( used < limit ) {
+				e->hash = hash;
+				e->count = 1;
+				e->offset = (uint32_t) p;
+				e->sample = i;
+				used++;
+			}
+		}
+		start = ends[i];
+	}
+
+	// Only substrings shared by several samples are worth a place.
+	as_train_entry ** ranked = (as_train_entry **) as_malloc(AS_ALLOC_RECORD, sizeof(as_train_entry *) * used);
+	uint32_t n_ranked = 0;
+
+	if ( !ranked ) {
+		as_free(ends);
+		as_free(table);
+		return 0;
+	}
+
+	for ( uint32_t i = 0; i < slots; i++ ) {
+		if ( table[i].count > 1 ) {
+			ranked[n_ranked++] = &table[i];
+		}
+	}
+
+	qsort(ranked, n_ranked, sizeof(as_train_entry *), as_train_entry_cmp);
+
+	// Find each segment's sample from its offset, to not run into the next.
+	size_t off = capacity;
+
+	for ( uint32_t r = 0; r < n_ranked && off > 0; r++ ) {
+		as_train_entry * e = ranked[r];
+
+		if ( e->count == 0 ) {
+			continue;
+		}
+
+		uint32_t lo = 0, hi = n;
+
+		while ( lo < hi ) {
+			uint32_t mid = (lo + hi) / 2;
+			if ( ends[mid] <= e->offset ) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+
+		size_t len = ends[lo] - e->offset;
+
+		if ( len > TRAIN_SEGMENT ) {
+			len = TRAIN_SEGMENT;
+		}
+		if ( len > off ) {
+			len = off;
+		}
+
+		const uint8_t * seg = samples + e->offset;
+		off -= len;
+		memcpy(dict + off, seg, len);
+
+		for ( size_t p = 0; p + TRAIN_GRAM <= len; p++ ) {
+			as_train_find(table, mask, as_train_hash(seg + p))->count = 0;
+		}
+	}
+
+	as_free(ranked);
+	as_free(ends);
+	as_free(table);
+
+	size_t dict_sz = capacity - off;
+	memmove(dict, dict + off, dict_sz);
+	return dict_sz;
+}
+
+static size_t as_zlib_bound(size_t size)
+{
+	return size > ULONG_MAX ? 0 : (size_t) compressBound((uLong) size);
+}
+
+static int as_zlib_compress(int level, const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz)
+{
+	uLongf n = (uLongf) *out_sz;
+
+	if ( compress2(out, &n, in, (uLong) in_sz, level) != Z_OK ) {
+		return -1;
+	}
+	*out_sz = (size_t) n;
+	return 0;
+}
+
+static int as_zlib_decompress(const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz)
+{
+	uLongf n = (uLongf) out_sz;
+
+	if ( uncompress(out, &n, in, (uLong) in_sz) != Z_OK || n != out_sz ) {
+		return -1;
+	}
+	return 0;
+}
+
+static int as_zlib_compress_dict(int level, const uint8_t * dict, size_t dict_sz,
+	const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz)
+{
+	if ( in_sz > UINT_MAX || *out_sz > UINT_MAX ) {
+		return -1;
+	}
+
+	if ( dict_sz > ZLIB_DICT_MAX ) {
+		dict += dict_sz - ZLIB_DICT_MAX;
+		dict_sz = ZLIB_DICT_MAX;
+	}
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	if ( deflateInit(&zs, level) != Z_OK ) {
+		return -1;
+	}
+
+	int rc = -1;
+
+	if ( deflateSetDictionary(&zs, dict, (uInt) dict_sz) == Z_OK ) {
+		zs.next_in = (Bytef *) in;
+		zs.avail_in = (uInt) in_sz;
+		zs.next_out = out;
+		zs.avail_out = (uInt) *out_sz;
+
+		if ( deflate(&zs, Z_FINISH) == Z_STREAM_END ) {
+			*out_sz = (size_t) zs.total_out;
+			rc = 0;
+		}
+	}
+
+	deflateEnd(&zs);
+	return rc;
+}
+
+static int as_zlib_decompress_dict(const uint8_t * dict, size_t dict_sz,
+	const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz)
+{
+	if ( in_sz > UINT_MAX || out_sz > UINT_MAX ) {
+		return -1;
+	}
+
+	if ( dict_sz > ZLIB_DICT_MAX ) {
+		dict += dict_sz - ZLIB_DICT_MAX;
+		dict_sz = ZLIB_DICT_MAX;
+	}
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	zs.next_in = (Bytef *) in;
+	zs.avail_in = (uInt) in_sz;
+
+	if ( inflateInit(&zs) != Z_OK ) {
+		return -1;
+	}
+
+	zs.next_out = out;
+	zs.avail_out = (uInt) out_sz;
+
+	int z = inflate(&zs, Z_FINISH);
+
+	if ( z == Z_NEED_DICT && inflateSetDictionary(&zs, dict, (uInt) dict_sz) == Z_OK ) {
+		z = inflate(&zs, Z_FINISH);
+	}
+
+	int rc = (z == Z_STREAM_END && zs.total_out == out_sz) ? 0 : -1;
+	inflateEnd(&zs);
+	return rc;
+}
+
+static size_t as_zlib_train(const uint8_t * samples, const size_t * sizes, uint32_t n,
+	uint8_t * dict, size_t capacity)
+{
+	return as_train_segments(samples, sizes, n, dict, capacity < ZLIB_DICT_MAX ? capacity : ZLIB_DICT_MAX);
+}
+
+#ifdef AS_USE_LZ4
+static size_t as_lz4_bound(size_t size)
+{
+	return size > LZ4_MAX_INPUT_SIZE ? 0 : (size_t) LZ4_compressBound((int) size);
+}
+
+static int as_lz4_compress(int level, const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz)
+{
+	if ( in_sz > LZ4_MAX_INPUT_SIZE ) {
+		return -1;
+	}
+
+	int capacity = *out_sz > INT_MAX ? INT_MAX : (int) *out_sz;
+	int n = LZ4_compress_fast((const char *) in, (char *) out, (int) in_sz, capacity, level);
+
+	if ( n <= 0 ) {
+		return -1;
+	}
+	*out_sz = (size_t) n;
+	return 0;
+}
+
+static int as_lz4_decompress(const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz)
+{
+	if ( in_sz > INT_MAX || out_sz > INT_MAX ) {
+		return -1;
+	}
+
+	int n = LZ4_decompress_safe((const char *) in, (char *) out, (int) in_sz, (int) out_sz);
+	return n == (int) out_sz ? 0 : -1;
+}
+#endif
+
+#ifdef AS_USE_ZSTD
+static size_t as_zstd_bound(size_t size)
+{
+	return ZSTD_compressBound(size);
+}
+
+static int as_zstd_compress(int level, const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz)
+{
+	size_t n = ZSTD_compress(out, *out_sz, in, in_sz, level);
+
+	if ( ZSTD_isError(n) ) {
+		return -1;
+	}
+	*out_sz = n;
+	return 0;
+}
+
+static int as_zstd_decompress(const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz)
+{
+	size_t n = ZSTD_decompress(out, out_sz, in, in_sz);
+	return (ZSTD_isError(n) || n != out_sz) ? -1 : 0;
+}
+
+static int as_zstd_compress_dict(int level, const uint8_t * dict, size_t dict_sz,
+	const uint8_t * in, size_t in_sz, uint8_t * out, size_t * out_sz)
+{
+	ZSTD_CCtx * ctx = ZSTD_createCCtx();
+
+	if ( !ctx ) {
+		return -1;
+	}
+
+	size_t n = ZSTD_compress_usingDict(ctx, out, *out_sz, in, in_sz, dict, dict_sz, level);
+	ZSTD_freeCCtx(ctx);
+
+	if ( ZSTD_isError(n) ) {
+		return -1;
+	}
+	*out_sz = n;
+	return 0;
+}
+
+static int as_zstd_decompress_dict(const uint8_t * dict, size_t dict_sz,
+	const uint8_t * in, size_t in_sz, uint8_t * out, size_t out_sz)
+{
+	ZSTD_DCtx * ctx = ZSTD_createDCtx();
+
+	if ( !ctx ) {
+		return -1;
+	}
+
+	size_t n = ZSTD_decompress_usingDict(ctx, out, out_sz, in, in_sz, dict, dict_sz);
+	ZSTD_freeDCtx(ctx);
+	return (ZSTD_isError(n) || n != out_sz) ? -1 : 0;
+}
+
+static size_t as_zstd_train(const uint8_t * samples, const size_t * sizes, uint32_t n,
+	uint8_t * dict, size_t capacity)
+{
+	size_t sz = ZDICT_trainFromBuffer(dict, capacity, samples, sizes, n);
+	return ZDICT_isError(sz) ? 0 : sz;
+}
+#endif
+
+/******************************************************************************
+ *	GLOBAL VARIABLES
+ *****************************************************************************/
+
+const as_codec as_codec_zlib = {
+	.name = "zlib",
+	.default_level = Z_BEST_SPEED,
+	.bound = as_zlib_bound,
+	.compress = as_zlib_compress,
+	.decompress = as_zlib_decompress,
+	.compress_dict = as_zlib_compress_dict,
+	.decompress_dict = as_zlib_decompress_dict,
+	.train = as_zlib_train
+};
+
+#ifdef AS_USE_LZ4
+const as_codec as_codec_lz4 = {
+	.name = "lz4",
+	.default_level = 1,
+	.bound = as_lz4_bound,
+	.compress = as_lz4_compress,
+	.decompress = as_lz4_decompress,
+	.compress_dict = NULL,
+	.decompress_dict = NULL,
+	.train = NULL
+};
+#endif
+
+#ifdef AS_USE_ZSTD
+const as_codec as_codec_zstd = {
+	.name = "zstd",
+	.default_level = 1,
+	.bound = as_zstd_bound,
+	.compress = as_zstd_compress,
+	.decompress = as_zstd_decompress,
+	.compress_dict = as_zstd_compress_dict,
+	.decompress_dict = as_zstd_decompress_dict,
+	.train = as_zstd_train
+};
+#endif
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+const as_codec * as_codec_find(const char * name)
+{
+	if ( strcmp(name, as_codec_zlib.name) == 0 ) {
+		return &as_codec_zlib;
+	}
+#ifdef AS_USE_LZ4
+	if ( strcmp(name, as_codec_lz4.name) == 0 ) {
+		return &as_codec_lz4;
+	}
+#endif
+#ifdef AS_USE_ZSTD
+	if ( strcmp(name, as_codec_zstd.name) == 0 ) {
+		return &as_codec_zstd;
+	}
+#endif
+	return NULL;
+}
+
+int as_codec_compress_proto(const as_codec * codec, int level, const uint8_t * buf, size_t buf_sz,
+	uint8_t ** frame_r, size_t * frame_sz_r)
+{
+	if ( !codec ) {
+		codec = &as_codec_zlib;
+	}
+	if ( level == 0 ) {
+		level = codec->default_level;
+	}
+
+	size_t bound = codec->bound(buf_sz);
+
+	if ( bound == 0 ) {
+		return -1;
+	}
+
+	uint8_t * frame = cl_buf_acquire(sizeof(cl_comp_proto) + bound);
+
+	if ( !frame ) {
+		return -1;
+	}
+
+	cl_comp_proto * comp = (cl_comp_proto *) frame;
+	size_t data_sz = bound;
+
+	// Keep the request as is unless compressing saves something.
+	if ( codec->compress(level, buf, buf_sz, comp->data, &data_sz) != 0 ||
+		sizeof(cl_comp_proto) + data_sz >= buf_sz ) {
+		cl_buf_release(frame);
+		return -1;
+	}
+
+	comp->proto.version = CL_PROTO_VERSION;
+	comp->proto.type = CL_PROTO_TYPE_CL_MSG_COMPRESSED;
+	comp->proto.sz = sizeof(cl_comp_proto) - sizeof(cl_proto) + data_sz;
+	cl_proto_swap_to_be(&comp->proto);
+	comp->org_sz = buf_sz;
+
+	*frame_r = frame;
+	*frame_sz_r = sizeof(cl_comp_proto) + data_sz;
+	return 0;
+}
+
+int as_codec_decompress_body(const as_codec * codec, const uint8_t * body, size_t body_sz,
+	uint8_t ** out_r, size_t * out_sz_r)
+{
+	if ( !codec ) {
+		codec = &as_codec_zlib;
+	}
+
+	// The original size is sent in host order, as cf_packet_compression() does.
+	uint64_t org_sz;
+
+	if ( body_sz < sizeof(org_sz) ) {
+		return -1;
+	}
+	memcpy(&org_sz, body, sizeof(org_sz));
+
+	if ( org_sz == 0 || org_sz > AS_CODEC_MAX_SIZE ) {
+		return -1;
+	}
+
+	uint8_t * out = cl_buf_acquire((size_t) org_sz);
+
+	if ( !out ) {
+		return -1;
+	}
+
+	if ( codec->decompress(body + sizeof(org_sz), body_sz - sizeof(org_sz), out, (size_t) org_sz) != 0 ) {
+		cl_buf_release(out);
+		return -1;
+	}
+
+	*out_r = out;
+	*out_sz_r = (size_t) org_sz;
+	return 0;
+}
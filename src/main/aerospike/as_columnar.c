@@ -0,0 +1,213 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_columnar.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static inline void as_column_set_valid(as_column * column, uint32_t row)
+{
+	column->validity[row >> 3] |= (uint8_t)(1 << (row & 7));
+}
+
+static inline uint32_t as_column_validity_size(uint32_t capacity)
+{
+	return (capacity + 7) / 8;
+}
+
+static void as_column_destroy(as_column * column)
+{
+	free(column->validity);
+	free(column->values);
+	free(column->offsets);
+	free(column->data);
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_columnar_batch * as_columnar_batch_init(as_columnar_batch * batch, uint32_t capacity)
+{
+	if ( !batch ) return batch;
+
+	batch->n_rows = 0;
+	batch->capacity = capacity ? capacity : 1;
+	batch->n_columns = 0;
+	batch->columns = NULL;
+	return batch;
+}
+
+as_column * as_columnar_batch_add_column(as_columnar_batch * batch, const char * name, as_column_type type)
+{
+	if ( !batch || !name || batch->n_rows > 0 ) {
+		return NULL;
+	}
+
+	size_t name_sz = strlen(name);
+	if ( name_sz == 0 || name_sz >= AS_BIN_NAME_MAX_SIZE ) {
+		return NULL;
+	}
+
+	as_column * columns = (as_column *) realloc(batch->columns, sizeof(as_column) * (batch->n_columns + 1));
+	if ( !columns ) {
+		return NULL;
+	}
+	batch->columns = columns;
+
+	as_column * column = &columns[batch->n_columns];
+	memset(column, 0, sizeof(as_column));
+	memcpy(column->name, name, name_sz + 1);
+	column->type = type;
+	column->validity = (uint8_t *) calloc(as_column_validity_size(batch->capacity), 1);
+
+	if ( type == AS_COLUMN_INT64 ) {
+		column->values = (int64_t *) malloc(sizeof(int64_t) * batch->capacity);
+	}
+	else {
+		column->offsets = (int32_t *) calloc(batch->capacity + 1, sizeof(int32_t));
+	}
+
+	if ( !column->validity || (!column->values && !column->offsets) ) {
+		as_column_destroy(column);
+		return NULL;
+	}
+
+	batch->n_columns++;
+	return column;
+}
+
+int as_columnar_batch_find_column(const as_columnar_batch * batch, const char * name, uint32_t name_sz)
+{
+	if ( name_sz >= AS_BIN_NAME_MAX_SIZE ) {
+		return -1;
+	}
+
+	for ( uint32_t i = 0; i < batch->n_columns; i++ ) {
+		const char * column_name = batch->columns[i].name;
+		if ( memcmp(column_name, name, name_sz) == 0 && column_name[name_sz] == 0 ) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+void as_columnar_batch_clear(as_columnar_batch * batch)
+{
+	for ( uint32_t i = 0; i < batch->n_columns; i++ ) {
+		as_column * column = &batch->columns[i];
+		memset(column->validity, 0, as_column_validity_size(batch->capacity));
+		column->null_count = 0;
+		column->data_size = 0;
+	}
+	batch->n_rows = 0;
+}
+
+void as_columnar_batch_destroy(as_columnar_batch * batch)
+{
+	if ( !batch ) return;
+
+	for ( uint32_t i = 0; i < batch->n_columns; i++ ) {
+		as_column_destroy(&batch->columns[i]);
+	}
+	free(batch->columns);
+	batch->columns = NULL;
+	batch->n_columns = 0;
+	batch->n_rows = 0;
+}
+
+bool as_column_set_int64(as_columnar_batch * batch, as_column * column, int64_t value)
+{
+	uint32_t row = batch->n_rows;
+
+	if ( column->type != AS_COLUMN_INT64 || row >= batch->capacity ) {
+		return false;
+	}
+
+	column->values[row] = value;
+	as_column_set_valid(column, row);
+	return true;
+}
+
+bool as_column_set_bytes(as_columnar_batch * batch, as_column * column, const uint8_t * value, uint32_t size)
+{
+	uint32_t row = batch->n_rows;
+
+	if ( column->type == AS_COLUMN_INT64 || row >= batch->capacity ) {
+		return false;
+	}
+
+	// Arrow offsets are signed 32 bit.
+	uint64_t needed = (uint64_t) column->data_size + size;
+	if ( needed > INT32_MAX ) {
+		return false;
+	}
+
+	if ( needed > column->data_capacity ) {
+		uint64_t capacity = column->data_capacity ? column->data_capacity : 1024;
+		while ( capacity < needed ) {
+			capacity *= 2;
+		}
+		if ( capacity > INT32_MAX ) {
+			capacity = INT32_MAX;
+		}
+
+		uint8_t * data = (uint8_t *) realloc(column->data, capacity);
+		if ( !data ) {
+			return false;
+		}
+		column->data = data;
+		column->data_capacity = (uint32_t) capacity;
+	}
+
+	memcpy(column->data + column->data_size, value, size);
+	column->data_size += size;
+	column->offsets[row + 1] = (int32_t) column->data_size;
+	as_column_set_valid(column, row);
+	return true;
+}
+
+void as_columnar_batch_end_row(as_columnar_batch * batch)
+{
+	uint32_t row = batch->n_rows;
+
+	if ( row >= batch->capacity ) {
+		return;
+	}
+
+	for ( uint32_t i = 0; i < batch->n_columns; i++ ) {
+		as_column * column = &batch->columns[i];
+
+		if ( as_column_is_valid(column, row) ) {
+			continue;
+		}
+
+		column->null_count++;
+
+		if ( column->type == AS_COLUMN_INT64 ) {
+			column->values[row] = 0;
+		}
+		else {
+			column->offsets[row + 1] = (int32_t) column->data_size;
+		}
+	}
+	batch->n_rows++;
+}
@@ -55,7 +55,23 @@ as_config * as_config_init(as_config * c)
 	c->shm_key = 0xA5000000;
 	c->shm_max_nodes = 16;
 	c->shm_max_namespaces = 8;
+	c->shm_max_processes = 64;
+	c->shm_huge_pages = false;
+	c->shm_numa_node = -1;
+	c->shm_double_buffer = false;
 	c->shm_takeover_threshold_sec = 30;
+	c->allocator = NULL;
+	c->codec = NULL;
+	c->codec_level = 0;
+	c->hedge_max_percent = 5;
+	c->breaker_threshold = 10;
+	c->breaker_open_ms = 1000;
+	c->adaptive_timeout_percentile = 99;
+	c->adaptive_timeout_multiplier = 3;
+	memset(c->zone, 0, sizeof(c->zone));
+	c->zone_map = 0;
+	c->zone_map_size = 0;
+	memset(c->zone_info_name, 0, sizeof(c->zone_info_name));
 	return c;
 }
 
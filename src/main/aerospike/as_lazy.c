@@ -0,0 +1,539 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_buffer.h>
+#include <aerospike/as_iterator.h>
+#include <aerospike/as_lazy.h>
+#include <aerospike/as_msgpack.h>
+#include <aerospike/as_serializer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+/**
+ *	State behind a lazy list or map. The serialized form stays valid until
+ *	the decoded value may have been modified.
+ */
+typedef struct as_lazy_s {
+	uint8_t * data;
+	uint32_t size;
+	bool free;
+
+	// Deserialized on first access, NULL until then or if it failed.
+	as_val * decoded;
+	bool failed;
+
+	// The decoded value holds lists or maps, which callers can modify.
+	bool nested;
+
+	// The serialized form no longer matches the value.
+	bool stale;
+} as_lazy;
+
+/******************************************************************************
+ *	STATIC VARIABLES
+ *****************************************************************************/
+
+static const as_list_hooks as_lazy_list_hooks;
+static const as_map_hooks as_lazy_map_hooks;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static as_lazy * as_lazy_create(uint8_t * data, uint32_t size, bool free)
+{
+	as_lazy * lazy = (as_lazy *) as_calloc(AS_ALLOC_RECORD, 1, sizeof(as_lazy));
+	if ( !lazy ) {
+		return NULL;
+	}
+	lazy->data = data;
+	lazy->size = size;
+	lazy->free = free;
+	return lazy;
+}
+
+static void as_lazy_destroy(as_lazy * lazy)
+{
+	if ( lazy->decoded ) {
+		as_val_destroy(lazy->decoded);
+	}
+	if ( lazy->free ) {
+		free(lazy->data);
+	}
+	as_free(lazy);
+}
+
+/**
+ *	Element count from a msgpack array or map header, without decoding the
+ *	elements. Returns false if the header is not of the expected kind.
+ */
+static bool as_lazy_header_count(const as_lazy * lazy, bool map, uint32_t * count)
+{
+	if ( lazy->size < 1 ) {
+		return false;
+	}
+
+	const uint8_t * p = lazy->data;
+	uint8_t fix = map ? 0x80 : 0x90;
+	uint8_t b16 = map ? 0xde : 0xdc;
+
+	if ( (p[0] & 0xf0) == fix ) {
+		*count = p[0] & 0x0f;
+		return true;
+	}
+	if ( p[0] == b16 && lazy->size >= 3 ) {
+		*count = ((uint32_t) p[1] << 8) | p[2];
+		return true;
+	}
+	if ( p[0] == b16 + 1 && lazy->size >= 5 ) {
+		*count = ((uint32_t) p[1] << 24) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 8) | p[4];
+		return true;
+	}
+	return false;
+}
+
+static bool as_lazy_find_nested_cb(const as_val * key, const as_val * value, void * udata)
+{
+	as_val_t t = as_val_type(value);
+
+	if ( t == AS_LIST || t == AS_MAP || (key && (as_val_type(key) == AS_LIST || as_val_type(key) == AS_MAP)) ) {
+		*(bool *) udata = true;
+		return false;
+	}
+	return true;
+}
+
+static bool as_lazy_find_nested_list_cb(as_val * value, void * udata)
+{
+	return as_lazy_find_nested_cb(NULL, value, udata);
+}
+
+static as_val * as_lazy_decode(as_lazy * lazy, as_val_t type)
+{
+	if ( lazy->decoded || lazy->failed ) {
+		return lazy->decoded;
+	}
+
+	as_buffer buffer;
+	buffer.data = lazy->data;
+	buffer.size = lazy->size;
+	buffer.capacity = lazy->size;
+
+	as_val * val = NULL;
+
+	as_serializer ser;
+	as_msgpack_init(&ser);
+	as_serializer_deserialize(&ser, &buffer, &val);
+	as_serializer_destroy(&ser);
+
+	if ( !val || as_val_type(val) != type ) {
+		if ( val ) {
+			as_val_destroy(val);
+		}
+		lazy->failed = true;
+		return NULL;
+	}
+
+	if ( type == AS_LIST ) {
+		as_list_foreach((as_list *) val, as_lazy_find_nested_list_cb, &lazy->nested);
+	}
+	else {
+		as_map_foreach((as_map *) val, as_lazy_find_nested_cb, &lazy->nested);
+	}
+
+	lazy->decoded = val;
+	return val;
+}
+
+/**
+ *	Decoded list for reading scalars.
+ */
+static inline as_list * as_lazy_list_read(const as_list * list)
+{
+	return (as_list *) as_lazy_decode((as_lazy *) list->data, AS_LIST);
+}
+
+/**
+ *	Decoded list for handing out elements, which may be modified if they
+ *	are lists or maps.
+ */
+static inline as_list * as_lazy_list_expose(const as_list * list)
+{
+	as_lazy * lazy = (as_lazy *) list->data;
+	as_list * decoded = (as_list *) as_lazy_decode(lazy, AS_LIST);
+
+	if ( lazy->nested ) {
+		lazy->stale = true;
+	}
+	return decoded;
+}
+
+/**
+ *	Decoded list for modifying.
+ */
+static inline as_list * as_lazy_list_write(as_list * list)
+{
+	as_lazy * lazy = (as_lazy *) list->data;
+	as_list * decoded = (as_list *) as_lazy_decode(lazy, AS_LIST);
+
+	lazy->stale = true;
+	return decoded;
+}
+
+static inline as_map * as_lazy_map_expose(const as_map * map)
+{
+	as_lazy * lazy = (as_lazy *) map->data;
+	as_map * decoded = (as_map *) as_lazy_decode(lazy, AS_MAP);
+
+	if ( lazy->nested ) {
+		lazy->stale = true;
+	}
+	return decoded;
+}
+
+static inline as_map * as_lazy_map_write(as_map * map)
+{
+	as_lazy * lazy = (as_lazy *) map->data;
+	as_map * decoded = (as_map *) as_lazy_decode(lazy, AS_MAP);
+
+	lazy->stale = true;
+	return decoded;
+}
+
+/******************************************************************************
+ *	LIST HOOKS
+ *****************************************************************************/
+
+static bool as_lazy_list_destroy(as_list * list)
+{
+	as_lazy_destroy((as_lazy *) list->data);
+	list->data = NULL;
+	return true;
+}
+
+static uint32_t as_lazy_list_hashcode(const as_list * list)
+{
+	as_list * l = as_lazy_list_read(list);
+	return l ? as_val_hashcode((as_val *) l) : 0;
+}
+
+static uint32_t as_lazy_list_size(const as_list * list)
+{
+	as_lazy * lazy = (as_lazy *) list->data;
+	uint32_t count;
+
+	if ( !lazy->decoded && as_lazy_header_count(lazy, false, &count) ) {
+		return count;
+	}
+
+	as_list * l = as_lazy_list_read(list);
+	return l ? as_list_size(l) : 0;
+}
+
+static as_val * as_lazy_list_get(const as_list * list, const uint32_t i)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_get(l, i) : NULL;
+}
+
+static int64_t as_lazy_list_get_int64(const as_list * list, const uint32_t i)
+{
+	as_list * l = as_lazy_list_read(list);
+	return l ? as_list_get_int64(l, i) : 0;
+}
+
+static char * as_lazy_list_get_str(const as_list * list, const uint32_t i)
+{
+	as_list * l = as_lazy_list_read(list);
+	return l ? as_list_get_str(l, i) : NULL;
+}
+
+static int as_lazy_list_set(as_list * list, const uint32_t i, as_val * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_set(l, i, value) : 1;
+}
+
+static int as_lazy_list_set_int64(as_list * list, const uint32_t i, int64_t value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_set_int64(l, i, value) : 1;
+}
+
+static int as_lazy_list_set_str(as_list * list, const uint32_t i, const char * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_set_str(l, i, value) : 1;
+}
+
+static int as_lazy_list_append(as_list * list, as_val * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_append(l, value) : 1;
+}
+
+static int as_lazy_list_append_int64(as_list * list, int64_t value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_append_int64(l, value) : 1;
+}
+
+static int as_lazy_list_append_str(as_list * list, const char * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_append_str(l, value) : 1;
+}
+
+static int as_lazy_list_prepend(as_list * list, as_val * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_prepend(l, value) : 1;
+}
+
+static int as_lazy_list_prepend_int64(as_list * list, int64_t value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_prepend_int64(l, value) : 1;
+}
+
+static int as_lazy_list_prepend_str(as_list * list, const char * value)
+{
+	as_list * l = as_lazy_list_write(list);
+	return l ? as_list_prepend_str(l, value) : 1;
+}
+
+static as_val * as_lazy_list_head(const as_list * list)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_head(l) : NULL;
+}
+
+static as_list * as_lazy_list_tail(const as_list * list)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_tail(l) : NULL;
+}
+
+static as_list * as_lazy_list_drop(const as_list * list, uint32_t n)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_drop(l, n) : NULL;
+}
+
+static as_list * as_lazy_list_take(const as_list * list, uint32_t n)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_take(l, n) : NULL;
+}
+
+static bool as_lazy_list_foreach(const as_list * list, as_list_foreach_callback callback, void * udata)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? as_list_foreach(l, callback, udata) : false;
+}
+
+static as_iterator * as_lazy_list_iterator_new(const as_list * list)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? l->hooks->iterator_new(l) : NULL;
+}
+
+static as_iterator * as_lazy_list_iterator_init(const as_list * list, as_iterator * it)
+{
+	as_list * l = as_lazy_list_expose(list);
+	return l ? l->hooks->iterator_init(l, it) : NULL;
+}
+
+/******************************************************************************
+ *	MAP HOOKS
+ *****************************************************************************/
+
+static bool as_lazy_map_destroy(as_map * map)
+{
+	as_lazy_destroy((as_lazy *) map->data);
+	map->data = NULL;
+	return true;
+}
+
+static uint32_t as_lazy_map_hashcode(const as_map * map)
+{
+	as_map * m = (as_map *) as_lazy_decode((as_lazy *) map->data, AS_MAP);
+	return m ? as_val_hashcode((as_val *) m) : 0;
+}
+
+static uint32_t as_lazy_map_size(const as_map * map)
+{
+	as_lazy * lazy = (as_lazy *) map->data;
+	uint32_t count;
+
+	if ( !lazy->decoded && as_lazy_header_count(lazy, true, &count) ) {
+		return count;
+	}
+
+	as_map * m = (as_map *) as_lazy_decode(lazy, AS_MAP);
+	return m ? as_map_size(m) : 0;
+}
+
+static as_val * as_lazy_map_get(const as_map * map, const as_val * key)
+{
+	as_map * m = as_lazy_map_expose(map);
+	return m ? as_map_get(m, key) : NULL;
+}
+
+static int as_lazy_map_set(as_map * map, const as_val * key, const as_val * value)
+{
+	as_map * m = as_lazy_map_write(map);
+	return m ? as_map_set(m, key, value) : 1;
+}
+
+static int as_lazy_map_clear(as_map * map)
+{
+	as_map * m = as_lazy_map_write(map);
+	return m ? as_map_clear(m) : 1;
+}
+
+static int as_lazy_map_remove(as_map * map, const as_val * key)
+{
+	as_map * m = as_lazy_map_write(map);
+	return m ? as_map_remove(m, key) : 1;
+}
+
+static bool as_lazy_map_foreach(const as_map * map, as_map_foreach_callback callback, void * udata)
+{
+	as_map * m = as_lazy_map_expose(map);
+	return m ? as_map_foreach(m, callback, udata) : false;
+}
+
+static as_iterator * as_lazy_map_iterator_new(const as_map * map)
+{
+	as_map * m = as_lazy_map_expose(map);
+	return m ? m->hooks->iterator_new(m) : NULL;
+}
+
+static as_iterator * as_lazy_map_iterator_init(const as_map * map, as_iterator * it)
+{
+	as_map * m = as_lazy_map_expose(map);
+	return m ? m->hooks->iterator_init(m, it) : NULL;
+}
+
+/******************************************************************************
+ *	HOOKS
+ *****************************************************************************/
+
+static const as_list_hooks as_lazy_list_hooks = {
+	.destroy		= as_lazy_list_destroy,
+	.hashcode		= as_lazy_list_hashcode,
+	.size			= as_lazy_list_size,
+	.get			= as_lazy_list_get,
+	.get_int64		= as_lazy_list_get_int64,
+	.get_str		= as_lazy_list_get_str,
+	.set			= as_lazy_list_set,
+	.set_int64		= as_lazy_list_set_int64,
+	.set_str		= as_lazy_list_set_str,
+	.append			= as_lazy_list_append,
+	.append_int64	= as_lazy_list_append_int64,
+	.append_str		= as_lazy_list_append_str,
+	.prepend		= as_lazy_list_prepend,
+	.prepend_int64	= as_lazy_list_prepend_int64,
+	.prepend_str	= as_lazy_list_prepend_str,
+	.head			= as_lazy_list_head,
+	.tail			= as_lazy_list_tail,
+	.drop			= as_lazy_list_drop,
+	.take			= as_lazy_list_take,
+	.foreach		= as_lazy_list_foreach,
+	.iterator_new	= as_lazy_list_iterator_new,
+	.iterator_init	= as_lazy_list_iterator_init
+};
+
+static const as_map_hooks as_lazy_map_hooks = {
+	.destroy		= as_lazy_map_destroy,
+	.hashcode		= as_lazy_map_hashcode,
+	.size			= as_lazy_map_size,
+	.set			= as_lazy_map_set,
+	.get			= as_lazy_map_get,
+	.clear			= as_lazy_map_clear,
+	.remove			= as_lazy_map_remove,
+	.foreach		= as_lazy_map_foreach,
+	.iterator_new	= as_lazy_map_iterator_new,
+	.iterator_init	= as_lazy_map_iterator_init
+};
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_list * as_lazy_list_new(uint8_t * data, uint32_t size, bool free)
+{
+	as_lazy * lazy = as_lazy_create(data, size, free);
+	if ( !lazy ) {
+		return NULL;
+	}
+
+	as_list * list = as_list_new(lazy, &as_lazy_list_hooks);
+	if ( !list ) {
+		// Leave the data with the caller.
+		as_free(lazy);
+	}
+	return list;
+}
+
+as_map * as_lazy_map_new(uint8_t * data, uint32_t size, bool free)
+{
+	as_lazy * lazy = as_lazy_create(data, size, free);
+	if ( !lazy ) {
+		return NULL;
+	}
+
+	as_map * map = as_map_new(lazy, &as_lazy_map_hooks);
+	if ( !map ) {
+		as_free(lazy);
+	}
+	return map;
+}
+
+bool as_lazy_serialized(const as_val * val, const uint8_t ** data_r, uint32_t * size_r)
+{
+	as_lazy * lazy = NULL;
+
+	switch ( as_val_type(val) ) {
+		case AS_LIST:
+			if ( ((as_list *) val)->hooks == &as_lazy_list_hooks ) {
+				lazy = (as_lazy *) ((as_list *) val)->data;
+			}
+			break;
+		case AS_MAP:
+			if ( ((as_map *) val)->hooks == &as_lazy_map_hooks ) {
+				lazy = (as_lazy *) ((as_map *) val)->data;
+			}
+			break;
+		default:
+			break;
+	}
+
+	if ( !lazy || lazy->stale ) {
+		return false;
+	}
+
+	*data_r = lazy->data;
+	*size_r = lazy->size;
+	return true;
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_boolean.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_lazy.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_msgpack_writer.h>
+#include <aerospike/as_pair.h>
+#include <aerospike/as_string.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+/******************************************************************************
+ *	TYPES
+ *****************************************************************************/
+
+typedef struct as_msgpack_sizer_s {
+	size_t size;
+	bool failed;
+} as_msgpack_sizer;
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+/**
+ *	Headers are those of msgpack_pack_array(), msgpack_pack_map() and
+ *	msgpack_pack_raw(), which the serializer packs with: no str8 form.
+ */
+static inline size_t as_msgpack_header_size(uint32_t n, uint32_t fix_max)
+{
+	return n < fix_max ? 1 : n < 0x10000 ? 3 : 5;
+}
+
+static inline uint8_t * as_msgpack_write_header(uint8_t * p, uint32_t n, uint32_t fix_max,
+	uint8_t fix, uint8_t b16, uint8_t b32)
+{
+	if ( n < fix_max ) {
+		*p++ = fix | (uint8_t) n;
+	}
+	else if ( n < 0x10000 ) {
+		*p++ = b16;
+		*p++ = (uint8_t) (n >> 8);
+		*p++ = (uint8_t) n;
+	}
+	else {
+		*p++ = b32;
+		*p++ = (uint8_t) (n >> 24);
+		*p++ = (uint8_t) (n >> 16);
+		*p++ = (uint8_t) (n >> 8);
+		*p++ = (uint8_t) n;
+	}
+	return p;
+}
+
+/**
+ *	Integers take the smallest form, as msgpack_pack_int64() does.
+ */
+static inline size_t as_msgpack_int_size(int64_t v)
+{
+	if ( v < 0 ) {
+		return v >= -32 ? 1 : v >= INT8_MIN ? 2 : v >= INT16_MIN ? 3 : v >= INT32_MIN ? 5 : 9;
+	}
+	return v < 128 ? 1 : v <= UINT8_MAX ? 2 : v <= UINT16_MAX ? 3 : v <= UINT32_MAX ? 5 : 9;
+}
+
+static inline uint8_t * as_msgpack_write_int(uint8_t * p, int64_t v)
+{
+	size_t size = as_msgpack_int_size(v);
+
+	if ( size == 1 ) {
+		*p++ = (uint8_t) v;
+		return p;
+	}
+
+	if ( v < 0 ) {
+		*p++ = size == 2 ? 0xd0 : size == 3 ? 0xd1 : size == 5 ? 0xd2 : 0xd3;
+	}
+	else {
+		*p++ = size == 2 ? 0xcc : size == 3 ? 0xcd : size == 5 ? 0xce : 0xcf;
+	}
+
+	uint64_t u = (uint64_t) v;
+	for ( size_t i = size - 1; i > 0; i-- ) {
+		*p++ = (uint8_t) (u >> ((i - 1) * 8));
+	}
+	return p;
+}
+
+static size_t as_msgpack_val_size(const as_val * val);
+static uint8_t * as_msgpack_write_val(uint8_t * p, const as_val * val);
+
+static bool as_msgpack_size_list_cb(as_val * val, void * udata)
+{
+	as_msgpack_sizer * sizer = (as_msgpack_sizer *) udata;
+	size_t size = as_msgpack_val_size(val);
+
+	if ( size == 0 ) {
+		sizer->failed = true;
+		return false;
+	}
+	sizer->size += size;
+	return true;
+}
+
+static bool as_msgpack_size_map_cb(const as_val * key, const as_val * val, void * udata)
+{
+	return as_msgpack_size_list_cb((as_val *) key, udata) &&
+		as_msgpack_size_list_cb((as_val *) val, udata);
+}
+
+static bool as_msgpack_write_list_cb(as_val * val, void * udata)
+{
+	uint8_t ** p = (uint8_t **) udata;
+	*p = as_msgpack_write_val(*p, val);
+	return true;
+}
+
+static bool as_msgpack_write_map_cb(const as_val * key, const as_val * val, void * udata)
+{
+	uint8_t ** p = (uint8_t **) udata;
+	*p = as_msgpack_write_val(*p, key);
+	*p = as_msgpack_write_val(*p, val);
+	return true;
+}
+
+static size_t as_msgpack_val_size(const as_val * val)
+{
+	if ( ! val ) {
+		return 1;
+	}
+
+	switch ( val->type ) {
+		case AS_NIL:
+		case AS_BOOLEAN:
+			return 1;
+		case AS_INTEGER:
+			return as_msgpack_int_size(as_integer_get((const as_integer *) val));
+		case AS_STRING: {
+			// Strings and bytes are raws led by their as_bytes type.
+			uint32_t n = (uint32_t) as_string_len((as_string *) val) + 1;
+			return as_msgpack_header_size(n, 32) + n;
+		}
+		case AS_BYTES: {
+			uint32_t n = ((const as_bytes *) val)->size + 1;
+			return as_msgpack_header_size(n, 32) + n;
+		}
+		case AS_LIST:
+		case AS_MAP: {
+			const uint8_t * data;
+			uint32_t size;
+			if ( as_lazy_serialized(val, &data, &size) ) {
+				return size;
+			}
+
+			as_msgpack_sizer sizer = { .size = 0, .failed = false };
+			if ( val->type == AS_LIST ) {
+				const as_list * list = (const as_list *) val;
+				sizer.size = as_msgpack_header_size(as_list_size(list), 16);
+				as_list_foreach(list, as_msgpack_size_list_cb, &sizer);
+			}
+			else {
+				const as_map * map = (const as_map *) val;
+				sizer.size = as_msgpack_header_size(as_map_size(map), 16);
+				as_map_foreach(map, as_msgpack_size_map_cb, &sizer);
+			}
+			return sizer.failed ? 0 : sizer.size;
+		}
+		case AS_PAIR: {
+			as_pair * pair = (as_pair *) val;
+			size_t s1 = as_msgpack_val_size(as_pair_1(pair));
+			size_t s2 = as_msgpack_val_size(as_pair_2(pair));
+			return s1 && s2 ? 1 + s1 + s2 : 0;
+		}
+		default:
+			return 0;
+	}
+}
+
+static uint8_t * as_msgpack_write_val(uint8_t * p, const as_val * val)
+{
+	if ( ! val ) {
+		*p++ = 0xc0;
+		return p;
+	}
+
+	switch ( val->type ) {
+		case AS_NIL:
+			*p++ = 0xc0;
+			return p;
+		case AS_BOOLEAN:
+			*p++ = as_boolean_get((const as_boolean *) val) ? 0xc3 : 0xc2;
+			return p;
+		case AS_INTEGER:
+			return as_msgpack_write_int(p, as_integer_get((const as_integer *) val));
+		case AS_STRING: {
+			as_string * s = (as_string *) val;
+			uint32_t n = (uint32_t) as_string_len(s);
+			p = as_msgpack_write_header(p, n + 1, 32, 0xa0, 0xda, 0xdb);
+			*p++ = AS_BYTES_STRING;
+			memcpy(p, as_string_get(s), n);
+			return p + n;
+		}
+		case AS_BYTES: {
+			const as_bytes * b = (const as_bytes *) val;
+			p = as_msgpack_write_header(p, b->size + 1, 32, 0xa0, 0xda, 0xdb);
+			*p++ = (uint8_t) b->type;
+			memcpy(p, b->value, b->size);
+			return p + b->size;
+		}
+		case AS_LIST:
+		case AS_MAP: {
+			const uint8_t * data;
+			uint32_t size;
+			if ( as_lazy_serialized(val, &data, &size) ) {
+				memcpy(p, data, size);
+				return p + size;
+			}
+
+			if ( val->type == AS_LIST ) {
+				const as_list * list = (const as_list *) val;
+				p = as_msgpack_write_header(p, as_list_size(list), 16, 0x90, 0xdc, 0xdd);
+				as_list_foreach(list, as_msgpack_write_list_cb, &p);
+			}
+			else {
+				const as_map * map = (const as_map *) val;
+				p = as_msgpack_write_header(p, as_map_size(map), 16, 0x80, 0xde, 0xdf);
+				as_map_foreach(map, as_msgpack_write_map_cb, &p);
+			}
+			return p;
+		}
+		case AS_PAIR: {
+			as_pair * pair = (as_pair *) val;
+			*p++ = 0x92;
+			p = as_msgpack_write_val(p, as_pair_1(pair));
+			return as_msgpack_write_val(p, as_pair_2(pair));
+		}
+		default:
+			return p;
+	}
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+size_t as_msgpack_writer_size(const as_val * val)
+{
+	return as_msgpack_val_size(val);
+}
+
+size_t as_msgpack_writer_write(const as_val * val, uint8_t * buf)
+{
+	return (size_t) (as_msgpack_write_val(buf, val) - buf);
+}
@@ -16,11 +16,14 @@
  */
 #include <aerospike/as_node.h>
 #include <aerospike/as_admin.h>
+#include <aerospike/as_allocator.h>
 #include <aerospike/as_cluster.h>
 #include <aerospike/as_info.h>
 #include <aerospike/as_log_macros.h>
+#include <aerospike/as_shm_cluster.h>
 #include <aerospike/as_string.h>
 #include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cf_clock.h>
 #include <citrusleaf/cf_proto.h>
 #include <citrusleaf/cf_socket.h>
 #include <errno.h> //errno
@@ -42,7 +45,7 @@ as_partition_tables_update(struct as_cluster_s* cluster, as_node* node, char* bu
 as_node*
 as_node_create(as_cluster* cluster, const char* name, struct sockaddr_in* addr)
 {
-	as_node* node = cf_malloc(sizeof(as_node));
+	as_node* node = as_malloc(AS_ALLOC_TEND, sizeof(as_node));
 
 	if (!node) {
 		return 0;
@@ -66,6 +69,12 @@ as_node_create(as_cluster* cluster, const char* name, struct sockaddr_in* addr)
 	node->friends = 0;
 	node->failures = 0;
 	node->index = 0;
+	memset(&node->stats, 0, sizeof(as_node_stats));
+	memset(&node->breaker, 0, sizeof(as_node_breaker));
+	memset(node->latency, 0, sizeof(node->latency));
+	node->zone[0] = 0;
+	node->in_zone = false;
+	node->zone_checked = false;
 	node->active = true;
 	return node;
 }
@@ -116,7 +125,7 @@ as_node_destroy(as_node* node)
 		cf_close(node->info_fd);
 	}
 
-	cf_free(node);
+	as_free(node);
 }
 
 void
@@ -294,6 +303,287 @@ as_node_put_connection(as_node* node, int fd)
 	}*/
 }
 
+static void
+as_node_stats_average(uint32_t* average, uint32_t sample, bool seed)
+{
+	// Concurrent transactions update the average with compare and swap, so no
+	// sample is lost.
+	uint32_t old;
+	uint32_t next;
+	
+	do {
+		old = ck_pr_load_32(average);
+		
+		if (seed && old == 0) {
+			next = sample;
+		}
+		else {
+			next = old - (old >> AS_NODE_STATS_EWMA_SHIFT) + (sample >> AS_NODE_STATS_EWMA_SHIFT);
+		}
+	} while (! ck_pr_cas_32(average, old, next));
+}
+
+void
+as_node_latency_add(as_node* node, uint32_t kind, uint64_t latency_us)
+{
+	uint32_t i = latency_us > 1 ? 63 - __builtin_clzll(latency_us) : 0;
+	
+	if (i >= AS_NODE_LATENCY_BUCKETS) {
+		i = AS_NODE_LATENCY_BUCKETS - 1;
+	}
+	ck_pr_inc_32(&node->latency[kind].buckets[i]);
+}
+
+static uint32_t
+as_node_latency_total(as_node_latency* latency)
+{
+	uint32_t total = 0;
+	
+	for (uint32_t i = 0; i < AS_NODE_LATENCY_BUCKETS; i++) {
+		total += ck_pr_load_32(&latency->buckets[i]);
+	}
+	return total;
+}
+
+uint64_t
+as_node_latency_percentile(as_node* node, uint32_t kind, uint32_t percentile)
+{
+	as_node_latency* latency = &node->latency[kind];
+	uint32_t total = as_node_latency_total(latency);
+	
+	if (total < AS_NODE_LATENCY_MIN_SAMPLES) {
+		return 0;
+	}
+	
+	uint64_t limit = (uint64_t)total * percentile / 100;
+	uint64_t count = 0;
+	uint32_t i = 0;
+	
+	for (; i < AS_NODE_LATENCY_BUCKETS - 1; i++) {
+		count += ck_pr_load_32(&latency->buckets[i]);
+		
+		if (count >= limit) {
+			break;
+		}
+	}
+	return 2ULL << i;
+}
+
+void
+as_node_latency_decay(as_node* node)
+{
+	for (uint32_t k = 0; k < AS_NODE_LATENCY_MAX; k++) {
+		as_node_latency* latency = &node->latency[k];
+		
+		if (as_node_latency_total(latency) < AS_NODE_LATENCY_WINDOW) {
+			continue;
+		}
+		
+		// Latencies added while halving may be lost, which does not matter.
+		for (uint32_t i = 0; i < AS_NODE_LATENCY_BUCKETS; i++) {
+			ck_pr_store_32(&latency->buckets[i], ck_pr_load_32(&latency->buckets[i]) / 2);
+		}
+	}
+}
+
+static void
+as_node_breaker_update(as_node* node, bool success)
+{
+	as_node_breaker* breaker = &node->breaker;
+	uint32_t threshold = node->cluster->breaker_threshold;
+	
+	if (threshold == 0) {
+		return;
+	}
+	
+	if (success) {
+		if (ck_pr_load_32(&breaker->failures)) {
+			ck_pr_store_32(&breaker->failures, 0);
+		}
+		
+		if (ck_pr_load_32(&breaker->state) != AS_NODE_BREAKER_CLOSED) {
+			ck_pr_store_32(&breaker->state, AS_NODE_BREAKER_CLOSED);
+			as_log_info("Node %s responding again. Circuit breaker closed.", node->name);
+		}
+		return;
+	}
+	
+	uint32_t failures = ck_pr_faa_32(&breaker->failures, 1) + 1;
+	uint32_t state = ck_pr_load_32(&breaker->state);
+	
+	// A failed probe opens the breaker again for another breaker_open_ms.
+	if (state == AS_NODE_BREAKER_PROBING || (state == AS_NODE_BREAKER_CLOSED && failures >= threshold)) {
+		ck_pr_store_64(&breaker->changed_ms, cf_getms());
+		ck_pr_fence_store();
+		
+		if (ck_pr_cas_32(&breaker->state, state, AS_NODE_BREAKER_OPEN) && state == AS_NODE_BREAKER_CLOSED) {
+			as_log_warn("Node %s failed %u consecutive transactions. Circuit breaker opened.", node->name, failures);
+		}
+	}
+}
+
+static inline bool
+as_node_zone_healthy(as_node* node)
+{
+	return ck_pr_load_8(&node->in_zone) && ck_pr_load_8(&node->active) && ! as_node_breaker_is_open(node);
+}
+
+bool
+as_node_choose_zone(as_node* master, as_node* prole, uint32_t random)
+{
+	if (! prole) {
+		return true;
+	}
+	
+	if (! master) {
+		return false;
+	}
+	
+	as_cluster* cluster = master->cluster;
+	bool master_local = as_node_zone_healthy(master);
+	bool prole_local = as_node_zone_healthy(prole);
+	
+	if (master_local || prole_local) {
+		ck_pr_inc_64(&cluster->zone_stats.local);
+		return master_local && prole_local ? as_node_is_faster(master, prole, random) : master_local;
+	}
+	
+	if (ck_pr_load_8(&master->in_zone) || ck_pr_load_8(&prole->in_zone)) {
+		ck_pr_inc_64(&cluster->zone_stats.unhealthy);
+	}
+	else {
+		ck_pr_inc_64(&cluster->zone_stats.remote);
+	}
+	return as_node_is_faster(master, prole, random);
+}
+
+bool
+as_node_breaker_allow(as_node* node)
+{
+	as_node_breaker* breaker = &node->breaker;
+	
+	if (ck_pr_load_32(&breaker->state) == AS_NODE_BREAKER_CLOSED) {
+		return true;
+	}
+	
+	ck_pr_fence_load();
+	uint64_t changed_ms = ck_pr_load_64(&breaker->changed_ms);
+	uint64_t now = cf_getms();
+	
+	if (now < changed_ms + node->cluster->breaker_open_ms) {
+		return false;
+	}
+	
+	// Let one transaction through as a probe. If it does not complete, another
+	// is let through after breaker_open_ms.
+	if (! ck_pr_cas_64(&breaker->changed_ms, changed_ms, now)) {
+		return false;
+	}
+	ck_pr_store_32(&breaker->state, AS_NODE_BREAKER_PROBING);
+	return true;
+}
+
+static void
+as_node_stats_count(as_node* node, uint64_t begin_us, bool success)
+{
+	ck_pr_dec_32(&node->stats.in_flight);
+	ck_pr_inc_32(&node->stats.transactions);
+	
+	// Failures count with the time they took, so a node that only times out
+	// does not keep the latency of a node never heard from.
+	uint64_t elapsed = cf_getus() - begin_us;
+	uint32_t sample = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+	
+	if (success) {
+		uint32_t average = ck_pr_load_32(&node->stats.latency_us);
+		uint32_t deviation = sample > average ? sample - average : average - sample;
+		as_node_stats_average(&node->stats.latency_dev_us, deviation, false);
+	}
+	as_node_stats_average(&node->stats.latency_us, sample, true);
+	as_node_stats_average(&node->stats.error_ppm, success ? 0 : 1000000, false);
+}
+
+void
+as_node_stats_end(as_node* node, uint64_t begin_us, bool success)
+{
+	as_node_breaker_update(node, success);
+	as_node_stats_count(node, begin_us, success);
+}
+
+void
+as_node_stats_expire(as_node* node, uint64_t begin_us)
+{
+	// The node may only be slower than the attempt allowed, so the breaker is
+	// left as it is. A probe that expires is followed by another one.
+	as_node_stats_count(node, begin_us, false);
+}
+
+void
+as_node_get_stats(as_node* node, as_node_stats* stats)
+{
+	if (node->cluster->shm_info && as_shm_get_node_stats(node->cluster->shm_info, node->index, stats)) {
+		return;
+	}
+	
+	stats->in_flight = ck_pr_load_32(&node->stats.in_flight);
+	stats->latency_us = ck_pr_load_32(&node->stats.latency_us);
+	stats->latency_dev_us = ck_pr_load_32(&node->stats.latency_dev_us);
+	stats->error_ppm = ck_pr_load_32(&node->stats.error_ppm);
+	stats->transactions = ck_pr_load_32(&node->stats.transactions);
+}
+
+static uint64_t
+as_node_expected_wait(as_node* node, as_node_stats* stats, uint32_t latency_us)
+{
+	// With shared memory, latency and error rate are those of the fleet as of the last
+	// tend. The transactions this process has in flight are counted as they change.
+	uint32_t in_flight = ck_pr_load_32(&node->stats.in_flight);
+	
+	// Queueing behind transactions in flight, with failures weighing up to five times.
+	uint64_t wait = (uint64_t)latency_us * (in_flight + 1);
+	return wait + (wait * stats->error_ppm / 250000);
+}
+
+bool
+as_node_is_faster(as_node* a, as_node* b, uint32_t random)
+{
+	if (! b) {
+		return true;
+	}
+	
+	if (! a) {
+		return false;
+	}
+	
+	// Spread the bits of sequential counters.
+	random *= 2654435761u;
+	
+	// Send 1 in 16 reads to the node not chosen, so its statistics show when it recovers.
+	bool explore = ((random >> 28) == 0);
+	
+	as_node_stats stats_a;
+	as_node_stats stats_b;
+	as_node_get_stats(a, &stats_a);
+	as_node_get_stats(b, &stats_b);
+	
+	// A latency of 0 is not known yet, rather than fast.
+	uint32_t latency_a = stats_a.latency_us;
+	uint32_t latency_b = stats_b.latency_us;
+	
+	if (latency_a == 0) {
+		latency_a = latency_b ? latency_b : AS_NODE_LATENCY_PRIOR_US;
+	}
+	
+	if (latency_b == 0) {
+		latency_b = latency_a;
+	}
+	
+	// Jitter each wait by up to 7/8, so close nodes share reads instead of herding.
+	uint64_t wait_a = as_node_expected_wait(a, &stats_a, latency_a) * (8 + ((random >> 8) & 7));
+	uint64_t wait_b = as_node_expected_wait(b, &stats_b, latency_b) * (8 + ((random >> 12) & 7));
+	return (wait_a <= wait_b) != explore;
+}
+
 static int
 as_node_get_info_connection(as_node* node)
 {
@@ -353,7 +643,7 @@ as_node_get_info(as_node* node, const char* names, size_t names_len, int timeout
 	// caller must free it if this call succeeds. Note that proto is overwritten
 	// if stack_buf is used, so we save the sz field here.
 	size_t proto_sz = proto->sz;
-	uint8_t* rbuf = proto_sz >= INFO_STACK_BUF_SIZE ? (uint8_t*)cf_malloc(proto_sz + 1) : stack_buf;
+	uint8_t* rbuf = proto_sz >= INFO_STACK_BUF_SIZE ? (uint8_t*)as_malloc(AS_ALLOC_TEND, proto_sz + 1) : stack_buf;
 	
 	if (! rbuf) {
 		as_log_error("Node %s failed allocation for info response", node->name);
@@ -365,7 +655,7 @@ as_node_get_info(as_node* node, const char* names, size_t names_len, int timeout
 		as_log_debug("Node %s failed info socket read body", node->name);
 		
 		if (rbuf != stack_buf) {
-			cf_free(rbuf);
+			as_free(rbuf);
 		}
 		return 0;
 	}
@@ -553,6 +843,71 @@ as_node_process_partitions(as_cluster* cluster, as_node* node, as_vector* values
 	}
 }
 
+static void
+as_node_set_zone(as_cluster* cluster, as_node* node, const char* zone)
+{
+	as_strncpy(node->zone, zone, sizeof(node->zone));
+	ck_pr_store_8(&node->in_zone, cluster->zone[0] && strcmp(node->zone, cluster->zone) == 0);
+	as_log_info("Node %s zone %s", node->name, node->zone);
+}
+
+void
+as_node_update_zone(as_cluster* cluster, as_node* node)
+{
+	for (uint32_t i = 0; i < cluster->zone_map_size; i++) {
+		as_zone_map* entry = &cluster->zone_map[i];
+		
+		for (uint32_t j = 0; j < node->addresses.size; j++) {
+			as_address* address = as_vector_get(&node->addresses, j);
+			
+			if (strcmp(entry->addr, address->name) == 0) {
+				as_node_set_zone(cluster, node, entry->zone);
+				node->zone_checked = true;
+				return;
+			}
+		}
+	}
+	
+	if (! cluster->zone_info_name[0]) {
+		node->zone_checked = true;
+		return;
+	}
+	
+	char names[AS_CONFIG_ZONE_SIZE + 1];
+	size_t names_len = strlen(cluster->zone_info_name);
+	memcpy(names, cluster->zone_info_name, names_len);
+	names[names_len++] = '\n';
+	
+	uint8_t stack_buf[INFO_STACK_BUF_SIZE];
+	uint8_t* buf = as_node_get_info(node, names, names_len, cluster->conn_timeout_ms, stack_buf);
+	
+	if (! buf) {
+		// Asked again on the next tend.
+		as_node_close_info_connection(node);
+		return;
+	}
+	
+	// A node without a zone is not asked again.
+	node->zone_checked = true;
+	
+	as_vector values;
+	as_vector_inita(&values, sizeof(as_name_value), 1);
+	as_info_parse_multi_response((char*)buf, &values);
+	
+	if (values.size > 0) {
+		as_name_value* nv = as_vector_get(&values, 0);
+		
+		if (nv->value && *nv->value) {
+			as_node_set_zone(cluster, node, nv->value);
+		}
+	}
+	as_vector_destroy(&values);
+	
+	if (buf != stack_buf) {
+		as_free(buf);
+	}
+}
+
 const char INFO_STR_CHECK[] = "node\npartition-generation\nservices\n";
 const char INFO_STR_GET_REPLICAS[] = "partition-generation\nreplicas-master\nreplicas-prole\n";
 
@@ -586,7 +941,7 @@ as_node_refresh(as_cluster* cluster, as_node* node, as_vector* /* <as_friend> */
 	bool status = as_node_process_response(cluster, node, &values, friends, &update_partitions);
 		
 	if (buf != stack_buf) {
-		cf_free(buf);
+		as_free(buf);
 	}
 	
 	if (status && update_partitions) {
@@ -606,11 +961,15 @@ as_node_refresh(as_cluster* cluster, as_node* node, as_vector* /* <as_friend> */
 			as_node_process_partitions(cluster, node, &values);
 			
 			if (buf != stack_buf) {
-				cf_free(buf);
+				as_free(buf);
 			}
 		}
 	}
 	
 	as_vector_destroy(&values);
+	
+	if (status && ! node->zone_checked) {
+		as_node_update_zone(cluster, node);
+	}
 	return status;
 }
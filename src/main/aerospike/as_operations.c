@@ -173,6 +173,24 @@ void as_operations_destroy(as_operations * ops)
 	}
 }
 
+/**
+ *	Removes all operations, keeping the entries for reuse.
+ *
+ *	@param ops 	The `as_operations` to reset.
+ */
+void as_operations_reset(as_operations * ops)
+{
+	if ( !ops ) return;
+
+	for(int i = 0; i < ops->binops.size; i++) {
+		as_bin_destroy(&ops->binops.entries[i].bin);
+	}
+
+	ops->binops.size = 0;
+	ops->gen = 0;
+	ops->ttl = 0;
+}
+
 /**
  *	Add a AS_OPERATOR_WRITE bin operation.
  *
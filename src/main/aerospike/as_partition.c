@@ -46,7 +46,7 @@ static as_partition_table*
 as_partition_table_create(const char* ns, uint32_t capacity)
 {
 	size_t len = sizeof(as_partition_table) + (sizeof(as_partition) * capacity);
-	as_partition_table* table = cf_malloc(len);
+	as_partition_table* table = as_malloc(AS_ALLOC_TEND, len);
 	memset(table, 0, len);
 	as_strncpy(table->ns, ns, AS_MAX_NAMESPACE_SIZE);
 	table->size = capacity;
@@ -67,14 +67,14 @@ as_partition_table_destroy(as_partition_table* table)
 			as_node_release(p->prole);
 		}
 	}
-	cf_free(table);
+	as_free(table);
 }
 
 as_partition_tables*
 as_partition_tables_create(uint32_t capacity)
 {
 	size_t size = sizeof(as_partition_tables) + (sizeof(as_partition_table*) * capacity);
-	as_partition_tables* tables = cf_malloc(size);
+	as_partition_tables* tables = as_malloc(AS_ALLOC_TEND, size);
 	memset(tables, 0, size);
 	tables->ref_count = 1;
 	tables->size = capacity;
@@ -129,6 +129,8 @@ as_partition_table_get_node(as_cluster* cluster, as_partition_table* table, cons
 				use_master_replica = true;
 				break;
 			case AS_POLICY_REPLICA_ANY:
+			case AS_POLICY_REPLICA_LATENCY:
+			case AS_POLICY_REPLICA_ZONE:
 				use_master_replica = false;
 				break;
 			default:
@@ -149,10 +151,19 @@ as_partition_table_get_node(as_cluster* cluster, as_partition_table* table, cons
 				return reserve_node(cluster, prole);
 			}
 
-			// Alternate between master and prole for reads.
+			// Alternate between master and prole for reads, or prefer the faster one
+			// or the one in the client's zone.
 			uint32_t r = ck_pr_faa_32(&g_randomizer, 1);
+			bool use_master = (r & 1);
+			
+			if (replica == AS_POLICY_REPLICA_LATENCY) {
+				use_master = as_node_is_faster(master, prole, r);
+			}
+			else if (replica == AS_POLICY_REPLICA_ZONE) {
+				use_master = as_node_choose_zone(master, prole, r);
+			}
 				
-			if (r & 1) {
+			if (use_master) {
 				return reserve_node_alternate(cluster, master, prole);
 			}
 			return reserve_node_alternate(cluster, prole, master);
@@ -165,6 +176,26 @@ as_partition_table_get_node(as_cluster* cluster, as_partition_table* table, cons
 	return as_node_get_random(cluster);
 }
 
+as_node*
+as_partition_table_get_replica(as_partition_table* table, const cf_digest* d, as_node* node)
+{
+	cl_partition_id partition_id = cl_partition_getid(table->size, d);
+	as_partition* p = &table->partitions[partition_id];
+	
+	// Make volatile reference so changes to tend thread will be reflected in this thread.
+	as_node* replica = ck_pr_load_ptr(&p->master);
+	
+	if (replica == node) {
+		replica = ck_pr_load_ptr(&p->prole);
+	}
+	
+	if (replica && replica != node && ck_pr_load_8(&replica->active)) {
+		as_node_reserve(replica);
+		return replica;
+	}
+	return 0;
+}
+
 as_partition_table*
 as_partition_tables_get(as_partition_tables* tables, const char* ns)
 {
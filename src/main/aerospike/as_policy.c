@@ -50,6 +50,10 @@ as_policies_init(as_policies* p)
 	p->read.key = -1;
 	p->read.replica = -1;
 	p->read.consistency_level = -1;
+	p->read.use_arena = false;
+	p->read.hedge_delay = AS_POLICY_HEDGE_DELAY_DEFAULT;
+	p->read.retry = -1;
+	p->read.attempt_timeout = 0;
 
 	p->write.timeout = -1;
 	p->write.retry = -1;
@@ -57,6 +61,9 @@ as_policies_init(as_policies* p)
 	p->write.gen = -1;
 	p->write.exists = -1;
 	p->write.commit_level = -1;
+	p->write.rate_limiter = NULL;
+	p->write.compression_threshold = 0;
+	p->write.attempt_timeout = 0;
 
 	p->operate.timeout = -1;
 	p->operate.retry = -1;
@@ -65,6 +72,7 @@ as_policies_init(as_policies* p)
 	p->operate.replica = -1;
 	p->operate.consistency_level = -1;
 	p->operate.commit_level = -1;
+	p->operate.rate_limiter = NULL;
 
 	p->remove.timeout = -1;
 	p->remove.retry = -1;
@@ -72,6 +80,7 @@ as_policies_init(as_policies* p)
 	p->remove.gen = -1;
 	p->remove.generation = 0;
 	p->remove.commit_level = -1;
+	p->remove.rate_limiter = NULL;
 
 	p->apply.timeout = -1;
 	p->apply.key = -1;
@@ -82,15 +91,18 @@ as_policies_init(as_policies* p)
 	p->info.check_bounds = true;
 
 	p->batch.timeout = -1;
+	p->batch.rate_limiter = NULL;
 
 	p->admin.timeout = -1;
 
 	// Scan timeout should not be tied to global timeout.
 	p->scan.timeout = 0;
 	p->scan.fail_on_cluster_change = false;
+	p->scan.rate_limiter = NULL;
 
 	// Query timeout should not be tied to global timeout.
 	p->query.timeout = 0;
+	p->query.rate_limiter = NULL;
 
 	return p;
 }
@@ -102,6 +114,7 @@ as_policies_resolve(as_policies* p)
 	as_policy_resolve(p->read.key, p->key);
 	as_policy_resolve(p->read.replica, p->replica);
 	as_policy_resolve(p->read.consistency_level, p->consistency_level);
+	as_policy_resolve(p->read.retry, p->retry);
 
 	as_policy_resolve(p->write.timeout, p->timeout);
 	as_policy_resolve(p->write.retry, p->retry);
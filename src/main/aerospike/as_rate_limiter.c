@@ -0,0 +1,124 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_rate_limiter.h>
+#include <citrusleaf/cf_clock.h>
+
+#include <unistd.h>
+
+/******************************************************************************
+ *	MACROS
+ *****************************************************************************/
+
+// Credit is kept in micro tokens, so a refill of rate tokens per second adds
+// exactly rate micro tokens per elapsed microsecond.
+#define MICRO_TOKENS 1000000LL
+
+/******************************************************************************
+ *	STATIC FUNCTIONS
+ *****************************************************************************/
+
+static inline void as_rate_limiter_refill(as_rate_limiter * limiter)
+{
+	uint64_t now = cf_getus();
+
+	if ( now > limiter->last_us ) {
+		int64_t credit = limiter->credit + (int64_t)(now - limiter->last_us) * limiter->rate;
+		limiter->credit = credit < limiter->capacity ? credit : limiter->capacity;
+		limiter->last_us = now;
+	}
+}
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_rate_limiter * as_rate_limiter_init(as_rate_limiter * limiter, uint32_t rate, uint32_t burst)
+{
+	if ( !limiter || rate == 0 ) {
+		return NULL;
+	}
+
+	if ( burst == 0 ) {
+		burst = rate / 10 ? rate / 10 : 1;
+	}
+
+	pthread_mutex_init(&limiter->lock, NULL);
+	limiter->rate = rate;
+	limiter->capacity = burst * MICRO_TOKENS;
+	limiter->credit = limiter->capacity;
+	limiter->last_us = cf_getus();
+	return limiter;
+}
+
+void as_rate_limiter_set_rate(as_rate_limiter * limiter, uint32_t rate)
+{
+	if ( rate == 0 ) {
+		return;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+	as_rate_limiter_refill(limiter);
+	limiter->rate = rate;
+	pthread_mutex_unlock(&limiter->lock);
+}
+
+void as_rate_limiter_acquire(as_rate_limiter * limiter, uint32_t n)
+{
+	if ( !limiter || n == 0 ) {
+		return;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+	as_rate_limiter_refill(limiter);
+
+	// Reserve the tokens even when they are not there yet. Later callers see
+	// the debt and wait behind this one.
+	limiter->credit -= n * MICRO_TOKENS;
+	int64_t debt = -limiter->credit;
+	uint32_t rate = limiter->rate;
+
+	pthread_mutex_unlock(&limiter->lock);
+
+	if ( debt > 0 ) {
+		usleep((useconds_t)((debt + rate - 1) / rate));
+	}
+}
+
+bool as_rate_limiter_try_acquire(as_rate_limiter * limiter, uint32_t n)
+{
+	if ( !limiter ) {
+		return true;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+	as_rate_limiter_refill(limiter);
+
+	bool acquired = limiter->credit >= n * MICRO_TOKENS;
+	if ( acquired ) {
+		limiter->credit -= n * MICRO_TOKENS;
+	}
+
+	pthread_mutex_unlock(&limiter->lock);
+	return acquired;
+}
+
+void as_rate_limiter_destroy(as_rate_limiter * limiter)
+{
+	if ( limiter ) {
+		pthread_mutex_destroy(&limiter->lock);
+	}
+}
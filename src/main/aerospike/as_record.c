@@ -14,6 +14,8 @@
  * License for the specific language governing permissions and limitations under
  * the License.
  */
+#include <aerospike/as_allocator.h>
+#include <aerospike/as_arena.h>
 #include <aerospike/as_bin.h>
 #include <aerospike/as_bytes.h>
 #include <aerospike/as_integer.h>
@@ -53,6 +55,8 @@ extern inline bool as_record_set_raw(as_record * rec, const as_bin_name name, co
 
 static as_record * 	as_record_defaults(as_record * rec, bool free, uint16_t nbins);
 static as_bin * 	as_record_bin_forupdate(as_record * rec, const as_bin_name name);
+static bool 		as_record_index_build(as_record * rec, uint32_t nbins);
+static uint32_t 	as_record_index_slot(const as_record * rec, const char * name);
 
 /******************************************************************************
  *	STATIC FUNCTIONS
@@ -75,11 +79,16 @@ static as_record * as_record_defaults(as_record * rec, bool free, uint16_t nbins
 
 	rec->gen = 0;
 	rec->ttl = 0;
+	rec->arena = NULL;
+	rec->index = NULL;
+	rec->index_mask = 0;
 
 	if ( nbins > 0 ) {
 		rec->bins._free = true;
 		rec->bins.capacity = nbins;
 		rec->bins.size = 0;
+		// Bin entries can be set up and freed by the application, so they
+		// stay on malloc().
 		rec->bins.entries = (as_bin *) malloc(sizeof(as_bin) * nbins);
 	}
 	else {
@@ -92,6 +101,69 @@ static as_record * as_record_defaults(as_record * rec, bool free, uint16_t nbins
 	return rec;
 }
 
+/**
+ *	FNV-1a hash of a bin name.
+ */
+static inline uint32_t as_record_name_hash(const char * name)
+{
+	uint32_t hash = 2166136261u;
+	while ( *name ) {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ *	Find the slot of the index holding the bin of given name, or the empty
+ *	slot where it would go.
+ */
+static uint32_t as_record_index_slot(const as_record * rec, const char * name)
+{
+	uint32_t slot = as_record_name_hash(name) & rec->index_mask;
+
+	while ( rec->index[slot] != 0 ) {
+		if ( strcmp(rec->bins.entries[rec->index[slot] - 1].name, name) == 0 ) {
+			break;
+		}
+		slot = (slot + 1) & rec->index_mask;
+	}
+	return slot;
+}
+
+/**
+ *	(Re)build the index with room for nbins bins, keeping it at most half
+ *	full so probes stay short.
+ */
+static bool as_record_index_build(as_record * rec, uint32_t nbins)
+{
+	uint32_t n_slots = 32;
+	while ( n_slots < nbins * 2 ) {
+		n_slots *= 2;
+	}
+
+	if ( rec->index == NULL || n_slots > rec->index_mask + 1 ) {
+		uint16_t * index = (uint16_t *) as_realloc(AS_ALLOC_RECORD, rec->index, sizeof(uint16_t) * n_slots);
+		if ( !index ) {
+			// Without room for every bin the index would go stale, so fall
+			// back to comparing names.
+			as_free(rec->index);
+			rec->index = NULL;
+			rec->index_mask = 0;
+			return false;
+		}
+		rec->index = index;
+		rec->index_mask = n_slots - 1;
+	}
+
+	memset(rec->index, 0, sizeof(uint16_t) * (rec->index_mask + 1));
+
+	for ( uint16_t i = 0; i < rec->bins.size; i++ ) {
+		rec->index[as_record_index_slot(rec, rec->bins.entries[i].name)] = i + 1;
+	}
+	return true;
+}
+
 /**
  *	Find a bin for updating.
  *	Either return an existing bin of given name, or return an empty entry.
@@ -103,6 +175,31 @@ static as_bin * as_record_bin_forupdate(as_record * rec, const as_bin_name name)
 		return NULL;
 	}
 
+	// Wide records look the name up in the index. Once built, the index is
+	// kept up to date until the record is released.
+	bool indexed = rec->index != NULL || rec->bins.size >= AS_RECORD_INDEX_THRESHOLD;
+
+	if ( indexed && (rec->index == NULL || (rec->bins.size + 1) * 2 > rec->index_mask + 1) ) {
+		indexed = as_record_index_build(rec, rec->bins.size + 1);
+	}
+
+	if ( indexed ) {
+		uint32_t slot = as_record_index_slot(rec, name);
+
+		if ( rec->index[slot] != 0 ) {
+			as_bin * bin = &rec->bins.entries[rec->index[slot] - 1];
+			as_val_destroy(bin->valuep);
+			bin->valuep = NULL;
+			return bin;
+		}
+
+		if ( rec->bins.size < rec->bins.capacity ) {
+			rec->index[slot] = rec->bins.size + 1;
+			return &rec->bins.entries[rec->bins.size++];
+		}
+		return NULL;
+	}
+
 	// look for bin of same name
 	for(int i = 0; i < rec->bins.size; i++) {
 		if ( strcmp(rec->bins.entries[i].name, name) == 0 ) {
@@ -142,6 +239,16 @@ void as_record_release(as_record * rec)
 		rec->bins.capacity = 0;
 		rec->bins.size = 0;
 
+		// The values above only point into the arena, so it goes in one step.
+		if ( rec->arena ) {
+			as_arena_release(rec->arena);
+			rec->arena = NULL;
+		}
+
+		as_free(rec->index);
+		rec->index = NULL;
+		rec->index_mask = 0;
+
 		rec->key.ns[0] = '\0';
 		rec->key.set[0] = '\0';
 
@@ -192,6 +299,43 @@ void as_record_destroy(as_record * rec)
 	as_rec_destroy((as_rec *) rec);
 }
 
+/**
+ *	Empty the record, keeping its bin entries and arena for the next read.
+ */
+void as_record_reset(as_record * rec)
+{
+	if ( !rec ) return;
+
+	for ( int i = 0; i < rec->bins.size; i++ ) {
+		as_val_destroy((as_val *) rec->bins.entries[i].valuep);
+		rec->bins.entries[i].valuep = NULL;
+	}
+	rec->bins.size = 0;
+
+	if ( rec->index ) {
+		memset(rec->index, 0, sizeof(uint16_t) * (rec->index_mask + 1));
+	}
+
+	if ( rec->arena ) {
+		// Entries carved from the arena go with it. The next read carves them
+		// again from the same place.
+		if ( rec->bins.entries && as_arena_owns(rec->arena, rec->bins.entries) ) {
+			rec->bins.entries = NULL;
+			rec->bins.capacity = 0;
+		}
+		as_arena_reset(rec->arena);
+	}
+
+	as_val_destroy((as_val *) rec->key.valuep);
+	rec->key.valuep = NULL;
+	rec->key.ns[0] = '\0';
+	rec->key.set[0] = '\0';
+	rec->key.digest.init = false;
+
+	rec->gen = 0;
+	rec->ttl = 0;
+}
+
 /******************************************************************************
  *	VALUE FUNCTIONS
  *****************************************************************************/
@@ -412,6 +556,11 @@ bool as_record_set_nil(as_record * rec, const as_bin_name name)
  */
 as_bin_value * as_record_get(const as_record * rec, const as_bin_name name) 
 {
+	if ( rec->index ) {
+		uint32_t slot = as_record_index_slot(rec, name);
+		return rec->index[slot] ? (as_bin_value *) rec->bins.entries[rec->index[slot] - 1].valuep : NULL;
+	}
+
 	for(int i=0; i<rec->bins.size; i++) {
 		if ( strcmp(rec->bins.entries[i].name, name) == 0 ) {
 			return (as_bin_value *) rec->bins.entries[i].valuep;
@@ -28,6 +28,48 @@
 #include <signal.h>
 #include <sys/sysctl.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Preferred node memory policy of mbind().
+#define AS_SHM_MPOL_PREFERRED 1
+
+// Reads of a partition retried while the tend owner changes it, before reading it unchecked.
+#define AS_SHM_SEQ_MAX_TRIES 1000
+
+/******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+// Sizes and offsets of a shared memory segment.
+typedef struct as_shm_layout_s {
+	uint32_t n_partitions;
+	uint32_t partition_buffers;
+	uint32_t nodes_capacity;
+	uint32_t partition_tables_capacity;
+	uint32_t process_stats_capacity;
+	uint32_t partition_tables_offset;
+	uint32_t partition_table_byte_size;
+	uint32_t node_stats_offset;
+	uint32_t process_stats_offset;
+	uint32_t process_stats_byte_size;
+	size_t size;
+} as_shm_layout;
+
+// Segment replaced after the cluster map moved.
+typedef struct as_shm_retired_s {
+	as_cluster_shm* cluster_shm;
+	as_node** local_nodes;
+	int shm_id;
+	bool mirror;	// still updated by the tend owner for processes that did not follow
+} as_shm_retired;
+
+/******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+// Last token given to an instance of this process, see as_shm_info.token.
+static uint32_t g_shm_token = 0;
 
 /******************************************************************************
  * DECLARATIONS
@@ -52,6 +94,12 @@ as_cluster_remove_nodes_copy(as_cluster* cluster, as_vector* /* <as_node*> */ no
  * FUNCTIONS
  ******************************************************************************/
 
+static inline uint32_t
+as_shm_align(size_t size)
+{
+	return (uint32_t)((size + AS_SHM_CACHE_LINE - 1) & ~(size_t)(AS_SHM_CACHE_LINE - 1));
+}
+
 // Note on why shared memory robust mutex locks were not used:
 //
 // Shared memory robust mutex locks do not work properly on some supported platforms.
@@ -112,6 +160,337 @@ as_shm_get_max_size()
 #endif
 }
 
+#ifdef SHM_HUGETLB
+static size_t
+as_shm_get_huge_page_size()
+{
+	// Default to the most common huge page size.
+	size_t page_size = 2 * 1024 * 1024;
+	char* fn = "/proc/meminfo";
+	FILE *f = fopen(fn, "r");
+	
+	if (!f) {
+		return page_size;
+	}
+	
+	char line[128];
+	size_t kb;
+	
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+			page_size = kb * 1024;
+			break;
+		}
+	}
+	fclose(f);
+	return page_size;
+}
+#endif
+
+static void
+as_shm_bind_numa_node(void* addr, size_t size, int numa_node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	// Call mbind() directly, so the client does not depend on libnuma.
+	unsigned long mask[4];
+	
+	if (numa_node >= (int)(sizeof(mask) * 8)) {
+		as_log_warn("Invalid shared memory NUMA node: %d", numa_node);
+		return;
+	}
+	
+	memset(mask, 0, sizeof(mask));
+	mask[numa_node / (sizeof(unsigned long) * 8)] |= 1UL << (numa_node % (sizeof(unsigned long) * 8));
+	
+	if (syscall(SYS_mbind, addr, size, AS_SHM_MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+		as_log_warn("Failed to place shared memory on NUMA node %d: %s", numa_node, strerror(errno));
+	}
+#else
+	as_log_warn("Shared memory NUMA placement is not supported on this platform");
+#endif
+}
+
+static void
+as_shm_cleanup(int id, as_cluster_shm* cluster_shm)
+{
+	// Detach shared memory.
+	if (cluster_shm) {
+		shmdt(cluster_shm);
+	}
+	
+	// Try removing the shared memory - it will fail if any other process is still attached.
+	shmctl(id, IPC_RMID, 0);
+}
+
+static void
+as_shm_layout_init(as_shm_layout* layout, uint32_t n_partitions, uint32_t partition_buffers,
+	uint32_t nodes_capacity, uint32_t partition_tables_capacity, uint32_t process_stats_capacity)
+{
+	layout->n_partitions = n_partitions;
+	layout->partition_buffers = partition_buffers;
+	layout->nodes_capacity = nodes_capacity;
+	layout->partition_tables_capacity = partition_tables_capacity;
+	layout->process_stats_capacity = process_stats_capacity;
+	
+	// Partition tables and statistics start on cache lines, so reading one namespace's
+	// partitions or publishing one process's statistics does not share lines with another.
+	layout->partition_tables_offset = as_shm_align(sizeof(as_cluster_shm) + (sizeof(as_node_shm) * nodes_capacity));
+	layout->partition_table_byte_size = as_shm_align(sizeof(as_partition_table_shm) + (sizeof(as_partition_shm) * n_partitions * partition_buffers));
+	layout->node_stats_offset = layout->partition_tables_offset + (layout->partition_table_byte_size * partition_tables_capacity);
+	layout->process_stats_offset = as_shm_align(layout->node_stats_offset + (sizeof(as_node_stats) * nodes_capacity));
+	layout->process_stats_byte_size = as_shm_align(sizeof(as_process_stats_shm) + (sizeof(as_node_stats) * nodes_capacity));
+	layout->size = layout->process_stats_offset + (layout->process_stats_byte_size * process_stats_capacity);
+}
+
+static int
+as_shm_get_segment(key_t key, size_t size, int flags, bool huge_pages, size_t* create_size)
+{
+	*create_size = size;
+	
+	if (huge_pages) {
+#ifdef SHM_HUGETLB
+		// Huge page segments must be a multiple of the huge page size.
+		size_t page_size = as_shm_get_huge_page_size();
+		*create_size = (size + page_size - 1) / page_size * page_size;
+		flags |= SHM_HUGETLB;
+#else
+		as_log_warn("Shared memory huge pages are not supported on this platform");
+#endif
+	}
+	
+	int id = shmget(key, *create_size, flags);
+	
+#ifdef SHM_HUGETLB
+	if (id < 0 && (flags & SHM_HUGETLB) && errno != EEXIST) {
+		as_log_warn("Shared memory huge pages not available: %s. Use normal pages.", strerror(errno));
+		*create_size = size;
+		id = shmget(key, size, flags & ~SHM_HUGETLB);
+	}
+#endif
+	return id;
+}
+
+static void
+as_shm_format(as_cluster_shm* cluster_shm, as_shm_layout* layout, size_t create_size, int numa_node)
+{
+	// Pages are placed when first touched, so bind before clearing the segment.
+	if (numa_node >= 0) {
+		as_shm_bind_numa_node(cluster_shm, create_size, numa_node);
+	}
+	
+	memset(cluster_shm, 0, create_size);
+	cluster_shm->n_partitions = layout->n_partitions;
+	cluster_shm->nodes_capacity = layout->nodes_capacity;
+	cluster_shm->partition_tables_capacity = layout->partition_tables_capacity;
+	cluster_shm->partition_tables_offset = layout->partition_tables_offset;
+	cluster_shm->partition_table_byte_size = layout->partition_table_byte_size;
+	cluster_shm->node_stats_offset = layout->node_stats_offset;
+	cluster_shm->process_stats_offset = layout->process_stats_offset;
+	cluster_shm->process_stats_capacity = layout->process_stats_capacity;
+	cluster_shm->process_stats_byte_size = layout->process_stats_byte_size;
+	cluster_shm->partition_buffers = layout->partition_buffers;
+	cluster_shm->version = 1;
+	cluster_shm->timestamp = cf_getms();
+}
+
+as_cluster_shm*
+as_shm_create_local(uint32_t n_partitions, uint32_t partition_buffers, uint32_t nodes_capacity, uint32_t partition_tables_capacity)
+{
+	as_shm_layout layout;
+	as_shm_layout_init(&layout, n_partitions, partition_buffers, nodes_capacity, partition_tables_capacity, 0);
+	
+	as_cluster_shm* cluster_shm = malloc(layout.size);
+	
+	if (cluster_shm) {
+		as_shm_format(cluster_shm, &layout, layout.size, -1);
+	}
+	return cluster_shm;
+}
+
+static as_process_stats_shm*
+as_shm_claim_process_stats(as_cluster_shm* cluster_shm, uint32_t pid, uint32_t token)
+{
+	uint32_t max = cluster_shm->process_stats_capacity;
+	
+	for (uint32_t i = 0; i < max; i++) {
+		as_process_stats_shm* ps = as_shm_get_process_stats(cluster_shm, i);
+		uint32_t owner = ck_pr_load_32(&ps->pid);
+		
+		// Take free slots and slots of processes that exited without releasing them.
+		if ((owner == 0 || (kill(owner, 0) != 0 && errno == ESRCH)) && ck_pr_cas_32(&ps->pid, owner, pid)) {
+			ck_pr_store_32(&ps->token, token);
+			memset(ps->nodes, 0, sizeof(as_node_stats) * cluster_shm->nodes_capacity);
+			ck_pr_store_32(&ps->followed, 0);
+			ck_pr_store_64(&ps->timestamp, cf_getms());
+			return ps;
+		}
+	}
+	as_log_warn("Node statistics not published. Shared memory process capacity exceeeded: %d", max);
+	return 0;
+}
+
+static as_process_stats_shm*
+as_shm_attach_process_stats(as_cluster_shm* cluster_shm, uint32_t pid, uint32_t token)
+{
+	// Keep the slot copied from the segment this instance moved from. Other instances
+	// in the same process have slots of their own.
+	uint32_t max = cluster_shm->process_stats_capacity;
+	
+	for (uint32_t i = 0; i < max; i++) {
+		as_process_stats_shm* ps = as_shm_get_process_stats(cluster_shm, i);
+		
+		if (ck_pr_load_32(&ps->pid) == pid && ck_pr_load_32(&ps->token) == token) {
+			return ps;
+		}
+	}
+	return as_shm_claim_process_stats(cluster_shm, pid, token);
+}
+
+static void
+as_shm_switch(as_shm_info* shm_info, as_cluster_shm* cluster_shm, int id)
+{
+	as_cluster_shm* old = shm_info->cluster_shm;
+	
+	// Node indexes are the same in the new segment.
+	as_node** local_nodes = cf_calloc(cluster_shm->nodes_capacity, sizeof(as_node*));
+	memcpy(local_nodes, shm_info->local_nodes, sizeof(as_node*) * ck_pr_load_32(&old->nodes_size));
+	
+	as_shm_retired retired = {old, shm_info->local_nodes, shm_info->shm_id, false};
+	as_vector_append(&shm_info->retired, &retired);
+	
+	// Let the tend owner know this process no longer reads the old segment.
+	if (shm_info->process_stats) {
+		ck_pr_store_32(&shm_info->process_stats->followed, 1);
+	}
+	
+	shm_info->process_stats = as_shm_attach_process_stats(cluster_shm, getpid(), shm_info->token);
+	shm_info->shm_id = id;
+	
+	// Readers load the segment before the local nodes, so they never pair the new
+	// segment with the smaller local nodes array.
+	ck_pr_store_ptr(&shm_info->local_nodes, local_nodes);
+	ck_pr_fence_store();
+	ck_pr_store_ptr(&shm_info->cluster_shm, cluster_shm);
+}
+
+static bool
+as_shm_follow_successor(as_shm_info* shm_info)
+{
+	int id = ck_pr_load_int(&shm_info->cluster_shm->successor_id);
+	as_cluster_shm* cluster_shm = shmat(id, NULL, 0);
+	
+	if (cluster_shm == (void*)-1) {
+		as_log_error("Error attaching to moved shared memory: %s pid: %d", strerror(errno), getpid());
+		return false;
+	}
+	
+	as_log_info("Follow shared memory cluster to version %u: %d", cluster_shm->version, getpid());
+	as_shm_switch(shm_info, cluster_shm, id);
+	return true;
+}
+
+static bool
+as_shm_follow_moves(as_shm_info* shm_info)
+{
+	while (ck_pr_load_8(&shm_info->cluster_shm->moved)) {
+		if (! as_shm_follow_successor(shm_info)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+as_shm_grow(as_shm_info* shm_info, uint32_t nodes_capacity, uint32_t partition_tables_capacity)
+{
+	// This function is called by shared memory master tending thread when the nodes
+	// or partition tables array is full.
+	as_cluster_shm* old = shm_info->cluster_shm;
+	uint32_t n_partitions = old->n_partitions;
+	as_shm_layout layout;
+	as_shm_layout_init(&layout, n_partitions, old->partition_buffers, nodes_capacity,
+		partition_tables_capacity, old->process_stats_capacity);
+	
+	size_t create_size;
+	int id = as_shm_get_segment(IPC_PRIVATE, layout.size, IPC_CREAT | 0666, shm_info->huge_pages, &create_size);
+	
+	if (id < 0) {
+		as_log_error("Failed to grow shared memory to %zu bytes: %s", create_size, strerror(errno));
+		return false;
+	}
+	
+	as_cluster_shm* cluster_shm = shmat(id, NULL, 0);
+	
+	if (cluster_shm == (void*)-1) {
+		as_log_error("Error attaching to shared memory: %s pid: %d", strerror(errno), getpid());
+		as_shm_cleanup(id, 0);
+		return false;
+	}
+	
+	as_shm_format(cluster_shm, &layout, create_size, shm_info->numa_node);
+	cluster_shm->version = old->version + 1;
+	cluster_shm->owner_pid = old->owner_pid;
+	cluster_shm->nodes_gen = old->nodes_gen + 1;
+	cluster_shm->lock = 1;
+	cluster_shm->ready = old->ready;
+	
+	// Copy nodes in place, so node indexes in partition tables stay valid.
+	uint32_t nodes_size = old->nodes_size;
+	
+	for (uint32_t i = 0; i < nodes_size; i++) {
+		as_node_shm* src = &old->nodes[i];
+		as_node_shm* dst = &cluster_shm->nodes[i];
+		memcpy(dst->name, src->name, NODE_NAME_SIZE);
+		memcpy(&dst->addr, &src->addr, sizeof(struct sockaddr_in));
+		dst->active = src->active;
+	}
+	cluster_shm->nodes_size = nodes_size;
+	
+	// Copy the partitions readers use, and those not yet published.
+	as_partition_table_shm* src = as_shm_get_partition_tables(old);
+	as_partition_table_shm* dst = as_shm_get_partition_tables(cluster_shm);
+	size_t partitions_size = sizeof(as_partition_shm) * n_partitions;
+	
+	for (uint32_t i = 0; i < old->partition_tables_size; i++) {
+		memcpy(dst->ns, src->ns, AS_MAX_NAMESPACE_SIZE);
+		memcpy(dst->partitions, &src->partitions[src->active * n_partitions], partitions_size);
+		
+		if (src->pending) {
+			memcpy(&dst->partitions[n_partitions], &src->partitions[(src->active ^ 1) * n_partitions], partitions_size);
+			dst->pending = 1;
+		}
+		src = as_shm_next_partition_table(old, src);
+		dst = as_shm_next_partition_table(cluster_shm, dst);
+	}
+	cluster_shm->partition_tables_size = old->partition_tables_size;
+	
+	// Copy statistics, so processes keep their slots.
+	memcpy(as_shm_get_node_stats_array(cluster_shm), as_shm_get_node_stats_array(old), sizeof(as_node_stats) * nodes_size);
+	
+	for (uint32_t i = 0; i < old->process_stats_capacity; i++) {
+		as_process_stats_shm* ps_src = as_shm_get_process_stats(old, i);
+		as_process_stats_shm* ps_dst = as_shm_get_process_stats(cluster_shm, i);
+		ps_dst->pid = ck_pr_load_32(&ps_src->pid);
+		ps_dst->token = ck_pr_load_32(&ps_src->token);
+		ps_dst->timestamp = ck_pr_load_64(&ps_src->timestamp);
+		memcpy(ps_dst->nodes, ps_src->nodes, sizeof(as_node_stats) * nodes_size);
+	}
+	
+	as_log_info("Move shared memory cluster to version %u. Max nodes: %u Max namespaces: %u",
+		cluster_shm->version, nodes_capacity, partition_tables_capacity);
+	as_shm_switch(shm_info, cluster_shm, id);
+	
+	// Keep the old segment up to date until the other processes follow.
+	as_shm_retired* retired = as_vector_get(&shm_info->retired, shm_info->retired.size - 1);
+	retired->mirror = true;
+	
+	// Point processes attached to the old segment to the new one.
+	ck_pr_store_int(&old->successor_id, id);
+	ck_pr_fence_store();
+	ck_pr_store_8(&old->moved, 1);
+	return true;
+}
+
 static int
 as_shm_find_node_index(as_cluster_shm* cluster_shm, const char* name)
 {
@@ -153,6 +532,12 @@ as_shm_add_nodes(as_cluster* cluster, as_vector* /* <as_node*> */ nodes_to_add)
 			node_to_add->index = node_index;
 		}
 		else {
+			// Move to a larger segment when the nodes array is full.
+			if (cluster_shm->nodes_size >= cluster_shm->nodes_capacity &&
+				as_shm_grow(shm_info, cluster_shm->nodes_capacity * 2, cluster_shm->partition_tables_capacity)) {
+				cluster_shm = shm_info->cluster_shm;
+			}
+			
 			// Add new node and activate.
 			if (cluster_shm->nodes_size < cluster_shm->nodes_capacity) {
 				as_node_shm* node_shm = &cluster_shm->nodes[cluster_shm->nodes_size];
@@ -177,6 +562,7 @@ as_shm_add_nodes(as_cluster* cluster, as_vector* /* <as_node*> */ nodes_to_add)
 					node_to_add->name, address->name,
 					(int)cf_swap_from_be16(address->addr.sin_port),
 					cluster_shm->nodes_capacity);
+				continue;
 			}
 		}
 		ck_pr_store_ptr(&shm_info->local_nodes[node_to_add->index], node_to_add);
@@ -240,6 +626,11 @@ as_shm_reset_nodes(as_cluster* cluster)
 				as_vector_append(&nodes_to_add, &node);
 				ck_pr_store_ptr(&shm_info->local_nodes[i], node);
 			}
+			
+			// Nodes are refreshed by the master process only.
+			if (! node->zone_checked) {
+				as_node_update_zone(cluster, node);
+			}
 		}
 		else {
 			if (node) {
@@ -280,8 +671,16 @@ as_shm_find_partition_table(as_cluster_shm* cluster_shm, const char* ns)
 }
 
 static as_partition_table_shm*
-as_shm_add_partition_table(as_cluster_shm* cluster_shm, const char* ns)
+as_shm_add_partition_table(as_shm_info* shm_info, const char* ns)
 {
+	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
+	
+	// Move to a larger segment when the partition tables array is full.
+	if (cluster_shm->partition_tables_size >= cluster_shm->partition_tables_capacity &&
+		as_shm_grow(shm_info, cluster_shm->nodes_capacity, cluster_shm->partition_tables_capacity * 2)) {
+		cluster_shm = shm_info->cluster_shm;
+	}
+	
 	if (cluster_shm->partition_tables_size >= cluster_shm->partition_tables_capacity) {
 		// There are no more partition table slots available in shared memory.
 		as_log_error("Failed to add partition table namespace %s. Shared memory capacity exceeeded: %d",
@@ -345,8 +744,38 @@ as_shm_partition_update(as_shm_info* shm_info, as_partition_shm* p, uint32_t nod
 	}
 }
 
+static inline void
+as_shm_seq_write_begin(uint32_t* seq)
+{
+	ck_pr_store_32(seq, *seq + 1);
+	ck_pr_fence_store();
+}
+
+static inline void
+as_shm_seq_write_end(uint32_t* seq)
+{
+	ck_pr_fence_store();
+	ck_pr_store_32(seq, *seq + 1);
+}
+
+static as_partition_shm*
+as_shm_get_pending_partitions(as_cluster_shm* cluster_shm, as_partition_table_shm* table)
+{
+	uint32_t n_partitions = cluster_shm->n_partitions;
+	uint32_t active = table->active;
+	as_partition_shm* pending = &table->partitions[(active ^ 1) * n_partitions];
+	
+	if (! table->pending) {
+		// First change since the last publish. Start from what readers use. Readers
+		// still on this buffer started before the last publish and will retry.
+		memcpy(pending, &table->partitions[active * n_partitions], sizeof(as_partition_shm) * n_partitions);
+		table->pending = 1;
+	}
+	return pending;
+}
+
 static void
-as_shm_decode_and_update(as_shm_info* shm_info, char* bitmap_b64, int64_t len, as_partition_table_shm* table, uint32_t node_index, bool master)
+as_shm_decode_and_update(as_shm_info* shm_info, char* bitmap_b64, int64_t len, as_partition_shm* partitions, uint32_t node_index, bool master)
 {
 	// Size allows for padding - is actual size rounded up to multiple of 3.
 	uint8_t* bitmap = (uint8_t*)alloca(cf_b64_decoded_buf_size((uint32_t)len));
@@ -359,25 +788,141 @@ as_shm_decode_and_update(as_shm_info* shm_info, char* bitmap_b64, int64_t len, a
 	
 	for (uint32_t i = 0; i < max; i++) {
 		bool owns = ((bitmap[i >> 3] & (0x80 >> (i & 7))) != 0);
-		as_shm_partition_update(shm_info, &table->partitions[i], node_index, master, owns);
+		as_shm_partition_update(shm_info, &partitions[i], node_index, master, owns);
+	}
+}
+
+static void
+as_shm_store_partitions(as_partition_shm* partitions, const as_partition_shm* scratch, uint32_t max)
+{
+	for (uint32_t i = 0; i < max; i++) {
+		if (partitions[i].master != scratch[i].master) {
+			ck_pr_store_32(&partitions[i].master, scratch[i].master);
+		}
+		
+		if (partitions[i].prole != scratch[i].prole) {
+			ck_pr_store_32(&partitions[i].prole, scratch[i].prole);
+		}
 	}
 }
 
 void
 as_shm_update_partitions(as_shm_info* shm_info, const char* ns, char* bitmap_b64, int64_t len, as_node* node, bool master)
 {
-	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
-	as_partition_table_shm* table = as_shm_find_partition_table(cluster_shm, ns);
+	as_partition_table_shm* table = as_shm_find_partition_table(shm_info->cluster_shm, ns);
 	
 	if (! table) {
-		table = as_shm_add_partition_table(cluster_shm, ns);
+		table = as_shm_add_partition_table(shm_info, ns);
 	}
 	
-	if (table) {
-		as_shm_decode_and_update(shm_info, bitmap_b64, len, table, node->index + 1, master);
+	if (! table) {
+		return;
+	}
+	
+	// Adding the table may have moved the map.
+	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
+	
+	if (cluster_shm->partition_buffers > 1) {
+		// Readers see the changes when the tend is published.
+		as_partition_shm* partitions = as_shm_get_pending_partitions(cluster_shm, table);
+		as_shm_decode_and_update(shm_info, bitmap_b64, len, partitions, node->index + 1, master);
+	}
+	else {
+		// Decode into a copy, so readers only wait while the changes are stored.
+		uint32_t max = cluster_shm->n_partitions;
+		as_partition_shm* scratch = (as_partition_shm*)alloca(sizeof(as_partition_shm) * max);
+		
+		memcpy(scratch, table->partitions, sizeof(as_partition_shm) * max);
+		as_shm_decode_and_update(shm_info, bitmap_b64, len, scratch, node->index + 1, master);
+		
+		as_shm_seq_write_begin(&table->seq);
+		as_shm_store_partitions(table->partitions, scratch, max);
+		as_shm_seq_write_end(&table->seq);
+	}
+}
+
+void
+as_shm_publish_partitions(as_cluster_shm* cluster_shm)
+{
+	// Switch readers to the tables changed since the last publish.
+	if (cluster_shm->partition_buffers < 2) {
+		return;
+	}
+	
+	as_partition_table_shm* table = as_shm_get_partition_tables(cluster_shm);
+	uint32_t max = cluster_shm->partition_tables_size;
+	
+	for (uint32_t i = 0; i < max; i++) {
+		if (table->pending) {
+			as_shm_seq_write_begin(&table->seq);
+			ck_pr_store_32(&table->active, table->active ^ 1);
+			as_shm_seq_write_end(&table->seq);
+			table->pending = 0;
+		}
+		table = as_shm_next_partition_table(cluster_shm, table);
 	}
 }
 
+void
+as_shm_repair_partition_tables(as_cluster_shm* cluster_shm)
+{
+	// A tend owner that died while changing partitions leaves their sequence odd.
+	as_partition_table_shm* table = as_shm_get_partition_tables(cluster_shm);
+	uint32_t max = cluster_shm->partition_tables_size;
+	
+	for (uint32_t i = 0; i < max; i++) {
+		if (ck_pr_load_32(&table->seq) & 1) {
+			as_shm_seq_write_end(&table->seq);
+		}
+		table = as_shm_next_partition_table(cluster_shm, table);
+	}
+}
+
+static inline void
+as_shm_load_partition(as_cluster_shm* cluster_shm, as_partition_table_shm* table, cl_partition_id partition_id,
+	uint32_t* master, uint32_t* prole)
+{
+	as_partition_shm* p;
+	
+	for (uint32_t i = 0; i < AS_SHM_SEQ_MAX_TRIES; i++) {
+		uint32_t seq = ck_pr_load_32(&table->seq);
+		ck_pr_fence_load();
+		
+		if (seq & 1) {
+			// Partitions are being changed.
+			ck_pr_stall();
+			continue;
+		}
+		
+		p = &table->partitions[(ck_pr_load_32(&table->active) * cluster_shm->n_partitions) + partition_id];
+		*master = ck_pr_load_32(&p->master);
+		*prole = ck_pr_load_32(&p->prole);
+		ck_pr_fence_load();
+		
+		if (ck_pr_load_32(&table->seq) == seq) {
+			return;
+		}
+	}
+	
+	// The tend owner may have died while changing partitions. Each entry is still
+	// valid on its own.
+	p = &table->partitions[(ck_pr_load_32(&table->active) * cluster_shm->n_partitions) + partition_id];
+	*master = ck_pr_load_32(&p->master);
+	*prole = ck_pr_load_32(&p->prole);
+}
+
+bool
+as_shm_get_partition(as_cluster_shm* cluster_shm, const char* ns, uint32_t partition_id, uint32_t* master, uint32_t* prole)
+{
+	as_partition_table_shm* table = as_shm_find_partition_table(cluster_shm, ns);
+	
+	if (! table || partition_id >= cluster_shm->n_partitions) {
+		return false;
+	}
+	as_shm_load_partition(cluster_shm, table, partition_id, master, prole);
+	return true;
+}
+
 static inline as_node*
 as_shm_reserve_node(as_cluster* cluster, as_node** local_nodes, uint32_t node_index)
 {
@@ -415,19 +960,22 @@ as_node*
 as_shm_node_get(as_cluster* cluster, const char* ns, const cf_digest* d, bool write, as_policy_replica replica)
 {
 	as_shm_info* shm_info = cluster->shm_info;
-	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
+	
+	// Load the segment before the local nodes, see as_shm_switch().
+	as_cluster_shm* cluster_shm = ck_pr_load_ptr(&shm_info->cluster_shm);
+	ck_pr_fence_load();
+	as_node** local_nodes = ck_pr_load_ptr(&shm_info->local_nodes);
 	as_partition_table_shm* table = as_shm_find_partition_table(cluster_shm, ns);
 
 	if (table) {
 		cl_partition_id partition_id = cl_partition_getid(cluster_shm->n_partitions, d);
-		as_partition_shm* p = &table->partitions[partition_id];
-
-		// Make volatile reference so changes to tend thread will be reflected in this thread.
-		uint32_t master = ck_pr_load_32(&p->master);
+		uint32_t master;
+		uint32_t prole;
+		as_shm_load_partition(cluster_shm, table, partition_id, &master, &prole);
 
 		if (write) {
 			// Writes always go to master.
-			return as_shm_reserve_node(cluster, shm_info->local_nodes, master);
+			return as_shm_reserve_node(cluster, local_nodes, master);
 		}
 
 		bool use_master_replica = true;
@@ -436,6 +984,8 @@ as_shm_node_get(as_cluster* cluster, const char* ns, const cf_digest* d, bool wr
 				use_master_replica = true;
 				break;
 			case AS_POLICY_REPLICA_ANY:
+			case AS_POLICY_REPLICA_LATENCY:
+			case AS_POLICY_REPLICA_ZONE:
 				use_master_replica = false;
 				break;
 			default:
@@ -444,25 +994,34 @@ as_shm_node_get(as_cluster* cluster, const char* ns, const cf_digest* d, bool wr
 		}
 
 		if (use_master_replica) {
-			return as_shm_reserve_node(cluster, shm_info->local_nodes, master);
+			return as_shm_reserve_node(cluster, local_nodes, master);
 		} else {
-			uint32_t prole = ck_pr_load_32(&p->prole);
-
 			if (! prole) {
-				return as_shm_reserve_node(cluster, shm_info->local_nodes, master);
+				return as_shm_reserve_node(cluster, local_nodes, master);
 			}
 
 			if (! master) {
-				return as_shm_reserve_node(cluster, shm_info->local_nodes, prole);
+				return as_shm_reserve_node(cluster, local_nodes, prole);
 			}
 
-			// Alternate between master and prole for reads.
+			// Alternate between master and prole for reads, or prefer the faster one
+			// or the one in the client's zone.
 			uint32_t r = ck_pr_faa_32(&g_shm_randomizer, 1);
+			bool use_master = (r & 1);
+			
+			if (replica == AS_POLICY_REPLICA_LATENCY) {
+				use_master = as_node_is_faster(ck_pr_load_ptr(&local_nodes[master-1]),
+					ck_pr_load_ptr(&local_nodes[prole-1]), r);
+			}
+			else if (replica == AS_POLICY_REPLICA_ZONE) {
+				use_master = as_node_choose_zone(ck_pr_load_ptr(&local_nodes[master-1]),
+					ck_pr_load_ptr(&local_nodes[prole-1]), r);
+			}
 
-			if (r & 1) {
-				return as_shm_reserve_node_alternate(cluster, shm_info->local_nodes, master, prole);
+			if (use_master) {
+				return as_shm_reserve_node_alternate(cluster, local_nodes, master, prole);
 			}
-			return as_shm_reserve_node_alternate(cluster, shm_info->local_nodes, prole, master);
+			return as_shm_reserve_node_alternate(cluster, local_nodes, prole, master);
 		}
 	}
 
@@ -470,11 +1029,316 @@ as_shm_node_get(as_cluster* cluster, const char* ns, const cf_digest* d, bool wr
 	return as_node_get_random(cluster);
 }
 
+as_node*
+as_shm_node_get_replica(as_cluster* cluster, const char* ns, const cf_digest* d, as_node* node)
+{
+	as_shm_info* shm_info = cluster->shm_info;
+	
+	// Load the segment before the local nodes, see as_shm_switch().
+	as_cluster_shm* cluster_shm = ck_pr_load_ptr(&shm_info->cluster_shm);
+	ck_pr_fence_load();
+	as_node** local_nodes = ck_pr_load_ptr(&shm_info->local_nodes);
+	as_partition_table_shm* table = as_shm_find_partition_table(cluster_shm, ns);
+	
+	if (! table) {
+		return 0;
+	}
+	
+	cl_partition_id partition_id = cl_partition_getid(cluster_shm->n_partitions, d);
+	uint32_t master;
+	uint32_t prole;
+	as_shm_load_partition(cluster_shm, table, partition_id, &master, &prole);
+	
+	// node_index starts at one (zero indicates unset).
+	uint32_t index = (master && master - 1 != node->index) ? master : prole;
+	
+	if (! index || index - 1 == node->index) {
+		return 0;
+	}
+	
+	as_node* replica = ck_pr_load_ptr(&local_nodes[index-1]);
+	
+	if (replica && ck_pr_load_8(&replica->active)) {
+		as_node_reserve(replica);
+		return replica;
+	}
+	return 0;
+}
+
+bool
+as_shm_get_node_stats(as_shm_info* shm_info, uint32_t index, as_node_stats* stats)
+{
+	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
+	
+	if (index >= cluster_shm->nodes_capacity || cluster_shm->process_stats_capacity == 0) {
+		return false;
+	}
+	
+	as_node_stats* fleet = &as_shm_get_node_stats_array(cluster_shm)[index];
+	stats->in_flight = ck_pr_load_32(&fleet->in_flight);
+	stats->latency_us = ck_pr_load_32(&fleet->latency_us);
+	stats->latency_dev_us = ck_pr_load_32(&fleet->latency_dev_us);
+	stats->error_ppm = ck_pr_load_32(&fleet->error_ppm);
+	stats->transactions = ck_pr_load_32(&fleet->transactions);
+	return true;
+}
+
+static void
+as_shm_release_process_stats(as_shm_info* shm_info)
+{
+	as_process_stats_shm* ps = shm_info->process_stats;
+	
+	if (ps) {
+		ck_pr_store_64(&ps->timestamp, 0);
+		ck_pr_fence_store();
+		ck_pr_store_32(&ps->pid, 0);
+		shm_info->process_stats = 0;
+	}
+}
+
+static void
+as_shm_publish_stats(as_shm_info* shm_info, as_cluster_shm* cluster_shm)
+{
+	as_process_stats_shm* ps = shm_info->process_stats;
+	
+	if (! ps) {
+		return;
+	}
+	
+	// Local nodes are only changed by the tend thread, which is this thread.
+	uint32_t max = ck_pr_load_32(&cluster_shm->nodes_size);
+	
+	for (uint32_t i = 0; i < max; i++) {
+		as_node* node = shm_info->local_nodes[i];
+		as_node_stats* s = &ps->nodes[i];
+		
+		if (node) {
+			ck_pr_store_32(&s->in_flight, ck_pr_load_32(&node->stats.in_flight));
+			ck_pr_store_32(&s->latency_us, ck_pr_load_32(&node->stats.latency_us));
+			ck_pr_store_32(&s->latency_dev_us, ck_pr_load_32(&node->stats.latency_dev_us));
+			ck_pr_store_32(&s->error_ppm, ck_pr_load_32(&node->stats.error_ppm));
+			ck_pr_store_32(&s->transactions, ck_pr_load_32(&node->stats.transactions));
+		}
+		else {
+			ck_pr_store_32(&s->in_flight, 0);
+			ck_pr_store_32(&s->latency_us, 0);
+			ck_pr_store_32(&s->latency_dev_us, 0);
+			ck_pr_store_32(&s->error_ppm, 0);
+			ck_pr_store_32(&s->transactions, 0);
+		}
+	}
+	ck_pr_store_64(&ps->timestamp, cf_getms());
+}
+
+static void
+as_shm_aggregate_stats(as_cluster_shm* cluster_shm, uint64_t stale_ms)
+{
+	// Fleet-wide in flight and transaction counts are sums over processes.
+	// Latency and error rate are means over processes that used the node.
+	uint32_t max = ck_pr_load_32(&cluster_shm->nodes_size);
+	
+	if (max == 0) {
+		return;
+	}
+	
+	as_node_stats* sums = alloca(sizeof(as_node_stats) * max);
+	uint32_t* latency_counts = alloca(sizeof(uint32_t) * max);
+	uint32_t* error_counts = alloca(sizeof(uint32_t) * max);
+	uint64_t* latency_sums = alloca(sizeof(uint64_t) * max);
+	uint64_t* latency_dev_sums = alloca(sizeof(uint64_t) * max);
+	uint64_t* error_sums = alloca(sizeof(uint64_t) * max);
+	memset(sums, 0, sizeof(as_node_stats) * max);
+	memset(latency_counts, 0, sizeof(uint32_t) * max);
+	memset(error_counts, 0, sizeof(uint32_t) * max);
+	memset(latency_sums, 0, sizeof(uint64_t) * max);
+	memset(latency_dev_sums, 0, sizeof(uint64_t) * max);
+	memset(error_sums, 0, sizeof(uint64_t) * max);
+	
+	uint64_t now = cf_getms();
+	uint32_t capacity = cluster_shm->process_stats_capacity;
+	
+	for (uint32_t p = 0; p < capacity; p++) {
+		as_process_stats_shm* ps = as_shm_get_process_stats(cluster_shm, p);
+		
+		// Skip free slots and processes that stopped publishing.
+		if (ck_pr_load_32(&ps->pid) == 0 || now - ck_pr_load_64(&ps->timestamp) > stale_ms) {
+			continue;
+		}
+		
+		for (uint32_t i = 0; i < max; i++) {
+			as_node_stats* s = &ps->nodes[i];
+			uint32_t transactions = ck_pr_load_32(&s->transactions);
+			uint32_t latency = ck_pr_load_32(&s->latency_us);
+			
+			sums[i].in_flight += ck_pr_load_32(&s->in_flight);
+			sums[i].transactions += transactions;
+			
+			if (latency) {
+				latency_sums[i] += latency;
+				latency_dev_sums[i] += ck_pr_load_32(&s->latency_dev_us);
+				latency_counts[i]++;
+			}
+			
+			if (transactions) {
+				error_sums[i] += ck_pr_load_32(&s->error_ppm);
+				error_counts[i]++;
+			}
+		}
+	}
+	
+	as_node_stats* fleet = as_shm_get_node_stats_array(cluster_shm);
+	
+	for (uint32_t i = 0; i < max; i++) {
+		as_node_stats* f = &fleet[i];
+		ck_pr_store_32(&f->in_flight, sums[i].in_flight);
+		ck_pr_store_32(&f->latency_us, latency_counts[i] ? (uint32_t)(latency_sums[i] / latency_counts[i]) : 0);
+		ck_pr_store_32(&f->latency_dev_us, latency_counts[i] ? (uint32_t)(latency_dev_sums[i] / latency_counts[i]) : 0);
+		ck_pr_store_32(&f->error_ppm, error_counts[i] ? (uint32_t)(error_sums[i] / error_counts[i]) : 0);
+		ck_pr_store_32(&f->transactions, sums[i].transactions);
+	}
+}
+
+static bool
+as_shm_all_followed(as_cluster_shm* old)
+{
+	// Processes without a statistics slot can't be told apart. They follow on their
+	// next tend either way.
+	uint32_t max = old->process_stats_capacity;
+	
+	for (uint32_t i = 0; i < max; i++) {
+		as_process_stats_shm* ps = as_shm_get_process_stats(old, i);
+		uint32_t pid = ck_pr_load_32(&ps->pid);
+		
+		if (pid == 0 || ck_pr_load_32(&ps->followed) || (kill(pid, 0) != 0 && errno == ESRCH)) {
+			continue;
+		}
+		return false;
+	}
+	return true;
+}
+
+static void
+as_shm_mirror(as_cluster_shm* cluster_shm, as_cluster_shm* old)
+{
+	// This function is called by shared memory master tending thread. Nodes past the
+	// old capacity are left out, and partitions they own read as unset.
+	uint32_t nodes_max = old->nodes_capacity;
+	uint32_t nodes_size = ck_pr_load_32(&cluster_shm->nodes_size);
+	uint32_t old_nodes_size = old->nodes_size;
+	bool nodes_changed = false;
+	
+	if (nodes_size > nodes_max) {
+		nodes_size = nodes_max;
+	}
+	
+	for (uint32_t i = 0; i < nodes_size; i++) {
+		as_node_shm* src = &cluster_shm->nodes[i];
+		as_node_shm* dst = &old->nodes[i];
+		
+		if (i < old_nodes_size && dst->active == src->active &&
+			memcmp(&dst->addr, &src->addr, sizeof(struct sockaddr_in)) == 0) {
+			continue;
+		}
+		
+		// Update shared memory node in write lock.
+		ck_swlock_write_lock(&dst->lock);
+		memcpy(dst->name, src->name, NODE_NAME_SIZE);
+		memcpy(&dst->addr, &src->addr, sizeof(struct sockaddr_in));
+		dst->active = src->active;
+		ck_swlock_write_unlock(&dst->lock);
+		nodes_changed = true;
+	}
+	
+	if (nodes_size > old_nodes_size) {
+		ck_pr_store_32(&old->nodes_size, nodes_size);
+	}
+	
+	if (nodes_changed) {
+		ck_pr_inc_32(&old->nodes_gen);
+	}
+	
+	// The partitions readers use are complete, since this thread is the only writer.
+	uint32_t n_partitions = cluster_shm->n_partitions;
+	size_t partitions_size = sizeof(as_partition_shm) * n_partitions;
+	as_partition_shm* scratch = (as_partition_shm*)alloca(partitions_size);
+	as_partition_table_shm* src = as_shm_get_partition_tables(cluster_shm);
+	as_partition_table_shm* dst = as_shm_get_partition_tables(old);
+	uint32_t tables_size = ck_pr_load_32(&cluster_shm->partition_tables_size);
+	uint32_t old_tables_size = old->partition_tables_size;
+	
+	if (tables_size > old->partition_tables_capacity) {
+		tables_size = old->partition_tables_capacity;
+	}
+	
+	for (uint32_t i = 0; i < tables_size; i++) {
+		memcpy(scratch, &src->partitions[src->active * n_partitions], partitions_size);
+		
+		for (uint32_t j = 0; j < n_partitions; j++) {
+			if (scratch[j].master > nodes_max) {
+				scratch[j].master = 0;
+			}
+			
+			if (scratch[j].prole > nodes_max) {
+				scratch[j].prole = 0;
+			}
+		}
+		
+		if (i >= old_tables_size) {
+			memcpy(dst->ns, src->ns, AS_MAX_NAMESPACE_SIZE);
+		}
+		
+		as_partition_shm* partitions = &dst->partitions[dst->active * n_partitions];
+		
+		if (memcmp(partitions, scratch, partitions_size) != 0) {
+			if (old->partition_buffers > 1) {
+				memcpy(as_shm_get_pending_partitions(old, dst), scratch, partitions_size);
+			}
+			else {
+				as_shm_seq_write_begin(&dst->seq);
+				as_shm_store_partitions(partitions, scratch, n_partitions);
+				as_shm_seq_write_end(&dst->seq);
+			}
+		}
+		src = as_shm_next_partition_table(cluster_shm, src);
+		dst = as_shm_next_partition_table(old, dst);
+	}
+	as_shm_publish_partitions(old);
+	
+	// New tables are complete before readers can find them.
+	if (tables_size > old_tables_size) {
+		ck_pr_store_32(&old->partition_tables_size, tables_size);
+	}
+	
+	memcpy(as_shm_get_node_stats_array(old), as_shm_get_node_stats_array(cluster_shm), sizeof(as_node_stats) * nodes_size);
+	ck_pr_store_64(&old->timestamp, cf_getms());
+}
+
+static void
+as_shm_mirror_retired(as_shm_info* shm_info)
+{
+	// Publish to the segments the map moved from, until every process has followed.
+	for (uint32_t i = 0; i < shm_info->retired.size; i++) {
+		as_shm_retired* retired = as_vector_get(&shm_info->retired, i);
+		
+		if (! retired->mirror) {
+			continue;
+		}
+		
+		if (as_shm_all_followed(retired->cluster_shm)) {
+			as_log_info("Stop updating shared memory cluster version %u", retired->cluster_shm->version);
+			retired->mirror = false;
+			continue;
+		}
+		as_shm_mirror(shm_info->cluster_shm, retired->cluster_shm);
+	}
+}
+
 static void
 as_shm_takeover_cluster(as_shm_info* shm_info, as_cluster_shm* cluster_shm, uint32_t pid)
 {
 	as_log_info("Take over shared memory cluster: %d", pid);
 	ck_pr_store_32(&cluster_shm->owner_pid, pid);
+	as_shm_repair_partition_tables(cluster_shm);
 	shm_info->is_tend_master = true;
 }
 
@@ -484,19 +1348,33 @@ as_shm_tender(void* userdata)
 	// Shared memory cluster tender.
 	as_cluster* cluster = userdata;
 	as_shm_info* shm_info = cluster->shm_info;
-	as_cluster_shm* cluster_shm = shm_info->cluster_shm;
+	as_cluster_shm* cluster_shm;
 	uint64_t threshold = shm_info->takeover_threshold_ms;
 	uint64_t limit = 0;
 	uint32_t tend_interval_micro = cluster->tend_interval * 1000;
 	uint32_t pid = getpid();
 	uint32_t nodes_gen = 0;
 	
+	// Processes publish statistics every tend interval. Those that missed a few are left out.
+	uint64_t stats_stale_ms = cluster->tend_interval * 3;
+	
 	while (cluster->valid) {
+		// The tend owner may have moved the map to a larger segment.
+		cluster_shm = shm_info->cluster_shm;
+		
 		if (shm_info->is_tend_master) {
 			// Tend shared memory cluster.
 			as_cluster_tend(cluster, false);
+			cluster_shm = shm_info->cluster_shm;
+			as_shm_publish_partitions(cluster_shm);
 			ck_pr_store_64(&cluster_shm->timestamp, cf_getms());
 		}
+		else if (ck_pr_load_8(&cluster_shm->moved)) {
+			// Follow the map to the larger segment.
+			if (as_shm_follow_successor(shm_info)) {
+				continue;
+			}
+		}
 		else {
 			// Follow shared memory cluster.
 			// Check if tend owner has released lock.
@@ -538,12 +1416,19 @@ as_shm_tender(void* userdata)
 				as_shm_reset_nodes(cluster);
 			}
 		}
+		
+		as_shm_publish_stats(shm_info, cluster_shm);
+		
+		if (shm_info->is_tend_master) {
+			as_shm_aggregate_stats(cluster_shm, stats_stale_ms);
+			as_shm_mirror_retired(shm_info);
+		}
 		usleep(tend_interval_micro);
 	}
 	
 	if (shm_info->is_tend_master) {
 		shm_info->is_tend_master = false;
-		ck_pr_store_8(&cluster_shm->lock, 0);
+		ck_pr_store_8(&shm_info->cluster_shm->lock, 0);
 	}
 	return 0;
 }
@@ -558,24 +1443,12 @@ as_shm_wait_till_ready(as_cluster* cluster, as_cluster_shm* cluster_shm)
 	do {
 		usleep(interval_micros);
 		
-		if (ck_pr_load_8(&cluster_shm->ready)) {
+		if (ck_pr_load_8(&cluster_shm->ready) || ck_pr_load_8(&cluster_shm->moved)) {
 			break;
 		}
 	} while (cf_getms() < limit);
 }
 
-static void
-as_shm_cleanup(int id, as_cluster_shm* cluster_shm)
-{
-	// Detach shared memory.
-	if (cluster_shm) {
-		shmdt(cluster_shm);
-	}
-	
-	// Try removing the shared memory - it will fail if any other process is still attached.
-	shmctl(id, IPC_RMID, 0);
-}
-
 int
 as_shm_create(as_cluster* cluster, as_config* config)
 {
@@ -585,13 +1458,15 @@ as_shm_create(as_cluster* cluster, as_config* config)
 	// Hard code value for now.
 	uint32_t n_partitions = 4096;
 	
-	uint32_t size = sizeof(as_cluster_shm) + (sizeof(as_node_shm) * config->shm_max_nodes) +
-		((sizeof(as_partition_table_shm) + (sizeof(as_partition_shm) * n_partitions)) * config->shm_max_namespaces);
+	as_shm_layout layout;
+	as_shm_layout_init(&layout, n_partitions, config->shm_double_buffer ? 2 : 1, config->shm_max_nodes,
+		config->shm_max_namespaces, config->shm_max_processes);
 	
 	uint32_t pid = getpid();
 
 	// Create shared memory segment.  Only one process will succeed.
-	int id = shmget(config->shm_key, size, IPC_CREAT | IPC_EXCL | 0666);
+	size_t create_size;
+	int id = as_shm_get_segment(config->shm_key, layout.size, IPC_CREAT | IPC_EXCL | 0666, config->shm_huge_pages, &create_size);
 	as_cluster_shm* cluster_shm = 0;
 	
 	if (id >= 0) {
@@ -608,17 +1483,11 @@ as_shm_create(as_cluster* cluster, as_config* config)
 			return AEROSPIKE_ERR_CLIENT;
 		}
 		
-		memset(cluster_shm, 0, size);
-		cluster_shm->n_partitions = n_partitions;
-		cluster_shm->nodes_capacity = config->shm_max_nodes;
-		cluster_shm->partition_tables_capacity = config->shm_max_namespaces;
-		cluster_shm->partition_tables_offset = sizeof(as_cluster_shm) + (sizeof(as_node_shm) * config->shm_max_nodes);
-		cluster_shm->partition_table_byte_size = sizeof(as_partition_table_shm) + (sizeof(as_partition_shm) * n_partitions);
-		cluster_shm->timestamp = cf_getms();
+		as_shm_format(cluster_shm, &layout, create_size, config->shm_numa_node);
 	}
 	else if (errno == EEXIST) {
 		// Some other process has created shared memory.  Use that shared memory.
-		id = shmget(config->shm_key, size, IPC_CREAT | 0666);
+		id = shmget(config->shm_key, layout.size, IPC_CREAT | 0666);
 		
 		if (id < 0) {
 			as_log_error("Shared memory get failed: %s pid: %d", strerror(errno), pid);
@@ -636,7 +1505,7 @@ as_shm_create(as_cluster* cluster, as_config* config)
 	else if (errno == ENOMEM) {
 		// OS shared memory max exceeded.
 		size_t max = as_shm_get_max_size();
-		as_log_error("Shared memory max %zu has been exceeded with latest shared memory request of size %zu", max, size);
+		as_log_error("Shared memory max %zu has been exceeded with latest shared memory request of size %zu", max, create_size);
 		
 #ifdef __linux__
 		as_log_error("You can increase shared memory size by: sysctl -w kernel.shmmax=<new_size>");
@@ -652,16 +1521,35 @@ as_shm_create(as_cluster* cluster, as_config* config)
 	}
 
 	as_shm_info* shm_info = cf_malloc(sizeof(as_shm_info));
-	shm_info->local_nodes = cf_calloc(config->shm_max_nodes, sizeof(as_node*));
+	// Size local nodes for the segment, which may have grown beyond this process's settings.
+	uint32_t nodes_capacity = ck_pr_load_32(&cluster_shm->nodes_capacity);
+	
+	if (nodes_capacity < config->shm_max_nodes) {
+		nodes_capacity = config->shm_max_nodes;
+	}
+	shm_info->local_nodes = cf_calloc(nodes_capacity, sizeof(as_node*));
 	shm_info->cluster_shm = cluster_shm;
 	shm_info->shm_id = id;
+	as_vector_init(&shm_info->retired, sizeof(as_shm_retired), 2);
+	shm_info->huge_pages = config->shm_huge_pages;
+	shm_info->numa_node = config->shm_numa_node;
 	shm_info->takeover_threshold_ms = config->shm_takeover_threshold_sec * 1000;
-	shm_info->is_tend_master = ck_pr_cas_8(&cluster_shm->lock, 0, 1);
+	shm_info->token = ck_pr_faa_32(&g_shm_token, 1) + 1;
+	shm_info->process_stats = as_shm_attach_process_stats(cluster_shm, pid, shm_info->token);
 	cluster->shm_info = shm_info;
 	
+	// The map may have moved to larger segments since the key was created.
+	if (! as_shm_follow_moves(shm_info)) {
+		as_shm_destroy(cluster, false);
+		return AEROSPIKE_ERR_CLIENT;
+	}
+	cluster_shm = shm_info->cluster_shm;
+	shm_info->is_tend_master = ck_pr_cas_8(&cluster_shm->lock, 0, 1);
+	
 	if (shm_info->is_tend_master) {
 		as_log_info("Take over shared memory cluster: %d", pid);
 		ck_pr_store_32(&cluster_shm->owner_pid, pid);
+		as_shm_repair_partition_tables(cluster_shm);
 		
 		// Ensure shared memory cluster is fully initialized.
 		if (cluster_shm->ready) {
@@ -672,11 +1560,15 @@ as_shm_create(as_cluster* cluster, as_config* config)
 		else {
 			int status = as_cluster_init(cluster, true);
 			
+			// Adding nodes and namespaces may have moved the map.
+			cluster_shm = shm_info->cluster_shm;
+			
 			if (status != 0) {
 				ck_pr_store_8(&cluster_shm->lock, 0);
 				as_shm_destroy(cluster, false);
 				return status;
 			}
+			as_shm_publish_partitions(cluster_shm);
 			cluster_shm->ready = 1;
 		}
 	}
@@ -688,6 +1580,11 @@ as_shm_create(as_cluster* cluster, as_config* config)
 			as_shm_wait_till_ready(cluster, cluster_shm);
 		}
 		
+		if (! as_shm_follow_moves(shm_info)) {
+			as_shm_destroy(cluster, false);
+			return AEROSPIKE_ERR_CLIENT;
+		}
+		
 		// Copy shared memory nodes to local nodes.
 		as_shm_reset_nodes(cluster);
 		as_cluster_add_seeds(cluster);
@@ -713,12 +1610,23 @@ as_shm_destroy(as_cluster* cluster, bool join_threads)
 		return;
 	}
 	
+	as_shm_release_process_stats(shm_info);
+	
 	// Detach shared memory.
 	shmdt(shm_info->cluster_shm);
 	
 	// Try removing the shared memory - it will fail if any other process is still attached.
 	// Failure is normal behavior, so don't check return code.
 	shmctl(shm_info->shm_id, IPC_RMID, 0);
+	
+	// Same for the segments the map moved from.
+	for (uint32_t i = 0; i < shm_info->retired.size; i++) {
+		as_shm_retired* retired = as_vector_get(&shm_info->retired, i);
+		shmdt(retired->cluster_shm);
+		shmctl(retired->shm_id, IPC_RMID, 0);
+		cf_free(retired->local_nodes);
+	}
+	as_vector_destroy(&shm_info->retired);
 
 	// Release memory.
 	cf_free(shm_info->local_nodes);
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_write_template.h>
+#include <aerospike/as_record.h>
+
+#include <citrusleaf/citrusleaf.h>
+#include <citrusleaf/cl_kv.h>
+#include <citrusleaf/cl_write.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "_shim.h"
+
+/******************************************************************************
+ *	FUNCTIONS
+ *****************************************************************************/
+
+as_status as_write_template_init(
+	aerospike * as, as_error * err, as_write_template * tmpl, const as_policy_write * policy,
+	const as_namespace ns, const as_set set, const char ** bins, const as_operator * ops, uint16_t n_bins,
+	uint32_t ttl)
+{
+	as_error_reset(err);
+	memset(tmpl, 0, sizeof(as_write_template));
+
+	if (! policy) {
+		policy = &as->config.policies.write;
+	}
+
+	if ( policy->gen != AS_POLICY_GEN_IGNORE ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "write templates do not support generation checks");
+	}
+
+	if ( n_bins == 0 || strlen(ns) >= AS_NAMESPACE_MAX_SIZE || (set && strlen(set) >= AS_SET_MAX_SIZE) ) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "invalid namespace, set or bins");
+	}
+
+	for ( uint16_t i = 0; i < n_bins; i++ ) {
+		if ( strlen(bins[i]) >= AS_BIN_NAME_MAX_SIZE ) {
+			return as_error_update(err, AEROSPIKE_ERR_PARAM, "bin name too long: %s", bins[i]);
+		}
+
+		switch ( ops[i] ) {
+			case AS_OPERATOR_WRITE:
+			case AS_OPERATOR_INCR:
+			case AS_OPERATOR_APPEND:
+			case AS_OPERATOR_PREPEND:
+			case AS_OPERATOR_TOUCH:
+				break;
+			default:
+				return as_error_update(err, AEROSPIKE_ERR_PARAM, "unsupported operation on bin %s", bins[i]);
+		}
+	}
+
+	strcpy(tmpl->ns, ns);
+	strcpy(tmpl->set, set ? set : "");
+	as_policy_write_copy((as_policy_write *) policy, &tmpl->policy);
+	tmpl->n_bins = n_bins;
+	tmpl->bins = (as_bin_name *) malloc(sizeof(as_bin_name) * n_bins);
+	tmpl->ops = (as_operator *) malloc(sizeof(as_operator) * n_bins);
+	tmpl->compiled = (cl_write_template *) malloc(sizeof(cl_write_template));
+
+	if ( ! tmpl->bins || ! tmpl->ops || ! tmpl->compiled ) {
+		free(tmpl->compiled);
+		tmpl->compiled = NULL;
+		as_write_template_destroy(tmpl);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "out of memory");
+	}
+
+	cl_operator * clops = (cl_operator *) alloca(sizeof(cl_operator) * n_bins);
+
+	for ( uint16_t i = 0; i < n_bins; i++ ) {
+		strcpy(tmpl->bins[i], bins[i]);
+		tmpl->ops[i] = ops[i];
+		clops[i] = (cl_operator) ops[i];
+	}
+
+	// Only the TTL of the record is used.
+	as_record rec;
+	memset(&rec, 0, sizeof(as_record));
+	rec.ttl = ttl;
+
+	cl_write_parameters wp;
+	aspolicywrite_to_clwriteparameters(policy, &rec, &wp);
+
+	int commit_level = 0;
+	if ( policy->commit_level == AS_POLICY_COMMIT_LEVEL_MASTER ) {
+		commit_level |= CL_MSG_INFO3_COMMIT_LEVEL_B0;
+	}
+
+	if ( citrusleaf_write_template_init(tmpl->compiled, ns, set, bins, clops, n_bins,
+			policy->key == AS_POLICY_KEY_SEND, &wp, commit_level) != 0 ) {
+		free(tmpl->compiled);
+		tmpl->compiled = NULL;
+		as_write_template_destroy(tmpl);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "failed to compile write template");
+	}
+
+	return AEROSPIKE_OK;
+}
+
+void as_write_template_destroy(as_write_template * tmpl)
+{
+	if ( tmpl->compiled ) {
+		citrusleaf_write_template_destroy(tmpl->compiled);
+		free(tmpl->compiled);
+	}
+	free(tmpl->bins);
+	free(tmpl->ops);
+	memset(tmpl, 0, sizeof(as_write_template));
+}
@@ -25,21 +25,29 @@
 #include <fcntl.h>
 #include <inttypes.h> // PRIu64
 #include <signal.h>
+#include <poll.h>
 
 #include <aerospike/as_cluster.h>
+#include <aerospike/as_codec.h>
 #include <aerospike/as_log_macros.h>
+#include <aerospike/as_msgpack_writer.h>
 
 #include <citrusleaf/cf_byte_order.h>
 #include <citrusleaf/cf_atomic.h>
 #include <citrusleaf/cf_proto.h>
 #include <citrusleaf/cf_socket.h>
 #include <citrusleaf/citrusleaf.h>
+#include <citrusleaf/cl_buf_cache.h>
 
 #include "internal.h"
 
 // This is a per-transaction deadline kind of thing
 #define DEFAULT_TIMEOUT 200
 
+// Limits of the random wait before a retry, which double with each attempt.
+#define RETRY_BACKOFF_BASE_US 500
+#define RETRY_BACKOFF_MAX_US 16000
+
 // #define DEBUG 1
 // #define DEBUG_VERBOSE 1
 // #define DEBUG_TIME 1 // debugs involving timing
@@ -184,6 +192,15 @@ int citrusleaf_copy_object(cl_object *destobj, cl_object *srcobj)
 			}
 			memcpy(destobj->u.blob, srcobj->u.blob, destobj->sz);
 			break;
+		case CL_AS_VAL:
+			// The copy must not depend on the as_val, so it holds it encoded.
+			destobj->type = ((as_val *) srcobj->u.blob)->type == AS_MAP ? CL_MAP : CL_LIST;
+			destobj->free = destobj->u.blob = malloc(destobj->sz);
+			if (destobj->free == NULL) {
+				return -1;
+			}
+			as_msgpack_writer_write((as_val *) srcobj->u.blob, destobj->u.blob);
+			break;
 		default:
 			as_log_error("Encountered an unknown bin type %d", srcobj->type);
 			return -1;
@@ -637,6 +654,7 @@ cl_value_to_op_get_size(cl_bin *v, size_t *sz)
 		case CL_CSHARP_BLOB:
 		case CL_PHP_BLOB:
 		case CL_LUA_BLOB:
+		case CL_AS_VAL:
 			*sz += v->object.sz;
 			break;
 		default:
@@ -668,6 +686,7 @@ cl_object_get_size(cl_object *obj, size_t *sz)
 		case CL_CSHARP_BLOB:
 		case CL_PHP_BLOB:
 		case CL_LUA_BLOB:
+		case CL_AS_VAL:
 			*sz += obj->sz;
 			break;
 		default:
@@ -764,6 +783,13 @@ cl_value_to_op(cl_bin *v, cl_operator operator, cl_operation *operation, cl_msg_
 				memcpy(data, tmpValue->object.u.blob, tmpValue->object.sz);
 			}
 			break;
+		case CL_AS_VAL: {
+			// Encoded in place, in the space cl_value_to_op_get_size() reserved.
+			as_val *val = (as_val *) tmpValue->object.u.blob;
+			op->particle_type = val->type == AS_MAP ? CL_MAP : CL_LIST;
+			op->op_sz += (uint32_t) as_msgpack_writer_write(val, data);
+			break;
+		}
 		default:
 #ifdef DEBUG_VERBOSE
 			as_log_debug("internal error value_to_op has unknown value type %d",tmpValue->object.type);
@@ -799,6 +825,9 @@ cl_object_to_buf (cl_object *obj, uint8_t *data)
 			sz += obj->sz;
 			memcpy(data, obj->u.blob, obj->sz);
 			break;
+		case CL_AS_VAL:
+			sz += (int) as_msgpack_writer_write((as_val *) obj->u.blob, data);
+			break;
 		default:
 #ifdef DEBUG_VERBOSE
 			as_log_error("internal error value_to_op has unknown value type %d", obj->type);
@@ -807,6 +836,42 @@ cl_object_to_buf (cl_object *obj, uint8_t *data)
 	}
 	return(0);
 }
+//
+// Fold the write parameters into the info bits of a request. Returns the
+// generation to send.
+//
+
+static uint32_t
+cl_write_parameters_to_info(const cl_write_parameters *cl_w_p, uint *info2, uint *info3)
+{
+	uint32_t generation = 0;
+	if (cl_w_p) {
+		if (cl_w_p->unique) {
+			*info2 |= CL_MSG_INFO2_CREATE_ONLY;
+		} else if (cl_w_p->unique_bin) {
+			*info2 |= CL_MSG_INFO2_BIN_CREATE_ONLY;
+		} else if (cl_w_p->update_only) {
+			*info3 |= CL_MSG_INFO3_UPDATE_ONLY;
+		} else if (cl_w_p->create_or_replace) {
+			*info3 |= CL_MSG_INFO3_CREATE_OR_REPLACE;
+		} else if (cl_w_p->replace_only) {
+			*info3 |= CL_MSG_INFO3_REPLACE_ONLY;
+		} else if (cl_w_p->bin_replace_only) {
+			*info3 |= CL_MSG_INFO3_BIN_REPLACE_ONLY;
+		} else if (cl_w_p->use_generation) {
+			*info2 |= CL_MSG_INFO2_GENERATION;
+			generation = cl_w_p->generation;
+		} else if (cl_w_p->use_generation_gt) {
+			*info2 |= CL_MSG_INFO2_GENERATION_GT;
+			generation = cl_w_p->generation;
+		} else if (cl_w_p->use_generation_dup) {
+			*info2 |= CL_MSG_INFO2_GENERATION_DUP;
+			generation = cl_w_p->generation;
+		}
+	}
+	return generation;
+}
+
 //
 // n_values can be passed in 0, and then values is undefined / probably 0.
 //
@@ -859,11 +924,12 @@ cl_compile(uint info1, uint info2, uint info3, const char *ns, const char *set,
 		}
 	}
 	
-	// size too small? malloc!
+	// size too small? take a buffer from the thread's cache, the caller
+	// gives it back with cl_buf_release()
 	uint8_t	*buf;
 	uint8_t *mbuf = 0;
 	if ((*buf_r) && (msg_sz > *buf_sz_r)) {
-		mbuf = buf = malloc(msg_sz);
+		mbuf = buf = cl_buf_acquire(msg_sz);
 		if (!buf) 			return(-1);
 		*buf_r = buf;
 	}
@@ -876,31 +942,7 @@ cl_compile(uint info1, uint info2, uint info3, const char *ns, const char *set,
 	memset(buf, 0, msg_sz);
 	
 	// lay in some parameters
-	uint32_t generation = 0;
-	if (cl_w_p) {
-		if (cl_w_p->unique) {
-			info2 |= CL_MSG_INFO2_CREATE_ONLY;
-		} else if (cl_w_p->unique_bin) {
-			info2 |= CL_MSG_INFO2_BIN_CREATE_ONLY;
-		} else if (cl_w_p->update_only) {
-			info3 |= CL_MSG_INFO3_UPDATE_ONLY;
-		} else if (cl_w_p->create_or_replace) {
-			info3 |= CL_MSG_INFO3_CREATE_OR_REPLACE;
-		} else if (cl_w_p->replace_only) {
-			info3 |= CL_MSG_INFO3_REPLACE_ONLY;
-		} else if (cl_w_p->bin_replace_only) {
-			info3 |= CL_MSG_INFO3_BIN_REPLACE_ONLY;
-		} else if (cl_w_p->use_generation) {
-			info2 |= CL_MSG_INFO2_GENERATION;
-			generation = cl_w_p->generation;
-		} else if (cl_w_p->use_generation_gt) {
-			info2 |= CL_MSG_INFO2_GENERATION_GT;
-			generation = cl_w_p->generation;
-		} else if (cl_w_p->use_generation_dup) {
-			info2 |= CL_MSG_INFO2_GENERATION_DUP;
-			generation = cl_w_p->generation;
-		}
-	}
+	uint32_t generation = cl_write_parameters_to_info(cl_w_p, &info2, &info3);
 
 	uint32_t record_ttl = cl_w_p ? cl_w_p->record_ttl : 0;
 	uint32_t transaction_ttl = cl_w_p ? cl_w_p->timeout_ms : 0;
@@ -912,7 +954,7 @@ cl_compile(uint info1, uint info2, uint info3, const char *ns, const char *set,
 	// now the fields
 	buf = write_fields(buf, ns, ns_len, set, set_len, key, digest, d_ret, trid,scan_param_field, call, udf_type);
 	if (!buf) {
-		if (mbuf)	free(mbuf);
+		if (mbuf)	cl_buf_release(mbuf);
 		return(-1);
 	}
 
@@ -1223,22 +1265,285 @@ cl_parse(cl_msg *msg, uint8_t *buf, size_t buf_len, cl_bin **values_r,
 
 
 //
-// Omnibus (!beep!! !beep!!) internal function that the externals can map to
-// If you don't want any values back, pass the values and n_values pointers as null
+// Walk the fields and swap the ops of a response, then hand the ops to the
+// callback without copying them out of the buffer. Returns the result of the
+// callback.
 //
-// WARNING - this parsing system relied on the length of cl_msg, which is
-// clumsy and against the spirit of the protocol. The length of cl_msg is specified
-// in the protocol, and the length of the message is defined - it should all be used.
+
+static int
+cl_parse_ops(cl_msg *msg, uint8_t *buf, size_t buf_len, citrusleaf_get_ops_cb ops_cb, void *udata)
+{
+	uint8_t *buf_lim = buf + buf_len;
+
+	int i;
+	cl_msg_field *mf = (cl_msg_field *)buf;
+
+	for (i = 0; i < msg->n_fields; i++) {
+		if (buf_lim < buf + sizeof(cl_msg_field)) {
+			return(AEROSPIKE_ERR_SERVER);
+		}
+		cl_msg_swap_field_from_be(mf);
+		mf = cl_msg_field_get_next(mf);
+		buf = (uint8_t *) mf;
+	}
+
+	cl_msg_op *ops = (cl_msg_op *)buf;
+	cl_msg_op *op = ops;
+
+	for (i = 0; i < msg->n_ops; i++) {
+		if (buf_lim < buf + sizeof(cl_msg_op)) {
+			return(AEROSPIKE_ERR_SERVER);
+		}
+		cl_msg_swap_op_from_be(op);
+		op = cl_msg_op_get_next(op);
+		buf = (uint8_t *) op;
+	}
+
+	if (buf_lim < buf) {
+		return(AEROSPIKE_ERR_SERVER);
+	}
+
+	return (*ops_cb)(ops, msg->n_ops, udata);
+}
+
+
 //
-// EITHER set + key must be set, or digest must be set! not both!
+// Finish reading a compressed response, of which the proto and the first
+// sizeof(as_msg) - sizeof(cl_proto) bytes of the body are already in msg, and
+// inflate it. On success msg holds the real header, and *rd_buf_r the rest of
+// the message in a buffer from cl_buf_acquire(), or 0 if there is none.
 //
-// Similarly, either values or operations must be set, but not both.
+static int
+cl_read_compressed_msg(as_cluster *asc, int fd, as_msg *msg, uint8_t **rd_buf_r, uint64_t deadline_ms, int progress_timeout_ms)
+{
+	size_t have = sizeof(as_msg) - sizeof(cl_proto);
+	size_t body_sz = msg->proto.sz;
 
-int
-do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *ns, const char *set, const cl_object *key,
-	const cf_digest *digest, cl_bin **values, cl_operator operator, cl_operation **operations, int *n_values, 
-	uint32_t *cl_gen, const cl_write_parameters *cl_w_p, uint64_t *trid, char **setname_r, as_call * call, uint32_t* cl_ttl,
-	as_policy_replica replica)
+	if (body_sz < have) {
+		return AEROSPIKE_ERR_CLIENT;
+	}
+
+	uint8_t *body = cl_buf_acquire(body_sz);
+	if (!body) {
+		return AEROSPIKE_ERR_CLIENT;
+	}
+	memcpy(body, &msg->m, have);
+
+	if (cf_socket_read_timeout(fd, body + have, body_sz - have, deadline_ms, progress_timeout_ms)) {
+		cl_buf_release(body);
+		return AEROSPIKE_ERR_TIMEOUT;
+	}
+
+	uint8_t *msgs;
+	size_t msgs_sz;
+	int rv = as_codec_decompress_body(asc->codec, body, body_sz, &msgs, &msgs_sz);
+	cl_buf_release(body);
+
+	if (rv || msgs_sz < sizeof(cl_msg)) {
+		if (rv == 0) {
+			cl_buf_release(msgs);
+		}
+		as_log_error("could not decompress response");
+		return AEROSPIKE_ERR_CLIENT;
+	}
+
+	memcpy(&msg->m, msgs, sizeof(cl_msg));
+	cl_msg_swap_header_from_be(&msg->m);
+
+	if (msg->m.header_sz < sizeof(cl_msg) || msg->m.header_sz > msgs_sz) {
+		cl_buf_release(msgs);
+		return AEROSPIKE_ERR_CLIENT;
+	}
+
+	// Present the inflated message as if it had been received uncompressed.
+	msg->proto.type = CL_PROTO_TYPE_CL_MSG;
+	msg->proto.sz = msgs_sz;
+
+	size_t rd_buf_sz = msgs_sz - msg->m.header_sz;
+	if (rd_buf_sz > 0) {
+		memmove(msgs, msgs + msg->m.header_sz, rd_buf_sz);
+		*rd_buf_r = msgs;
+	}
+	else {
+		cl_buf_release(msgs);
+		*rd_buf_r = 0;
+	}
+	return 0;
+}
+
+//
+// Wait up to the hedge delay for a read sent to *node_r to be answered. If it
+// is not, send the same read to the other replica of the partition, and leave
+// in *node_r, *fd_r and *begin_us_r whichever request is answered first. The
+// other connection is closed, since its response is never read.
+//
+
+static void
+cl_hedge(as_cluster *asc, const char *ns, const cf_digest *d, uint32_t hedge_delay_ms, uint8_t *wr_buf, size_t wr_buf_sz,
+	as_node **node_r, int *fd_r, uint64_t *begin_us_r, uint64_t deadline_ms, uint progress_timeout_ms)
+{
+	int delay_ms;
+
+	if (hedge_delay_ms == AS_POLICY_HEDGE_DELAY_ADAPTIVE) {
+		uint64_t p95_us = as_node_latency_percentile(*node_r, AS_NODE_LATENCY_READ, 95);
+
+		if (p95_us == 0) {
+			// Not enough reads seen on the node yet.
+			return;
+		}
+		delay_ms = (int)((p95_us + 999) / 1000);
+	}
+	else {
+		delay_ms = (int)hedge_delay_ms;
+	}
+
+	// No point hedging a read that times out first.
+	if (deadline_ms) {
+		uint64_t now = cf_getms();
+
+		if (now >= deadline_ms) {
+			return;
+		}
+
+		if ((uint64_t)delay_ms > deadline_ms - now) {
+			delay_ms = (int)(deadline_ms - now);
+		}
+	}
+
+	// Each read that may be hedged earns hedge_max_percent hundredths of a
+	// hedge, so no more than that share of reads are. At most 100 unused
+	// hedges are kept.
+	if (ck_pr_load_32(&asc->hedge_tokens) < 100 * 100) {
+		ck_pr_add_32(&asc->hedge_tokens, asc->hedge_max_percent);
+	}
+
+	struct pollfd pfd[2];
+	pfd[0].fd = *fd_r;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+
+	if (poll(pfd, 1, delay_ms) != 0) {
+		// Answered, failed or interrupted - the read that follows handles it.
+		return;
+	}
+
+	ck_pr_inc_64(&asc->hedge_stats.slow);
+
+	uint32_t tokens;
+	do {
+		tokens = ck_pr_load_32(&asc->hedge_tokens);
+
+		if (tokens < 100) {
+			ck_pr_inc_64(&asc->hedge_stats.throttled);
+			return;
+		}
+	} while (! ck_pr_cas_32(&asc->hedge_tokens, tokens, tokens - 100));
+
+	as_node *replica = as_node_get_replica(asc, ns, d, *node_r);
+	int fd = -1;
+
+	if (! replica || ! as_node_breaker_allow(replica) || as_node_get_connection(replica, &fd)) {
+		if (replica) {
+			as_node_release(replica);
+		}
+		ck_pr_add_32(&asc->hedge_tokens, 100);
+		return;
+	}
+
+	as_node_stats_begin(replica);
+	uint64_t begin_us = cf_getus();
+
+	if (cf_socket_write_timeout(fd, wr_buf, wr_buf_sz, deadline_ms, progress_timeout_ms)) {
+		cf_close(fd);
+		as_node_stats_end(replica, begin_us, false);
+		as_node_release(replica);
+		ck_pr_add_32(&asc->hedge_tokens, 100);
+		return;
+	}
+
+	ck_pr_inc_64(&asc->hedge_stats.hedged);
+
+	pfd[0].revents = 0;
+	pfd[1].fd = fd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	int timeout_ms = (int)progress_timeout_ms;
+
+	if (deadline_ms) {
+		uint64_t now = cf_getms();
+		timeout_ms = deadline_ms > now ? (int)(deadline_ms - now) : 0;
+	}
+
+	int rv = poll(pfd, 2, timeout_ms);
+
+	if (rv > 0 && ! (pfd[0].revents & POLLIN) && (pfd[1].revents & POLLIN)) {
+		// The replica answered first.
+		cf_close(*fd_r);
+		as_node_stats_cancel(*node_r);
+		as_node_release(*node_r);
+		ck_pr_inc_64(&asc->hedge_stats.won);
+
+		*node_r = replica;
+		*fd_r = fd;
+		*begin_us_r = begin_us;
+		return;
+	}
+
+	// Keep the first request. If neither answered, its read times out as
+	// it would have without the hedge.
+	cf_close(fd);
+	as_node_stats_cancel(replica);
+	as_node_release(replica);
+}
+
+//
+// Wait before attempt number try, for a random time up to a limit that doubles
+// with each attempt, so threads that failed together do not retry together.
+// The wait never passes the deadline.
+//
+
+static void
+cl_retry_backoff(int try, uint64_t deadline_ms)
+{
+	uint64_t limit_us = (uint64_t)RETRY_BACKOFF_BASE_US << (try < 7 ? try - 2 : 5);
+
+	if (limit_us > RETRY_BACKOFF_MAX_US) {
+		limit_us = RETRY_BACKOFF_MAX_US;
+	}
+
+	if (deadline_ms) {
+		uint64_t now_ms = cf_getms();
+
+		if (now_ms >= deadline_ms) {
+			return;
+		}
+
+		if (limit_us > (deadline_ms - now_ms) * 1000) {
+			limit_us = (deadline_ms - now_ms) * 1000;
+		}
+	}
+
+	// Spread the bits of the clock.
+	uint32_t random = (uint32_t)cf_getus() * 2654435761u;
+	usleep((useconds_t)(random % (limit_us + 1)));
+}
+
+//
+// Send a compiled request and read the response, retrying as the write
+// parameters allow. The caller keeps ownership of wr_buf.
+//
+// Each attempt lasts at most attempt_timeout_ms, and attempts stop at the
+// deadline. A request that was never sent is always retried while there is
+// time left. Once sent, it is only retried with CL_WRITE_RETRY, and retried
+// reads alternate between the node chosen by the replica policy and the other
+// replica.
+//
+
+static int
+cl_transact(as_cluster *asc, int info2, const char *ns, const cf_digest *d_ret, uint8_t *wr_buf, size_t wr_buf_sz,
+	cl_bin **values, int *n_values, uint32_t *cl_gen, const cl_write_parameters *cl_w_p, uint64_t *trid, char **setname_r,
+	uint32_t* cl_ttl, as_policy_replica replica, citrusleaf_get_ops_cb ops_cb, void *udata)
 {
 	int rv = -1;
 #ifdef DEBUG_HISTOGRAM
@@ -1248,38 +1553,31 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 	uint8_t		rd_stack_buf[STACK_BUF_SZ];
 	uint8_t		*rd_buf = rd_stack_buf;
 	size_t		rd_buf_sz = 0;
-    
-	uint8_t		wr_stack_buf[STACK_BUF_SZ];
-	uint8_t		*wr_buf = wr_stack_buf;
-	size_t		wr_buf_sz = sizeof(wr_stack_buf);
+
+	uint8_t		*frame = 0;
 
 	as_msg 		msg;
     
     uint        progress_timeout_ms;
 	uint64_t deadline_ms;
+	uint64_t attempt_deadline_ms = 0;
 	as_node *node = 0;
+	uint64_t begin_us = 0;
 	
 	int fd = -1;
 
-//	if( *values ){
-//		dump_values(*values, null, *n_values);
-//	}else if( *operations ){
-//		dump_values(null, *operations, *n_values);
-//	}
+	// Large writes go out compressed when the policy asks for it, and only if
+	// that makes them smaller.
+	if (cl_w_p && cl_w_p->compression_threshold && (info2 & CL_MSG_INFO2_WRITE) &&
+		wr_buf_sz >= cl_w_p->compression_threshold) {
+		size_t frame_sz;
 
-	cf_digest d_ret;
-	if (n_values && ( values || operations) ){
-		if (cl_compile(info1, info2, info3, ns, set, key, digest, values?*values:NULL, operator, operations?*operations:NULL,
-				*n_values , &wr_buf, &wr_buf_sz, cl_w_p, &d_ret, *trid, NULL, call, 0 /* udf_type */)) {
-			return(rv);
+		if (as_codec_compress_proto(asc->codec, asc->codec_level, wr_buf, wr_buf_sz, &frame, &frame_sz) == 0) {
+			wr_buf = frame;
+			wr_buf_sz = frame_sz;
 		}
-		if (operations) {
-			// Force results of operations returned in response to be malloc'd.
-			*n_values = 0;
-		}
-	}else{
-		if (cl_compile(info1, info2, info3, ns, set, key, digest, 0, 0, 0, 0, &wr_buf, &wr_buf_sz, cl_w_p, &d_ret, *trid, NULL, call, 0 /*udf_type*/)) {
-			return(rv);
+		else {
+			frame = 0;
 		}
 	}
 
@@ -1313,6 +1611,12 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
         progress_timeout_ms = DEFAULT_PROGRESS_TIMEOUT;
     }
 
+	bool is_read = ! (info2 & CL_MSG_INFO2_WRITE);
+	bool retry_sent = (cl_w_p == 0) || (cl_w_p->w_pol == CL_WRITE_RETRY);
+	uint32_t attempt_timeout_ms = cl_w_p ? cl_w_p->attempt_timeout_ms : 0;
+	uint32_t latency_kind = is_read ? AS_NODE_LATENCY_READ : AS_NODE_LATENCY_WRITE;
+	bool sent;
+
 	// retry request based on the write_policy
 	do {
 
@@ -1330,20 +1634,94 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 			as_log_debug("request retrying try %d tid %zu", try, (uint64_t)pthread_self());
 #endif        
 		try++;
+		sent = false;
+
+		// A failed attempt may have released the read buffer.
+		rd_buf = rd_stack_buf;
+		rd_buf_sz = 0;
+
+		ck_pr_inc_64(&asc->retry_stats.attempts);
+
+		if (try > 1) {
+			ck_pr_inc_64(&asc->retry_stats.retries);
+		}
+
 		
 		// Get an FD from a cluster
-		node = as_node_get(asc, ns, &d_ret, info2 & CL_MSG_INFO2_WRITE ? true : false, replica);
+		node = as_node_get(asc, ns, d_ret, is_read ? false : true, replica);
 		if (!node) {
 #ifdef DEBUG_VERBOSE
 			as_log_debug("warning: no healthy nodes in cluster, retrying");
 #endif
-			usleep(10000);
 			goto Retry;
 		}
+
+		// Each node's breaker is asked once per attempt, since letting a probe
+		// through changes its state. alt is kept if its breaker refused.
+		as_node *alt = 0;
+		bool allowed = false;
+
+		if (is_read && (try % 2) == 0) {
+			alt = as_node_get_replica(asc, ns, d_ret, node);
+
+			if (alt && as_node_breaker_allow(alt)) {
+				as_node_release(node);
+				node = alt;
+				alt = 0;
+				allowed = true;
+				ck_pr_inc_64(&asc->retry_stats.replica_retries);
+			}
+		}
+
+		if (! allowed && ! as_node_breaker_allow(node)) {
+			// The node keeps failing. Reads go to the replica, writes fail now
+			// rather than at their timeout.
+			as_node *replica = 0;
+
+			if (is_read && ! alt) {
+				replica = as_node_get_replica(asc, ns, d_ret, node);
+
+				if (replica && ! as_node_breaker_allow(replica)) {
+					as_node_release(replica);
+					replica = 0;
+				}
+			}
+			as_node_release(node);
+			node = replica;
+		}
+
+		if (alt) {
+			as_node_release(alt);
+		}
+
+		if (!node) {
+			rv = AEROSPIKE_ERR_CLUSTER;
+			goto Error;
+		}
+
+		attempt_deadline_ms = deadline_ms;
+		uint64_t attempt_ms = attempt_timeout_ms;
+
+		if (attempt_timeout_ms == AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE) {
+			// A multiple of the node's recent latency, in whole milliseconds. Not
+			// limited until the node has enough latencies.
+			uint64_t latency_us = as_node_latency_percentile(node, latency_kind, asc->adaptive_timeout_percentile);
+			attempt_ms = (latency_us * asc->adaptive_timeout_multiplier + 999) / 1000;
+		}
+
+		if (attempt_ms) {
+			uint64_t limit_ms = cf_getms() + attempt_ms;
+
+			if (deadline_ms == 0 || limit_ms < deadline_ms) {
+				attempt_deadline_ms = limit_ms;
+			}
+		}
+
+		as_node_stats_begin(node);
+		begin_us = cf_getus();
 		
 		rv = as_node_get_connection(node, &fd);
 		if (rv) {
-			usleep(1000);
 			goto Retry;
 		}
 		
@@ -1352,7 +1730,7 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 #ifdef DEBUG_TIME
         before_write_time = cf_getms();
 #endif
-		rv = cf_socket_write_timeout(fd, wr_buf, wr_buf_sz, deadline_ms, progress_timeout_ms);
+		rv = cf_socket_write_timeout(fd, wr_buf, wr_buf_sz, attempt_deadline_ms, progress_timeout_ms);
 #ifdef DEBUG_TIME
         after_write_time = cf_getms();
 #endif
@@ -1369,6 +1747,13 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 			goto Retry;
 		}
 
+		sent = true;
+
+		if (cl_w_p && cl_w_p->hedge_delay_ms && is_read) {
+			cl_hedge(asc, ns, d_ret, cl_w_p->hedge_delay_ms, wr_buf, wr_buf_sz, &node, &fd, &begin_us,
+				attempt_deadline_ms, progress_timeout_ms);
+		}
+
 #ifdef DEBUG_VERBOSE
 		memset(&msg, 0, sizeof(as_msg));
 #endif
@@ -1377,7 +1762,7 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 #endif
 		
 		// Now turn around and read into this fine cl_msg, which is the short header
-		rv = cf_socket_read_timeout(fd, (uint8_t *) &msg, sizeof(as_msg), deadline_ms, progress_timeout_ms);
+		rv = cf_socket_read_timeout(fd, (uint8_t *) &msg, sizeof(as_msg), attempt_deadline_ms, progress_timeout_ms);
 #ifdef DEBUG_TIME
         after_read_header_time = cf_getms();
 #endif
@@ -1399,7 +1784,23 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 		dump_buf("read header from cluster", (uint8_t *) &msg, sizeof(cl_msg));
 #endif	
 		cl_proto_swap_from_be(&msg.proto);
-		cl_msg_swap_header_from_be(&msg.m);
+
+		uint8_t *inflated = 0;
+		if (msg.proto.type == CL_PROTO_TYPE_CL_MSG_COMPRESSED) {
+			rv = cl_read_compressed_msg(asc, fd, &msg, &inflated, attempt_deadline_ms, progress_timeout_ms);
+			if (rv == AEROSPIKE_ERR_TIMEOUT) {
+				goto Retry;
+			}
+			if (rv) {
+				as_node_stats_end(node, begin_us, false);
+				as_node_release(node);
+				node = 0;
+				goto Error;
+			}
+		}
+		else {
+			cl_msg_swap_header_from_be(&msg.m);
+		}
 
 		if (/*(info1 & CL_MSG_INFO1_READ) &&*/ cl_gen) {
 			*cl_gen = msg.m.generation;
@@ -1412,9 +1813,12 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 		// second read for the remainder of the message - expect this to cover everything requested
 		// if there's no error
 		rd_buf_sz =  msg.proto.sz  - msg.m.header_sz;
-		if (rd_buf_sz > 0) {
+		if (inflated) {
+			rd_buf = inflated;
+		}
+		else if (rd_buf_sz > 0) {
 			if (rd_buf_sz > sizeof(rd_stack_buf)) {
-				rd_buf = malloc(rd_buf_sz);
+				rd_buf = cl_buf_acquire(rd_buf_sz);
 				if (!rd_buf) {
                     as_log_error("malloc fail: trying %zu", rd_buf_sz);
                     rv = -1; 
@@ -1424,12 +1828,12 @@ do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *
 #ifdef DEBUG_TIME
         before_read_body_time = cf_getms();
 #endif            
-			rv = cf_socket_read_timeout(fd, rd_buf, rd_buf_sz, deadline_ms, progress_timeout_ms);
+			rv = cf_socket_read_timeout(fd, rd_buf, rd_buf_sz, attempt_deadline_ms, progress_timeout_ms);
 #ifdef DEBUG_TIME
         after_read_body_time = cf_getms();
 #endif
 			if (rv) {
-				if (rd_buf != rd_stack_buf) { free(rd_buf); }
+				if (rd_buf != rd_stack_buf) { cl_buf_release(rd_buf); }
                 rd_buf = 0;
                 
 #ifdef DEBUG_VERBOSE            
@@ -1460,6 +1864,20 @@ Retry:
 		}
 
 		if (node) {
+			if (sent && rv == AEROSPIKE_ERR_TIMEOUT) {
+				// Attempts cut short still count, so that adaptive timeouts grow
+				// when the node slows down.
+				as_node_latency_add(node, latency_kind, cf_getus() - begin_us);
+			}
+
+			// An attempt that ran out of its own time, short of the deadline, only
+			// shows the node is slower than the attempt timeout, not that it is down.
+			if (rv == AEROSPIKE_ERR_TIMEOUT && attempt_deadline_ms != deadline_ms && cf_getms() > attempt_deadline_ms) {
+				as_node_stats_expire(node, begin_us);
+			}
+			else {
+				as_node_stats_end(node, begin_us, false);
+			}
             as_node_release(node);
             node = 0; 
         }
@@ -1473,7 +1891,13 @@ Retry:
             goto Error;
         }
 
-	} while ( (cl_w_p == 0) || (cl_w_p->w_pol == CL_WRITE_RETRY) );
+		if (! retry_sent && (sent || deadline_ms == 0)) {
+			break;
+		}
+
+		cl_retry_backoff(try + 1, deadline_ms);
+
+	} while (true);
 	
 Error:
 	
@@ -1485,19 +1909,36 @@ Error:
 
     if (fd != -1)   cf_close(fd);
 
-	if (wr_buf != wr_stack_buf)		free(wr_buf);
-	if (rd_buf && (rd_buf != rd_stack_buf))		free(rd_buf);
+	if (node) {
+		as_node_stats_end(node, begin_us, false);
+		as_node_release(node);
+	}
+
+	if (frame)		cl_buf_release(frame);
+	if (rd_buf && (rd_buf != rd_stack_buf))		cl_buf_release(rd_buf);
 
 	return(rv);
     
 Ok:    
 
+	if (try > 1) {
+		ck_pr_inc_64(&asc->retry_stats.recovered);
+	}
+
+	as_node_latency_add(node, latency_kind, cf_getus() - begin_us);
+	as_node_stats_end(node, begin_us, true);
 	as_node_put_connection(node, fd);
 	as_node_release(node);
    
-	if (wr_buf != wr_stack_buf)		free(wr_buf);
+	if (frame)		cl_buf_release(frame);
 
-	if (rd_buf) {
+	if (rd_buf && ops_cb) {
+		rv = msg.m.result_code;
+		if (rv == 0) {
+			rv = cl_parse_ops(&msg.m, rd_buf, rd_buf_sz, ops_cb, udata);
+		}
+	}
+	else if (rd_buf) {
 		if (0 != cl_parse(&msg.m, rd_buf, rd_buf_sz, values, n_values, trid, setname_r)) {
 			rv = AEROSPIKE_ERR_SERVER;
 		}
@@ -1514,7 +1955,7 @@ Ok:
     else {
         rv = AEROSPIKE_ERR_SERVER;
     }    
-	if (rd_buf && (rd_buf != rd_stack_buf))		free(rd_buf);
+	if (rd_buf && (rd_buf != rd_stack_buf))		cl_buf_release(rd_buf);
 	
 	// if (rv == 0 && (values || operations) && n_values) {
 	// 	for (int i=0;i<*n_values;i++) {
@@ -1536,6 +1977,68 @@ Ok:
 	return(rv);
 }
 
+static int
+do_the_full_monte_ops(as_cluster *asc, int info1, int info2, int info3, const char *ns, const char *set, const cl_object *key,
+	const cf_digest *digest, cl_bin **values, cl_operator operator, cl_operation **operations, int *n_values, 
+	uint32_t *cl_gen, const cl_write_parameters *cl_w_p, uint64_t *trid, char **setname_r, as_call * call, uint32_t* cl_ttl,
+	as_policy_replica replica, citrusleaf_get_ops_cb ops_cb, void *udata)
+{
+	uint8_t		wr_stack_buf[STACK_BUF_SZ];
+	uint8_t		*wr_buf = wr_stack_buf;
+	size_t		wr_buf_sz = sizeof(wr_stack_buf);
+
+//	if( *values ){
+//		dump_values(*values, null, *n_values);
+//	}else if( *operations ){
+//		dump_values(null, *operations, *n_values);
+//	}
+
+	cf_digest d_ret;
+	if (n_values && ( values || operations) ){
+		if (cl_compile(info1, info2, info3, ns, set, key, digest, values?*values:NULL, operator, operations?*operations:NULL,
+				*n_values , &wr_buf, &wr_buf_sz, cl_w_p, &d_ret, *trid, NULL, call, 0 /* udf_type */)) {
+			return(-1);
+		}
+		if (operations) {
+			// Force results of operations returned in response to be malloc'd.
+			*n_values = 0;
+		}
+	}else{
+		if (cl_compile(info1, info2, info3, ns, set, key, digest, 0, 0, 0, 0, &wr_buf, &wr_buf_sz, cl_w_p, &d_ret, *trid, NULL, call, 0 /*udf_type*/)) {
+			return(-1);
+		}
+	}
+
+	int rv = cl_transact(asc, info2, ns, &d_ret, wr_buf, wr_buf_sz, values, n_values, cl_gen, cl_w_p, trid, setname_r,
+			cl_ttl, replica, ops_cb, udata);
+
+	if (wr_buf != wr_stack_buf)		cl_buf_release(wr_buf);
+
+	return(rv);
+}
+
+//
+// Omnibus (!beep!! !beep!!) internal function that the externals can map to
+// If you don't want any values back, pass the values and n_values pointers as null
+//
+// WARNING - this parsing system relied on the length of cl_msg, which is
+// clumsy and against the spirit of the protocol. The length of cl_msg is specified
+// in the protocol, and the length of the message is defined - it should all be used.
+//
+// EITHER set + key must be set, or digest must be set! not both!
+//
+// Similarly, either values or operations must be set, but not both.
+
+int
+do_the_full_monte(as_cluster *asc, int info1, int info2, int info3, const char *ns, const char *set, const cl_object *key,
+	const cf_digest *digest, cl_bin **values, cl_operator operator, cl_operation **operations, int *n_values, 
+	uint32_t *cl_gen, const cl_write_parameters *cl_w_p, uint64_t *trid, char **setname_r, as_call * call, uint32_t* cl_ttl,
+	as_policy_replica replica)
+{
+	return do_the_full_monte_ops(asc, info1, info2, info3, ns, set, key, digest, values, operator, operations, n_values,
+			cl_gen, cl_w_p, trid, setname_r, call, cl_ttl, replica, NULL, NULL);
+}
+
 
 //
 // head functions
@@ -1546,11 +2049,16 @@ Ok:
 extern cl_rv
 citrusleaf_get(as_cluster *asc, const char *ns, const char *set, const cl_object *key,
 		const cf_digest *digest, cl_bin *values, int n_values, int timeout_ms,
-		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica)
+		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p)
 {
 	uint64_t trid=0;
 	cl_write_parameters cl_w_p;
-	cl_write_parameters_set_default(&cl_w_p);
+	if (read_p) {
+		cl_w_p = *read_p;
+	}
+	else {
+		cl_write_parameters_set_default(&cl_w_p);
+	}
 	cl_w_p.timeout_ms = timeout_ms;
 
 	return( do_the_full_monte( asc, CL_MSG_INFO1_READ | consistency_level, 0, 0, ns, set, key, digest, &values,
@@ -1612,6 +2120,274 @@ citrusleaf_restore(as_cluster *asc, const char *ns, const cf_digest *digest,
 			&trid, NULL, NULL, NULL, -1) );
 }
 
+//
+// Prepared writes. The template is compiled as cl_compile() would compile
+// the write with empty values and without the key and digest fields, which
+// put lays in each time with the values.
+//
+
+static uint8_t
+cl_object_particle_type(const cl_object *obj)
+{
+	if (obj->type == CL_AS_VAL) {
+		return ((as_val *) obj->u.blob)->type == AS_MAP ? CL_MAP : CL_LIST;
+	}
+	return (uint8_t) obj->type;
+}
+
+int
+citrusleaf_write_template_init(cl_write_template *t, const char *ns, const char *set, const char **bin_names,
+		const cl_operator *ops, int n_bins, bool send_key, const cl_write_parameters *cl_w_p, int commit_level)
+{
+	memset(t, 0, sizeof(cl_write_template));
+
+	if (!ns || n_bins <= 0) {
+		return(-1);
+	}
+
+	int ns_len = (int)strlen(ns);
+	int set_len = set ? (int)strlen(set) : 0;
+
+	size_t image_sz = sizeof(as_msg) + sizeof(cl_msg_field) + ns_len;
+	if (set) image_sz += sizeof(cl_msg_field) + set_len;
+
+	for (int i = 0; i < n_bins; i++) {
+		if (ops[i] == CL_OP_MC_INCR || strlen(bin_names[i]) >= CL_BINNAME_SIZE) {
+			return(-1);
+		}
+		image_sz += sizeof(cl_msg_op) + strlen(bin_names[i]);
+	}
+
+	t->ns = strdup(ns);
+	t->image = malloc(image_sz);
+	t->op_offsets = malloc(sizeof(size_t) * (n_bins + 1));
+
+	if (!t->ns || !t->image || !t->op_offsets) {
+		citrusleaf_write_template_destroy(t);
+		return(-1);
+	}
+
+	if (cl_w_p) {
+		t->wp = *cl_w_p;
+	}
+	else {
+		cl_write_parameters_set_default(&t->wp);
+	}
+	t->n_ops = n_bins;
+
+	uint info2 = CL_MSG_INFO2_WRITE;
+	uint info3 = commit_level;
+	uint32_t generation = cl_write_parameters_to_info(cl_w_p, &info2, &info3);
+	int n_fields = 1 + (set ? 1 : 0) + (send_key ? 1 : 0) + 1;
+
+	// The size in the proto is that of each put, the one written here is a
+	// placeholder.
+	uint8_t *buf = cl_write_header(t->image, image_sz, 0, info2, info3, generation, t->wp.record_ttl,
+			t->wp.timeout_ms, n_fields, n_bins);
+	buf = write_fields(buf, ns, ns_len, set, set_len, NULL, NULL, NULL, 0, NULL, NULL, 0);
+	t->prefix_sz = buf - t->image;
+
+	for (int i = 0; i < n_bins; i++) {
+		cl_bin bin;
+		strcpy(bin.bin_name, bin_names[i]);
+		citrusleaf_object_init_null(&bin.object);
+
+		cl_msg_op *op = (cl_msg_op *) buf;
+		t->op_offsets[i] = buf - t->image;
+
+		if (cl_value_to_op(&bin, ops[i], NULL, op)) {
+			citrusleaf_write_template_destroy(t);
+			return(-1);
+		}
+
+		buf = (uint8_t *) cl_msg_op_get_next(op);
+		cl_msg_swap_op_to_be(op);
+	}
+	t->op_offsets[n_bins] = buf - t->image;
+
+	return(0);
+}
+
+void
+citrusleaf_write_template_destroy(cl_write_template *t)
+{
+	free(t->ns);
+	free(t->image);
+	free(t->op_offsets);
+	memset(t, 0, sizeof(cl_write_template));
+}
+
+extern cl_rv
+citrusleaf_write_template_put(as_cluster *asc, const cl_write_template *t, const cl_object *key,
+		const cf_digest *d, const cl_bin *values)
+{
+	size_t msg_sz = t->op_offsets[t->n_ops];
+	if (key) msg_sz += sizeof(cl_msg_field) + 1 + key->sz;
+	msg_sz += sizeof(cl_msg_field) + 1 + sizeof(cf_digest);
+
+	for (int i = 0; i < t->n_ops; i++) {
+		if (cl_object_get_size((cl_object *) &values[i].object, &msg_sz)) {
+			return(-1);
+		}
+	}
+
+	uint8_t		wr_stack_buf[STACK_BUF_SZ];
+	uint8_t		*wr_buf = wr_stack_buf;
+
+	if (msg_sz > sizeof(wr_stack_buf)) {
+		wr_buf = cl_buf_acquire(msg_sz);
+		if (!wr_buf) {
+			return(-1);
+		}
+	}
+
+	memcpy(wr_buf, t->image, t->prefix_sz);
+
+	as_msg *msg = (as_msg *) wr_buf;
+	msg->proto.version = CL_PROTO_VERSION;
+	msg->proto.type = CL_PROTO_TYPE_CL_MSG;
+	msg->proto.sz = msg_sz - sizeof(cl_proto);
+	cl_proto_swap_to_be(&msg->proto);
+
+	uint8_t *buf = write_fields(wr_buf + t->prefix_sz, NULL, 0, NULL, 0, key, d, NULL, 0, NULL, NULL, 0);
+	if (!buf) {
+		if (wr_buf != wr_stack_buf)		cl_buf_release(wr_buf);
+		return(-1);
+	}
+
+	for (int i = 0; i < t->n_ops; i++) {
+		const cl_object *obj = &values[i].object;
+		size_t op_hdr_sz = t->op_offsets[i + 1] - t->op_offsets[i];
+		size_t value_sz = 0;
+		cl_object_get_size((cl_object *) obj, &value_sz);
+
+		memcpy(buf, t->image + t->op_offsets[i], op_hdr_sz);
+
+		cl_msg_op *op = (cl_msg_op *) buf;
+		op->op_sz = cf_swap_to_be32(cf_swap_from_be32(op->op_sz) + (uint32_t)value_sz);
+		op->particle_type = cl_object_particle_type(obj);
+		cl_object_to_buf((cl_object *) obj, cl_msg_op_get_value_p(op));
+
+		buf += op_hdr_sz + value_sz;
+	}
+
+	uint64_t trid = 0;
+	int n_values = t->n_ops;
+	int rv = cl_transact(asc, CL_MSG_INFO2_WRITE, t->ns, d, wr_buf, msg_sz, (cl_bin **) &values, &n_values,
+			NULL, &t->wp, &trid, NULL, NULL, -1, NULL, NULL);
+
+	if (wr_buf != wr_stack_buf)		cl_buf_release(wr_buf);
+
+	return(rv);
+}
+
+//
+// Pipelined writes of records given as ops. Each request is compiled straight
+// from the ops, and all of them go out on the connection before the first
+// response is read.
+//
+
+extern cl_rv
+citrusleaf_put_ops_pipelined(as_cluster *asc, as_node *node, const char *ns, const cl_ops_record *records,
+		int n_records, uint32_t timeout_ms, int *results)
+{
+	int ns_len = (int)strlen(ns);
+	size_t wr_buf_sz = 0;
+
+	for (int i = 0; i < n_records; i++) {
+		const cl_ops_record *rec = &records[i];
+		wr_buf_sz += sizeof(as_msg) + sizeof(cl_msg_field) + ns_len + sizeof(cl_msg_field) + sizeof(cf_digest) + rec->ops_sz;
+
+		if (rec->set) {
+			wr_buf_sz += sizeof(cl_msg_field) + strlen(rec->set);
+		}
+		results[i] = AEROSPIKE_ERR_CLIENT;
+	}
+
+	uint8_t *wr_buf = cl_buf_acquire(wr_buf_sz);
+	if (!wr_buf) {
+		return AEROSPIKE_ERR_CLIENT;
+	}
+
+	uint8_t *p = wr_buf;
+
+	for (int i = 0; i < n_records; i++) {
+		const cl_ops_record *rec = &records[i];
+		int set_len = rec->set ? (int)strlen(rec->set) : 0;
+		size_t msg_sz = sizeof(as_msg) + sizeof(cl_msg_field) + ns_len + sizeof(cl_msg_field) + sizeof(cf_digest) + rec->ops_sz;
+
+		if (rec->set) {
+			msg_sz += sizeof(cl_msg_field) + set_len;
+		}
+
+		uint8_t *buf = cl_write_header(p, msg_sz, 0, CL_MSG_INFO2_WRITE, 0, 0, rec->record_ttl, timeout_ms,
+				rec->set ? 3 : 2, rec->n_ops);
+		buf = write_fields(buf, ns, ns_len, rec->set, set_len, NULL, rec->digest, NULL, 0, NULL, NULL, 0);
+		memcpy(buf, rec->ops, rec->ops_sz);
+
+		uint8_t *op = buf;
+		for (uint16_t j = 0; j < rec->n_ops; j++) {
+			((cl_msg_op *) op)->op = CL_MSG_OP_WRITE;
+			op += sizeof(uint32_t) + cf_swap_from_be32(((cl_msg_op *) op)->op_sz);
+		}
+		p += msg_sz;
+	}
+
+	uint64_t deadline_ms = timeout_ms ? cf_getms() + timeout_ms : 0;
+	uint progress_timeout_ms = timeout_ms ? timeout_ms : DEFAULT_PROGRESS_TIMEOUT;
+	int fd;
+	int rv = as_node_get_connection(node, &fd);
+
+	if (rv) {
+		cl_buf_release(wr_buf);
+		return rv;
+	}
+
+	if (cf_socket_write_timeout(fd, wr_buf, wr_buf_sz, deadline_ms, progress_timeout_ms)) {
+		rv = AEROSPIKE_ERR_TIMEOUT;
+	}
+	cl_buf_release(wr_buf);
+
+	int i = 0;
+
+	for ( ; rv == 0 && i < n_records; i++) {
+		as_msg msg;
+
+		if (cf_socket_read_timeout(fd, (uint8_t *) &msg, sizeof(as_msg), deadline_ms, progress_timeout_ms)) {
+			rv = AEROSPIKE_ERR_TIMEOUT;
+			break;
+		}
+		cl_proto_swap_from_be(&msg.proto);
+		cl_msg_swap_header_from_be(&msg.m);
+
+		// Write responses carry no bins, but skip whatever the server sent.
+		size_t rd_buf_sz = msg.proto.sz - msg.m.header_sz;
+		uint8_t rd_buf[256];
+
+		while (rd_buf_sz > 0) {
+			size_t sz = rd_buf_sz < sizeof(rd_buf) ? rd_buf_sz : sizeof(rd_buf);
+
+			if (cf_socket_read_timeout(fd, rd_buf, sz, deadline_ms, progress_timeout_ms)) {
+				rv = AEROSPIKE_ERR_TIMEOUT;
+				break;
+			}
+			rd_buf_sz -= sz;
+		}
+		results[i] = msg.m.result_code;
+	}
+
+	if (rv) {
+		for ( ; i < n_records; i++) {
+			results[i] = rv;
+		}
+		cf_close(fd);
+		return rv;
+	}
+
+	as_node_put_connection(node, fd);
+	return 0;
+}
+
 extern cl_rv
 citrusleaf_delete(as_cluster *asc, const char *ns, const char *set, const cl_object *key,
 		const cf_digest *digest, const cl_write_parameters *cl_w_p, int commit_level)
@@ -1638,11 +2414,16 @@ citrusleaf_delete_digest(as_cluster *asc, const char *ns, const cf_digest *diges
 extern cl_rv
 citrusleaf_exists_key(as_cluster *asc, const char *ns, const char *set, const cl_object *key,
 		const cf_digest *digest, cl_bin *values, int n_values, int timeout_ms,
-		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica)
+		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p)
 {
 	uint64_t trid=0;
 	cl_write_parameters cl_w_p;
-	cl_write_parameters_set_default(&cl_w_p);
+	if (read_p) {
+		cl_w_p = *read_p;
+	}
+	else {
+		cl_write_parameters_set_default(&cl_w_p);
+	}
 	cl_w_p.timeout_ms = timeout_ms;
 
 	return( do_the_full_monte( asc, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_NOBINDATA | consistency_level, 0, 0,
@@ -1669,7 +2450,7 @@ citrusleaf_exists_digest(as_cluster *asc, const char *ns, const cf_digest *diges
 extern cl_rv
 citrusleaf_get_all(as_cluster *asc, const char *ns, const char *set, const cl_object *key,
 		const cf_digest *digest, cl_bin **values, int *n_values, int timeout_ms,
-		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica)
+		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p)
 {
 	if ((values == 0) || (n_values == 0)) {
 		as_log_error("citrusleaf_get_all: illegal parameters passed");
@@ -1681,7 +2462,12 @@ citrusleaf_get_all(as_cluster *asc, const char *ns, const char *set, const cl_ob
 
 	uint64_t trid=0;
 	cl_write_parameters cl_w_p;
-	cl_write_parameters_set_default(&cl_w_p);
+	if (read_p) {
+		cl_w_p = *read_p;
+	}
+	else {
+		cl_write_parameters_set_default(&cl_w_p);
+	}
 	cl_w_p.timeout_ms = timeout_ms;
 	
 	return( do_the_full_monte( asc, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL | consistency_level, 0, 0,
@@ -1689,6 +2475,31 @@ citrusleaf_get_all(as_cluster *asc, const char *ns, const char *set, const cl_ob
 			cl_gen, &cl_w_p, &trid, NULL, NULL, cl_ttl, replica) );
 }
 
+extern cl_rv
+citrusleaf_get_all_ops(as_cluster *asc, const char *ns, const char *set, const cl_object *key,
+		const cf_digest *digest, citrusleaf_get_ops_cb cb, void *udata, int timeout_ms,
+		uint32_t *cl_gen, uint32_t* cl_ttl, int consistency_level, as_policy_replica replica, const cl_write_parameters *read_p)
+{
+	if (cb == 0) {
+		as_log_error("citrusleaf_get_all_ops: illegal parameters passed");
+		return(-1);
+	}
+
+	uint64_t trid=0;
+	cl_write_parameters cl_w_p;
+	if (read_p) {
+		cl_w_p = *read_p;
+	}
+	else {
+		cl_write_parameters_set_default(&cl_w_p);
+	}
+	cl_w_p.timeout_ms = timeout_ms;
+
+	return( do_the_full_monte_ops( asc, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL | consistency_level, 0, 0,
+			ns, set, key, digest, NULL, CL_OP_READ, 0, NULL,
+			cl_gen, &cl_w_p, &trid, NULL, NULL, cl_ttl, replica, cb, udata) );
+}
+
 extern cl_rv
 citrusleaf_get_all_digest_getsetname(as_cluster *asc, const char *ns, const cf_digest *digest,
 	cl_bin **values, int *n_values, int timeout_ms, uint32_t *cl_gen, char **setname, uint32_t* cl_ttl, int consistency_level,
@@ -22,76 +22,22 @@
 #include <string.h>
 #include <pthread.h>
 #include <fcntl.h>
-#include <zlib.h>
 
+#include <aerospike/as_allocator.h>
 #include <aerospike/as_cluster.h>
+#include <aerospike/as_codec.h>
 #include <aerospike/as_log_macros.h>
+#include <aerospike/as_rate_limiter.h>
 
 #include <citrusleaf/cf_socket.h>
 #include <citrusleaf/cf_proto.h>
 
 #include <citrusleaf/citrusleaf.h>
+#include <citrusleaf/cl_buf_cache.h>
 #include <citrusleaf/cl_types.h>
 
 #include "internal.h"
 
-//
-// Decompresses a compressed CL msg
-// The buffer passed in is the space *after* the header, just the compressed data
-//
-//
-// returns -1 if it can't be decompressed for some reason
-//
-
-
-static int
-batch_decompress(uint8_t *in_buf, size_t in_sz, uint8_t **out_buf, size_t *out_sz) 
-{
-	z_stream 	strm;
-
-	// uint64_t now = cf_getms();
-	
-	strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    int rv = inflateInit(&strm);
-    if (rv != Z_OK)
-        return (-1);
-
-    
-    // first 8 bytes are the inflated size, allows efficient alloc (round up: the buf likes that)
-    size_t  	b_sz_alloc = *(uint64_t *)in_buf;
-    uint8_t 	*b = malloc(b_sz_alloc);
-    if (0 == b) {
-    	as_log_error("batch_decompress: could not malloc %"PRIu64" bytes", b_sz_alloc);
-    	inflateEnd(&strm);
-    	return(-1);
-    }
-    
-    strm.avail_in = (uInt)in_sz - 8;
-    strm.next_in = in_buf + 8;
-    
-	strm.avail_out = (uInt)b_sz_alloc; // round up: seems to like that
-	strm.next_out = b;
-
-	rv = inflate(&strm, Z_FINISH);
-
-	if (rv != Z_STREAM_END) {
-		as_log_error("could not deflate data: zlib error %d (check zlib.h)", rv);
-		free(b);
-		inflateEnd(&strm);
-		return(-1);
-	}
-    	
-	inflateEnd(&strm);
-    
-    *out_buf = b;
-    *out_sz = b_sz_alloc - strm.avail_out;
-	
-	return(0);	
-}
-
-
 static uint8_t *
 write_fields_batch_digests(uint8_t *buf, char *ns, int ns_len, cf_digest *digests, as_node **nodes, int n_digests, 
 	int n_my_digests, as_node *my_node )
@@ -156,7 +102,7 @@ batch_compile(uint info1, uint info2, char *ns, cf_digest *digests, as_node **no
 	uint8_t	*buf;
 	uint8_t *mbuf = 0;
 	if ((*buf_r) && (msg_sz > *buf_sz_r)) {
-		mbuf = buf = malloc(msg_sz);
+		mbuf = buf = cl_buf_acquire(msg_sz);
 		if (!buf) 			return(-1);
 		*buf_r = buf;
 	}
@@ -214,7 +160,7 @@ batch_compile(uint info1, uint info2, char *ns, cf_digest *digests, as_node **no
 	// now the fields
 	buf = write_fields_batch_digests(buf, ns, ns_len, digests, nodes, n_digests, n_my_digests, my_node);
 	if (!buf) {
-		if (mbuf)	free(mbuf);
+		if (mbuf)	cl_buf_release(mbuf);
 		return(-1);
 	}
 
@@ -334,7 +280,7 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
 		if (rd_buf_sz > 0) {
                                                          
 			if (rd_buf_sz > sizeof(rd_stack_buf))
-				rd_buf = malloc(rd_buf_sz);
+				rd_buf = cl_buf_acquire(rd_buf_sz);
 			else
 				rd_buf = rd_stack_buf;
 			if (rd_buf == NULL) {
@@ -344,7 +290,7 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
 
 			if ((rv = cf_socket_read_forever(fd, rd_buf, rd_buf_sz))) {
 				as_log_error("network error: errno %d fd %d", rv, fd);
-				if (rd_buf != rd_stack_buf)	{ free(rd_buf); }
+				if (rd_buf != rd_stack_buf)	{ cl_buf_release(rd_buf); }
 				cf_close(fd);
 				return(-1);
 			}
@@ -359,15 +305,15 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
 			uint8_t *new_rd_buf   = NULL;
 			size_t  new_rd_buf_sz = 0;
 			
-			rv = batch_decompress(rd_buf, rd_buf_sz, &new_rd_buf, &new_rd_buf_sz);
+			rv = as_codec_decompress_body(asc->codec, rd_buf, rd_buf_sz, &new_rd_buf, &new_rd_buf_sz);
 			if (rv != 0) {
 				as_log_error("could not decompress compressed message: error %d", rv);
-				if (rd_buf != rd_stack_buf)	{ free(rd_buf); }
+				if (rd_buf != rd_stack_buf)	{ cl_buf_release(rd_buf); }
 				cf_close(fd);
 				return -1;
 			}				
 				
-			if (rd_buf != rd_stack_buf)	{ free(rd_buf); }
+			if (rd_buf != rd_stack_buf)	{ cl_buf_release(rd_buf); }
 			rd_buf = new_rd_buf;
 			rd_buf_sz = new_rd_buf_sz;
 			
@@ -434,7 +380,7 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
 
 
 			if (msg->n_ops > STACK_BINS) {
-				bins_local = malloc(sizeof(cl_bin) * msg->n_ops);
+				bins_local = as_malloc(AS_ALLOC_BATCH, sizeof(cl_bin) * msg->n_ops);
 			}
 			else {
 				bins_local = stack_bins;
@@ -488,7 +434,7 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
             // should free allocated memory for blob object
             citrusleaf_bins_free( bins_local, (int)msg->n_ops );
 			if (bins_local != stack_bins) {
-				free(bins_local);
+				as_free(bins_local);
 				bins_local = 0;
 			}
 
@@ -504,14 +450,14 @@ do_batch_monte(as_cluster *asc, int info1, int info2, char *ns, cf_digest *diges
 		}
 		
 		if (rd_buf && (rd_buf != rd_stack_buf))	{
-			free(rd_buf);
+			cl_buf_release(rd_buf);
 			rd_buf = 0;
 		}
 
 	} while ( done == false );
 
 	if (wr_buf != wr_stack_buf) {
-		free(wr_buf);
+		cl_buf_release(wr_buf);
 		wr_buf = 0;
 	}
 
@@ -608,7 +554,8 @@ batch_worker_fn(void* pv_asc)
 
 cl_rv
 citrusleaf_batch_read(as_cluster *asc, char *ns, const cf_digest *digests, int n_digests,
-		cl_bin *bins, int n_bins, bool get_bin_data, citrusleaf_get_many_cb cb, void *udata)
+		cl_bin *bins, int n_bins, bool get_bin_data, citrusleaf_get_many_cb cb, void *udata,
+		as_rate_limiter *rate_limiter)
 {
 	// fast path: if there's only one node, or the number of digests is super short, just dispatch to the server directly
 
@@ -617,7 +564,7 @@ citrusleaf_batch_read(as_cluster *asc, char *ns, const cf_digest *digests, int n
 	//
 	// allocate the digest-node array, and populate it
 	// 
-	as_node **nodes = malloc( sizeof(as_node *)  * n_digests);
+	as_node **nodes = as_malloc(AS_ALLOC_BATCH, sizeof(as_node *) * n_digests);
 	if (!nodes) {
 		as_log_error("allocation failed");
 		return(-1);
@@ -637,7 +584,7 @@ citrusleaf_batch_read(as_cluster *asc, char *ns, const cf_digest *digests, int n
 			for (int j = 0; j < i; j++) {
 				as_node_release(nodes[j]);
 			}
-			free(nodes);
+			as_free(nodes);
 			return(-1);
 		}
 	}
@@ -692,6 +639,10 @@ citrusleaf_batch_read(as_cluster *asc, char *ns, const cf_digest *digests, int n
 		work.my_node = unique_nodes[i];
 		work.my_node_digest_count = unique_nodes_count[i];
 		work.index = i;
+
+		// Wait for the node's tokens here, so a limited batch holds back only
+		// its caller and never a thread of the shared batch pool.
+		as_rate_limiter_acquire(rate_limiter, work.my_node_digest_count);
 		
 		// dispatch - copies data
 		cf_queue_push(asc->batch_q, &work);
@@ -720,7 +671,7 @@ citrusleaf_batch_read(as_cluster *asc, char *ns, const cf_digest *digests, int n
 	for (int i=0;i<n_digests;i++) {
 		as_node_release(nodes[i]);
 	}
-	free(nodes);
+	as_free(nodes);
 	return retval;
 }
 
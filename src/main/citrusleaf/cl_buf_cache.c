@@ -0,0 +1,231 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <aerospike/as_allocator.h>
+
+#include <citrusleaf/cl_buf_cache.h>
+
+/******************************************************************************
+ * TYPES
+ ******************************************************************************/
+
+/**
+ * Prefix of every buffer. Two words keep the buffer 16 byte aligned.
+ */
+typedef struct cl_buf_header_s {
+    size_t      capacity;
+    size_t      reserved;
+} cl_buf_header;
+
+typedef struct cl_buf_entry_s {
+    uint8_t *   buf;
+    size_t      capacity;
+    uint64_t    last_use;
+} cl_buf_entry;
+
+typedef struct cl_buf_cache_s {
+    uint64_t        uses;
+    uint32_t        count;
+    cl_buf_entry    entries[CL_BUF_CACHE_SIZE];
+} cl_buf_cache;
+
+/******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static pthread_once_t g_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_cache_key;
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+static inline cl_buf_header * cl_buf_header_of(uint8_t * buf) {
+    return (cl_buf_header *) buf - 1;
+}
+
+static void cl_buf_free(uint8_t * buf) {
+    as_free(cl_buf_header_of(buf));
+}
+
+static void cl_buf_cache_destroy(void * udata) {
+    cl_buf_cache * cache = (cl_buf_cache *) udata;
+
+    for (uint32_t i = 0; i < cache->count; i++) {
+        cl_buf_free(cache->entries[i].buf);
+    }
+    as_free(cache);
+}
+
+static void cl_buf_cache_key_create() {
+    pthread_key_create(&g_cache_key, cl_buf_cache_destroy);
+}
+
+static cl_buf_cache * cl_buf_cache_get(bool create) {
+    pthread_once(&g_cache_once, cl_buf_cache_key_create);
+
+    cl_buf_cache * cache = (cl_buf_cache *) pthread_getspecific(g_cache_key);
+
+    if (cache == NULL && create) {
+        cache = (cl_buf_cache *) as_malloc(AS_ALLOC_NETWORK, sizeof(cl_buf_cache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        cache->uses = 0;
+        cache->count = 0;
+        pthread_setspecific(g_cache_key, cache);
+    }
+    return cache;
+}
+
+static void cl_buf_cache_remove(cl_buf_cache * cache, uint32_t i) {
+    cache->entries[i] = cache->entries[--cache->count];
+}
+
+/**
+ * Free the buffers that sat unused for a whole trim interval.
+ */
+static void cl_buf_cache_trim_stale(cl_buf_cache * cache) {
+    uint32_t i = 0;
+
+    while (i < cache->count) {
+        if (cache->uses - cache->entries[i].last_use > CL_BUF_TRIM_INTERVAL) {
+            cl_buf_free(cache->entries[i].buf);
+            cl_buf_cache_remove(cache, i);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+static size_t cl_buf_capacity(size_t size) {
+    if (size <= CL_BUF_MIN_SIZE) {
+        return CL_BUF_MIN_SIZE;
+    }
+    if (size > CL_BUF_RETAIN_MAX) {
+        // Not kept anyway, so don't round it up.
+        return size;
+    }
+
+    size_t capacity = CL_BUF_MIN_SIZE;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+uint8_t * cl_buf_acquire(size_t size) {
+    cl_buf_cache * cache = cl_buf_cache_get(true);
+
+    if (cache) {
+        cache->uses++;
+
+        if (cache->uses % CL_BUF_TRIM_INTERVAL == 0) {
+            cl_buf_cache_trim_stale(cache);
+        }
+
+        // Smallest fit, and the most recently used of equal buffers, so the
+        // others go cold and get trimmed.
+        int best = -1;
+
+        for (uint32_t i = 0; i < cache->count; i++) {
+            cl_buf_entry * e = &cache->entries[i];
+
+            if (e->capacity < size) {
+                continue;
+            }
+            if (best < 0 || e->capacity < cache->entries[best].capacity ||
+                (e->capacity == cache->entries[best].capacity && e->last_use > cache->entries[best].last_use)) {
+                best = (int) i;
+            }
+        }
+
+        if (best >= 0) {
+            uint8_t * buf = cache->entries[best].buf;
+            cl_buf_cache_remove(cache, (uint32_t) best);
+            return buf;
+        }
+    }
+
+    size_t capacity = cl_buf_capacity(size);
+
+    if (capacity > SIZE_MAX - sizeof(cl_buf_header)) {
+        return NULL;
+    }
+
+    cl_buf_header * h = (cl_buf_header *) as_malloc(AS_ALLOC_NETWORK, sizeof(cl_buf_header) + capacity);
+    if (h == NULL) {
+        return NULL;
+    }
+    h->capacity = capacity;
+    return (uint8_t *) (h + 1);
+}
+
+void cl_buf_release(uint8_t * buf) {
+    if (buf == NULL) {
+        return;
+    }
+
+    size_t capacity = cl_buf_header_of(buf)->capacity;
+    cl_buf_cache * cache = capacity <= CL_BUF_RETAIN_MAX ? cl_buf_cache_get(true) : NULL;
+
+    if (cache == NULL) {
+        cl_buf_free(buf);
+        return;
+    }
+
+    if (cache->count == CL_BUF_CACHE_SIZE) {
+        // Keep the largest buffers: they are the ones that are slow to get.
+        uint32_t smallest = 0;
+
+        for (uint32_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].capacity < cache->entries[smallest].capacity) {
+                smallest = i;
+            }
+        }
+
+        if (cache->entries[smallest].capacity >= capacity) {
+            cl_buf_free(buf);
+            return;
+        }
+        cl_buf_free(cache->entries[smallest].buf);
+        cl_buf_cache_remove(cache, smallest);
+    }
+
+    cl_buf_entry * e = &cache->entries[cache->count++];
+    e->buf = buf;
+    e->capacity = capacity;
+    e->last_use = cache->uses;
+}
+
+void cl_buf_cache_trim() {
+    cl_buf_cache * cache = cl_buf_cache_get(false);
+
+    if (cache) {
+        for (uint32_t i = 0; i < cache->count; i++) {
+            cl_buf_free(cache->entries[i].buf);
+        }
+        cache->count = 0;
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/as_status.h>
+#include <citrusleaf/cl_projection.h>
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+int cl_projection_init(cl_projection * proj, uint32_t n_names) {
+    // Keep the load factor at or below one half so probe chains stay short.
+    uint32_t n_slots = 8;
+    while (n_slots < n_names * 2) {
+        n_slots <<= 1;
+    }
+
+    proj->slots = calloc(n_slots, sizeof(cl_projection_slot));
+    if (proj->slots == NULL) {
+        proj->n_names = 0;
+        proj->mask = 0;
+        return AEROSPIKE_ERR_CLIENT;
+    }
+    proj->n_names = 0;
+    proj->mask = n_slots - 1;
+    return AEROSPIKE_OK;
+}
+
+int cl_projection_add(cl_projection * proj, const char * name) {
+    size_t name_sz = strlen(name);
+
+    if (name_sz == 0 || name_sz >= CL_BINNAME_SIZE) {
+        return AEROSPIKE_ERR_PARAM;
+    }
+
+    if (proj->n_names && cl_projection_contains(proj, (const uint8_t *) name, (uint32_t) name_sz)) {
+        return AEROSPIKE_OK;
+    }
+
+    if ((proj->n_names + 1) * 2 > proj->mask + 1) {
+        return AEROSPIKE_ERR_CLIENT;
+    }
+
+    uint32_t h = cl_projection_hash((const uint8_t *) name, (uint32_t) name_sz);
+    uint32_t i = h & proj->mask;
+
+    while (proj->slots[i].name[0]) {
+        i = (i + 1) & proj->mask;
+    }
+
+    proj->slots[i].hash = h;
+    memcpy(proj->slots[i].name, name, name_sz + 1);
+    proj->n_names++;
+    return AEROSPIKE_OK;
+}
+
+void cl_projection_destroy(cl_projection * proj) {
+    if (proj->slots) {
+        free(proj->slots);
+        proj->slots = NULL;
+    }
+    proj->n_names = 0;
+    proj->mask = 0;
+}
+
+uint8_t * cl_projection_parse_ops(const cl_projection * proj, uint8_t * buf, uint16_t n_ops, cl_projection_op_cb cb, void * udata) {
+    cl_msg_op * op = (cl_msg_op *) buf;
+
+    for (uint16_t i = 0; i < n_ops; i++) {
+        cl_msg_swap_op_from_be(op);
+
+        if (cl_projection_contains(proj, op->name, op->name_sz)) {
+            cb(op, udata);
+        }
+        op = cl_msg_op_get_next(op);
+    }
+    return (uint8_t *) op;
+}
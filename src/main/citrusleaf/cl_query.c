@@ -33,9 +33,11 @@
 #include <citrusleaf/cf_vector.h>
 
 #include <aerospike/as_aerospike.h>
+#include <aerospike/as_allocator.h>
 #include <aerospike/as_module.h>
 #include <aerospike/as_msgpack.h>
 #include <aerospike/as_list.h>
+#include <aerospike/as_rate_limiter.h>
 #include <aerospike/as_log_macros.h>
 #include <aerospike/as_record.h>
 #include <aerospike/as_serializer.h>
@@ -46,7 +48,10 @@
 
 #include <citrusleaf/citrusleaf.h>
 #include <aerospike/as_cluster.h>
+#include <citrusleaf/cl_buf_cache.h>
+#include <citrusleaf/cl_projection.h>
 #include <citrusleaf/cl_query.h>
+#include <citrusleaf/cl_read_ahead.h>
 #include <citrusleaf/cl_udf.h>
 
 #include "../aerospike/_shim.h"
@@ -61,7 +66,12 @@
  * stacks these days
  */ 
 #define STACK_BUF_SZ        (1024 * 16) 
-#define STACK_BINS           100
+
+/*
+ * The bin list field counts its names in one byte. Longer selections are not
+ * sent, and the bins are filtered as the responses are parsed.
+ */
+#define QUERY_BINLIST_MAX   255
 
 #define LOG_ENABLED 0
 
@@ -101,6 +111,8 @@ typedef struct {
 	cf_queue              * complete_q;
 	bool                    abort;
     as_val                * err_val;
+    const cl_projection   * projection;
+    as_rate_limiter       * rate_limiter;
 } cl_query_task;
 
 
@@ -409,7 +421,7 @@ static int query_compile(const cl_query * query, uint8_t ** buf_r, size_t * buf_
         msg_sz += range_sz + sizeof(cl_msg_field);
 
         // bin field    
-        if (query->binnames) {
+        if (query->binnames && cf_vector_size(query->binnames) <= QUERY_BINLIST_MAX) {
             n_fields++;
             num_bins = 0;
             if ( query_compile_select(query->binnames, NULL, &num_bins) != 0 ) {
@@ -435,7 +447,7 @@ static int query_compile(const cl_query * query, uint8_t ** buf_r, size_t * buf_
     // get a buffer to write to.
     uint8_t *buf; uint8_t *mbuf = 0;
     if ((*buf_r) && (msg_sz > *buf_sz_r)) { 
-        mbuf   = buf = malloc(msg_sz); if (!buf) return(-1);
+        mbuf   = buf = cl_buf_acquire(msg_sz); if (!buf) return(-1);
         *buf_r = buf;
     } else buf = *buf_r;
     *buf_sz_r  = msg_sz;
@@ -486,7 +498,7 @@ static int query_compile(const cl_query * query, uint8_t ** buf_r, size_t * buf_
         mf = mf_tmp;
     }
 
-    if (query->binnames) {
+    if (query->binnames && cf_vector_size(query->binnames) <= QUERY_BINLIST_MAX) {
         mf->type = CL_MSG_FIELD_TYPE_QUERY_BINLIST;
         mf->field_sz = num_bins + 1;
         query_compile_select(query->binnames, mf->data, &num_bins);
@@ -559,7 +571,7 @@ static int query_compile(const cl_query * query, uint8_t ** buf_r, size_t * buf_
 
     if (!buf) { 
         if (mbuf) {
-            free(mbuf); 
+            cl_buf_release(mbuf); 
         }
         as_buffer_destroy(&argbuffer);
         return AEROSPIKE_ERR_CLIENT;
@@ -663,13 +675,19 @@ const as_rec_hooks query_response_hooks = {
     .destroy    = query_response_destroy
 };
 
+/*
+ * Decode a response op into the record being filled
+ */
+static void cl_query_decode_op(cl_msg_op * op, void * udata) {
+    clmsgop_to_asrecord(op, (as_record *) udata);
+}
+
 /* 
  * this is an actual instance of a query, running on a query thread
  */
-static int cl_query_worker_do(as_node * node, cl_query_task * task) {
+static int cl_query_worker_do(as_node * node, cl_query_task * task, cl_read_ahead * ra) {
 
-    uint8_t     rd_stack_buf[STACK_BUF_SZ] = {0};    
-    uint8_t *   rd_buf = rd_stack_buf;
+    uint8_t *   rd_buf = NULL;
     size_t      rd_buf_sz = 0;
 
 	int fd;
@@ -681,60 +699,85 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
     // send it to the cluster - non blocking socket, but we're blocking
     if (0 != cf_socket_write_forever(fd, (uint8_t *) task->query_buf, (size_t) task->query_sz)) {
         LOG("[ERROR] cl_query_worker_do: unable to write to %s ",node->name);
+        cf_close(fd);
         return AEROSPIKE_ERR_CLIENT;
     }
 
+    // Parse each proto while the next ones are received. The receive thread
+    // must be stopped before fd is closed or reused.
+    cl_read_ahead_start(ra, fd);
+
     cl_proto  proto;
     bool      done = false;
 
+    // One record shell is filled and handed to the callback for every
+    // response, so the bin entries are only allocated when a wider record
+    // than any before it comes in.
+    as_record   r;
+    as_record * record = as_record_init(&r, 0);
+
     do {
 	int ret_val = 0;	
 
         // multiple CL proto per response
         // Now turn around and read a fine cl_proto - that's the first 8 bytes 
-        // that has types and lengths
-        if ( (rc = cf_socket_read_forever(fd, (uint8_t *) &proto, sizeof(cl_proto) ) ) ) {
+        // that has types and lengths. Usually it is already in the read-ahead
+        // buffer, received with the previous proto.
+        if ( (rc = cl_read_ahead_fill(ra, fd, sizeof(cl_proto) ) ) ) {
             LOG("[ERROR] cl_query_worker_do: network error: errno %d fd %d\n", rc, fd);
+            cl_read_ahead_stop(ra);
+            cf_close(fd);
+            as_record_destroy(record);
             return AEROSPIKE_ERR_CLIENT;
         }
+        memcpy(&proto, cl_read_ahead_peek(ra), sizeof(cl_proto));
+        cl_read_ahead_consume(ra, sizeof(cl_proto));
         cl_proto_swap_from_be(&proto);
 
         if ( proto.version != CL_PROTO_VERSION) {
             LOG("[ERROR] cl_query_worker_do: network error: received protocol message of wrong version %d\n",proto.version);
+            cl_read_ahead_stop(ra);
+            cf_close(fd);
+            as_record_destroy(record);
             return AEROSPIKE_ERR_CLIENT;
         }
 
         if ( proto.type != CL_PROTO_TYPE_CL_MSG && proto.type != CL_PROTO_TYPE_CL_MSG_COMPRESSED ) {
             LOG("[ERROR] cl_query_worker_do: network error: received incorrect message version %d\n",proto.type);
+            cl_read_ahead_stop(ra);
+            cf_close(fd);
+            as_record_destroy(record);
             return AEROSPIKE_ERR_CLIENT;
         }
 
         // second read for the remainder of the message - expect this to cover 
         // lots of data, many lines if there's no error
+        // The body is parsed in place, so it must be contiguous in the buffer.
         rd_buf_sz =  proto.sz;
         if (rd_buf_sz > 0) {
-
-            if (rd_buf_sz > sizeof(rd_stack_buf)){
-                rd_buf = malloc(rd_buf_sz);
-            }
-            else {
-                rd_buf = rd_stack_buf;
+            if ( (rc = cl_read_ahead_fill(ra, fd, rd_buf_sz)) ) {
+                LOG("[ERROR] cl_query_worker_do: network error: errno %d fd %d\n", rc, fd);
+                cl_read_ahead_stop(ra);
+                cf_close(fd);
+                as_record_destroy(record);
+                return AEROSPIKE_ERR_CLIENT;
             }
 
-            if (rd_buf == NULL) return AEROSPIKE_ERR_CLIENT;
-
-            if ( (rc = cf_socket_read_forever(fd, rd_buf, rd_buf_sz)) ) {
-                LOG("[ERROR] cl_query_worker_do: network error: errno %d fd %d\n", rc, fd);
-                if ( rd_buf != rd_stack_buf ) free(rd_buf);
+            // The messages of a compressed proto take the place of its body.
+            if ( proto.type == CL_PROTO_TYPE_CL_MSG_COMPRESSED &&
+                 cl_read_ahead_inflate(ra, node->cluster->codec, rd_buf_sz, &rd_buf_sz) ) {
+                LOG("[ERROR] cl_query_worker_do: could not decompress response from %s\n", node->name);
+                cl_read_ahead_stop(ra);
+                cf_close(fd);
+                as_record_destroy(record);
                 return AEROSPIKE_ERR_CLIENT;
             }
         }
+        rd_buf = cl_read_ahead_peek(ra);
 
         // process all the cl_msg in this proto
         uint8_t *   buf = rd_buf;
         uint        pos = 0;
-        cl_bin      stack_bins[STACK_BINS];
-        cl_bin *    bins;
 		cl_object   key;
 		citrusleaf_object_init_null(&key);
 
@@ -749,6 +792,9 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
             if ( msg->header_sz != sizeof(cl_msg) ) {
                 LOG("[ERROR] cl_query_worker_do: received cl msg of unexpected size: expecting %zd found %d, internal error\n",
                         sizeof(cl_msg),msg->header_sz);
+                cl_read_ahead_stop(ra);
+                cf_close(fd);
+                as_record_destroy(record);
                 return AEROSPIKE_ERR_CLIENT;
             }
 
@@ -797,39 +843,13 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
                 mf = cl_msg_field_get_next(mf);
             }
 
-            bool free_bins = false;
             buf = (uint8_t *) mf;
-            if (msg->n_ops > STACK_BINS) {
-                bins = malloc(sizeof(cl_bin) * msg->n_ops);
-                free_bins = true;
-            }
-            else {
-                bins = stack_bins;
-            }
-
-            if (bins == NULL) {
-                return AEROSPIKE_ERR_CLIENT;
-            }
-
-            // parse through the bins/ops
-            cl_msg_op * op = (cl_msg_op *) buf;
-            for (int i=0;i<msg->n_ops;i++) {
 
-                cl_msg_swap_op_from_be(op);
-
-#ifdef DEBUG_VERBOSE
-                LOG("[DEBUG] cl_query_worker_do: op receive: %p size %d op %d ptype %d pversion %d namesz %d \n",
-                        op,op->op_sz, op->op, op->particle_type, op->version, op->name_sz);
-#endif            
-
-#ifdef DEBUG_VERBOSE
-                dump_buf("individual op (host order)", (uint8_t *) op, op->op_sz + sizeof(uint32_t));
-#endif    
+            asrecord_clear(record, msg->n_ops);
 
-                cl_set_value_particular(op, &bins[i]);
-                op = cl_msg_op_get_next(op);
-            }
-            buf = (uint8_t *) op;
+            // parse through the bins/ops - ops outside the projection are
+            // skipped by length and never decoded
+            buf = cl_projection_parse_ops(task->projection, buf, msg->n_ops, cl_query_decode_op, record);
 
             if (msg->result_code != CL_RESULT_OK) {
 
@@ -845,10 +865,9 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
             }
             else if ((msg->n_ops || (msg->info1 & CL_MSG_INFO1_GET_NOBINDATA))) {
 
-                as_record r;
-                as_record * record = &r;
-
-				as_record_inita(record, msg->n_ops);
+                // Wait for a token per record. Meanwhile the read-ahead
+                // thread keeps receiving until its buffer is full.
+                as_rate_limiter_acquire(task->rate_limiter, 1);
 
 				askey_from_clkey(&record->key, ns_ret, set_ret, &key);
                 memcpy(record->key.digest.value, &keyd, 20);
@@ -857,8 +876,6 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
                 record->ttl = cf_server_void_time_to_ttl(msg->record_ttl);
     			record->gen = msg->generation;
 
-                clbins_to_asrecord(bins, msg->n_ops, record);
-
                 // TODO:
                 //      Fix the following block of code. It is really lame 
                 //      to check for a bin called "SUCCESS" to determine
@@ -936,20 +953,12 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
                     }
                 }
 
-				as_record_destroy(record);
                 if (task->err_val) 
                     rc = AEROSPIKE_ERR_SERVER;
                 else
                     rc = AEROSPIKE_OK;
             }
 
-			citrusleaf_bins_free(bins, (int)msg->n_ops);
-
-                if (free_bins) {
-                    free(bins);
-                    bins = 0;
-                }
-
             // don't have to free object internals. They point into the read buffer, where
             // a pointer is required
             pos += buf - buf_start;
@@ -959,23 +968,31 @@ static int cl_query_worker_do(as_node * node, cl_query_task * task) {
 
         }
 
-        if (rd_buf && (rd_buf != rd_stack_buf))    {
-            free(rd_buf);
-            rd_buf = 0;
-        }
+        cl_read_ahead_consume(ra, rd_buf_sz);
 
         // abort requested by the user
         if (task->abort || gasq_abort || ret_val) {
+			cl_read_ahead_stop(ra);
 			cf_close(fd);
             goto Final;
         }
     } while ( done == false );
 
-    as_node_put_connection(node, fd);
+    // Bytes past the last message would belong to no request. Don't hand the
+    // connection to the next transaction in that case.
+    cl_read_ahead_stop(ra);
+
+    if ( cl_read_ahead_available(ra) == 0 ) {
+        as_node_put_connection(node, fd);
+    }
+    else {
+        cf_close(fd);
+    }
 
     goto Final;
 
 Final:    
+    as_record_destroy(record);
 
 #ifdef DEBUG_VERBOSE    
     LOG("[DEBUG] exited loop: rc %d\n", rc );
@@ -984,6 +1001,48 @@ Final:
     return rc;
 }
 
+/*
+ * Query one node for a task, and report the result on its completion queue.
+ */
+static void cl_query_task_run(cl_query_task * task) {
+    // query if the node is still around
+    as_query_fail_t rc_fail = {
+        .rc      = AEROSPIKE_ERR_CLUSTER,
+        .err_val = NULL
+    };
+
+    // Each thread keeps its read-ahead buffers for all its tasks.
+    as_node * node = as_node_get_by_name(task->asc, task->node_name);
+    if ( node ) {
+        cl_read_ahead * ra = cl_read_ahead_acquire();
+
+        if ( ra ) {
+            LOG("[DEBUG] cl_query_worker: working\n");
+            rc_fail.rc = cl_query_worker_do(node, task, ra);
+            cl_read_ahead_release(ra);
+        }
+        else {
+            rc_fail.rc = AEROSPIKE_ERR_CLIENT;
+        }
+		as_node_release(node);
+    }
+    if (task->err_val) {
+        rc_fail.err_val = task->err_val;
+    }
+    cf_queue_push(task->complete_q, (void *)&rc_fail);
+}
+
+/*
+ * Thread of a rate limited query, for one node, so its waits for tokens never
+ * hold up the shared worker pool.
+ */
+static void * cl_query_limited_worker(void * pv_task) {
+    cl_query_task * task = (cl_query_task *) pv_task;
+    cl_query_task_run(task);
+    free(task);
+    return NULL;
+}
+
 static void * cl_query_worker(void * pv_asc) {
 	as_cluster* asc = (as_cluster*)pv_asc;
 
@@ -1006,22 +1065,7 @@ static void * cl_query_worker(void * pv_asc) {
             break;
         }
 
-        // query if the node is still around
-        as_query_fail_t rc_fail = {
-            .rc      = AEROSPIKE_ERR_CLUSTER,
-            .err_val = NULL
-        };
-
-        as_node * node = as_node_get_by_name(task.asc, task.node_name);
-        if ( node ) {
-            LOG("[DEBUG] cl_query_worker: working\n");
-            rc_fail.rc = cl_query_worker_do(node, &task);
-			as_node_release(node);
-        }
-        if (task.err_val) {
-            rc_fail.err_val = task.err_val;
-        }
-        cf_queue_push(task.complete_q, (void *)&rc_fail);
+        cl_query_task_run(&task);
     }
 
     return NULL;
@@ -1164,6 +1208,20 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
         return rc;
     }
 
+    // The server only returns the selected bins when the list fits in the
+    // request. Otherwise hash the names once for all the workers, to drop the
+    // other bins as they are parsed. Aggregations return their results in
+    // their own bins, so they are never projected.
+    cl_projection projection = { 0 };
+    if ( query->udf.type == AS_UDF_CALLTYPE_NONE && query->binnames && cf_vector_size(query->binnames) > QUERY_BINLIST_MAX ) {
+        uint32_t n_names = cf_vector_size(query->binnames);
+        if ( cl_projection_init(&projection, n_names) == AEROSPIKE_OK ) {
+            for ( uint32_t i = 0; i < n_names; i++ ) {
+                cl_projection_add(&projection, (char *) cf_vector_getp(query->binnames, i));
+            }
+        }
+    }
+
     // Setup worker
     cl_query_task task = {
         .asc                = cluster,
@@ -1173,7 +1231,9 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
         .udata              = udata,
         .callback           = callback,
 		.abort              = false,
-        .err_val            = NULL
+        .err_val            = NULL,
+        .projection         = &projection,
+        .rate_limiter       = query->rate_limiter
     };
 
     char *node_names    = NULL;    
@@ -1183,6 +1243,7 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
 	as_cluster_get_node_names(cluster, &node_count, &node_names);
     if ( node_count == 0 ) {
         LOG("[ERROR] cl_query_execute: don't have any nodes?\n");
+        cl_projection_destroy(&projection);
         return AEROSPIKE_ERR_CLIENT;
     }
 
@@ -1193,8 +1254,28 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
     for ( int i=0; i < node_count; i++ ) {
         // fill in per-request specifics
         strcpy(task.node_name, node_name);
-        cf_queue_push(cluster->query_q, &task);
         node_name += NODE_NAME_SIZE;                    
+
+        // Rate limited queries wait for tokens on threads of their own, or
+        // else in the caller's thread.
+        if ( task.rate_limiter ) {
+            pthread_t thread;
+            cl_query_task * limited = (cl_query_task *) malloc(sizeof(cl_query_task));
+
+            if ( limited ) {
+                *limited = task;
+
+                if ( pthread_create(&thread, NULL, cl_query_limited_worker, limited) == 0 ) {
+                    pthread_detach(thread);
+                    continue;
+                }
+                free(limited);
+            }
+            LOG("[WARNING] cl_query_execute: no thread for a limited query, running it in the caller\n");
+            cl_query_task_run(&task);
+            continue;
+        }
+        cf_queue_push(cluster->query_q, &task);
     }
     free(node_names);
     node_names = NULL;
@@ -1221,7 +1302,7 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
     }
 
     if ( wr_buf && (wr_buf != wr_stack_buf) ) { 
-        free(wr_buf); 
+        cl_buf_release(wr_buf); 
         wr_buf = 0;
     }
 
@@ -1231,6 +1312,7 @@ static cl_rv cl_query_execute(as_cluster * cluster, const cl_query * query, void
     }
 
 	if (task.complete_q) cf_queue_destroy(task.complete_q);
+    cl_projection_destroy(&projection);
     return rc;
 }
 
@@ -1310,7 +1392,7 @@ Cleanup:
  * Allocates and initializes a new cl_query.
  */
 cl_query * cl_query_new(const char * ns, const char * setname) {
-    cl_query * query = malloc(sizeof(cl_query));
+    cl_query * query = as_malloc(AS_ALLOC_QUERY, sizeof(cl_query));
     memset(query, 0, sizeof(cl_query));
     return cl_query_init(query, ns, setname);
 }
@@ -1329,6 +1411,7 @@ cl_query * cl_query_init(cl_query * query, const char * ns, const char * setname
 
     query->res_streamq = result_queue;
     query->job_id = cf_get_rand64();
+    query->rate_limiter = NULL;
     query->setname = setname == NULL ? NULL : strdup(setname);
     query->ns = ns == NULL ? NULL : strdup(ns);
 
@@ -1381,7 +1464,7 @@ void cl_query_destroy(cl_query *query) {
         query->res_streamq = NULL;
     }
 
-    free(query);
+    as_free(query);
     query = NULL;
 }
 
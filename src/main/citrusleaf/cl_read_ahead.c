@@ -0,0 +1,455 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <aerospike/as_allocator.h>
+
+#include <citrusleaf/cl_buf_cache.h>
+#include <citrusleaf/cl_read_ahead.h>
+
+/******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static pthread_once_t g_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_thread_key;
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+static void cl_read_ahead_free(void * udata) {
+    cl_read_ahead * ra = (cl_read_ahead *) udata;
+    cl_read_ahead_destroy(ra);
+    as_free(ra);
+}
+
+static void cl_read_ahead_key_create() {
+    pthread_key_create(&g_thread_key, cl_read_ahead_free);
+}
+
+static cl_read_ahead * cl_read_ahead_new() {
+    cl_read_ahead * ra = (cl_read_ahead *) as_malloc(AS_ALLOC_NETWORK, sizeof(cl_read_ahead));
+    if (ra == NULL) {
+        return NULL;
+    }
+
+    if (cl_read_ahead_init(ra, CL_READ_AHEAD_SIZE)) {
+        as_free(ra);
+        return NULL;
+    }
+    return ra;
+}
+
+/**
+ * Make room for need bytes from start, moving the unconsumed bytes to the
+ * front, and growing the buffer if the frame is larger than the whole buffer.
+ */
+static int cl_read_ahead_reserve(cl_read_ahead * ra, size_t need) {
+    if (ra->capacity - ra->start >= need) {
+        return 0;
+    }
+
+    size_t avail = ra->end - ra->start;
+
+    if (ra->capacity < need) {
+        size_t capacity = ra->capacity * 2;
+        if (capacity < need) {
+            capacity = need;
+        }
+
+        uint8_t * buf = as_malloc(AS_ALLOC_NETWORK, capacity);
+        if (buf == NULL) {
+            return ENOMEM;
+        }
+        memcpy(buf, ra->buf + ra->start, avail);
+        as_free(ra->buf);
+        ra->buf = buf;
+        ra->capacity = capacity;
+    }
+    else {
+        memmove(ra->buf, ra->buf + ra->start, avail);
+    }
+    ra->start = 0;
+    ra->end = avail;
+    return 0;
+}
+
+/**
+ * Move what the receive thread read behind the unconsumed bytes. Called with
+ * the lock held.
+ */
+static int cl_read_ahead_take(cl_read_ahead * ra) {
+    int rv = cl_read_ahead_reserve(ra, ra->end - ra->start + ra->recv_size);
+    if (rv) {
+        return rv;
+    }
+
+    memcpy(ra->buf + ra->end, ra->recv_buf, ra->recv_size);
+    ra->end += ra->recv_size;
+    ra->recv_size = 0;
+    pthread_cond_broadcast(&ra->cond);
+    return 0;
+}
+
+static void * cl_read_ahead_receive(void * udata) {
+    cl_read_ahead * ra = (cl_read_ahead *) udata;
+
+    pthread_mutex_lock(&ra->lock);
+
+    while (true) {
+        // Wait for a stream between streams.
+        while (! ra->streaming && ! ra->exit) {
+            pthread_cond_wait(&ra->cond, &ra->lock);
+        }
+
+        if (ra->exit) {
+            break;
+        }
+
+        struct pollfd pfds[2] = {
+            { .fd = ra->fd, .events = POLLIN, .revents = 0 },
+            { .fd = ra->wake_fds[0], .events = POLLIN, .revents = 0 }
+        };
+
+        pthread_mutex_unlock(&ra->lock);
+        int n_ready = poll(pfds, 2, -1);
+        pthread_mutex_lock(&ra->lock);
+
+        // Wait for the caller to take the last read before reading more.
+        while (ra->recv_size == CL_READ_AHEAD_SIZE && ! ra->stop) {
+            pthread_cond_wait(&ra->cond, &ra->lock);
+        }
+
+        if (ra->stop) {
+            ra->streaming = false;
+            pthread_cond_broadcast(&ra->cond);
+            continue;
+        }
+
+        int err = 0;
+
+        if (n_ready < 0) {
+            if (errno != EINTR) {
+                err = errno;
+            }
+        }
+        else if (pfds[0].revents) {
+            ssize_t r_bytes = recv(ra->fd, ra->recv_buf + ra->recv_size, CL_READ_AHEAD_SIZE - ra->recv_size, MSG_DONTWAIT);
+
+            if (r_bytes > 0) {
+                ra->recv_size += (size_t) r_bytes;
+                pthread_cond_broadcast(&ra->cond);
+            }
+            else if (r_bytes == 0) {
+                err = EBADF;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                err = errno;
+            }
+        }
+
+        // Leave fd alone until the next stream.
+        if (err) {
+            ra->recv_err = err;
+            ra->streaming = false;
+            pthread_cond_broadcast(&ra->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static int cl_read_ahead_fill_received(cl_read_ahead * ra, size_t need) {
+    int rv = 0;
+
+    pthread_mutex_lock(&ra->lock);
+
+    while (ra->end - ra->start < need) {
+        while (ra->recv_size == 0 && ra->recv_err == 0) {
+            pthread_cond_wait(&ra->cond, &ra->lock);
+        }
+
+        // Bytes received before an error are still used.
+        if (ra->recv_size == 0) {
+            rv = ra->recv_err;
+            break;
+        }
+
+        if ((rv = cl_read_ahead_take(ra))) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&ra->lock);
+    return rv;
+}
+
+/******************************************************************************
+ * FUNCTIONS
+ ******************************************************************************/
+
+int cl_read_ahead_init(cl_read_ahead * ra, size_t capacity) {
+    ra->buf = as_malloc(AS_ALLOC_NETWORK, capacity);
+    ra->capacity = ra->buf ? capacity : 0;
+    ra->start = 0;
+    ra->end = 0;
+    ra->recv_buf = NULL;
+    ra->recv_size = 0;
+    ra->recv_err = 0;
+    ra->fd = -1;
+    ra->wake_fds[0] = -1;
+    ra->wake_fds[1] = -1;
+    ra->receiving = false;
+    ra->streaming = false;
+    ra->stop = false;
+    ra->exit = false;
+    ra->started = false;
+    ra->in_use = false;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+    return ra->buf ? 0 : ENOMEM;
+}
+
+cl_read_ahead * cl_read_ahead_acquire() {
+    pthread_once(&g_thread_once, cl_read_ahead_key_create);
+
+    cl_read_ahead * ra = (cl_read_ahead *) pthread_getspecific(g_thread_key);
+
+    if (ra == NULL) {
+        if ((ra = cl_read_ahead_new()) == NULL) {
+            return NULL;
+        }
+        pthread_setspecific(g_thread_key, ra);
+    }
+    else if (ra->in_use) {
+        // A stream nested in a callback of this thread's stream.
+        return cl_read_ahead_new();
+    }
+
+    ra->in_use = true;
+    return ra;
+}
+
+void cl_read_ahead_release(cl_read_ahead * ra) {
+    cl_read_ahead_stop(ra);
+
+    if (ra != pthread_getspecific(g_thread_key)) {
+        cl_read_ahead_free(ra);
+        return;
+    }
+
+    cl_read_ahead_reset(ra);
+    ra->in_use = false;
+}
+
+void cl_read_ahead_start(cl_read_ahead * ra, int fd) {
+    if (ra->recv_buf == NULL) {
+        ra->recv_buf = as_malloc(AS_ALLOC_NETWORK, CL_READ_AHEAD_SIZE);
+        if (ra->recv_buf == NULL) {
+            return;
+        }
+    }
+
+    // The pipe only wakes the receive thread to stop, and lives as long as
+    // the buffer.
+    if (ra->wake_fds[0] == -1) {
+        if (pipe(ra->wake_fds) != 0) {
+            ra->wake_fds[0] = ra->wake_fds[1] = -1;
+            return;
+        }
+        fcntl(ra->wake_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(ra->wake_fds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    ra->fd = fd;
+    ra->recv_size = 0;
+    ra->recv_err = 0;
+    ra->stop = false;
+    ra->streaming = true;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    if (! ra->started && pthread_create(&ra->thread, NULL, cl_read_ahead_receive, ra) == 0) {
+        ra->started = true;
+    }
+
+    if (ra->started) {
+        ra->receiving = true;
+    }
+    else {
+        ra->streaming = false;
+        ra->fd = -1;
+    }
+}
+
+void cl_read_ahead_stop(cl_read_ahead * ra) {
+    if (! ra->receiving) {
+        return;
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    ra->stop = true;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    char wake = 0;
+    if (write(ra->wake_fds[1], &wake, 1) < 0) {
+        // The pipe is only full if a wake-up is already pending.
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    while (ra->streaming) {
+        pthread_cond_wait(&ra->cond, &ra->lock);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    while (read(ra->wake_fds[0], &wake, 1) > 0) {
+    }
+
+    ra->receiving = false;
+    ra->fd = -1;
+}
+
+int cl_read_ahead_fill(cl_read_ahead * ra, int fd, size_t need) {
+    if (ra->end - ra->start >= need) {
+        return 0;
+    }
+
+    if (ra->receiving) {
+        return cl_read_ahead_fill_received(ra, need);
+    }
+
+    int rv = cl_read_ahead_reserve(ra, need);
+    if (rv) {
+        return rv;
+    }
+
+    // Same blocking mode as cf_socket_read_forever(). A blocking read returns
+    // whatever has arrived, so each wake-up drains the socket buffer.
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags != -1 && (flags & O_NONBLOCK)) {
+        if (-1 == fcntl(fd, F_SETFL, flags & ~O_NONBLOCK)) {
+            return ENOENT;
+        }
+    }
+
+    while (ra->end - ra->start < need) {
+        ssize_t r_bytes = read(fd, ra->buf + ra->end, ra->capacity - ra->end);
+
+        if (r_bytes < 0) {
+            if (errno != ETIMEDOUT && errno != EINTR) {
+                return errno;
+            }
+        }
+        else if (r_bytes == 0) {
+            return EBADF;
+        }
+        else {
+            ra->end += (size_t) r_bytes;
+        }
+    }
+    return 0;
+}
+
+int cl_read_ahead_inflate(cl_read_ahead * ra, const as_codec * codec, size_t sz, size_t * out_sz) {
+    uint8_t * msgs;
+    size_t msgs_sz;
+
+    if (as_codec_decompress_body(codec, ra->buf + ra->start, sz, &msgs, &msgs_sz)) {
+        return -1;
+    }
+
+    // Bytes received after the compressed body stay behind the messages.
+    size_t rest = ra->end - ra->start - sz;
+
+    if (msgs_sz + rest > ra->capacity) {
+        uint8_t * buf = as_malloc(AS_ALLOC_NETWORK, msgs_sz + rest);
+        if (buf == NULL) {
+            cl_buf_release(msgs);
+            return -1;
+        }
+        memcpy(buf + msgs_sz, ra->buf + ra->start + sz, rest);
+        as_free(ra->buf);
+        ra->buf = buf;
+        ra->capacity = msgs_sz + rest;
+    }
+    else {
+        memmove(ra->buf + msgs_sz, ra->buf + ra->start + sz, rest);
+    }
+
+    memcpy(ra->buf, msgs, msgs_sz);
+    ra->start = 0;
+    ra->end = msgs_sz + rest;
+    cl_buf_release(msgs);
+
+    *out_sz = msgs_sz;
+    return 0;
+}
+
+void cl_read_ahead_reset(cl_read_ahead * ra) {
+    ra->start = 0;
+    ra->end = 0;
+    ra->recv_size = 0;
+
+    if (ra->capacity > CL_READ_AHEAD_RETAIN_MAX) {
+        uint8_t * buf = as_realloc(AS_ALLOC_NETWORK, ra->buf, CL_READ_AHEAD_SIZE);
+        if (buf) {
+            ra->buf = buf;
+            ra->capacity = CL_READ_AHEAD_SIZE;
+        }
+    }
+}
+
+void cl_read_ahead_destroy(cl_read_ahead * ra) {
+    cl_read_ahead_stop(ra);
+
+    if (ra->started) {
+        pthread_mutex_lock(&ra->lock);
+        ra->exit = true;
+        pthread_cond_broadcast(&ra->cond);
+        pthread_mutex_unlock(&ra->lock);
+
+        pthread_join(ra->thread, NULL);
+        ra->started = false;
+    }
+
+    if (ra->wake_fds[0] != -1) {
+        close(ra->wake_fds[0]);
+        close(ra->wake_fds[1]);
+        ra->wake_fds[0] = ra->wake_fds[1] = -1;
+    }
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+
+    as_free(ra->recv_buf);
+    ra->recv_buf = NULL;
+    ra->recv_size = 0;
+    as_free(ra->buf);
+    ra->buf = NULL;
+    ra->capacity = 0;
+    ra->start = 0;
+    ra->end = 0;
+}
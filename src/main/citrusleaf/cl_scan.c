@@ -28,6 +28,7 @@
 #include <aerospike/as_cluster.h>
 #include <aerospike/as_key.h>
 #include <aerospike/as_log_macros.h>
+#include <aerospike/as_rate_limiter.h>
 
 #include <citrusleaf/cf_atomic.h>
 #include <citrusleaf/cf_byte_order.h>
@@ -35,6 +36,8 @@
 #include <citrusleaf/cf_proto.h>
 #include <citrusleaf/cf_socket.h>
 #include <citrusleaf/citrusleaf.h>
+#include <citrusleaf/cl_buf_cache.h>
+#include <citrusleaf/cl_read_ahead.h>
 
 #include "internal.h"
 
@@ -74,14 +77,23 @@ typedef struct scan_node_worker_scandef {
 } scan_node_worker_scandef;
 
 extern bool gasq_abort;
+
+// The receive thread must be done with fd before it is closed.
+static void
+scan_close(cl_read_ahead *ra, int fd)
+{
+	cl_read_ahead_stop(ra);
+	cf_close(fd);
+}
+
 static int
-do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operation_info2, const char *ns, const char *set, 
+do_scan_monte_stream(as_cluster *asc, char *node_name, uint operation_info, uint operation_info2, const char *ns, const char *set, 
 	cl_bin *bins, int n_bins, uint8_t scan_pct, 
-	citrusleaf_get_many_cb cb, void *udata, cl_scan_parameters *scan_opt)
+	citrusleaf_get_many_cb cb, citrusleaf_scan_ops_cb ops_cb, void *udata, cl_scan_parameters *scan_opt,
+	cl_read_ahead *ra)
 {
 	int rv = -1;
 
-	uint8_t		rd_stack_buf[STACK_BUF_SZ];	
 	uint8_t		*rd_buf = 0;
 	size_t		rd_buf_sz = 0;
 	uint8_t		wr_stack_buf[STACK_BUF_SZ];
@@ -139,22 +151,28 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 		return(-1);
 	}
 	if (wr_buf != wr_stack_buf) {
-		free(wr_buf);
+		cl_buf_release(wr_buf);
 		wr_buf = 0;
 	}
 
+	// Parse each proto while the next ones are received.
+	cl_read_ahead_start(ra, fd);
+
 	cl_proto 		proto;
 	bool done = false;
 	
 	do { // multiple CL proto per response
 		
 		// Now turn around and read a fine cl_pro - that's the first 8 bytes that has types and lengths
-		if ((rv = cf_socket_read_forever(fd, (uint8_t *) &proto, sizeof(cl_proto) ) ) ) {
+		// Usually they were already received together with the previous proto.
+		if ((rv = cl_read_ahead_fill(ra, fd, sizeof(cl_proto) ) ) ) {
 			as_log_error("network error: errno %d fd %d",rv, fd);
-			cf_close(fd);
+			scan_close(ra, fd);
 			as_node_release(node);
 			return(-1);
 		}
+		memcpy(&proto, cl_read_ahead_peek(ra), sizeof(cl_proto));
+		cl_read_ahead_consume(ra, sizeof(cl_proto));
 #ifdef DEBUG_VERBOSE
 		dump_buf("read proto header from cluster", (uint8_t *) &proto, sizeof(cl_proto));
 #endif	
@@ -162,13 +180,13 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 
 		if (proto.version != CL_PROTO_VERSION) {
 			as_log_error("network error: received protocol message of wrong version %d", proto.version);
-			cf_close(fd);
+			scan_close(ra, fd);
 			as_node_release(node);
 			return(-1);
 		}
-		if (proto.type != CL_PROTO_TYPE_CL_MSG) {
+		if (proto.type != CL_PROTO_TYPE_CL_MSG && proto.type != CL_PROTO_TYPE_CL_MSG_COMPRESSED) {
 			as_log_error("network error: received incorrect message version %d", proto.type);
-			cf_close(fd);
+			scan_close(ra, fd);
 			as_node_release(node);
 			return(-1);
 		}
@@ -181,23 +199,23 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
                                                          
 //            as_log_debug("message read: size %u",(uint)proto.sz);
 
-			if (rd_buf_sz > sizeof(rd_stack_buf))
-				rd_buf = malloc(rd_buf_sz);
-			else
-				rd_buf = rd_stack_buf;
-			if (rd_buf == NULL) {
-				cf_close(fd);
+			// The body is parsed in place, so it must be contiguous in the buffer.
+			if ((rv = cl_read_ahead_fill(ra, fd, rd_buf_sz))) {
+				as_log_error("network error: errno %d fd %d", rv, fd);
+				scan_close(ra, fd);
 				as_node_release(node);
-				return (-1);
+				return(-1);
 			}
 
-			if ((rv = cf_socket_read_forever(fd, rd_buf, rd_buf_sz))) {
-				as_log_error("network error: errno %d fd %d", rv, fd);
-				if (rd_buf != rd_stack_buf)	{ free(rd_buf); }
-				cf_close(fd);
+			// The messages of a compressed proto take the place of its body.
+			if (proto.type == CL_PROTO_TYPE_CL_MSG_COMPRESSED &&
+				cl_read_ahead_inflate(ra, asc->codec, rd_buf_sz, &rd_buf_sz)) {
+				as_log_error("could not decompress response");
+				scan_close(ra, fd);
 				as_node_release(node);
 				return(-1);
 			}
+			rd_buf = cl_read_ahead_peek(ra);
 // this one's a little much: printing the entire body before printing the other bits			
 #ifdef DEBUG_VERBOSE
 			dump_buf("read msg body header (multiple msgs)", rd_buf, rd_buf_sz);
@@ -224,7 +242,7 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 			if (msg->header_sz != sizeof(cl_msg)) {
 				as_log_error("received cl msg of unexpected size: expecting %zd found %d, internal error",
 					sizeof(cl_msg),msg->header_sz);
-				cf_close(fd);
+				scan_close(ra, fd);
 				as_node_release(node);
 				return(-1);
 			}
@@ -284,20 +302,22 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 #endif
 
 
-			if (msg->n_ops > STACK_BINS) {
+			if (msg->n_ops > STACK_BINS && !ops_cb) {
 				bins_local = malloc(sizeof(cl_bin) * msg->n_ops);
 			}
 			else {
 				bins_local = stack_bins;
 			}
 			if (bins_local == NULL) {
-				cf_close(fd);
+				scan_close(ra, fd);
 				as_node_release(node);
 				return (-1);
 			}
 			
 			// parse through the bins/ops
-			cl_msg_op *op = (cl_msg_op *)buf;
+			int n_bins_local = 0;
+			cl_msg_op *ops = (cl_msg_op *)buf;
+			cl_msg_op *op = ops;
 			for (int i=0;i<msg->n_ops;i++) {
 
 				cl_msg_swap_op_from_be(op);
@@ -311,7 +331,11 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 				dump_buf("individual op (host order)", (uint8_t *) op, op->op_sz + sizeof(uint32_t));
 #endif	
 
-				cl_set_value_particular(op, &bins_local[i]);
+				// The request names the bins, so the server only returns those.
+				// Op callbacks read the values themselves, straight from rd_buf.
+				if (!ops_cb) {
+					cl_set_value_particular(op, &bins_local[n_bins_local++]);
+				}
 				op = cl_msg_op_get_next(op);
 			}
 			buf = (uint8_t *) op;
@@ -330,10 +354,22 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 				done = true;
 			}
 			else if ((msg->n_ops) || (operation_info & CL_MSG_INFO1_GET_NOBINDATA)) {
+				// Stop reading the socket while the limiter has no tokens.
+				if (scan_opt) {
+					as_rate_limiter_acquire(scan_opt->rate_limiter, 1);
+				}
+
 				// got one good value? call it a success!
-				rv = (*cb)(ns_ret, keyd, set_ret, &key, CL_RESULT_OK, msg->generation,
-						cf_server_void_time_to_ttl(msg->record_ttl), bins_local,
-						msg->n_ops, udata);
+				if (ops_cb) {
+					rv = (*ops_cb)(ns_ret, keyd, set_ret, msg->generation,
+							cf_server_void_time_to_ttl(msg->record_ttl), ops,
+							msg->n_ops, udata);
+				}
+				else {
+					rv = (*cb)(ns_ret, keyd, set_ret, &key, CL_RESULT_OK, msg->generation,
+							cf_server_void_time_to_ttl(msg->record_ttl), bins_local,
+							n_bins_local, udata);
+				}
 				// To be cleaned up.   
 				if (rv) {
 
@@ -342,12 +378,7 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 						bins_local = 0;
 					}
 
-					if (rd_buf && (rd_buf != rd_stack_buf))	{
-						free(rd_buf);
-						rd_buf = 0;
-					}
-
-					cf_close(fd);
+					scan_close(ra, fd);
 					as_node_release(node);
 					node = 0;
 
@@ -370,13 +401,10 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 			
 		}
 		
-		if (rd_buf && (rd_buf != rd_stack_buf))	{
-			free(rd_buf);
-			rd_buf = 0;
-		}
+		cl_read_ahead_consume(ra, rd_buf_sz);
 		
 		if (gasq_abort) {
-			cf_close(fd);
+			scan_close(ra, fd);
 			as_node_release(node);
 			node = 0;
 			return (rv);
@@ -384,7 +412,16 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 
 	} while ( done == false );
 
-	as_node_put_connection(node, fd);
+	// Bytes past the last message would belong to no request. Don't hand the
+	// connection to the next transaction in that case.
+	cl_read_ahead_stop(ra);
+
+	if (cl_read_ahead_available(ra) == 0) {
+		as_node_put_connection(node, fd);
+	}
+	else {
+		cf_close(fd);
+	}
 	as_node_release(node);
 	node = 0;
 	
@@ -395,6 +432,25 @@ do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operat
 	return(rv);
 }
 
+static int
+do_scan_monte(as_cluster *asc, char *node_name, uint operation_info, uint operation_info2, const char *ns, const char *set, 
+	cl_bin *bins, int n_bins, uint8_t scan_pct, 
+	citrusleaf_get_many_cb cb, citrusleaf_scan_ops_cb ops_cb, void *udata, cl_scan_parameters *scan_opt)
+{
+	// The thread's read-ahead buffers are reused by each of its node scans,
+	// instead of a buffer per proto larger than the stack buffer.
+	cl_read_ahead *ra = cl_read_ahead_acquire();
+	if (!ra) {
+		return(-1);
+	}
+
+	int rv = do_scan_monte_stream(asc, node_name, operation_info, operation_info2, ns, set, bins, n_bins,
+			scan_pct, cb, ops_cb, udata, scan_opt, ra);
+
+	cl_read_ahead_release(ra);
+	return(rv);
+}
+
 
 extern cl_rv
 citrusleaf_scan(as_cluster *asc, char *ns, char *set, cl_bin *bins, int n_bins, bool get_key, citrusleaf_get_many_cb cb, void *udata, bool nobindata)
@@ -412,7 +468,7 @@ citrusleaf_scan(as_cluster *asc, char *ns, char *set, cl_bin *bins, int n_bins,
 		info = CL_MSG_INFO1_READ; 
 	}
 
-	return( do_scan_monte( asc, NULL, info, 0, ns, set, bins,n_bins, 100, cb, udata, NULL ) );
+	return( do_scan_monte( asc, NULL, info, 0, ns, set, bins, n_bins, 100, cb, NULL, udata, NULL ) );
 }
 
 extern cl_rv
@@ -438,7 +494,21 @@ citrusleaf_scan_node (as_cluster *asc, char *node_name, char *ns, char *set, cl_
 		scan_param = &default_scan_param;
 	}
 		
-	return( do_scan_monte( asc, node_name, info, 0, ns, set, bins, n_bins, scan_pct, cb, udata, scan_param ) ); 
+	return( do_scan_monte( asc, node_name, info, 0, ns, set, bins, n_bins, scan_pct, cb, NULL, udata, scan_param ) );
+}
+
+extern cl_rv
+citrusleaf_scan_node_ops(as_cluster *asc, char *node_name, char *ns, char *set, cl_bin *bins, int n_bins, uint8_t scan_pct,
+		citrusleaf_scan_ops_cb cb, void *udata, cl_scan_parameters *scan_param)
+{
+	cl_scan_parameters default_scan_param;
+	if (scan_param == NULL) {
+		cl_scan_parameters_set_default(&default_scan_param);
+		scan_param = &default_scan_param;
+	}
+
+	// The server only sends the requested bins, the callback picks what it needs.
+	return do_scan_monte( asc, node_name, CL_MSG_INFO1_READ, 0, ns, set, bins, n_bins, scan_pct, NULL, cb, udata, scan_param );
 }
 
 void *
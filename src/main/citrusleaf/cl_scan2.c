@@ -33,6 +33,7 @@
 #include <citrusleaf/cf_proto.h>
 
 #include <aerospike/as_aerospike.h>
+#include <aerospike/as_codec.h>
 #include <aerospike/as_list.h>
 #include <aerospike/as_module.h>
 #include <aerospike/as_msgpack.h>
@@ -45,6 +46,8 @@
 #include <citrusleaf/citrusleaf.h>
 #include <aerospike/as_cluster.h>
 #include <citrusleaf/as_scan.h>
+#include <citrusleaf/cl_buf_cache.h>
+#include <citrusleaf/cl_read_ahead.h>
 #include <citrusleaf/cl_udf.h>
 
 #include "internal.h"
@@ -62,6 +65,12 @@ extern as_val * citrusleaf_udf_bin_to_val(as_serializer *ser, cl_bin *);
 #define STACK_BUF_SZ        (1024 * 16) 
 #define STACK_BINS           100
 
+/*
+ * Name of the bin carrying the per record udf result
+ */
+#define SUCCESS_BIN_NAME     "SUCCESS"
+#define SUCCESS_BIN_NAME_SZ  (sizeof(SUCCESS_BIN_NAME) - 1)
+
 static void __log(const char * file, const int line, const char * fmt, ...) {
     char msg[256] = {0};
     va_list ap;
@@ -213,10 +222,9 @@ const as_rec_hooks scan_response_hooks = {
  * task->callback on the returned data. The returned data is a bin of name SUCCESS/FAILURE
  * and the value of the bin is the return value from the udf.
  */
-static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
+static int cl_scan_worker_do(as_node * node, cl_scan_task * task, cl_read_ahead * ra) {
 
-    uint8_t     rd_stack_buf[STACK_BUF_SZ] = {0};    
-    uint8_t *   rd_buf = rd_stack_buf;
+    uint8_t *   rd_buf = NULL;
     size_t      rd_buf_sz = 0;
 	
 	int fd;
@@ -232,56 +240,64 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
         return AEROSPIKE_ERR_CLIENT;
     }
 
+    // Parse each proto while the next ones are received. The receive thread
+    // must be stopped before fd is closed or reused.
+    cl_read_ahead_start(ra, fd);
+
     cl_proto  proto;
     bool      done = false;
 
     do {
         // multiple CL proto per response
         // Now turn around and read a fine cl_proto - that's the first 8 bytes 
-        // that has types and lengths
-        if ( (rc = cf_socket_read_forever(fd, (uint8_t *) &proto, sizeof(cl_proto) ) ) ) {
+        // that has types and lengths. Usually it is already in the read-ahead
+        // buffer, received with the previous proto.
+        if ( (rc = cl_read_ahead_fill(ra, fd, sizeof(cl_proto) ) ) ) {
             LOG("[ERROR] cl_scan_worker_do: network error: errno %d fd %d node name %s\n", rc, fd, node->name);
+            cl_read_ahead_stop(ra);
             cf_close(fd);
             return AEROSPIKE_ERR_CLIENT;
         }
+        memcpy(&proto, cl_read_ahead_peek(ra), sizeof(cl_proto));
+        cl_read_ahead_consume(ra, sizeof(cl_proto));
         cl_proto_swap_from_be(&proto);
 
         if ( proto.version != CL_PROTO_VERSION) {
             LOG("[ERROR] cl_scan_worker_do: network error: received protocol message of wrong version %d from node %s\n", proto.version, node->name);
+            cl_read_ahead_stop(ra);
             cf_close(fd);
             return AEROSPIKE_ERR_CLIENT;
         }
 
         if ( proto.type != CL_PROTO_TYPE_CL_MSG && proto.type != CL_PROTO_TYPE_CL_MSG_COMPRESSED ) {
             LOG("[ERROR] cl_scan_worker_do: network error: received incorrect message version %d from node %s \n",proto.type, node->name);
+            cl_read_ahead_stop(ra);
             cf_close(fd);
             return AEROSPIKE_ERR_CLIENT;
         }
 
         // second read for the remainder of the message - expect this to cover 
         // lots of data, many lines if there's no error
+        // The body is parsed in place, so it must be contiguous in the buffer.
         rd_buf_sz =  proto.sz;
         if (rd_buf_sz > 0) {
-
-            if (rd_buf_sz > sizeof(rd_stack_buf)){
-                rd_buf = malloc(rd_buf_sz);
-            }
-            else {
-                rd_buf = rd_stack_buf;
-            }
-
-            if (rd_buf == NULL) {
-            	cf_close(fd);
-            	return AEROSPIKE_ERR_CLIENT;
+            if ( (rc = cl_read_ahead_fill(ra, fd, rd_buf_sz)) ) {
+                LOG("[ERROR] cl_scan_worker_do: network error: errno %d fd %d node name %s\n", rc, fd, node->name);
+                cl_read_ahead_stop(ra);
+                cf_close(fd);
+                return AEROSPIKE_ERR_CLIENT;
             }
 
-            if ( (rc = cf_socket_read_forever(fd, rd_buf, rd_buf_sz)) ) {
-                LOG("[ERROR] cl_scan_worker_do: network error: errno %d fd %d node name %s\n", rc, fd, node->name);
-                if ( rd_buf != rd_stack_buf ) free(rd_buf);
+            // The messages of a compressed proto take the place of its body.
+            if ( proto.type == CL_PROTO_TYPE_CL_MSG_COMPRESSED &&
+                 cl_read_ahead_inflate(ra, node->cluster->codec, rd_buf_sz, &rd_buf_sz) ) {
+                LOG("[ERROR] cl_scan_worker_do: could not decompress response from node %s\n", node->name);
+                cl_read_ahead_stop(ra);
                 cf_close(fd);
                 return AEROSPIKE_ERR_CLIENT;
             }
         }
+        rd_buf = cl_read_ahead_peek(ra);
 
         // process all the cl_msg in this proto
         uint8_t *   buf = rd_buf;
@@ -300,6 +316,7 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
             if ( msg->header_sz != sizeof(cl_msg) ) {
                 LOG("[ERROR] cl_scan_worker_do: received cl msg of unexpected size: expecting %zd found %d, internal error\n",
                         sizeof(cl_msg),msg->header_sz);
+                cl_read_ahead_stop(ra);
                 cf_close(fd);
                 return AEROSPIKE_ERR_CLIENT;
             }
@@ -343,11 +360,14 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
                 if (set_ret) {
                     free(set_ret);
                 }
+                cl_read_ahead_stop(ra);
                 cf_close(fd);
                return AEROSPIKE_ERR_CLIENT;
             }
 
-            // parse through the bins/ops
+            // parse through the bins/ops - only the udf result bin is read,
+            // everything else is skipped by length without being decoded
+            int n_bins = 0;
             cl_msg_op * op = (cl_msg_op *) buf;
             for (int i=0;i<msg->n_ops;i++) {
                 cl_msg_swap_op_from_be(op);
@@ -361,7 +381,9 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
                 dump_buf("individual op (host order)", (uint8_t *) op, op->op_sz + sizeof(uint32_t));
 #endif    
 
-                cl_set_value_particular(op, &bins[i]);
+                if (op->name_sz == SUCCESS_BIN_NAME_SZ && memcmp(op->name, SUCCESS_BIN_NAME, SUCCESS_BIN_NAME_SZ) == 0) {
+                    cl_set_value_particular(op, &bins[n_bins++]);
+                }
                 op = cl_msg_op_get_next(op);
             }
             buf = (uint8_t *) op;
@@ -393,14 +415,14 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
                 recp->generation = msg->generation;
                 recp->record_ttl = msg->record_ttl;
                 recp->bins       = bins;
-                recp->n_bins     = msg->n_ops;
+                recp->n_bins     = n_bins;
                 recp->ismalloc   = false;
 
                 as_rec r;
                 as_rec *rp = &r;
                 rp = as_rec_init(rp, recp, &scan_response_hooks);
 
-                as_val * v = as_rec_get(rp, "SUCCESS");
+                as_val * v = as_rec_get(rp, SUCCESS_BIN_NAME);
                 if ( v  != NULL && task->callback) {
                     // Got a non null value for the resposne bin,
                     // call callback on it and destroy the record
@@ -415,7 +437,7 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
 
             // if done free it 
             if (done) {
-                citrusleaf_bins_free(bins, msg->n_ops);
+                citrusleaf_bins_free(bins, n_bins);
                 if (bins != stack_bins) {
                     free(bins);
                     bins = 0;
@@ -433,13 +455,20 @@ static int cl_scan_worker_do(as_node * node, cl_scan_task * task) {
 
         }
 
-        if (rd_buf && (rd_buf != rd_stack_buf))    {
-            free(rd_buf);
-            rd_buf = 0;
-        }
+        cl_read_ahead_consume(ra, rd_buf_sz);
 
     } while ( done == false );
-    as_node_put_connection(node, fd);
+
+    // Bytes past the last message would belong to no request. Don't hand the
+    // connection to the next transaction in that case.
+    cl_read_ahead_stop(ra);
+
+    if ( cl_read_ahead_available(ra) == 0 ) {
+        as_node_put_connection(node, fd);
+    }
+    else {
+        cf_close(fd);
+    }
 
 #ifdef DEBUG_VERBOSE    
     LOG("[DEBUG] cl_scan_worker_do: exited loop: rc %d\n", rc );
@@ -476,9 +505,18 @@ void * cl_scan_worker(void * pv_asc) {
         // query if the node is still around
         int rc = AEROSPIKE_ERR_CLUSTER;
 
+        // Each worker thread keeps its read-ahead buffers for all its tasks.
         as_node * node = as_node_get_by_name(task.asc, task.node_name);
         if ( node ) {
-            rc = cl_scan_worker_do(node, &task);
+            cl_read_ahead * ra = cl_read_ahead_acquire();
+
+            if ( ra ) {
+                rc = cl_scan_worker_do(node, &task, ra);
+                cl_read_ahead_release(ra);
+            }
+            else {
+                rc = AEROSPIKE_ERR_CLIENT;
+            }
 			as_node_release(node);
         }
         else {
@@ -667,7 +705,7 @@ cf_vector * cl_scan_execute(as_cluster * cluster, const cl_scan * scan, char * n
 
 Cleanup:
     if ( wr_buf && (wr_buf != wr_stack_buf) ) { 
-        free(wr_buf); 
+        cl_buf_release(wr_buf); 
         wr_buf = 0;
     }
     cf_queue_destroy(task.complete_q);
@@ -18,6 +18,7 @@
 #include <citrusleaf/cf_proto.h>
 
 #include <aerospike/as_bytes.h>
+#include <aerospike/as_lazy.h>
 #include <aerospike/as_nil.h>
 #include <aerospike/as_msgpack.h>
 
@@ -183,19 +184,25 @@ static as_val * cl_udf_bin_to_val(as_serializer * ser, cl_bin * bin) {
 		case CL_RUBY_BLOB:
 		case CL_ERLANG_BLOB:
 		{
-			uint8_t *b = malloc(sizeof(bin->object.sz));
+			uint8_t *b = malloc(bin->object.sz);
 			memcpy(b, bin->object.u.blob, bin->object.sz);
 			val = (as_val *)as_bytes_new_wrap(b, (uint32_t)bin->object.sz, true /*ismalloc*/);
+			break;
 		}
 		case CL_LIST :
 		case CL_MAP : {
-			// use a temporary buffer, which doesn't need to be destroyed
-			as_buffer buf = {
-				.capacity = (uint32_t) bin->object.sz,
-				.size = (uint32_t) bin->object.sz,
-				.data = (uint8_t *) bin->object.u.blob
-			};
-			as_serializer_deserialize(ser, &buf, &val);
+			// decoded on first access, see as_lazy.h
+			uint8_t * data = (uint8_t *) malloc(bin->object.sz);
+			if ( data == NULL ) {
+				break;
+			}
+			memcpy(data, bin->object.u.blob, bin->object.sz);
+			val = bin->object.type == CL_LIST ?
+				(as_val *) as_lazy_list_new(data, (uint32_t) bin->object.sz, true) :
+				(as_val *) as_lazy_map_new(data, (uint32_t) bin->object.sz, true);
+			if ( val == NULL ) {
+				free(data);
+			}
 			break;
 		}
 		case CL_NULL : {
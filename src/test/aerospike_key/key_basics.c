@@ -16,7 +16,12 @@
  */
 #include <aerospike/aerospike.h>
 #include <aerospike/aerospike_key.h>
+#include <aerospike/as_allocator.h>
 
+#include <aerospike/as_bin_codec.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_cluster.h>
+#include <aerospike/as_codec.h>
 #include <aerospike/as_error.h>
 #include <aerospike/as_status.h>
 
@@ -30,7 +35,15 @@
 #include <aerospike/as_stringmap.h>
 #include <aerospike/as_val.h>
 
+#include <citrusleaf/cf_clock.h>
+#include <citrusleaf/cl_buf_cache.h>
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "../test.h"
+#include "../util/stand_in_server.h"
 
 /******************************************************************************
  * GLOBAL VARS
@@ -51,6 +64,122 @@ static bool key_basics_print_bins(const char * name, const as_val * value, void
 	return true;
 }
 
+typedef struct key_basics_stand_in_s {
+	const char * from;
+	useconds_t delay_us;
+} key_basics_stand_in;
+
+static bool key_basics_stand_in_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// Answer any read with bin "from" naming the server, after its delay.
+	key_basics_stand_in * s = (key_basics_stand_in *) udata;
+	uint8_t ops[64];
+
+	usleep(s->delay_us);
+
+	uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "from", CL_PARTICLE_TYPE_STRING, s->from, (uint32_t) strlen(s->from));
+	return stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, ops, end - ops, 1);
+}
+
+static bool key_basics_truncate_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// The first response stops after its header, so its body read times out.
+	uint32_t * requests = (uint32_t *) udata;
+
+	if ( ck_pr_faa_32(requests, 1) > 0 ) {
+		uint8_t ops[64];
+		uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "from", CL_PARTICLE_TYPE_STRING, "retry", 5);
+		return stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, ops, end - ops, 1);
+	}
+
+	as_msg header;
+	memset(&header, 0, sizeof(as_msg));
+	header.proto.version = CL_PROTO_VERSION;
+	header.proto.type = CL_PROTO_TYPE_CL_MSG;
+	header.proto.sz = sizeof(cl_msg) + 64;
+	cl_proto_swap_to_be(&header.proto);
+	header.m.header_sz = sizeof(cl_msg);
+	header.m.n_ops = 1;
+	cl_msg_swap_header_to_be(&header.m);
+
+	if ( send(fd, &header, sizeof(as_msg), MSG_NOSIGNAL) != sizeof(as_msg) ) {
+		return false;
+	}
+	usleep(600 * 1000);
+	return false;
+}
+
+static bool key_basics_slow_once_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// Answer at once, except for one request after the flag is set.
+	uint32_t * slow = (uint32_t *) udata;
+
+	if ( ck_pr_fas_32(slow, 0) ) {
+		usleep(300 * 1000);
+	}
+
+	uint8_t ops[64];
+	uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "from", CL_PARTICLE_TYPE_STRING, "adaptive", 8);
+	return stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, ops, end - ops, 1);
+}
+
+static bool key_basics_compressed_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// Acknowledge writes, and answer reads compressed.
+	if ( msg->info2 & CL_MSG_INFO2_WRITE ) {
+		return stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, NULL, 0, 0);
+	}
+
+	uint8_t ops[64];
+	uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "from", CL_PARTICLE_TYPE_STRING, "compressed", 10);
+	return stand_in_send_compressed(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, ops, end - ops, 1);
+}
+
+static void key_basics_event_json(char * buf, size_t size, uint32_t i)
+{
+	snprintf(buf, size,
+		"{\"user\":\"user-%u\",\"session\":\"%08x\",\"country\":\"%s\",\"device\":\"%s\","
+		"\"event\":\"page_view\",\"page\":\"/products/%u\",\"referrer\":\"https://www.example.com/search\"}",
+		i, i * 2654435761u, i % 2 ? "fr" : "de", i % 3 ? "mobile" : "desktop", i % 17);
+}
+
+static void * key_basics_malloc(as_alloc_tag tag, size_t size, void * udata)
+{
+	return malloc(size);
+}
+
+static void * key_basics_realloc(as_alloc_tag tag, void * p, size_t size, void * udata)
+{
+	return realloc(p, size);
+}
+
+static void key_basics_free(as_alloc_tag tag, void * p, size_t size, void * udata)
+{
+	free(p);
+}
+
+static uint32_t key_basics_n_nodes(aerospike * client)
+{
+	as_nodes * nodes = as_nodes_reserve(client->cluster);
+	uint32_t size = nodes->size;
+	as_nodes_release(nodes);
+	return size;
+}
+
+static uint32_t key_basics_n_in_zone(aerospike * client)
+{
+	as_nodes * nodes = as_nodes_reserve(client->cluster);
+	uint32_t n = 0;
+
+	for ( uint32_t i = 0; i < nodes->size; i++ ) {
+		if ( ck_pr_load_8(&nodes->array[i]->in_zone) ) {
+			n++;
+		}
+	}
+	as_nodes_release(nodes);
+	return n;
+}
+
 /******************************************************************************
  * TEST CASES
  *****************************************************************************/
@@ -145,6 +274,143 @@ TEST( key_basics_get , "get: (test,test,foo) = {a: 123, b: 'abc', c: 456, d: 'de
     as_record_destroy(rec);
 }
 
+TEST( key_basics_get_arena , "get with arena: (test,test,foo) = {a: 123, b: 'abc', c: 456, d: 'def', e: [1,2,3], f: {x: 7, y: 8, z: 9}}" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.use_arena = true;
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	// The second get should reuse the arena released by the first one.
+	for ( int i = 0; i < 2; i++ ) {
+		as_record * rec = NULL;
+
+		as_status rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_not_null( rec );
+		assert_not_null( rec->arena );
+		assert_int_eq( as_record_numbins(rec), 6 );
+
+		assert_int_eq( as_record_get_int64(rec, "a", 0), 123 );
+		assert_string_eq( as_record_get_str(rec, "b"), "abc" );
+		assert_int_eq( as_record_get_int64(rec, "c", 0), 456 );
+		assert_string_eq( as_record_get_str(rec, "d"), "def" );
+
+		as_list * list = as_record_get_list(rec, "e");
+		assert_not_null( list );
+		assert_int_eq( as_list_size(list), 3 );
+
+		as_map * map = as_record_get_map(rec, "f");
+		assert_not_null( map );
+		assert_int_eq( as_map_size(map), 3 );
+
+		as_record_destroy(rec);
+	}
+
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_get_reset , "get into a reused record: (test,test,foo)" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.use_arena = true;
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_record r, *rec = &r;
+	as_record_init(&r, 0);
+
+	as_status rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_bin * entries = rec->bins.entries;
+	as_record_reset(rec);
+	assert_int_eq( as_record_numbins(rec), 0 );
+
+	// Same shape, so the entries come back from the same arena memory.
+	rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_true( rec == &r );
+	assert_true( rec->bins.entries == entries );
+	assert_int_eq( as_record_numbins(rec), 6 );
+	assert_string_eq( as_record_get_str(rec, "b"), "abc" );
+
+	as_record_destroy(rec);
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_get_reset_scalar , "get into a reused record allocates nothing: (test,test,scalar) = {a: 123, b: 'abc', c: <bytes>}" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "scalar");
+
+	uint8_t bytes[] = { 1, 2, 3, 4 };
+
+	as_record r, *rec = &r;
+	as_record_init(&r, 3);
+	as_record_set_int64(&r, "a", 123);
+	as_record_set_str(&r, "b", "abc");
+	as_record_set_rawp(&r, "c", bytes, sizeof(bytes), false);
+
+	as_status rc = aerospike_key_put(as, &err, NULL, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.use_arena = true;
+
+	as_record_init(&r, 0);
+
+	// Warm up the bin entries and the arena.
+	for ( int i = 0; i < 2; i++ ) {
+		rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+		assert_int_eq( rc, AEROSPIKE_OK );
+		as_record_reset(rec);
+	}
+
+	as_alloc_stats before;
+	as_allocator_stats(AS_ALLOC_RECORD, &before);
+
+	bool matched = true;
+
+	for ( int i = 0; i < 100; i++ ) {
+		rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+		assert_int_eq( rc, AEROSPIKE_OK );
+
+		if ( as_record_numbins(rec) != 3 || as_record_get_int64(rec, "a", 0) != 123 ||
+			strcmp(as_record_get_str(rec, "b"), "abc") != 0 ||
+			as_bytes_size(as_record_get_bytes(rec, "c")) != sizeof(bytes) ) {
+			matched = false;
+		}
+		as_record_reset(rec);
+	}
+
+	as_alloc_stats after;
+	as_allocator_stats(AS_ALLOC_RECORD, &after);
+
+	assert_true( matched );
+	assert_int_eq( after.allocs - before.allocs, 0 );
+
+	as_record_destroy(rec);
+	aerospike_key_remove(as, &err, NULL, &key);
+	as_key_destroy(&key);
+}
+
 TEST( key_basics_select , "select: (test,test,foo) = {a: 123, b: 'abc'}" ) {
 
 	as_error err;
@@ -206,6 +472,379 @@ TEST( key_basics_exists , "exists: (test,test,foo)" ) {
 	as_record_destroy(rec);
 }
 
+TEST( key_basics_get_replica_latency , "get from the faster replica: (test,test,foo)" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.replica = AS_POLICY_REPLICA_LATENCY;
+
+	// Enough reads for both replicas to be chosen.
+	for ( int i = 0; i < 100; i++ ) {
+		as_record * rec = NULL;
+		as_status rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_not_null( rec );
+
+		as_record_destroy(rec);
+	}
+
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_get_hedged , "get hedged to the prole when the master is slow" ) {
+
+	key_basics_stand_in slow = { "master", 300 * 1000 };
+	key_basics_stand_in fast = { "prole", 0 };
+
+	stand_in_server * master = stand_in_server_start("BB9000000000031", key_basics_stand_in_handler, &slow);
+	stand_in_server * prole = stand_in_server_start("BB9000000000032", key_basics_stand_in_handler, &fast);
+	assert_not_null( master );
+	assert_not_null( prole );
+	stand_in_server_set_prole(prole);
+	stand_in_server_set_peer(master, prole);
+
+	// Every read may be hedged.
+	as_config config;
+	as_config_init(&config);
+	config.hedge_max_percent = 100;
+
+	aerospike * client = stand_in_connect(master, &config);
+	assert_not_null( client );
+
+	for ( int i = 0; i < 100 && key_basics_n_nodes(client) < 2; i++ ) {
+		usleep(50 * 1000);
+	}
+	assert_int_eq( key_basics_n_nodes(client), 2 );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.timeout = 2000;
+	policy.replica = AS_POLICY_REPLICA_MASTER;
+	policy.hedge_delay = 20;
+
+	for ( int i = 0; i < 5; i++ ) {
+		as_record * rec = NULL;
+		as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_not_null( rec );
+		assert_string_eq( as_record_get_str(rec, "from"), "prole" );
+		as_record_destroy(rec);
+	}
+
+	as_hedge_stats stats;
+	as_cluster_get_hedge_stats(client->cluster, &stats);
+	assert_int_eq( stats.slow, 5 );
+	assert_int_eq( stats.hedged, 5 );
+	assert_int_eq( stats.won, 5 );
+	assert_int_eq( stats.throttled, 0 );
+
+	// Without a hedge delay, the read waits for the master.
+	as_policy_read_init(&policy);
+	policy.timeout = 2000;
+	policy.replica = AS_POLICY_REPLICA_MASTER;
+
+	as_record * rec = NULL;
+	as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_string_eq( as_record_get_str(rec, "from"), "master" );
+	as_record_destroy(rec);
+
+	as_cluster_get_hedge_stats(client->cluster, &stats);
+	assert_int_eq( stats.slow, 5 );
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(master);
+	stand_in_server_stop(prole);
+}
+
+TEST( key_basics_get_attempt_timeout , "get with a timeout per attempt: (test,test,foo)" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.retry = AS_POLICY_RETRY_ONCE;
+	policy.attempt_timeout = 200;
+
+	as_retry_stats before;
+	as_cluster_get_retry_stats(as->cluster, &before);
+
+	as_record * rec = NULL;
+	as_status rc = aerospike_key_get(as, &err, &policy, &key, &rec);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_not_null( rec );
+
+	as_record_destroy(rec);
+
+	as_retry_stats after;
+	as_cluster_get_retry_stats(as->cluster, &after);
+
+	assert_true( after.attempts > before.attempts );
+	assert_true( after.recovered - before.recovered <= after.retries - before.retries );
+
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_get_body_timeout , "get retried after the body of the response timed out" ) {
+
+	uint32_t requests = 0;
+	stand_in_server * server = stand_in_server_start("BB9000000000041", key_basics_truncate_handler, &requests);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.timeout = 2000;
+	policy.attempt_timeout = 200;
+	policy.retry = AS_POLICY_RETRY_ONCE;
+
+	// The retry reads into the stack buffer again, not the one released
+	// after the failed read.
+	as_record * rec = NULL;
+	as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_not_null( rec );
+	assert_string_eq( as_record_get_str(rec, "from"), "retry" );
+	as_record_destroy(rec);
+
+	assert_int_eq( ck_pr_load_32(&requests), 2 );
+
+	as_retry_stats stats;
+	as_cluster_get_retry_stats(client->cluster, &stats);
+	assert_int_eq( stats.retries, 1 );
+	assert_int_eq( stats.recovered, 1 );
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+TEST( key_basics_get_adaptive_timeout , "get with attempt timeouts derived from the node's read latencies" ) {
+
+	uint32_t slow = 0;
+	stand_in_server * server = stand_in_server_start("BB9000000000051", key_basics_slow_once_handler, &slow);
+	assert_not_null( server );
+
+	// A single counted failure would open the breaker.
+	as_config config;
+	as_config_init(&config);
+	config.breaker_threshold = 1;
+	config.adaptive_timeout_multiplier = 20;
+
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.timeout = 2000;
+	policy.retry = AS_POLICY_RETRY_ONCE;
+	policy.attempt_timeout = AS_POLICY_ATTEMPT_TIMEOUT_ADAPTIVE;
+
+	// Enough reads for attempts to be limited by the latencies of the first.
+	for ( int i = 0; i < 200; i++ ) {
+		as_record * rec = NULL;
+		as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+		assert_int_eq( rc, AEROSPIKE_OK );
+		as_record_destroy(rec);
+	}
+
+	as_nodes * nodes = as_nodes_reserve(client->cluster);
+	as_node * node = nodes->array[0];
+	uint64_t latency_us = as_node_latency_percentile(node, AS_NODE_LATENCY_READ, config.adaptive_timeout_percentile);
+	uint64_t attempt_ms = (latency_us * config.adaptive_timeout_multiplier + 999) / 1000;
+	info("p%u read latency: %u us, attempt timeout: %u ms", config.adaptive_timeout_percentile, (uint32_t) latency_us, (uint32_t) attempt_ms);
+	assert_true( attempt_ms > 0 );
+	assert_true( attempt_ms < 100 );
+
+	as_retry_stats before;
+	as_cluster_get_retry_stats(client->cluster, &before);
+
+	// The first attempt is cut short at the attempt timeout, well before the
+	// server answers it, and the retry is answered at once.
+	ck_pr_store_32(&slow, 1);
+	uint64_t begin_ms = cf_getms();
+
+	as_record * rec = NULL;
+	as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+	uint64_t elapsed_ms = cf_getms() - begin_ms;
+	info("read with a slow first attempt: %u ms", (uint32_t) elapsed_ms);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_not_null( rec );
+	assert_string_eq( as_record_get_str(rec, "from"), "adaptive" );
+	as_record_destroy(rec);
+
+	assert_true( elapsed_ms >= attempt_ms );
+	assert_true( elapsed_ms < attempt_ms + 150 );
+
+	as_retry_stats after;
+	as_cluster_get_retry_stats(client->cluster, &after);
+	assert_int_eq( after.retries - before.retries, 1 );
+	assert_int_eq( after.recovered - before.recovered, 1 );
+
+	// Running out of the attempt timeout is not a failure of the node.
+	assert_false( as_node_breaker_is_open(node) );
+	assert_int_eq( node->breaker.failures, 0 );
+	as_nodes_release(nodes);
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+TEST( key_basics_get_replica_zone , "get from the replica in the client zone" ) {
+
+	key_basics_stand_in remote = { "master", 0 };
+	key_basics_stand_in local = { "prole", 0 };
+
+	stand_in_server * master = stand_in_server_start("BB9000000000061", key_basics_stand_in_handler, &remote);
+	stand_in_server * prole = stand_in_server_start("BB9000000000062", key_basics_stand_in_handler, &local);
+	assert_not_null( master );
+	assert_not_null( prole );
+	stand_in_server_set_prole(prole);
+	stand_in_server_set_zone(prole, "z1");
+	stand_in_server_set_peer(master, prole);
+
+	// Only the prole answers with a zone, the client's.
+	as_config config;
+	as_config_init(&config);
+	strcpy(config.zone, "z1");
+	strcpy(config.zone_info_name, "zone");
+	config.tender_interval = 100;
+
+	aerospike * client = stand_in_connect(master, &config);
+	assert_not_null( client );
+
+	for ( int i = 0; i < 100 && (key_basics_n_nodes(client) < 2 || key_basics_n_in_zone(client) < 1); i++ ) {
+		usleep(50 * 1000);
+	}
+	assert_int_eq( key_basics_n_nodes(client), 2 );
+	assert_int_eq( key_basics_n_in_zone(client), 1 );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_read policy;
+	as_policy_read_init(&policy);
+	policy.replica = AS_POLICY_REPLICA_ZONE;
+
+	as_zone_stats before;
+	as_cluster_get_zone_stats(client->cluster, &before);
+
+	for ( int i = 0; i < 20; i++ ) {
+		as_record * rec = NULL;
+		as_status rc = aerospike_key_get(client, &err, &policy, &key, &rec);
+
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_not_null( rec );
+		assert_string_eq( as_record_get_str(rec, "from"), "prole" );
+		as_record_destroy(rec);
+	}
+
+	as_zone_stats after;
+	as_cluster_get_zone_stats(client->cluster, &after);
+	assert_int_eq( after.local - before.local, 20 );
+	assert_int_eq( after.remote - before.remote, 0 );
+	assert_int_eq( after.unhealthy - before.unhealthy, 0 );
+
+	// Each node is asked for its zone once, even the master which has none.
+	usleep(500 * 1000);
+	assert_int_eq( stand_in_server_zone_requests(master), 1 );
+	assert_int_eq( stand_in_server_zone_requests(prole), 1 );
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(master);
+	stand_in_server_stop(prole);
+}
+
+TEST( key_basics_allocator_once , "clients of a process share the allocator of the first one" ) {
+
+	// Equal functions, but distinct allocators.
+	static as_allocator first = { key_basics_malloc, key_basics_realloc, key_basics_free, NULL };
+	static as_allocator second = { key_basics_malloc, key_basics_realloc, key_basics_free, NULL };
+
+	key_basics_stand_in s = { "allocator", 0 };
+	stand_in_server * server = stand_in_server_start("BB9000000000081", key_basics_stand_in_handler, &s);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	config.allocator = &first;
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	// The same allocator again is fine.
+	as_config_init(&config);
+	config.allocator = &first;
+	aerospike * same = stand_in_connect(server, &config);
+	assert_not_null( same );
+
+	// A different one is rejected.
+	as_config_init(&config);
+	config.allocator = &second;
+	as_config_add_host(&config, "127.0.0.1", stand_in_server_port(server));
+	aerospike * other = aerospike_new(&config);
+
+	as_error err;
+	as_status rc = aerospike_connect(other, &err);
+	aerospike_destroy(other);
+	assert_int_eq( rc, AEROSPIKE_ERR_PARAM );
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+	as_record * rec = NULL;
+	rc = aerospike_key_get(same, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_string_eq( as_record_get_str(rec, "from"), "allocator" );
+	as_record_destroy(rec);
+	as_key_destroy(&key);
+
+	aerospike_close(same, &err);
+	aerospike_destroy(same);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+
+	// Memory from the first allocator goes back to it, so it can be replaced.
+	as_allocator_set(NULL);
+}
+
 TEST( key_basics_notexists , "not exists: (test,test,foozoo)" ) {
 
 	as_error err;
@@ -310,6 +949,513 @@ TEST( key_basics_get2 , "get: (test,test,foo) = {a: 444, b: 'abcdef', d: 'abcdef
 
     as_record_destroy(rec);
 }
+
+TEST( key_basics_put_unchanged , "put back as read: (test,test,foo) = {e: [1,2,3], f: {x: 7, y: 8, z: 9}}" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_record * rec = NULL;
+	as_status rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	// The list and map are sent in the form they were read in.
+	rc = aerospike_key_put(as, &err, NULL, &key, rec);
+	as_record_destroy(rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	rec = NULL;
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_list * list = as_record_get_list(rec, "e");
+	assert_not_null( list );
+	assert_int_eq( as_list_size(list), 3 );
+	assert_int_eq( as_list_get_int64(list, 2), 3 );
+
+	as_map * map = as_record_get_map(rec, "f");
+	assert_not_null( map );
+	assert_int_eq( as_map_size(map), 3 );
+
+	as_record_destroy(rec);
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_put_large_list , "put: (test,test,foo) = {l: [0, 'x...', 2, ...]} with 1000 elements" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	// Long enough for the wide list, integer and string headers.
+	char str[101];
+	memset(str, 'x', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+
+	as_arraylist list;
+	as_arraylist_init(&list, 1000, 0);
+	for ( int i = 0; i < 1000; i++ ) {
+		if ( i % 2 ) {
+			as_arraylist_append_str(&list, str);
+		}
+		else {
+			as_arraylist_append_int64(&list, (int64_t) i * 100000 - 50000000);
+		}
+	}
+
+	as_record r, *rec = &r;
+	as_record_init(&r, 1);
+	as_record_set_list(&r, "l", (as_list *) &list);
+
+	as_status rc = aerospike_key_put(as, &err, NULL, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_record_init(&r, 0);
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_list * l = as_record_get_list(rec, "l");
+	assert_not_null( l );
+	assert_int_eq( as_list_size(l), 1000 );
+	assert_int_eq( as_list_get_int64(l, 0), -50000000 );
+	assert_int_eq( as_list_get_int64(l, 998), 49800000 );
+	assert_string_eq( as_list_get_str(l, 999), str );
+
+	as_record_destroy(rec);
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_wide_record_index , "set, get, overwrite and remove the bins of a record wider than AS_RECORD_INDEX_THRESHOLD" ) {
+
+	const int n_bins = AS_RECORD_INDEX_THRESHOLD * 3;
+	char name[AS_BIN_NAME_MAX_SIZE];
+
+	as_record r;
+	as_record_init(&r, n_bins);
+
+	for ( int i = 0; i < n_bins; i++ ) {
+		snprintf(name, sizeof(name), "bin%d", i);
+		assert_true( as_record_set_int64(&r, name, i) );
+	}
+
+	// Past the threshold, names are looked up in the index.
+	assert_not_null( r.index );
+	assert_int_eq( as_record_numbins(&r), n_bins );
+
+	for ( int i = 0; i < n_bins; i++ ) {
+		snprintf(name, sizeof(name), "bin%d", i);
+		assert_int_eq( as_record_get_int64(&r, name, -1), i );
+	}
+	assert_null( as_record_get(&r, "missing") );
+
+	// Overwriting keeps the bin in place.
+	assert_true( as_record_set_str(&r, "bin7", "seven") );
+	assert_true( as_record_set_int64(&r, "bin40", 400) );
+	assert_int_eq( as_record_numbins(&r), n_bins );
+	assert_string_eq( as_record_get_str(&r, "bin7"), "seven" );
+	assert_int_eq( as_record_get_int64(&r, "bin40", -1), 400 );
+	assert_int_eq( as_record_get_int64(&r, "bin41", -1), 41 );
+
+	// Removing a bin sets it to nil, to delete it on the server.
+	assert_int_eq( as_rec_remove(&r._, "bin20"), 0 );
+	as_bin_value * removed = as_record_get(&r, "bin20");
+	assert_not_null( removed );
+	assert_int_eq( as_val_type(removed), AS_NIL );
+	assert_int_eq( as_record_get_int64(&r, "bin21", -1), 21 );
+
+	// No room for a new bin.
+	assert_false( as_record_set_int64(&r, "extra", 1) );
+
+	// A reset record starts over with an empty index.
+	as_record_reset(&r);
+	assert_null( as_record_get(&r, "bin7") );
+	assert_true( as_record_set_int64(&r, "bin7", 77) );
+	assert_int_eq( as_record_get_int64(&r, "bin7", -1), 77 );
+	assert_int_eq( as_record_numbins(&r), 1 );
+
+	as_record_destroy(&r);
+}
+
+TEST( key_basics_alloc_stats , "put and get of (test,test,alloc) release all the record memory they take" ) {
+
+	const int n_bins = AS_RECORD_INDEX_THRESHOLD + 8;
+	char name[AS_BIN_NAME_MAX_SIZE];
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "alloc");
+
+	as_alloc_stats before;
+	as_allocator_stats(AS_ALLOC_RECORD, &before);
+
+	// Wide enough for both records to index their bins.
+	as_record r;
+	as_record_init(&r, n_bins);
+
+	for ( int i = 0; i < n_bins; i++ ) {
+		snprintf(name, sizeof(name), "bin%d", i);
+		as_record_set_int64(&r, name, i);
+	}
+
+	as_status rc = aerospike_key_put(as, &err, NULL, &key, &r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	as_record_destroy(&r);
+
+	as_record * rec = NULL;
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_not_null( rec );
+	assert_int_eq( as_record_numbins(rec), n_bins );
+	assert_int_eq( as_record_get_int64(rec, "bin20", -1), 20 );
+	as_record_destroy(rec);
+
+	as_alloc_stats after;
+	as_allocator_stats(AS_ALLOC_RECORD, &after);
+
+	// The index of each record, nothing left behind.
+	assert_true( after.allocs - before.allocs >= 2 );
+	assert_int_eq( after.frees - before.frees, after.allocs - before.allocs );
+	assert_int_eq( after.bytes, before.bytes );
+	assert_true( after.total_bytes > before.total_bytes );
+
+	aerospike_key_remove(as, &err, NULL, &key);
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_put_template , "put with a template: (test,test,foo{0,1}) = {a: ..., b: incr(1)}" ) {
+
+	as_error err;
+	as_error_reset(&err);
+
+	const char * bins[] = { "a", "b" };
+	as_operator ops[] = { AS_OPERATOR_WRITE, AS_OPERATOR_INCR };
+
+	as_write_template tmpl;
+	as_status rc = as_write_template_init(as, &err, &tmpl, NULL, "test", "test", bins, ops, 2, 0);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	const char * names[] = { "foo0", "foo1" };
+
+	for ( int i = 0; i < 2; i++ ) {
+		as_key key;
+		as_key_init(&key, "test", "test", names[i]);
+
+		aerospike_key_remove(as, &err, NULL, &key);
+
+		// Values of different sizes go through the same template.
+		as_string a;
+		as_string_init(&a, (char *) (i ? "a much longer string value" : "abc"), false);
+		as_integer b;
+		as_integer_init(&b, 1);
+		as_val * values[] = { (as_val *) &a, (as_val *) &b };
+
+		for ( int n = 0; n < 2; n++ ) {
+			rc = aerospike_key_put_template(as, &err, &tmpl, &key, values);
+			assert_int_eq( rc, AEROSPIKE_OK );
+		}
+
+		as_record * rec = NULL;
+		rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_string_eq( as_record_get_str(rec, "a"), as_string_get(&a) );
+		assert_int_eq( as_record_get_int64(rec, "b", 0), 2 );
+		as_record_destroy(rec);
+
+		aerospike_key_remove(as, &err, NULL, &key);
+		as_key_destroy(&key);
+	}
+
+	as_write_template_destroy(&tmpl);
+}
+
+TEST( key_basics_compressed , "compressed bin: (test,test,foo) = {j: '{\"user\": ...}'}" ) {
+
+	const char * dict = "{\"user\":\"\",\"session\":\"\",\"country\":\"\",\"device\":\"mobile\"}";
+	const char * json = "{\"user\":\"alice\",\"session\":\"a81f\",\"country\":\"fr\",\"device\":\"mobile\"}";
+
+	assert_true( as_bin_dict_register(1, NULL, 0, (const uint8_t *) dict, (uint32_t) strlen(dict)) );
+	assert_true( as_bin_codec_enable("test", "test", "j", 1, 0) );
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_record r, *rec = &r;
+	as_record_init(&r, 1);
+	as_record_set_str(&r, "j", json);
+
+	as_status rc = aerospike_key_put(as, &err, NULL, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	// Reads don't depend on the bin being configured, only on the dictionary.
+	as_bin_codec_disable("test", "test", "j");
+
+	as_record_init(&r, 0);
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_string_eq( as_record_get_str(rec, "j"), json );
+	as_record_destroy(rec);
+
+	// Without the dictionary the value is the plain blob the server stores.
+	as_bin_codec_clear();
+
+	rec = NULL;
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_bytes * stored = as_record_get_bytes(rec, "j");
+	assert_not_null( stored );
+	assert_int_eq( as_bytes_get_type(stored), AS_BYTES_BLOB );
+	assert_true( as_bytes_size(stored) > AS_BIN_CODEC_HEADER_SIZE );
+	assert_int_eq( memcmp(as_bytes_get(stored), AS_BIN_CODEC_TAG, 4), 0 );
+
+	as_record_destroy(rec);
+	as_key_destroy(&key);
+}
+
+TEST( key_basics_codec_proto , "compressed protos round trip, and corrupt ones are rejected" ) {
+
+	uint8_t request[4096];
+	for ( uint32_t i = 0; i < sizeof(request); i++ ) {
+		request[i] = (uint8_t) (i % 61);
+	}
+
+	uint8_t * frame = NULL;
+	size_t frame_sz = 0;
+	assert_int_eq( as_codec_compress_proto(NULL, 0, request, sizeof(request), &frame, &frame_sz), 0 );
+	assert_true( frame_sz < sizeof(request) );
+
+	cl_proto proto = ((cl_comp_proto *) frame)->proto;
+	cl_proto_swap_from_be(&proto);
+	assert_int_eq( proto.type, CL_PROTO_TYPE_CL_MSG_COMPRESSED );
+	assert_int_eq( proto.sz, frame_sz - sizeof(cl_proto) );
+
+	uint8_t * body = frame + sizeof(cl_proto);
+	size_t body_sz = frame_sz - sizeof(cl_proto);
+	uint8_t * out = NULL;
+	size_t out_sz = 0;
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), 0 );
+	assert_int_eq( out_sz, sizeof(request) );
+	assert_int_eq( memcmp(out, request, sizeof(request)), 0 );
+	cl_buf_release(out);
+
+	// Too short to hold the original size.
+	assert_int_eq( as_codec_decompress_body(NULL, body, sizeof(uint64_t) - 1, &out, &out_sz), -1 );
+
+	// Original sizes of 0, over AS_CODEC_MAX_SIZE, or not the real size.
+	uint64_t org_sz = 0;
+	memcpy(body, &org_sz, sizeof(org_sz));
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), -1 );
+
+	org_sz = (uint64_t) AS_CODEC_MAX_SIZE + 1;
+	memcpy(body, &org_sz, sizeof(org_sz));
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), -1 );
+
+	org_sz = sizeof(request) - 1;
+	memcpy(body, &org_sz, sizeof(org_sz));
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), -1 );
+
+	org_sz = sizeof(request) + 1;
+	memcpy(body, &org_sz, sizeof(org_sz));
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), -1 );
+
+	// Corrupt data.
+	org_sz = sizeof(request);
+	memcpy(body, &org_sz, sizeof(org_sz));
+	memset(body + sizeof(org_sz), 0, body_sz - sizeof(org_sz));
+	assert_int_eq( as_codec_decompress_body(NULL, body, body_sz, &out, &out_sz), -1 );
+
+	cl_buf_release(frame);
+
+	// A request that does not get smaller is left to be sent as is.
+	uint8_t small[16] = {0};
+	assert_int_eq( as_codec_compress_proto(NULL, 0, small, sizeof(small), &frame, &frame_sz), -1 );
+}
+
+TEST( key_basics_get_compressed , "get answered with a compressed response" ) {
+
+	stand_in_server * server = stand_in_server_start("BB9000000000071", key_basics_compressed_handler, NULL);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	for ( int i = 0; i < 3; i++ ) {
+		as_record * rec = NULL;
+		as_status rc = aerospike_key_get(client, &err, NULL, &key, &rec);
+		assert_int_eq( rc, AEROSPIKE_OK );
+		assert_not_null( rec );
+		assert_string_eq( as_record_get_str(rec, "from"), "compressed" );
+		assert_int_eq( rec->gen, 1 );
+		as_record_destroy(rec);
+	}
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+TEST( key_basics_put_compressed , "put compressed when over the policy's compression threshold" ) {
+
+	stand_in_server * server = stand_in_server_start("BB9000000000072", key_basics_compressed_handler, NULL);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_key key;
+	as_key_init(&key, "test", "test", "foo");
+
+	as_policy_write policy;
+	as_policy_write_init(&policy);
+	policy.compression_threshold = 1024;
+
+	char value[4096];
+	memset(value, 'x', sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+
+	// Under the threshold.
+	as_record r;
+	as_record_init(&r, 1);
+	as_record_set_str(&r, "s", "small");
+	as_status rc = aerospike_key_put(client, &err, &policy, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stand_in_server_compressed_requests(server), 0 );
+
+	// Over the threshold.
+	as_record_init(&r, 1);
+	as_record_set_str(&r, "s", value);
+	rc = aerospike_key_put(client, &err, &policy, &key, &r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stand_in_server_compressed_requests(server), 1 );
+
+	// Over the threshold, but the policy doesn't ask for compression.
+	policy.compression_threshold = 0;
+	rc = aerospike_key_put(client, &err, &policy, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stand_in_server_compressed_requests(server), 1 );
+
+	as_key_destroy(&key);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+TEST( key_basics_dict_train , "trained dictionary: (test,dict,*) = {j: '{\"user\": ...}'}" ) {
+
+	as_error err;
+	as_key key;
+	as_record r, *rec = NULL;
+	char json[256];
+	as_status rc;
+
+	// Records to sample.
+	for ( uint32_t i = 0; i < 50; i++ ) {
+		key_basics_event_json(json, sizeof(json), i);
+		as_key_init_int64(&key, "test", "dict", i);
+		as_record_init(&r, 1);
+		as_record_set_str(&r, "j", json);
+		rc = aerospike_key_put(as, &err, NULL, &key, &r);
+		as_record_destroy(&r);
+		as_key_destroy(&key);
+		assert_int_eq( rc, AEROSPIKE_OK );
+	}
+
+	uint8_t * dict = NULL;
+	uint32_t dict_sz = 0;
+	rc = as_bin_dict_train(as, &err, NULL, "test", "dict", "j", 2, NULL, 4096, 50, &dict, &dict_sz);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_not_null( dict );
+	assert_true( dict_sz > 0 && dict_sz <= 4096 );
+	assert_true( as_bin_codec_enable("test", "dict", "j", 2, 0) );
+
+	// A value not in the sample.
+	key_basics_event_json(json, sizeof(json), 1000);
+	as_key_init(&key, "test", "dict", "trained");
+	as_record_init(&r, 1);
+	as_record_set_str(&r, "j", json);
+	rc = aerospike_key_put(as, &err, NULL, &key, &r);
+	as_record_destroy(&r);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_string_eq( as_record_get_str(rec, "j"), json );
+	as_record_destroy(rec);
+
+	// The server holds a smaller tagged blob.
+	as_bin_codec_clear();
+
+	rec = NULL;
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+
+	as_bytes * stored = as_record_get_bytes(rec, "j");
+	assert_not_null( stored );
+	assert_int_eq( as_bytes_get_type(stored), AS_BYTES_BLOB );
+	assert_true( as_bytes_size(stored) < strlen(json) );
+	assert_int_eq( memcmp(as_bytes_get(stored), AS_BIN_CODEC_TAG, 4), 0 );
+	as_record_destroy(rec);
+
+	// Registering the returned dictionary again, as a later run would, reads
+	// it back unchanged.
+	assert_true( as_bin_dict_register(2, NULL, 0, dict, dict_sz) );
+
+	rec = NULL;
+	rc = aerospike_key_get(as, &err, NULL, &key, &rec);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_string_eq( as_record_get_str(rec, "j"), json );
+	as_record_destroy(rec);
+
+	// The id is taken by another dictionary.
+	const char * other = "{\"other\":\"dictionary\"}";
+	assert_false( as_bin_dict_register(2, NULL, 0, (const uint8_t *) other, (uint32_t) strlen(other)) );
+
+	rc = as_bin_dict_train(as, &err, NULL, "test", "dict", "j", 2, NULL, 64, 10, NULL, NULL);
+	assert_int_eq( rc, AEROSPIKE_ERR_PARAM );
+
+	// A codec that can't train.
+	as_codec untrained = as_codec_zlib;
+	untrained.train = NULL;
+	rc = as_bin_dict_train(as, &err, NULL, "test", "dict", "j", 3, &untrained, 4096, 50, NULL, NULL);
+	assert_int_eq( rc, AEROSPIKE_ERR_PARAM );
+
+	as_bin_codec_clear();
+	free(dict);
+
+	aerospike_key_remove(as, &err, NULL, &key);
+	as_key_destroy(&key);
+
+	for ( uint32_t i = 0; i < 50; i++ ) {
+		as_key_init_int64(&key, "test", "dict", i);
+		aerospike_key_remove(as, &err, NULL, &key);
+		as_key_destroy(&key);
+	}
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -319,11 +1465,31 @@ SUITE( key_basics, "aerospike_key basic tests" ) {
     suite_add( key_basics_remove );
     suite_add( key_basics_put );
     suite_add( key_basics_exists );
+    suite_add( key_basics_get_replica_latency );
+    suite_add( key_basics_get_replica_zone );
+    suite_add( key_basics_get_hedged );
+    suite_add( key_basics_get_attempt_timeout );
+    suite_add( key_basics_get_body_timeout );
+    suite_add( key_basics_get_adaptive_timeout );
+    suite_add( key_basics_allocator_once );
     suite_add( key_basics_notexists );
     suite_add( key_basics_get );
+    suite_add( key_basics_get_arena );
+    suite_add( key_basics_get_reset );
+    suite_add( key_basics_get_reset_scalar );
     suite_add( key_basics_select );
     suite_add( key_basics_operate );
     suite_add( key_basics_get2 );
+    suite_add( key_basics_put_unchanged );
+    suite_add( key_basics_put_large_list );
+    suite_add( key_basics_wide_record_index );
+    suite_add( key_basics_alloc_stats );
+    suite_add( key_basics_put_template );
+    suite_add( key_basics_compressed );
+    suite_add( key_basics_dict_train );
+    suite_add( key_basics_codec_proto );
+    suite_add( key_basics_get_compressed );
+    suite_add( key_basics_put_compressed );
     suite_add( key_basics_remove );
     suite_add( key_basics_notexists );
 }
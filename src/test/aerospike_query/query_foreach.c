@@ -34,9 +34,20 @@
 
 #include <aerospike/mod_lua.h>
 
+#include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cl_projection.h>
+#include <citrusleaf/cl_read_ahead.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "../test.h"
 #include "../util/udf.h"
 #include "../util/consumer_stream.h"
+#include "../util/stand_in_server.h"
 
 /******************************************************************************
  * GLOBAL VARS
@@ -354,11 +365,280 @@ TEST( query_foreach_4, "sum(d) where b == 100 and d == 1" ) {
  * TEST SUITE
  *****************************************************************************/
 
+static uint8_t * projection_put_op(uint8_t * p, const char * name, uint8_t type, const void * value, uint32_t value_sz) {
+	cl_msg_op * op = (cl_msg_op *) p;
+	uint8_t name_sz = (uint8_t) strlen(name);
+	op->op_sz = cf_swap_to_be32(4 + name_sz + value_sz);
+	op->op = CL_MSG_OP_READ;
+	op->particle_type = type;
+	op->version = 0;
+	op->name_sz = name_sz;
+	memcpy(op->name, name, name_sz);
+	memcpy(op->name + name_sz, value, value_sz);
+	return p + sizeof(cl_msg_op) + name_sz + value_sz;
+}
+
+typedef struct {
+	int n;
+	char names[4][CL_BINNAME_SIZE];
+} projection_decoded;
+
+static void projection_decode_op(cl_msg_op * op, void * udata) {
+	projection_decoded * decoded = (projection_decoded *) udata;
+	memcpy(decoded->names[decoded->n], op->name, op->name_sz);
+	decoded->names[decoded->n][op->name_sz] = '\0';
+	decoded->n++;
+}
+
+TEST( query_foreach_projection, "parse only the projected bins of a response" ) {
+
+	uint8_t buf[256];
+	uint8_t * p = buf;
+	uint64_t a = cf_swap_to_be64(1);
+	uint64_t c = cf_swap_to_be64(3);
+	p = projection_put_op(p, "a", CL_INT, &a, sizeof(a));
+	p = projection_put_op(p, "b", CL_STR, "skipped", 7);
+	p = projection_put_op(p, "c", CL_INT, &c, sizeof(c));
+	// Too long for a bin name, so never in a projection.
+	p = projection_put_op(p, "a_name_longer_than_a_bin", CL_STR, "x", 1);
+
+	cl_projection projection;
+	assert_int_eq( cl_projection_init(&projection, 2), AEROSPIKE_OK );
+	assert_int_eq( cl_projection_add(&projection, "a"), AEROSPIKE_OK );
+	assert_int_eq( cl_projection_add(&projection, "c"), AEROSPIKE_OK );
+	assert_int_eq( cl_projection_add(&projection, "c"), AEROSPIKE_OK );
+	assert_int_eq( projection.n_names, 2 );
+
+	projection_decoded decoded = { 0 };
+	uint8_t * end = cl_projection_parse_ops(&projection, buf, 4, projection_decode_op, &decoded);
+
+	assert( end == p );
+	assert_int_eq( decoded.n, 2 );
+	assert_string_eq( decoded.names[0], "a" );
+	assert_string_eq( decoded.names[1], "c" );
+
+	cl_projection_destroy(&projection);
+
+	// An empty projection passes every op on.
+	p = buf;
+	p = projection_put_op(p, "a", CL_INT, &a, sizeof(a));
+	p = projection_put_op(p, "b", CL_STR, "kept", 4);
+
+	memset(&decoded, 0, sizeof(decoded));
+	end = cl_projection_parse_ops(&projection, buf, 2, projection_decode_op, &decoded);
+
+	assert( end == p );
+	assert_int_eq( decoded.n, 2 );
+}
+
+/**
+ * Writes frames of a 4 byte size and a patterned body in small pieces, the
+ * way a server streams protos, followed by one stray byte.
+ */
+
+static const uint32_t read_ahead_frame_sizes[] = { 100, 100000, 3 * CL_READ_AHEAD_SIZE / 2, 1 };
+
+#define READ_AHEAD_FRAMES (sizeof(read_ahead_frame_sizes) / sizeof(uint32_t))
+
+static void * read_ahead_writer(void * udata) {
+	int fd = *(int *) udata;
+	size_t total = 1;
+
+	for ( uint32_t i = 0; i < READ_AHEAD_FRAMES; i++ ) {
+		total += sizeof(uint32_t) + read_ahead_frame_sizes[i];
+	}
+
+	uint8_t * data = (uint8_t *) malloc(total);
+	uint8_t * p = data;
+
+	for ( uint32_t i = 0; i < READ_AHEAD_FRAMES; i++ ) {
+		uint32_t sz = read_ahead_frame_sizes[i];
+		memcpy(p, &sz, sizeof(sz));
+		p += sizeof(sz);
+
+		for ( uint32_t j = 0; j < sz; j++ ) {
+			*p++ = (uint8_t) (i + j);
+		}
+	}
+	*p = 0xEE;
+
+	for ( size_t pos = 0; pos < total; pos += 7000 ) {
+		size_t n = total - pos < 7000 ? total - pos : 7000;
+		if ( write(fd, data + pos, n) != (ssize_t) n ) {
+			break;
+		}
+	}
+
+	free(data);
+	return NULL;
+}
+
+/**
+ * Parse the frames read_ahead_writer() writes to wfd, and the stray byte,
+ * from rfd.
+ */
+static bool read_ahead_parse(cl_read_ahead * ra, int rfd, int wfd) {
+
+	pthread_t writer;
+	if ( pthread_create(&writer, NULL, read_ahead_writer, &wfd) != 0 ) {
+		return false;
+	}
+
+	bool matched = true;
+
+	for ( uint32_t i = 0; i < READ_AHEAD_FRAMES && matched; i++ ) {
+		uint32_t sz;
+		if ( cl_read_ahead_fill(ra, rfd, sizeof(sz)) ) {
+			matched = false;
+			break;
+		}
+		memcpy(&sz, cl_read_ahead_peek(ra), sizeof(sz));
+		cl_read_ahead_consume(ra, sizeof(sz));
+
+		// Frames are contiguous, even one larger than the buffer.
+		if ( sz != read_ahead_frame_sizes[i] || cl_read_ahead_fill(ra, rfd, sz) ) {
+			matched = false;
+			break;
+		}
+		uint8_t * body = cl_read_ahead_peek(ra);
+
+		for ( uint32_t j = 0; j < sz; j++ ) {
+			if ( body[j] != (uint8_t) (i + j) ) {
+				matched = false;
+			}
+		}
+		cl_read_ahead_consume(ra, sz);
+	}
+
+	if ( matched && cl_read_ahead_fill(ra, rfd, 1) ) {
+		matched = false;
+	}
+
+	pthread_join(writer, NULL);
+	return matched;
+}
+
+TEST( query_foreach_read_ahead, "parse frames while the next ones are received" ) {
+
+	int fds[2];
+	assert_int_eq( socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0 );
+
+	cl_read_ahead * ra = cl_read_ahead_acquire();
+	assert_not_null( ra );
+
+	// A stream nested in a callback gets buffers of its own.
+	cl_read_ahead * nested = cl_read_ahead_acquire();
+	assert_not_null( nested );
+	assert( nested != ra );
+	cl_read_ahead_release(nested);
+
+	cl_read_ahead_start(ra, fds[0]);
+	assert_true( ra->receiving );
+	assert_true( read_ahead_parse(ra, fds[0], fds[1]) );
+
+	// The stray byte is still counted once receiving is stopped.
+	cl_read_ahead_stop(ra);
+	assert_int_eq( cl_read_ahead_available(ra), 1 );
+	cl_read_ahead_release(ra);
+
+	// The thread keeps its buffers, and their receive thread, for the next
+	// stream.
+	pthread_t receiver = ra->thread;
+	assert( cl_read_ahead_acquire() == ra );
+
+	cl_read_ahead_start(ra, fds[0]);
+	assert_true( ra->receiving );
+	assert_true( pthread_equal(ra->thread, receiver) );
+	assert_true( read_ahead_parse(ra, fds[0], fds[1]) );
+	cl_read_ahead_stop(ra);
+	assert_int_eq( cl_read_ahead_available(ra), 1 );
+	cl_read_ahead_release(ra);
+
+	// Without a receive thread, as when it can't be created, fills read the
+	// socket themselves.
+	cl_read_ahead sync;
+	assert_int_eq( cl_read_ahead_init(&sync, CL_READ_AHEAD_SIZE), 0 );
+	assert_false( sync.receiving );
+	assert_true( read_ahead_parse(&sync, fds[0], fds[1]) );
+	assert_int_eq( cl_read_ahead_available(&sync), 1 );
+	cl_read_ahead_destroy(&sync);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+#define COMPRESSED_RECORDS 10
+
+static bool compressed_stand_in_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata) {
+
+	// Answer any query with records in compressed protos, bin "a" set to
+	// the index of each record.
+	uint8_t ops[64];
+
+	for ( uint8_t i = 0; i < COMPRESSED_RECORDS; i++ ) {
+		cf_digest digest;
+		memset(&digest, 0, sizeof(digest));
+		digest.digest[0] = i;
+
+		uint64_t value = cf_swap_to_be64(i);
+		uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "a", CL_PARTICLE_TYPE_INTEGER, &value, sizeof(value));
+
+		if ( ! stand_in_send_compressed(fd, AEROSPIKE_OK, 0, 1, 0, SET, &digest, ops, end - ops, 1) ) {
+			return false;
+		}
+	}
+	return stand_in_send_compressed(fd, AEROSPIKE_OK, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+}
+
+static bool compressed_callback(const as_val * v, void * udata) {
+	int64_t * sum = (int64_t *) udata;
+	if ( v != NULL ) {
+		sum[0]++;
+		sum[1] += as_record_get_int64(as_record_fromval(v), "a", -1);
+	}
+	return true;
+}
+
+TEST( query_foreach_compressed, "query answered with compressed responses" ) {
+
+	stand_in_server * server = stand_in_server_start("BB9000000000003", compressed_stand_in_handler, NULL);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_error_reset(&err);
+
+	as_query q;
+	as_query_init(&q, NAMESPACE, SET);
+	as_query_where_inita(&q, 1);
+	as_query_where(&q, "a", integer_range(0, COMPRESSED_RECORDS));
+
+	// records and the sum of their bin "a"
+	int64_t sum[2] = { 0, 0 };
+	as_status rc = aerospike_query_foreach(client, &err, NULL, &q, compressed_callback, sum);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( sum[0], COMPRESSED_RECORDS );
+	assert_int_eq( sum[1], COMPRESSED_RECORDS * (COMPRESSED_RECORDS - 1) / 2 );
+
+	as_query_destroy(&q);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
 SUITE( query_foreach, "aerospike_query_foreach tests" ) {
 
 	suite_before( before );
 	suite_after( after   );
 	
+	suite_add( query_foreach_projection );
+	suite_add( query_foreach_read_ahead );
+	suite_add( query_foreach_compressed );
 	suite_add( query_foreach_create );
 	suite_add( query_foreach_1 );
 	suite_add( query_foreach_2 );
@@ -18,6 +18,7 @@
 #include <aerospike/aerospike_scan.h>
 #include <aerospike/aerospike_key.h>
 #include <aerospike/aerospike_info.h>
+#include <aerospike/aerospike_backup.h>
 
 #include <aerospike/as_error.h>
 #include <aerospike/as_status.h>
@@ -33,9 +34,16 @@
 #include <aerospike/as_val.h>
 
 #include <aerospike/as_cluster.h>
+#include <aerospike/as_columnar.h>
+#include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cf_clock.h>
 #include <citrusleaf/cf_types.h>
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include "../test.h"
+#include "../util/stand_in_server.h"
 #include "../util/udf.h"
 
 #define NS "test"
@@ -374,6 +382,42 @@ static void insert_data(int numrecs, const char *setname)
 }
 
 
+typedef struct columnar_check_s {
+	bool failed;
+	int count;
+	int batches;
+} columnar_check;
+
+static bool columnar_check_callback(const as_columnar_batch * batch, void * udata)
+{
+	columnar_check * check = (columnar_check *) udata;
+	const as_column * bin1 = &batch->columns[0];
+	const as_column * bin2 = &batch->columns[1];
+
+	check->batches++;
+
+	for ( uint32_t row = 0; row < batch->n_rows; row++ ) {
+		check->count++;
+
+		if ( !as_column_is_valid(bin1, row) || !as_column_is_valid(bin2, row) ) {
+			error("Expected values in row %u", row);
+			check->failed = true;
+			return false;
+		}
+
+		char expected[SET_STRSZ];
+		sprintf(expected, "str-%s-%" PRId64, SET1, bin1->values[row]);
+
+		int32_t len = bin2->offsets[row + 1] - bin2->offsets[row];
+		if ( len != (int32_t) strlen(expected) || memcmp(bin2->data + bin2->offsets[row], expected, len) != 0 ) {
+			error("Expected '%s' in bin('%s') of row %u", expected, "bin2", row);
+			check->failed = true;
+			return false;
+		}
+	}
+	return true;
+}
+
 /******************************************************************************
  * TEST CASES
  *****************************************************************************/
@@ -522,6 +566,445 @@ TEST( scan_basics_set1_nodata , "scan "SET1" with no-bin-data" ) {
 	as_scan_destroy(&scan);
 }
 
+TEST( scan_basics_set1_columnar , "scan "SET1" into columns" ) {
+
+	columnar_check check = {
+		.failed = false,
+		.count = 0,
+		.batches = 0
+	};
+
+	as_error err;
+
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	// Small batches, so the scan hands over several of them.
+	as_columnar_batch batch;
+	as_columnar_batch_init(&batch, 16);
+	as_columnar_batch_add_column(&batch, "bin1", AS_COLUMN_INT64);
+	as_columnar_batch_add_column(&batch, "bin2", AS_COLUMN_STRING);
+
+	as_status rc = aerospike_scan_columnar(as, &err, NULL, &scan, &batch, columnar_check_callback, &check);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_false( check.failed );
+	assert_int_eq( check.count, NUM_RECS_SET1 );
+	assert_true( check.batches >= NUM_RECS_SET1 / 16 );
+
+	as_columnar_batch_destroy(&batch);
+	as_scan_destroy(&scan);
+}
+
+TEST( scan_basics_set1_backup , "export "SET1" to a file and restore it" ) {
+
+	const char * path = "/tmp/scan_basics_set1.asbk";
+	as_error err;
+
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	as_backup_stats stats;
+	as_status rc = aerospike_backup_export(as, &err, NULL, &scan, path, true, &stats);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stats.records, NUM_RECS_SET1 );
+
+	rc = aerospike_backup_restore(as, &err, NULL, path, 4, &stats);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stats.records, NUM_RECS_SET1 );
+	assert_int_eq( stats.failed, 0 );
+
+	scan_check check = {
+		.failed = false,
+		.set = SET1,
+		.count = 0,
+		.nobindata = false,
+		.bins = { "bin1", "bin2", "bin3", NULL },
+		.unique_tcount = 0
+	};
+
+	rc = aerospike_scan_foreach(as, &err, NULL, &scan, scan_check_callback, &check);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_false( check.failed );
+	assert_int_eq( check.count, NUM_RECS_SET1 );
+
+	unlink(path);
+	as_scan_destroy(&scan);
+}
+
+/**
+ * Stand-in node for the restore test: answers scans with the records of
+ * backup_stand_in_records and keeps the writes of the restore.
+ */
+
+#define BACKUP_STAND_IN_RECORDS 3
+
+typedef struct backup_stand_in_s {
+	pthread_mutex_t lock;
+
+	// void times of the scanned records, in citrusleaf epoch seconds
+	uint32_t void_times[BACKUP_STAND_IN_RECORDS];
+
+	// ttl of the writes of each record, 0 if not written
+	uint32_t ttls[BACKUP_STAND_IN_RECORDS];
+	uint32_t writes;
+	bool bad_write;
+} backup_stand_in;
+
+static bool backup_stand_in_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	backup_stand_in * s = (backup_stand_in *) udata;
+	uint8_t ops[64];
+
+	if ( msg->info2 & CL_MSG_INFO2_WRITE ) {
+		uint32_t sz = 0;
+		const uint8_t * digest = stand_in_field(msg, data, CL_MSG_FIELD_TYPE_DIGEST_RIPE, &sz);
+		const cl_msg_op * op = (const cl_msg_op *) stand_in_ops(msg, data);
+
+		pthread_mutex_lock(&s->lock);
+		s->writes++;
+
+		if ( ! digest || sz != sizeof(cf_digest) || digest[0] >= BACKUP_STAND_IN_RECORDS ||
+			msg->n_ops != 1 || op->op != CL_MSG_OP_WRITE || op->name_sz != 1 || op->name[0] != 'a' ) {
+			s->bad_write = true;
+		}
+		else {
+			s->ttls[digest[0]] = msg->record_ttl;
+		}
+		pthread_mutex_unlock(&s->lock);
+
+		return stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, NULL, NULL, NULL, 0, 0);
+	}
+
+	for ( uint8_t i = 0; i < BACKUP_STAND_IN_RECORDS; i++ ) {
+		cf_digest digest;
+		memset(&digest, 0, sizeof(digest));
+		digest.digest[0] = i;
+
+		uint64_t value = cf_swap_to_be64(i);
+		uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "a", CL_PARTICLE_TYPE_INTEGER, &value, sizeof(value));
+
+		if ( ! stand_in_send(fd, AEROSPIKE_OK, 0, 1, s->void_times[i], SET1, &digest, ops, end - ops, 1) ) {
+			return false;
+		}
+	}
+	return stand_in_send(fd, AEROSPIKE_OK, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+}
+
+TEST( scan_basics_backup_stand_in , "restore pipelines the writes and keeps the absolute expiry" ) {
+
+	const char * path = "/tmp/scan_basics_stand_in.asbk";
+	uint32_t now = cf_clepoch_seconds();
+
+	backup_stand_in s = {
+		// never expires, expires in 1000 seconds, expires before the restore
+		.void_times = { 0, now + 1000, now + 2 },
+		.ttls = { 0, 0, 0 },
+		.writes = 0,
+		.bad_write = false
+	};
+	pthread_mutex_init(&s.lock, NULL);
+
+	stand_in_server * server = stand_in_server_start("BB9000000000001", backup_stand_in_handler, &s);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	as_backup_stats stats;
+	as_status rc = aerospike_backup_export(client, &err, NULL, &scan, path, false, &stats);
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stats.records, BACKUP_STAND_IN_RECORDS );
+
+	// Time spent between export and restore counts against the expiry.
+	sleep(3);
+
+	rc = aerospike_backup_restore(client, &err, NULL, path, 2, &stats);
+	uint32_t elapsed = cf_clepoch_seconds() - now;
+
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( stats.records, 2 );
+	assert_int_eq( stats.expired, 1 );
+	assert_int_eq( stats.failed, 0 );
+	assert_false( s.bad_write );
+	assert_int_eq( s.writes, 2 );
+	assert_int_eq( s.ttls[0], AS_RECORD_NO_EXPIRE_TTL );
+	assert_true( s.ttls[1] <= 1000 - 3 && s.ttls[1] >= 1000 - elapsed );
+	assert_int_eq( s.ttls[2], 0 );
+
+	unlink(path);
+	as_scan_destroy(&scan);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+	pthread_mutex_destroy(&s.lock);
+}
+
+static bool backup_no_digest_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// A record without a digest field.
+	uint8_t ops[64];
+	uint64_t value = cf_swap_to_be64(1);
+	uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "a", CL_PARTICLE_TYPE_INTEGER, &value, sizeof(value));
+
+	if ( ! stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, SET1, NULL, ops, end - ops, 1) ) {
+		return false;
+	}
+	return stand_in_send(fd, AEROSPIKE_OK, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+}
+
+TEST( scan_basics_backup_no_digest , "export fails on a record without a digest" ) {
+
+	const char * path = "/tmp/scan_basics_no_digest.asbk";
+
+	stand_in_server * server = stand_in_server_start("BB9000000000007", backup_no_digest_handler, NULL);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	as_error err;
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	as_backup_stats stats;
+	as_status rc = aerospike_backup_export(client, &err, NULL, &scan, path, false, &stats);
+
+	assert_int_eq( rc, AEROSPIKE_ERR_CLIENT );
+	assert_int_eq( stats.records, 0 );
+
+	unlink(path);
+	as_scan_destroy(&scan);
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+/**
+ * A stand-in node that answers any scan with COMPRESSED_STAND_IN_RECORDS
+ * records in compressed protos. Each record has bin "a" for plain scans and
+ * the "SUCCESS" bin a UDF scan reads, both set to the record's index.
+ */
+
+#define COMPRESSED_STAND_IN_RECORDS 10
+
+typedef struct compressed_check_s {
+	uint32_t records;
+	int64_t sum;
+	bool done;
+} compressed_check;
+
+static bool compressed_stand_in_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	uint8_t ops[128];
+
+	for ( uint8_t i = 0; i < COMPRESSED_STAND_IN_RECORDS; i++ ) {
+		cf_digest digest;
+		memset(&digest, 0, sizeof(digest));
+		digest.digest[0] = i;
+
+		uint64_t value = cf_swap_to_be64(i);
+		uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "a", CL_PARTICLE_TYPE_INTEGER, &value, sizeof(value));
+		end = stand_in_put_op(end, CL_MSG_OP_READ, "SUCCESS", CL_PARTICLE_TYPE_INTEGER, &value, sizeof(value));
+
+		if ( ! stand_in_send_compressed(fd, AEROSPIKE_OK, 0, 1, 0, SET1, &digest, ops, end - ops, 2) ) {
+			return false;
+		}
+	}
+	return stand_in_send_compressed(fd, AEROSPIKE_OK, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+}
+
+static bool compressed_check_callback(const as_val * val, void * udata)
+{
+	compressed_check * check = (compressed_check *) udata;
+
+	if ( ! val ) {
+		check->done = true;
+		return false;
+	}
+
+	as_record * rec = as_record_fromval(val);
+	as_integer * i = rec ? as_record_get_integer(rec, "a") : as_integer_fromval(val);
+
+	if ( i ) {
+		check->records++;
+		check->sum += as_integer_get(i);
+	}
+	return true;
+}
+
+TEST( scan_basics_compressed_stand_in , "scan answered with compressed responses, with and without a UDF" ) {
+
+	stand_in_server * server = stand_in_server_start("BB9000000000002", compressed_stand_in_handler, NULL);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	int64_t sum = COMPRESSED_STAND_IN_RECORDS * (COMPRESSED_STAND_IN_RECORDS - 1) / 2;
+
+	as_error err;
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	compressed_check check = { 0, 0, false };
+	as_status rc = aerospike_scan_foreach(client, &err, NULL, &scan, compressed_check_callback, &check);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( check.records, COMPRESSED_STAND_IN_RECORDS );
+	assert_int_eq( check.sum, sum );
+	assert_true( check.done );
+	as_scan_destroy(&scan);
+
+	// A UDF scan reads its responses in the scan threads of cl_scan2.
+	as_scan_init(&scan, NS, SET1);
+	as_scan_apply_each(&scan, "stand_in", "identity", NULL);
+
+	memset(&check, 0, sizeof(check));
+	rc = aerospike_scan_foreach(client, &err, NULL, &scan, compressed_check_callback, &check);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_int_eq( check.records, COMPRESSED_STAND_IN_RECORDS );
+	assert_int_eq( check.sum, sum );
+	assert_true( check.done );
+	as_scan_destroy(&scan);
+
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+}
+
+/**
+ * A stand-in node that answers a columnar scan with records of bins "bin1"
+ * and "bin2", or with an error.
+ */
+
+typedef struct columnar_stand_in_s {
+	uint8_t result_code;
+	uint32_t records;
+	uint32_t scans;
+} columnar_stand_in;
+
+static bool columnar_stand_in_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	columnar_stand_in * s = (columnar_stand_in *) udata;
+	ck_pr_inc_32(&s->scans);
+
+	if ( s->result_code != AEROSPIKE_OK ) {
+		return stand_in_send(fd, s->result_code, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+	}
+
+	uint8_t ops[128];
+
+	for ( uint32_t i = 0; i < s->records; i++ ) {
+		cf_digest digest;
+		memset(&digest, 0, sizeof(digest));
+		digest.digest[0] = (uint8_t) i;
+
+		char value[SET_STRSZ];
+		sprintf(value, "str-%s-%u", SET1, i);
+
+		uint64_t bin1 = cf_swap_to_be64(i);
+		uint8_t * end = stand_in_put_op(ops, CL_MSG_OP_READ, "bin1", CL_PARTICLE_TYPE_INTEGER, &bin1, sizeof(bin1));
+		end = stand_in_put_op(end, CL_MSG_OP_READ, "bin2", CL_PARTICLE_TYPE_STRING, value, (uint32_t) strlen(value));
+
+		if ( ! stand_in_send(fd, AEROSPIKE_OK, 0, 1, 0, SET1, &digest, ops, end - ops, 2) ) {
+			return false;
+		}
+	}
+	return stand_in_send(fd, AEROSPIKE_OK, CL_MSG_INFO3_LAST, 0, 0, NULL, NULL, NULL, 0, 0);
+}
+
+TEST( scan_basics_columnar_stand_in , "columnar scan stops at the first failing node, and hands over the last partial batch" ) {
+
+	as_error err;
+	as_scan scan;
+	as_scan_init(&scan, NS, SET1);
+
+	as_columnar_batch batch;
+	as_columnar_batch_init(&batch, 4);
+	as_columnar_batch_add_column(&batch, "bin1", AS_COLUMN_INT64);
+	as_columnar_batch_add_column(&batch, "bin2", AS_COLUMN_STRING);
+
+	// Two rows short of two full batches.
+	columnar_stand_in good = { AEROSPIKE_OK, 6, 0 };
+	stand_in_server * server = stand_in_server_start("BB9000000000004", columnar_stand_in_handler, &good);
+	assert_not_null( server );
+
+	as_config config;
+	as_config_init(&config);
+	aerospike * client = stand_in_connect(server, &config);
+	assert_not_null( client );
+
+	columnar_check check = { false, 0, 0 };
+	as_status rc = aerospike_scan_columnar(client, &err, NULL, &scan, &batch, columnar_check_callback, &check);
+	assert_int_eq( rc, AEROSPIKE_OK );
+	assert_false( check.failed );
+	assert_int_eq( check.count, 6 );
+	assert_int_eq( check.batches, 2 );
+	assert_int_eq( batch.n_rows, 0 );
+
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server);
+
+	// Two nodes that fail differently. Only the first one scanned is asked,
+	// and its error is the one returned.
+	columnar_stand_in bad1 = { AEROSPIKE_ERR_SERVER, 0, 0 };
+	columnar_stand_in bad2 = { AEROSPIKE_ERR_REQUEST_INVALID, 0, 0 };
+	stand_in_server * server1 = stand_in_server_start("BB9000000000005", columnar_stand_in_handler, &bad1);
+	stand_in_server * server2 = stand_in_server_start("BB9000000000006", columnar_stand_in_handler, &bad2);
+	assert_not_null( server1 );
+	assert_not_null( server2 );
+	stand_in_server_set_peer(server1, server2);
+
+	as_config_init(&config);
+	client = stand_in_connect(server1, &config);
+	assert_not_null( client );
+
+	uint32_t n_nodes = 0;
+
+	for ( int i = 0; i < 100 && n_nodes < 2; i++ ) {
+		as_nodes * nodes = as_nodes_reserve(client->cluster);
+		n_nodes = nodes->size;
+		as_nodes_release(nodes);
+
+		if ( n_nodes < 2 ) {
+			usleep(50 * 1000);
+		}
+	}
+	assert_int_eq( n_nodes, 2 );
+
+	memset(&check, 0, sizeof(check));
+	rc = aerospike_scan_columnar(client, &err, NULL, &scan, &batch, columnar_check_callback, &check);
+	uint32_t scans1 = ck_pr_load_32(&bad1.scans);
+	uint32_t scans2 = ck_pr_load_32(&bad2.scans);
+
+	assert_int_eq( scans1 + scans2, 1 );
+	assert_int_eq( rc, scans1 ? AEROSPIKE_ERR_SERVER : AEROSPIKE_ERR_REQUEST_INVALID );
+	assert_int_eq( err.code, rc );
+	assert_int_eq( check.batches, 0 );
+
+	aerospike_close(client, &err);
+	aerospike_destroy(client);
+	stand_in_server_stop(server1);
+	stand_in_server_stop(server2);
+
+	as_columnar_batch_destroy(&batch);
+	as_scan_destroy(&scan);
+}
 
 TEST( scan_basics_background , "scan "SET1" in background to insert a new bin" ) {
 
@@ -773,6 +1256,12 @@ SUITE( scan_basics, "aerospike_scan basic tests" ) {
 	suite_add( scan_basics_set1_concurrent );
 	suite_add( scan_basics_set1_select );
 	suite_add( scan_basics_set1_nodata );
+	suite_add( scan_basics_set1_columnar );
+	suite_add( scan_basics_set1_backup );
+	suite_add( scan_basics_backup_stand_in );
+	suite_add( scan_basics_backup_no_digest );
+	suite_add( scan_basics_compressed_stand_in );
+	suite_add( scan_basics_columnar_stand_in );
 	suite_add( scan_basics_background );
 	suite_add( scan_basics_background_sameid );
 	suite_add( scan_basics_background_poll_job_status );
@@ -218,5 +218,10 @@ PLAN( aerospike_test ) {
     // as_ldt module
     plan_add( ldt_lmap );
 
+    // as_cluster module
+    plan_add( cluster_node );
+    plan_add( cluster_shm );
+    plan_add( cluster_buf_cache );
+
 }
 
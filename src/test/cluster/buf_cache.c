@@ -0,0 +1,214 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_allocator.h>
+
+#include <citrusleaf/cl_buf_cache.h>
+
+#include "../test.h"
+
+/******************************************************************************
+ * MACROS
+ *****************************************************************************/
+
+#define KB 1024
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ *****************************************************************************/
+
+static as_alloc_stats buf_cache_stats()
+{
+	// Only the buffer cache and read-ahead buffers use the network tag, and
+	// the tests run one at a time.
+	as_alloc_stats stats;
+	as_allocator_stats(AS_ALLOC_NETWORK, &stats);
+	return stats;
+}
+
+static void buf_cache_empty()
+{
+	// The thread's cache itself is allocated on first use.
+	cl_buf_release(cl_buf_acquire(1));
+	cl_buf_cache_trim();
+}
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST( cluster_buf_cache_reuse , "a released buffer is reused for the next fitting acquire" ) {
+
+	buf_cache_empty();
+	as_alloc_stats before = buf_cache_stats();
+
+	uint8_t * buf = cl_buf_acquire(200 * KB);
+	assert_not_null( buf );
+	cl_buf_release(buf);
+
+	as_alloc_stats after = buf_cache_stats();
+	assert_int_eq( after.allocs - before.allocs, 1 );
+	assert_int_eq( after.frees - before.frees, 0 );
+
+	// The second 200 KB acquire allocates nothing, and neither does a smaller
+	// one.
+	assert( cl_buf_acquire(200 * KB) == buf );
+	cl_buf_release(buf);
+	assert( cl_buf_acquire(100 * KB) == buf );
+	cl_buf_release(buf);
+
+	as_alloc_stats reused = buf_cache_stats();
+	assert_int_eq( reused.allocs - after.allocs, 0 );
+	assert_int_eq( reused.bytes, after.bytes );
+
+	// A larger one doesn't fit.
+	uint8_t * large = cl_buf_acquire(300 * KB);
+	assert_not_null( large );
+	assert( large != buf );
+	cl_buf_release(large);
+	assert_int_eq( buf_cache_stats().allocs - reused.allocs, 1 );
+
+	// Trimming frees what is kept.
+	cl_buf_cache_trim();
+	assert_int_eq( buf_cache_stats().bytes, before.bytes );
+}
+
+TEST( cluster_buf_cache_full , "a full cache keeps the largest buffers and evicts the smallest" ) {
+
+	buf_cache_empty();
+
+	uint8_t * bufs[CL_BUF_CACHE_SIZE];
+	size_t size = 64 * KB;
+
+	for ( uint32_t i = 0; i < CL_BUF_CACHE_SIZE; i++ ) {
+		bufs[i] = cl_buf_acquire(size);
+		assert_not_null( bufs[i] );
+		size *= 2;
+	}
+
+	uint8_t * small = cl_buf_acquire(CL_BUF_MIN_SIZE);
+	assert_not_null( small );
+
+	for ( uint32_t i = 0; i < CL_BUF_CACHE_SIZE; i++ ) {
+		cl_buf_release(bufs[i]);
+	}
+
+	// The cache is full of larger buffers, so the small one is freed.
+	as_alloc_stats before = buf_cache_stats();
+	cl_buf_release(small);
+	as_alloc_stats after = buf_cache_stats();
+	assert_int_eq( after.frees - before.frees, 1 );
+
+	// A small acquire gets the smallest kept buffer instead.
+	assert( cl_buf_acquire(CL_BUF_MIN_SIZE) == bufs[0] );
+	cl_buf_release(bufs[0]);
+	assert_int_eq( buf_cache_stats().allocs, after.allocs );
+
+	// A buffer larger than all kept ones evicts the smallest.
+	uint8_t * largest = cl_buf_acquire(size);
+	assert_not_null( largest );
+	before = buf_cache_stats();
+	cl_buf_release(largest);
+	after = buf_cache_stats();
+	assert_int_eq( after.frees - before.frees, 1 );
+
+	assert( cl_buf_acquire(size) == largest );
+	assert( cl_buf_acquire(CL_BUF_MIN_SIZE) == bufs[1] );
+	assert_int_eq( buf_cache_stats().allocs, after.allocs );
+
+	cl_buf_release(largest);
+	cl_buf_release(bufs[1]);
+	cl_buf_cache_trim();
+}
+
+TEST( cluster_buf_cache_retain_max , "buffers over CL_BUF_RETAIN_MAX are never kept" ) {
+
+	buf_cache_empty();
+	as_alloc_stats before = buf_cache_stats();
+
+	for ( int i = 0; i < 2; i++ ) {
+		uint8_t * buf = cl_buf_acquire(CL_BUF_RETAIN_MAX + 1);
+		assert_not_null( buf );
+		cl_buf_release(buf);
+	}
+
+	as_alloc_stats after = buf_cache_stats();
+	assert_int_eq( after.allocs - before.allocs, 2 );
+	assert_int_eq( after.frees - before.frees, 2 );
+	assert_int_eq( after.bytes, before.bytes );
+
+	// The largest size kept.
+	uint8_t * buf = cl_buf_acquire(CL_BUF_RETAIN_MAX);
+	assert_not_null( buf );
+	cl_buf_release(buf);
+	assert( cl_buf_acquire(CL_BUF_RETAIN_MAX) == buf );
+	cl_buf_release(buf);
+	assert_int_eq( buf_cache_stats().allocs - after.allocs, 1 );
+
+	cl_buf_cache_trim();
+}
+
+TEST( cluster_buf_cache_trim_stale , "buffers unused for CL_BUF_TRIM_INTERVAL acquires are freed" ) {
+
+	buf_cache_empty();
+
+	uint8_t * small = cl_buf_acquire(CL_BUF_MIN_SIZE);
+	uint8_t * large = cl_buf_acquire(1024 * KB);
+	assert_not_null( small );
+	assert_not_null( large );
+	cl_buf_release(small);
+	cl_buf_release(large);
+
+	// Only the small buffer is used for a while.
+	as_alloc_stats before = buf_cache_stats();
+
+	bool reused = true;
+
+	for ( uint32_t i = 0; i < 2 * CL_BUF_TRIM_INTERVAL; i++ ) {
+		uint8_t * buf = cl_buf_acquire(CL_BUF_MIN_SIZE);
+		cl_buf_release(buf);
+
+		if ( buf != small ) {
+			reused = false;
+		}
+	}
+	assert_true( reused );
+
+	as_alloc_stats after = buf_cache_stats();
+	assert_int_eq( after.allocs - before.allocs, 0 );
+	assert_int_eq( after.frees - before.frees, 1 );
+	assert_true( after.bytes < before.bytes );
+
+	// So the next large acquire allocates again.
+	large = cl_buf_acquire(1024 * KB);
+	assert_not_null( large );
+	cl_buf_release(large);
+	assert_int_eq( buf_cache_stats().allocs - after.allocs, 1 );
+
+	cl_buf_cache_trim();
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE( cluster_buf_cache, "cl_buf_cache retention and trim tests" )
+{
+	suite_add( cluster_buf_cache_reuse );
+	suite_add( cluster_buf_cache_full );
+	suite_add( cluster_buf_cache_retain_max );
+	suite_add( cluster_buf_cache_trim_stale );
+}
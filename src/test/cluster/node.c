@@ -0,0 +1,208 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/as_cluster.h>
+#include <aerospike/as_node.h>
+
+#include <citrusleaf/cf_clock.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "../test.h"
+
+/******************************************************************************
+ * MACROS
+ *****************************************************************************/
+
+#define N_READS 16000
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ *****************************************************************************/
+
+static as_cluster node_cluster;
+
+static void node_init(as_node * node, uint32_t latency_us, uint32_t in_flight, uint32_t error_ppm)
+{
+	// Only what the replica choice looks at, without shared memory.
+	memset(node, 0, sizeof(as_node));
+	node->cluster = &node_cluster;
+	node->stats.latency_us = latency_us;
+	node->stats.in_flight = in_flight;
+	node->stats.error_ppm = error_ppm;
+}
+
+static uint32_t node_count_faster(as_node * a, as_node * b)
+{
+	// Sequential, as the callers' counters are.
+	uint32_t n = 0;
+
+	for ( uint32_t r = 0; r < N_READS; r++ ) {
+		if ( as_node_is_faster(a, b, r) ) {
+			n++;
+		}
+	}
+	return n;
+}
+
+static void node_transact(as_node * node, bool success)
+{
+	as_node_stats_begin(node);
+	as_node_stats_end(node, cf_getus(), success);
+}
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST( cluster_node_faster_slow , "a much slower replica gets about 1 in 16 reads" )
+{
+	as_node slow, fast;
+	node_init(&slow, 10000, 0, 0);
+	node_init(&fast, 1000, 0, 0);
+
+	uint32_t n = node_count_faster(&slow, &fast);
+	info("slow node reads: %u of %u", n, N_READS);
+	assert_true( n > N_READS / 16 * 8 / 10 );
+	assert_true( n < N_READS / 16 * 12 / 10 );
+
+	// Either way round.
+	n = node_count_faster(&fast, &slow);
+	assert_true( n > N_READS - N_READS / 16 * 12 / 10 );
+	assert_true( n < N_READS - N_READS / 16 * 8 / 10 );
+}
+
+TEST( cluster_node_faster_close , "replicas within the jitter share reads" )
+{
+	as_node a, b;
+	node_init(&a, 1000, 0, 0);
+	node_init(&b, 1050, 0, 0);
+
+	uint32_t n = node_count_faster(&a, &b);
+	info("first node reads: %u of %u", n, N_READS);
+	assert_true( n > N_READS * 3 / 10 );
+	assert_true( n < N_READS * 7 / 10 );
+
+	// Same statistics, even split.
+	node_init(&b, 1000, 0, 0);
+	n = node_count_faster(&a, &b);
+	assert_true( n > N_READS * 4 / 10 );
+	assert_true( n < N_READS * 6 / 10 );
+}
+
+TEST( cluster_node_faster_load , "transactions in flight and errors count against a replica" )
+{
+	as_node busy, idle;
+	node_init(&busy, 1000, 20, 0);
+	node_init(&idle, 1000, 0, 0);
+	assert_true( node_count_faster(&busy, &idle) < N_READS / 16 * 12 / 10 );
+
+	as_node failing, healthy;
+	node_init(&failing, 1000, 0, 1000000);
+	node_init(&healthy, 1000, 0, 0);
+	assert_true( node_count_faster(&failing, &healthy) < N_READS / 16 * 12 / 10 );
+
+	// A missing replica is never chosen.
+	assert_true( as_node_is_faster(&idle, NULL, 0) );
+	assert_false( as_node_is_faster(NULL, &idle, 0) );
+}
+
+TEST( cluster_node_faster_unknown , "a replica without a latency yet is not taken for a fast one" )
+{
+	// Never answered, only failed.
+	as_node failing, healthy;
+	node_init(&failing, 0, 0, 1000000);
+	node_init(&healthy, 1000, 0, 0);
+	uint32_t n = node_count_faster(&failing, &healthy);
+	info("failing node reads: %u of %u", n, N_READS);
+	assert_true( n < N_READS / 16 * 12 / 10 );
+	assert_true( node_count_faster(&healthy, &failing) > N_READS - N_READS / 16 * 12 / 10 );
+
+	// Neither known, even split.
+	as_node a, b;
+	node_init(&a, 0, 0, 0);
+	node_init(&b, 0, 0, 0);
+	n = node_count_faster(&a, &b);
+	assert_true( n > N_READS * 4 / 10 );
+	assert_true( n < N_READS * 6 / 10 );
+
+	// A failure counts the time it took towards the latency.
+	node_init(&a, 0, 0, 0);
+	as_node_stats_begin(&a);
+	as_node_stats_end(&a, cf_getus() - 5000, false);
+	assert_true( a.stats.latency_us >= 5000 );
+}
+
+TEST( cluster_node_breaker , "the breaker opens after consecutive failures, probes once and closes on success" )
+{
+	node_cluster.breaker_threshold = 3;
+	node_cluster.breaker_open_ms = 100;
+
+	as_node node;
+	node_init(&node, 0, 0, 0);
+
+	// A success in between starts the count again.
+	node_transact(&node, false);
+	node_transact(&node, false);
+	node_transact(&node, true);
+	node_transact(&node, false);
+	node_transact(&node, false);
+	assert_false( as_node_breaker_is_open(&node) );
+	assert_true( as_node_breaker_allow(&node) );
+
+	// CLOSED -> OPEN on the threshold-th failure in a row.
+	node_transact(&node, false);
+	assert_true( as_node_breaker_is_open(&node) );
+	assert_int_eq( node.breaker.state, AS_NODE_BREAKER_OPEN );
+	assert_false( as_node_breaker_allow(&node) );
+
+	// OPEN -> PROBING after breaker_open_ms, for a single transaction.
+	usleep(150 * 1000);
+	assert_true( as_node_breaker_allow(&node) );
+	assert_int_eq( node.breaker.state, AS_NODE_BREAKER_PROBING );
+	assert_false( as_node_breaker_allow(&node) );
+
+	// A failed probe opens the breaker for another breaker_open_ms.
+	node_transact(&node, false);
+	assert_int_eq( node.breaker.state, AS_NODE_BREAKER_OPEN );
+	assert_false( as_node_breaker_allow(&node) );
+
+	// PROBING -> CLOSED on a successful probe.
+	usleep(150 * 1000);
+	assert_true( as_node_breaker_allow(&node) );
+	node_transact(&node, true);
+	assert_int_eq( node.breaker.state, AS_NODE_BREAKER_CLOSED );
+	assert_int_eq( node.breaker.failures, 0 );
+	assert_true( as_node_breaker_allow(&node) );
+	assert_true( as_node_breaker_allow(&node) );
+
+	node_cluster.breaker_threshold = 0;
+	node_cluster.breaker_open_ms = 0;
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE( cluster_node, "as_node replica choice and circuit breaker tests" )
+{
+	suite_add( cluster_node_faster_slow );
+	suite_add( cluster_node_faster_close );
+	suite_add( cluster_node_faster_load );
+	suite_add( cluster_node_faster_unknown );
+	suite_add( cluster_node_breaker );
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <aerospike/aerospike.h>
+#include <aerospike/as_cluster.h>
+#include <aerospike/as_node.h>
+#include <aerospike/as_shm_cluster.h>
+
+#include <citrusleaf/cf_b64.h>
+#include <citrusleaf/cf_clock.h>
+#include <citrusleaf/cf_digest.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+#include "../test.h"
+#include "../util/stand_in_server.h"
+
+/******************************************************************************
+ * MACROS
+ *****************************************************************************/
+
+#define N_PARTITIONS 64
+
+/******************************************************************************
+ * TYPES
+ *****************************************************************************/
+
+typedef struct cluster_shm_reader_s {
+	as_cluster_shm * cluster_shm;
+	bool pairs;
+	bool stop;
+	uint32_t reads;
+	uint32_t bad;
+} cluster_shm_reader;
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ *****************************************************************************/
+
+static bool cluster_shm_handler(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata)
+{
+	// Only the cluster map is used.
+	return false;
+}
+
+static aerospike * cluster_shm_connect(stand_in_server * server, int key)
+{
+	as_config config;
+	as_config_init(&config);
+	config.use_shm = true;
+	config.shm_key = key;
+	config.shm_max_nodes = 1;
+	config.shm_max_namespaces = 1;
+	config.tender_interval = 100;
+	return stand_in_connect(server, &config);
+}
+
+static void cluster_shm_local(as_shm_info * shm_info, as_node * nodes, uint32_t n_nodes, uint32_t partition_buffers)
+{
+	// A segment of this process only, tended by the test.
+	memset(shm_info, 0, sizeof(as_shm_info));
+	shm_info->cluster_shm = as_shm_create_local(N_PARTITIONS, partition_buffers, n_nodes, 1);
+	shm_info->local_nodes = calloc(n_nodes, sizeof(as_node *));
+
+	for ( uint32_t i = 0; i < n_nodes; i++ ) {
+		memset(&nodes[i], 0, sizeof(as_node));
+		nodes[i].index = i;
+	}
+}
+
+static void cluster_shm_local_destroy(as_shm_info * shm_info)
+{
+	free(shm_info->cluster_shm);
+	free(shm_info->local_nodes);
+}
+
+static void cluster_shm_assign(as_shm_info * shm_info, as_node * node, bool master)
+{
+	// The node owns every partition.
+	uint8_t bitmap[N_PARTITIONS / 8];
+	char b64[cf_b64_encoded_len(sizeof(bitmap)) + 1];
+	memset(bitmap, 0xFF, sizeof(bitmap));
+	cf_b64_encode(bitmap, sizeof(bitmap), b64);
+	as_shm_update_partitions(shm_info, "test", b64, cf_b64_encoded_len(sizeof(bitmap)), node, master);
+}
+
+static void * cluster_shm_read(void * udata)
+{
+	// Nodes 1 and 2 take turns as master and prole. Pairs are either way round
+	// when they change together, otherwise each is one of them.
+	cluster_shm_reader * r = (cluster_shm_reader *) udata;
+
+	while ( ! ck_pr_load_8((uint8_t *) &r->stop) ) {
+		uint32_t master = 0;
+		uint32_t prole = 0;
+		as_shm_get_partition(r->cluster_shm, "test", r->reads % N_PARTITIONS, &master, &prole);
+
+		bool ok = r->pairs ? ((master == 1 && prole == 2) || (master == 2 && prole == 1)) :
+			((master == 1 || master == 2) && (prole == 1 || prole == 2));
+
+		if ( ! ok ) {
+			r->bad++;
+		}
+		r->reads++;
+	}
+	return NULL;
+}
+
+static uint32_t cluster_shm_race(uint32_t partition_buffers, uint32_t * reads)
+{
+	as_shm_info shm_info;
+	as_node nodes[2];
+	cluster_shm_local(&shm_info, nodes, 2, partition_buffers);
+
+	cluster_shm_assign(&shm_info, &nodes[0], true);
+	cluster_shm_assign(&shm_info, &nodes[1], false);
+	as_shm_publish_partitions(shm_info.cluster_shm);
+
+	cluster_shm_reader r = { shm_info.cluster_shm, partition_buffers > 1, false, 0, 0 };
+	pthread_t thread;
+	pthread_create(&thread, NULL, cluster_shm_read, &r);
+
+	// Swap master and prole for 200 milliseconds.
+	uint64_t limit = cf_getms() + 200;
+
+	for ( uint32_t i = 0; cf_getms() < limit; i++ ) {
+		cluster_shm_assign(&shm_info, &nodes[(i + 1) & 1], true);
+		cluster_shm_assign(&shm_info, &nodes[i & 1], false);
+		as_shm_publish_partitions(shm_info.cluster_shm);
+	}
+
+	ck_pr_store_8((uint8_t *) &r.stop, true);
+	pthread_join(thread, NULL);
+	cluster_shm_local_destroy(&shm_info);
+
+	*reads = r.reads;
+	return r.bad;
+}
+
+static uint32_t cluster_shm_n_nodes(aerospike * client)
+{
+	as_nodes * nodes = as_nodes_reserve(client->cluster);
+	uint32_t size = nodes->size;
+	as_nodes_release(nodes);
+	return size;
+}
+
+/******************************************************************************
+ * TEST CASES
+ *****************************************************************************/
+
+TEST( cluster_shm_grow_follow , "a full segment moves to a larger one, followed by the processes attached to it" )
+{
+	stand_in_server * a = stand_in_server_start("BB9000000000021", cluster_shm_handler, NULL);
+	stand_in_server * b = stand_in_server_start("BB9000000000022", cluster_shm_handler, NULL);
+	assert_not_null( a );
+	assert_not_null( b );
+
+	int key = (int) (0xA5100000 | (getpid() & 0xFFFF));
+
+	// The first instance tends the map, the second one reads it.
+	aerospike * owner = cluster_shm_connect(a, key);
+	assert_not_null( owner );
+	aerospike * follower = cluster_shm_connect(a, key);
+	assert_not_null( follower );
+
+	as_shm_info * owner_shm = owner->cluster->shm_info;
+	as_shm_info * follower_shm = follower->cluster->shm_info;
+	assert_true( owner_shm->is_tend_master );
+	assert_false( follower_shm->is_tend_master );
+	assert_int_eq( follower_shm->cluster_shm->nodes_capacity, 1 );
+	assert_int_eq( follower_shm->cluster_shm->nodes_size, 1 );
+
+	// The owner finds a second node, with no room for it in the segment.
+	stand_in_server_set_peer(a, b);
+
+	for ( int i = 0; i < 100 && cluster_shm_n_nodes(follower) < 2; i++ ) {
+		usleep(50 * 1000);
+	}
+
+	as_cluster_shm * cluster_shm = ck_pr_load_ptr(&follower_shm->cluster_shm);
+	assert_int_eq( cluster_shm_n_nodes(follower), 2 );
+	assert_int_eq( cluster_shm->version, 2 );
+	assert_true( cluster_shm->nodes_capacity >= 2 );
+	assert_int_eq( cluster_shm->nodes_size, 2 );
+	assert_int_eq( follower_shm->shm_id, owner_shm->shm_id );
+
+	// The keyed segment points to the new one.
+	int id = shmget(key, 0, 0);
+	assert_true( id >= 0 );
+	as_cluster_shm * keyed = shmat(id, NULL, SHM_RDONLY);
+	assert_true( keyed != (void *) -1 );
+	assert_int_eq( keyed->version, 1 );
+	assert_int_eq( keyed->moved, 1 );
+	assert_int_eq( keyed->successor_id, follower_shm->shm_id );
+	shmdt(keyed);
+
+	// Both nodes of the larger map are reachable from the follower.
+	cf_digest digest;
+	memset(&digest, 0, sizeof(digest));
+
+	as_node * node = as_shm_node_get(follower->cluster, "test", &digest, false, AS_POLICY_REPLICA_MASTER);
+	assert_not_null( node );
+	assert_true( strcmp(node->name, "BB9000000000021") == 0 || strcmp(node->name, "BB9000000000022") == 0 );
+	as_node_release(node);
+
+	as_error err;
+	aerospike_close(follower, &err);
+	aerospike_destroy(follower);
+	aerospike_close(owner, &err);
+	aerospike_destroy(owner);
+
+	stand_in_server_stop(a);
+	stand_in_server_stop(b);
+}
+
+TEST( cluster_shm_instances , "instances in one process publish statistics in slots of their own" )
+{
+	stand_in_server * a = stand_in_server_start("BB9000000000023", cluster_shm_handler, NULL);
+	assert_not_null( a );
+
+	int key = (int) (0xA5200000 | (getpid() & 0xFFFF));
+
+	aerospike * first = cluster_shm_connect(a, key);
+	assert_not_null( first );
+	aerospike * second = cluster_shm_connect(a, key);
+	assert_not_null( second );
+
+	as_shm_info * first_shm = first->cluster->shm_info;
+	as_shm_info * second_shm = second->cluster->shm_info;
+	as_process_stats_shm * ps = second_shm->process_stats;
+	assert_not_null( first_shm->process_stats );
+	assert_not_null( ps );
+	assert_true( first_shm->process_stats != ps );
+	assert_true( first_shm->token != second_shm->token );
+	assert_int_eq( first_shm->process_stats->pid, getpid() );
+	assert_int_eq( ps->pid, getpid() );
+
+	// Closing one leaves the other's slot claimed.
+	as_error err;
+	aerospike_close(first, &err);
+	aerospike_destroy(first);
+
+	assert_int_eq( ps->pid, getpid() );
+	assert_int_eq( ps->token, second_shm->token );
+	assert_true( second_shm->process_stats == ps );
+
+	aerospike_close(second, &err);
+	aerospike_destroy(second);
+	stand_in_server_stop(a);
+}
+
+TEST( cluster_shm_partitions_race , "readers see partitions as stored while the tend owner updates them" )
+{
+	uint32_t reads = 0;
+	uint32_t bad = cluster_shm_race(1, &reads);
+	info("single buffer: %u bad of %u reads", bad, reads);
+	assert_true( reads > 0 );
+	assert_int_eq( bad, 0 );
+
+	// Both replicas of a partition change at once when published.
+	bad = cluster_shm_race(2, &reads);
+	info("double buffer: %u bad of %u reads", bad, reads);
+	assert_true( reads > 0 );
+	assert_int_eq( bad, 0 );
+}
+
+TEST( cluster_shm_partitions_publish , "double buffered partitions are not seen until published" )
+{
+	as_shm_info shm_info;
+	as_node nodes[3];
+	cluster_shm_local(&shm_info, nodes, 3, 2);
+	as_cluster_shm * cluster_shm = shm_info.cluster_shm;
+
+	uint32_t master = 0;
+	uint32_t prole = 0;
+	assert_false( as_shm_get_partition(cluster_shm, "test", 0, &master, &prole) );
+
+	cluster_shm_assign(&shm_info, &nodes[0], true);
+	cluster_shm_assign(&shm_info, &nodes[1], false);
+	assert_true( as_shm_get_partition(cluster_shm, "test", 0, &master, &prole) );
+	assert_int_eq( master, 0 );
+	assert_int_eq( prole, 0 );
+
+	as_shm_publish_partitions(cluster_shm);
+	as_shm_get_partition(cluster_shm, "test", N_PARTITIONS - 1, &master, &prole);
+	assert_int_eq( master, 1 );
+	assert_int_eq( prole, 2 );
+
+	// Changes start from what readers see, and wait for the next publish.
+	cluster_shm_assign(&shm_info, &nodes[2], true);
+	as_shm_get_partition(cluster_shm, "test", 0, &master, &prole);
+	assert_int_eq( master, 1 );
+	assert_int_eq( prole, 2 );
+
+	as_shm_publish_partitions(cluster_shm);
+	as_shm_get_partition(cluster_shm, "test", 0, &master, &prole);
+	assert_int_eq( master, 3 );
+	assert_int_eq( prole, 2 );
+
+	// Nothing pending, nothing changes.
+	as_partition_table_shm * table = as_shm_get_partition_tables(cluster_shm);
+	uint32_t seq = table->seq;
+	as_shm_publish_partitions(cluster_shm);
+	assert_int_eq( table->seq, seq );
+
+	cluster_shm_local_destroy(&shm_info);
+}
+
+TEST( cluster_shm_partitions_repair , "an owner that died mid update leaves partitions readable and repairable" )
+{
+	as_shm_info shm_info;
+	as_node nodes[1];
+	cluster_shm_local(&shm_info, nodes, 1, 1);
+	as_cluster_shm * cluster_shm = shm_info.cluster_shm;
+
+	cluster_shm_assign(&shm_info, &nodes[0], true);
+	as_partition_table_shm * table = as_shm_get_partition_tables(cluster_shm);
+	assert_int_eq( table->seq & 1, 0 );
+
+	// Readers give up waiting after a bounded number of tries.
+	table->seq++;
+	uint32_t master = 0;
+	uint32_t prole = 0;
+	assert_true( as_shm_get_partition(cluster_shm, "test", 0, &master, &prole) );
+	assert_int_eq( master, 1 );
+
+	as_shm_repair_partition_tables(cluster_shm);
+	assert_int_eq( table->seq & 1, 0 );
+
+	// Even sequences are left as they are.
+	uint32_t seq = table->seq;
+	as_shm_repair_partition_tables(cluster_shm);
+	assert_int_eq( table->seq, seq );
+
+	cluster_shm_local_destroy(&shm_info);
+}
+
+/******************************************************************************
+ * TEST SUITE
+ *****************************************************************************/
+
+SUITE( cluster_shm, "shared memory cluster tests" )
+{
+	suite_add( cluster_shm_grow_follow );
+	suite_add( cluster_shm_instances );
+	suite_add( cluster_shm_partitions_race );
+	suite_add( cluster_shm_partitions_publish );
+	suite_add( cluster_shm_partitions_repair );
+}
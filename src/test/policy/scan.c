@@ -16,6 +16,8 @@
  */
 #include <aerospike/aerospike.h>
 #include <aerospike/as_policy.h>
+#include <aerospike/as_rate_limiter.h>
+#include <citrusleaf/cf_clock.h>
 
 #include "../test.h"
 
@@ -36,6 +38,7 @@ TEST( policy_scan_init , "init" )
 
 	assert_int_eq(policy.timeout, 0);
 	assert_int_eq(policy.fail_on_cluster_change, false);
+	assert_null(policy.rate_limiter);
 }
 
 TEST( policy_scan_resolve_1 , "resolve: global.scan (init)" )
@@ -120,6 +123,33 @@ TEST( policy_scan_resolve_4 , "resolve: global.scan.timeout=100, global.scan.fai
 	assert_int_ne(local.fail_on_cluster_change, global.scan.fail_on_cluster_change);
 }
 
+TEST( policy_scan_rate_limiter , "rate_limiter: 1000/s with a burst of 10 paces 110 records over 100ms" )
+{
+	as_rate_limiter limiter;
+	assert_not_null(as_rate_limiter_init(&limiter, 1000, 10));
+
+	as_policy_scan policy;
+	as_policy_scan_init(&policy);
+	policy.rate_limiter = &limiter;
+
+	uint64_t start = cf_getms();
+
+	for ( int i = 0; i < 110; i++ ) {
+		as_rate_limiter_acquire(policy.rate_limiter, 1);
+	}
+
+	uint64_t elapsed = cf_getms() - start;
+
+	// The burst is free, the other 100 tokens take 1ms each.
+	assert_true(elapsed >= 95);
+	assert_true(elapsed < 1000);
+
+	// The bucket is empty now.
+	assert_false(as_rate_limiter_try_acquire(&limiter, 10));
+
+	as_rate_limiter_destroy(&limiter);
+}
+
 /******************************************************************************
  * TEST SUITE
  *****************************************************************************/
@@ -131,4 +161,5 @@ SUITE( policy_scan, "as_policy_scan tests" )
 	suite_add( policy_scan_resolve_2 );
 	suite_add( policy_scan_resolve_3 );
 	suite_add( policy_scan_resolve_4 );
+	suite_add( policy_scan_rate_limiter );
 }
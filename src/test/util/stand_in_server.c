@@ -0,0 +1,603 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <aerospike/as_codec.h>
+#include <aerospike/as_error.h>
+#include <citrusleaf/cf_b64.h>
+#include <citrusleaf/cf_byte_order.h>
+#include <citrusleaf/cl_buf_cache.h>
+
+#include "stand_in_server.h"
+
+/******************************************************************************
+ * MACROS
+ *****************************************************************************/
+
+#define STAND_IN_NAMESPACE "test"
+#define STAND_IN_PARTITIONS 4096
+#define STAND_IN_MAX_CONNECTIONS 256
+#define STAND_IN_POLL_MS 50
+
+/******************************************************************************
+ * TYPES
+ *****************************************************************************/
+
+typedef struct stand_in_conn_s {
+	stand_in_server * server;
+	int fd;
+	pthread_t thread;
+} stand_in_conn;
+
+struct stand_in_server_s {
+	char node_name[32];
+	stand_in_handler handler;
+	void * udata;
+
+	int listen_fd;
+	uint16_t port;
+	pthread_t accept_thread;
+	volatile bool stop;
+
+	pthread_mutex_t lock;
+	stand_in_conn conns[STAND_IN_MAX_CONNECTIONS];
+	uint32_t n_conns;
+
+	// replicas-master value, every partition of the namespace
+	char replicas[sizeof(STAND_IN_NAMESPACE) + 1024];
+
+	// services value, the peers reported to the client
+	char services[256];
+
+	// replicas reported as replicas-prole instead of replicas-master
+	bool prole;
+
+	// zone value, and how many times it was asked for
+	char zone[AS_CONFIG_ZONE_SIZE];
+	uint32_t zone_requests;
+
+	// data requests received as compressed protos
+	uint32_t compressed_requests;
+};
+
+/******************************************************************************
+ * STATIC FUNCTIONS
+ *****************************************************************************/
+
+static bool stand_in_read(stand_in_server * server, int fd, uint8_t * buf, size_t size)
+{
+	size_t pos = 0;
+
+	while ( pos < size ) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+		int rv = poll(&pfd, 1, STAND_IN_POLL_MS);
+
+		if ( server->stop ) {
+			return false;
+		}
+
+		if ( rv <= 0 ) {
+			if ( rv < 0 && errno != EINTR ) {
+				return false;
+			}
+			continue;
+		}
+
+		ssize_t n = read(fd, buf + pos, size - pos);
+
+		if ( n <= 0 ) {
+			return false;
+		}
+		pos += n;
+	}
+	return true;
+}
+
+static bool stand_in_write(int fd, const void * buf, size_t size)
+{
+	const uint8_t * p = (const uint8_t *) buf;
+
+	while ( size > 0 ) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+
+		if ( n <= 0 ) {
+			if ( n < 0 && errno == EINTR ) {
+				continue;
+			}
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static uint8_t * stand_in_build(uint8_t result_code, uint8_t info3, uint32_t generation, uint32_t void_time,
+	const char * set, const cf_digest * digest, const uint8_t * ops, size_t ops_sz, uint16_t n_ops, size_t * size_r)
+{
+	size_t ns_sz = sizeof(STAND_IN_NAMESPACE) - 1;
+	size_t set_sz = set ? strlen(set) : 0;
+	size_t size = sizeof(as_msg) + ops_sz;
+	uint16_t n_fields = 0;
+
+	if ( digest ) {
+		size += sizeof(cl_msg_field) + sizeof(cf_digest) + sizeof(cl_msg_field) + ns_sz;
+		n_fields += 2;
+	}
+
+	if ( set ) {
+		size += sizeof(cl_msg_field) + set_sz;
+		n_fields++;
+	}
+
+	uint8_t * buf = (uint8_t *) malloc(size);
+
+	if ( ! buf ) {
+		return NULL;
+	}
+
+	as_msg * msg = (as_msg *) buf;
+	memset(msg, 0, sizeof(as_msg));
+	msg->proto.version = CL_PROTO_VERSION;
+	msg->proto.type = CL_PROTO_TYPE_CL_MSG;
+	msg->proto.sz = size - sizeof(cl_proto);
+	cl_proto_swap_to_be(&msg->proto);
+	msg->m.header_sz = sizeof(cl_msg);
+	msg->m.info3 = info3;
+	msg->m.result_code = result_code;
+	msg->m.generation = generation;
+	msg->m.record_ttl = void_time;
+	msg->m.n_fields = n_fields;
+	msg->m.n_ops = n_ops;
+	cl_msg_swap_header_to_be(&msg->m);
+
+	uint8_t * p = buf + sizeof(as_msg);
+
+	if ( digest ) {
+		cl_msg_field * mf = (cl_msg_field *) p;
+		mf->field_sz = cf_swap_to_be32((uint32_t) ns_sz + 1);
+		mf->type = CL_MSG_FIELD_TYPE_NAMESPACE;
+		memcpy(mf->data, STAND_IN_NAMESPACE, ns_sz);
+		p += sizeof(cl_msg_field) + ns_sz;
+
+		mf = (cl_msg_field *) p;
+		mf->field_sz = cf_swap_to_be32(sizeof(cf_digest) + 1);
+		mf->type = CL_MSG_FIELD_TYPE_DIGEST_RIPE;
+		memcpy(mf->data, digest, sizeof(cf_digest));
+		p += sizeof(cl_msg_field) + sizeof(cf_digest);
+	}
+
+	if ( set ) {
+		cl_msg_field * mf = (cl_msg_field *) p;
+		mf->field_sz = cf_swap_to_be32((uint32_t) set_sz + 1);
+		mf->type = CL_MSG_FIELD_TYPE_SET;
+		memcpy(mf->data, set, set_sz);
+		p += sizeof(cl_msg_field) + set_sz;
+	}
+
+	if ( ops_sz ) {
+		memcpy(p, ops, ops_sz);
+	}
+
+	*size_r = size;
+	return buf;
+}
+
+static const char * stand_in_info_value(stand_in_server * server, const char * name)
+{
+	if ( strcmp(name, "node") == 0 ) {
+		return server->node_name;
+	}
+
+	if ( strcmp(name, "partition-generation") == 0 ) {
+		return "1";
+	}
+
+	if ( strcmp(name, "partitions") == 0 ) {
+		return "4096";
+	}
+
+	if ( strcmp(name, "replicas-master") == 0 ) {
+		return server->prole ? "" : server->replicas;
+	}
+
+	if ( strcmp(name, "replicas-prole") == 0 ) {
+		return server->prole ? server->replicas : "";
+	}
+
+	if ( strcmp(name, "services") == 0 ) {
+		return server->services;
+	}
+
+	if ( strcmp(name, "zone") == 0 ) {
+		server->zone_requests++;
+		return server->zone;
+	}
+	return "";
+}
+
+static bool stand_in_info(stand_in_server * server, int fd, char * names, size_t names_sz)
+{
+	char response[4096 + sizeof(server->replicas)];
+	size_t pos = sizeof(cl_proto);
+	char * name = names;
+	char * end = names + names_sz;
+
+	for ( char * p = names; p < end; p++ ) {
+		if ( *p != '\n' ) {
+			continue;
+		}
+		*p = '\0';
+
+		if ( *name ) {
+			pthread_mutex_lock(&server->lock);
+			int n = snprintf(response + pos, sizeof(response) - pos, "%s\t%s\n", name, stand_in_info_value(server, name));
+			pthread_mutex_unlock(&server->lock);
+
+			if ( n < 0 || (size_t) n >= sizeof(response) - pos ) {
+				return false;
+			}
+			pos += n;
+		}
+		name = p + 1;
+	}
+
+	cl_proto * proto = (cl_proto *) response;
+	proto->version = CL_PROTO_VERSION;
+	proto->type = CL_PROTO_TYPE_INFO;
+	proto->sz = pos - sizeof(cl_proto);
+	cl_proto_swap_to_be(proto);
+	return stand_in_write(fd, response, pos);
+}
+
+static void * stand_in_conn_run(void * udata)
+{
+	stand_in_conn * conn = (stand_in_conn *) udata;
+	stand_in_server * server = conn->server;
+	int fd = conn->fd;
+
+	while ( ! server->stop ) {
+		cl_proto proto;
+
+		if ( ! stand_in_read(server, fd, (uint8_t *) &proto, sizeof(proto)) ) {
+			break;
+		}
+		cl_proto_swap_from_be(&proto);
+
+		size_t size = proto.sz;
+		uint8_t * body = (uint8_t *) malloc(size + 1);
+
+		if ( ! body || ! stand_in_read(server, fd, body, size) ) {
+			free(body);
+			break;
+		}
+
+		bool ok;
+
+		if ( proto.type == CL_PROTO_TYPE_INFO ) {
+			// Requests of a single name may not end with a newline.
+			if ( size == 0 || body[size - 1] != '\n' ) {
+				body[size++] = '\n';
+			}
+			ok = stand_in_info(server, fd, (char *) body, size);
+		}
+		else if ( proto.type == CL_PROTO_TYPE_CL_MSG && size >= sizeof(cl_msg) ) {
+			cl_msg * msg = (cl_msg *) body;
+			cl_msg_swap_header_from_be(msg);
+			ok = server->handler(fd, msg, msg->data, size - sizeof(cl_msg), server->udata);
+		}
+		else if ( proto.type == CL_PROTO_TYPE_CL_MSG_COMPRESSED ) {
+			// The whole request, its proto included, was compressed.
+			uint8_t * request = NULL;
+			size_t request_sz = 0;
+			ok = as_codec_decompress_body(NULL, body, size, &request, &request_sz) == 0;
+
+			if ( ok ) {
+				pthread_mutex_lock(&server->lock);
+				server->compressed_requests++;
+				pthread_mutex_unlock(&server->lock);
+
+				ok = request_sz >= sizeof(as_msg);
+
+				if ( ok ) {
+					cl_msg * msg = (cl_msg *) (request + sizeof(cl_proto));
+					cl_msg_swap_header_from_be(msg);
+					ok = server->handler(fd, msg, msg->data, request_sz - sizeof(as_msg), server->udata);
+				}
+				cl_buf_release(request);
+			}
+		}
+		else {
+			ok = false;
+		}
+
+		free(body);
+
+		if ( ! ok ) {
+			break;
+		}
+	}
+
+	shutdown(fd, SHUT_RDWR);
+	return NULL;
+}
+
+static void * stand_in_accept_run(void * udata)
+{
+	stand_in_server * server = (stand_in_server *) udata;
+
+	while ( ! server->stop ) {
+		struct pollfd pfd = { .fd = server->listen_fd, .events = POLLIN, .revents = 0 };
+
+		if ( poll(&pfd, 1, STAND_IN_POLL_MS) <= 0 ) {
+			continue;
+		}
+
+		int fd = accept(server->listen_fd, NULL, NULL);
+
+		if ( fd < 0 ) {
+			continue;
+		}
+
+		pthread_mutex_lock(&server->lock);
+
+		if ( server->n_conns == STAND_IN_MAX_CONNECTIONS ) {
+			pthread_mutex_unlock(&server->lock);
+			close(fd);
+			continue;
+		}
+
+		stand_in_conn * conn = &server->conns[server->n_conns];
+		conn->server = server;
+		conn->fd = fd;
+
+		if ( pthread_create(&conn->thread, NULL, stand_in_conn_run, conn) == 0 ) {
+			server->n_conns++;
+		}
+		else {
+			close(fd);
+		}
+		pthread_mutex_unlock(&server->lock);
+	}
+	return NULL;
+}
+
+/******************************************************************************
+ * FUNCTIONS
+ *****************************************************************************/
+
+stand_in_server * stand_in_server_start(const char * node_name, stand_in_handler handler, void * udata)
+{
+	stand_in_server * server = (stand_in_server *) calloc(1, sizeof(stand_in_server));
+
+	if ( ! server ) {
+		return NULL;
+	}
+
+	snprintf(server->node_name, sizeof(server->node_name), "%s", node_name);
+	server->handler = handler;
+	server->udata = udata;
+	pthread_mutex_init(&server->lock, NULL);
+
+	uint8_t bitmap[STAND_IN_PARTITIONS / 8];
+	memset(bitmap, 0xFF, sizeof(bitmap));
+	size_t pos = sizeof(STAND_IN_NAMESPACE) - 1;
+	memcpy(server->replicas, STAND_IN_NAMESPACE ":", pos + 1);
+	cf_b64_encode(bitmap, sizeof(bitmap), server->replicas + pos + 1);
+	server->replicas[pos + 1 + cf_b64_encoded_len(sizeof(bitmap))] = '\0';
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+
+	if ( server->listen_fd < 0 ||
+		bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+		listen(server->listen_fd, 64) != 0 ||
+		getsockname(server->listen_fd, (struct sockaddr *) &addr, &len) != 0 ) {
+		if ( server->listen_fd >= 0 ) {
+			close(server->listen_fd);
+		}
+		free(server);
+		return NULL;
+	}
+	server->port = ntohs(addr.sin_port);
+
+	if ( pthread_create(&server->accept_thread, NULL, stand_in_accept_run, server) != 0 ) {
+		close(server->listen_fd);
+		free(server);
+		return NULL;
+	}
+	return server;
+}
+
+void stand_in_server_stop(stand_in_server * server)
+{
+	server->stop = true;
+	pthread_join(server->accept_thread, NULL);
+	close(server->listen_fd);
+
+	for ( uint32_t i = 0; i < server->n_conns; i++ ) {
+		pthread_join(server->conns[i].thread, NULL);
+		close(server->conns[i].fd);
+	}
+	pthread_mutex_destroy(&server->lock);
+	free(server);
+}
+
+uint16_t stand_in_server_port(const stand_in_server * server)
+{
+	return server->port;
+}
+
+void stand_in_server_set_prole(stand_in_server * server)
+{
+	pthread_mutex_lock(&server->lock);
+	server->prole = true;
+	pthread_mutex_unlock(&server->lock);
+}
+
+void stand_in_server_set_peer(stand_in_server * server, const stand_in_server * peer)
+{
+	pthread_mutex_lock(&server->lock);
+
+	if ( peer ) {
+		snprintf(server->services, sizeof(server->services), "127.0.0.1:%u", peer->port);
+	}
+	else {
+		server->services[0] = '\0';
+	}
+	pthread_mutex_unlock(&server->lock);
+}
+
+void stand_in_server_set_zone(stand_in_server * server, const char * zone)
+{
+	pthread_mutex_lock(&server->lock);
+	snprintf(server->zone, sizeof(server->zone), "%s", zone);
+	pthread_mutex_unlock(&server->lock);
+}
+
+uint32_t stand_in_server_zone_requests(stand_in_server * server)
+{
+	pthread_mutex_lock(&server->lock);
+	uint32_t n = server->zone_requests;
+	pthread_mutex_unlock(&server->lock);
+	return n;
+}
+
+uint32_t stand_in_server_compressed_requests(stand_in_server * server)
+{
+	pthread_mutex_lock(&server->lock);
+	uint32_t n = server->compressed_requests;
+	pthread_mutex_unlock(&server->lock);
+	return n;
+}
+
+aerospike * stand_in_connect(stand_in_server * server, as_config * config)
+{
+	as_config_add_host(config, "127.0.0.1", server->port);
+
+	aerospike * client = aerospike_new(config);
+	as_error err;
+
+	if ( aerospike_connect(client, &err) != AEROSPIKE_OK ) {
+		aerospike_destroy(client);
+		return NULL;
+	}
+	return client;
+}
+
+bool stand_in_send(int fd, uint8_t result_code, uint8_t info3, uint32_t generation, uint32_t void_time,
+	const char * set, const cf_digest * digest, const uint8_t * ops, size_t ops_sz, uint16_t n_ops)
+{
+	size_t size;
+	uint8_t * buf = stand_in_build(result_code, info3, generation, void_time, set, digest, ops, ops_sz, n_ops, &size);
+
+	if ( ! buf ) {
+		return false;
+	}
+
+	bool ok = stand_in_write(fd, buf, size);
+	free(buf);
+	return ok;
+}
+
+bool stand_in_send_compressed(int fd, uint8_t result_code, uint8_t info3, uint32_t generation, uint32_t void_time,
+	const char * set, const cf_digest * digest, const uint8_t * ops, size_t ops_sz, uint16_t n_ops)
+{
+	size_t size;
+	uint8_t * buf = stand_in_build(result_code, info3, generation, void_time, set, digest, ops, ops_sz, n_ops, &size);
+
+	if ( ! buf ) {
+		return false;
+	}
+
+	// The message without its proto, after its size in host order.
+	const uint8_t * in = buf + sizeof(cl_proto);
+	size_t in_sz = size - sizeof(cl_proto);
+	size_t data_sz = as_codec_zlib.bound(in_sz);
+	cl_comp_proto * comp = (cl_comp_proto *) malloc(sizeof(cl_comp_proto) + data_sz);
+	bool ok = comp && as_codec_zlib.compress(as_codec_zlib.default_level, in, in_sz, comp->data, &data_sz) == 0;
+
+	if ( ok ) {
+		comp->proto.version = CL_PROTO_VERSION;
+		comp->proto.type = CL_PROTO_TYPE_CL_MSG_COMPRESSED;
+		comp->proto.sz = sizeof(comp->org_sz) + data_sz;
+		cl_proto_swap_to_be(&comp->proto);
+		comp->org_sz = in_sz;
+		ok = stand_in_write(fd, comp, sizeof(cl_comp_proto) + data_sz);
+	}
+
+	free(comp);
+	free(buf);
+	return ok;
+}
+
+const uint8_t * stand_in_field(const cl_msg * msg, const uint8_t * data, uint8_t type, uint32_t * sz)
+{
+	const uint8_t * p = data;
+
+	for ( uint16_t i = 0; i < msg->n_fields; i++ ) {
+		const cl_msg_field * mf = (const cl_msg_field *) p;
+		uint32_t field_sz = cf_swap_from_be32(mf->field_sz);
+
+		if ( mf->type == type ) {
+			*sz = field_sz - 1;
+			return mf->data;
+		}
+		p += sizeof(mf->field_sz) + field_sz;
+	}
+	return NULL;
+}
+
+const uint8_t * stand_in_ops(const cl_msg * msg, const uint8_t * data)
+{
+	const uint8_t * p = data;
+
+	for ( uint16_t i = 0; i < msg->n_fields; i++ ) {
+		const cl_msg_field * mf = (const cl_msg_field *) p;
+		p += sizeof(mf->field_sz) + cf_swap_from_be32(mf->field_sz);
+	}
+	return p;
+}
+
+uint8_t * stand_in_put_op(uint8_t * buf, uint8_t op, const char * name, uint8_t particle_type, const void * value, uint32_t value_sz)
+{
+	cl_msg_op * mop = (cl_msg_op *) buf;
+	uint8_t name_sz = (uint8_t) strlen(name);
+	mop->op_sz = cf_swap_to_be32(4 + name_sz + value_sz);
+	mop->op = op;
+	mop->particle_type = particle_type;
+	mop->version = 0;
+	mop->name_sz = name_sz;
+	memcpy(mop->name, name, name_sz);
+	memcpy(mop->name + name_sz, value, value_sz);
+	return buf + sizeof(cl_msg_op) + name_sz + value_sz;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2008-2014 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+#pragma once
+
+#include <aerospike/aerospike.h>
+#include <citrusleaf/cf_digest.h>
+#include <citrusleaf/cf_proto.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A node on a local port, for tests which need to control what the server
+ * answers. Info requests are answered as a node owning every partition of
+ * namespace "test", with no peers or zone unless set. Data requests are passed to a
+ * handler.
+ */
+typedef struct stand_in_server_s stand_in_server;
+
+/**
+ * Called with each data request. msg is the header in host order, data points
+ * to its fields and ops, still in network order. Write the response to fd, for
+ * example with stand_in_send(). Return false to close the connection instead.
+ * Requests from different connections are handled concurrently.
+ */
+typedef bool (* stand_in_handler)(int fd, const cl_msg * msg, const uint8_t * data, size_t data_sz, void * udata);
+
+/**
+ * Start serving on an ephemeral port of 127.0.0.1. Returns NULL on failure.
+ */
+stand_in_server * stand_in_server_start(const char * node_name, stand_in_handler handler, void * udata);
+
+/**
+ * Close all connections and free the server.
+ */
+void stand_in_server_stop(stand_in_server * server);
+
+/**
+ * The port the server listens on.
+ */
+uint16_t stand_in_server_port(const stand_in_server * server);
+
+/**
+ * Report every partition of namespace "test" as a prole rather than a master.
+ * Set before the client finds the node.
+ */
+void stand_in_server_set_prole(stand_in_server * server);
+
+/**
+ * Report peer to the client as another node of the cluster, or no peer if NULL.
+ */
+void stand_in_server_set_peer(stand_in_server * server, const stand_in_server * peer);
+
+/**
+ * Answer info name "zone" with zone. Empty until set.
+ */
+void stand_in_server_set_zone(stand_in_server * server, const char * zone);
+
+/**
+ * How many times info name "zone" was asked for.
+ */
+uint32_t stand_in_server_zone_requests(stand_in_server * server);
+
+/**
+ * How many data requests came as compressed protos. They are inflated before
+ * they are passed to the handler.
+ */
+uint32_t stand_in_server_compressed_requests(stand_in_server * server);
+
+/**
+ * Connect a new aerospike instance to the server, with the given config
+ * already initialized by the caller. Returns NULL on failure.
+ */
+aerospike * stand_in_connect(stand_in_server * server, as_config * config);
+
+/**
+ * Send one message in its own proto. set may be NULL, digest may be NULL. ops
+ * points to n_ops ops in network order.
+ */
+bool stand_in_send(int fd, uint8_t result_code, uint8_t info3, uint32_t generation, uint32_t void_time,
+	const char * set, const cf_digest * digest, const uint8_t * ops, size_t ops_sz, uint16_t n_ops);
+
+/**
+ * stand_in_send() in a compressed proto, deflated with zlib.
+ */
+bool stand_in_send_compressed(int fd, uint8_t result_code, uint8_t info3, uint32_t generation, uint32_t void_time,
+	const char * set, const cf_digest * digest, const uint8_t * ops, size_t ops_sz, uint16_t n_ops);
+
+/**
+ * Find a field of a request. Returns its data and size, or NULL.
+ */
+const uint8_t * stand_in_field(const cl_msg * msg, const uint8_t * data, uint8_t type, uint32_t * sz);
+
+/**
+ * The first op of a request, in network order.
+ */
+const uint8_t * stand_in_ops(const cl_msg * msg, const uint8_t * data);
+
+/**
+ * Append an op in network order to buf, and return the end of the op.
+ */
+uint8_t * stand_in_put_op(uint8_t * buf, uint8_t op, const char * name, uint8_t particle_type, const void * value, uint32_t value_sz);